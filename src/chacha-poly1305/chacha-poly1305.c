@@ -28,6 +28,11 @@ bool chacha_poly1305_set_key(chacha_poly1305_ctx_t *ctx, const void *key)
 	return true;
 }
 
+void chacha_poly1305_copy(chacha_poly1305_ctx_t *dst, const chacha_poly1305_ctx_t *src)
+{
+	*dst = *src;
+}
+
 static void put_u64(void *vp, uint64_t v)
 {
 	uint8_t *p = (uint8_t *) vp;
@@ -42,25 +47,79 @@ static void put_u64(void *vp, uint64_t v)
 	p[7] = (uint8_t) v & 0xff;
 }
 
+/*
+ * The cipher and the MAC are done in one pass over the data, in chunks that stay in the L1 cache.
+ * The first keystream block, which provides the Poly1305 key, is generated in the same ChaCha20 call
+ * as the first payload blocks, so the vectorized kernels are used for it as well.
+ * Both functions expect the ChaCha20 block counter to have been set to 0.
+ */
+#define CHUNK_LEN 1024
+
+static void aead_seal(struct chacha_ctx *cctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+	uint8_t first[CHUNK_LEN];
+	size_t n = len < CHUNK_LEN - CHACHA_BLOCKLEN ? len : CHUNK_LEN - CHACHA_BLOCKLEN;
+	poly1305_ctx poly;
+
+	memset(first, 0, CHACHA_BLOCKLEN);
+	memcpy(first + CHACHA_BLOCKLEN, in, n);
+	chacha_encrypt_bytes(cctx, first, first, CHACHA_BLOCKLEN + n);
+
+	poly1305_init(&poly, first);
+	memcpy(out, first + CHACHA_BLOCKLEN, n);
+	poly1305_update(&poly, out, n);
+
+	for (size_t i = n; i < len; i += n) {
+		n = len - i < CHUNK_LEN ? len - i : CHUNK_LEN;
+		chacha_encrypt_bytes(cctx, in + i, out + i, n);
+		poly1305_update(&poly, out + i, n);
+	}
+
+	poly1305_finish(&poly, out + len);
+	memset(first, 0, CHACHA_BLOCKLEN);
+}
+
+/* On failure the output is cleared, so unauthenticated plaintext is never handed out */
+static bool aead_open(struct chacha_ctx *cctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+	uint8_t first[CHUNK_LEN];
+	uint8_t expected_tag[POLY1305_TAGLEN];
+	size_t n = len < CHUNK_LEN - CHACHA_BLOCKLEN ? len : CHUNK_LEN - CHACHA_BLOCKLEN;
+	poly1305_ctx poly;
+
+	memset(first, 0, CHACHA_BLOCKLEN);
+	memcpy(first + CHACHA_BLOCKLEN, in, n);
+	chacha_encrypt_bytes(cctx, first, first, CHACHA_BLOCKLEN + n);
+
+	/* MAC the ciphertext before it is overwritten when decrypting in place */
+	poly1305_init(&poly, first);
+	poly1305_update(&poly, in, n);
+	memcpy(out, first + CHACHA_BLOCKLEN, n);
+
+	for (size_t i = n; i < len; i += n) {
+		n = len - i < CHUNK_LEN ? len - i : CHUNK_LEN;
+		poly1305_update(&poly, in + i, n);
+		chacha_encrypt_bytes(cctx, in + i, out + i, n);
+	}
+
+	poly1305_finish(&poly, expected_tag);
+	memset(first, 0, CHACHA_BLOCKLEN);
+
+	if (memcmp(expected_tag, in + len, POLY1305_TAGLEN)) {
+		memset(out, 0, len);
+		return false;
+	}
+
+	return true;
+}
+
 bool chacha_poly1305_encrypt(chacha_poly1305_ctx_t *ctx, uint64_t seqnr, const void *indata, size_t inlen, void *outdata, size_t *outlen) {
 	uint8_t seqbuf[8];
-	const uint8_t one[8] = { 1, 0, 0, 0, 0, 0, 0, 0 };	/* NB little-endian */
-	uint8_t poly_key[POLY1305_KEYLEN];
 
-	/*
-	 * Run ChaCha20 once to generate the Poly1305 key. The IV is the
-	 * packet sequence number.
-	 */
-	memset(poly_key, 0, sizeof(poly_key));
+	/* The IV is the packet sequence number */
 	put_u64(seqbuf, seqnr);
 	chacha_ivsetup(&ctx->main_ctx, seqbuf, NULL);
-	chacha_encrypt_bytes(&ctx->main_ctx, poly_key, poly_key, sizeof(poly_key));
-
-	/* Set Chacha's block counter to 1 */
-	chacha_ivsetup(&ctx->main_ctx, seqbuf, one);
-
-	chacha_encrypt_bytes(&ctx->main_ctx, indata, outdata, inlen);
-	poly1305_auth((uint8_t *)outdata + inlen, outdata, inlen, poly_key);
+	aead_seal(&ctx->main_ctx, indata, outdata, inlen);
 
 	if (outlen)
 		*outlen = inlen + POLY1305_TAGLEN;
@@ -68,6 +127,10 @@ bool chacha_poly1305_encrypt(chacha_poly1305_ctx_t *ctx, uint64_t seqnr, const v
 	return true;
 }
 
+bool chacha_poly1305_encrypt_in_place(chacha_poly1305_ctx_t *ctx, uint64_t seqnr, void *data, size_t len) {
+	return chacha_poly1305_encrypt(ctx, seqnr, data, len, data, NULL);
+}
+
 bool chacha_poly1305_verify(chacha_poly1305_ctx_t *ctx, uint64_t seqnr, const void *indata, size_t inlen) {
 	uint8_t seqbuf[8];
 	uint8_t expected_tag[POLY1305_TAGLEN], poly_key[POLY1305_KEYLEN];
@@ -94,54 +157,29 @@ bool chacha_poly1305_verify(chacha_poly1305_ctx_t *ctx, uint64_t seqnr, const vo
 
 bool chacha_poly1305_decrypt(chacha_poly1305_ctx_t *ctx, uint64_t seqnr, const void *indata, size_t inlen, void *outdata, size_t *outlen) {
 	uint8_t seqbuf[8];
-	const uint8_t one[8] = { 1, 0, 0, 0, 0, 0, 0, 0 };	/* NB little-endian */
-	uint8_t expected_tag[POLY1305_TAGLEN], poly_key[POLY1305_KEYLEN];
 
-	/*
-	 * Run ChaCha20 once to generate the Poly1305 key. The IV is the
-	 * packet sequence number.
-	 */
-	memset(poly_key, 0, sizeof(poly_key));
+	/* The IV is the packet sequence number */
 	put_u64(seqbuf, seqnr);
 	chacha_ivsetup(&ctx->main_ctx, seqbuf, NULL);
-	chacha_encrypt_bytes(&ctx->main_ctx, poly_key, poly_key, sizeof(poly_key));
-
-	/* Set Chacha's block counter to 1 */
-	chacha_ivsetup(&ctx->main_ctx, seqbuf, one);
 
-	/* Check tag before anything else */
 	inlen -= POLY1305_TAGLEN;
-	const uint8_t *tag = (const uint8_t *)indata + inlen;
 
-	poly1305_auth(expected_tag, indata, inlen, poly_key);
-	if (memcmp(expected_tag, tag, POLY1305_TAGLEN))
+	if (!aead_open(&ctx->main_ctx, indata, outdata, inlen))
 		return false;
 
-	chacha_encrypt_bytes(&ctx->main_ctx, indata, outdata, inlen);
-
 	if (outlen)
 		*outlen = inlen;
 
 	return true;
 }
 
-bool chacha_poly1305_encrypt_iv96(chacha_poly1305_ctx_t *ctx, const uint8_t *seqbuf, const void *indata, size_t inlen, void *outdata, size_t *outlen) {
-	const uint8_t one[4] = { 1, 0, 0, 0 };	/* NB little-endian */
-	uint8_t poly_key[POLY1305_KEYLEN];
+bool chacha_poly1305_decrypt_in_place(chacha_poly1305_ctx_t *ctx, uint64_t seqnr, void *data, size_t len, size_t *outlen) {
+	return chacha_poly1305_decrypt(ctx, seqnr, data, len, data, outlen);
+}
 
-	/*
-	 * Run ChaCha20 once to generate the Poly1305 key. The IV is the
-	 * packet sequence number.
-	 */
-	memset(poly_key, 0, sizeof(poly_key));
+bool chacha_poly1305_encrypt_iv96(chacha_poly1305_ctx_t *ctx, const uint8_t *seqbuf, const void *indata, size_t inlen, void *outdata, size_t *outlen) {
 	chacha_ivsetup_96(&ctx->main_ctx, seqbuf, NULL);
-	chacha_encrypt_bytes(&ctx->main_ctx, poly_key, poly_key, sizeof(poly_key));
-
-	/* Set Chacha's block counter to 1 */
-	chacha_ivsetup_96(&ctx->main_ctx, seqbuf, one);
-
-	chacha_encrypt_bytes(&ctx->main_ctx, indata, outdata, inlen);
-	poly1305_auth((uint8_t *)outdata + inlen, outdata, inlen, poly_key);
+	aead_seal(&ctx->main_ctx, indata, outdata, inlen);
 
 	if (outlen)
 		*outlen = inlen + POLY1305_TAGLEN;
@@ -150,30 +188,13 @@ bool chacha_poly1305_encrypt_iv96(chacha_poly1305_ctx_t *ctx, const uint8_t *seq
 }
 
 bool chacha_poly1305_decrypt_iv96(chacha_poly1305_ctx_t *ctx, const uint8_t *seqbuf, const void *indata, size_t inlen, void *outdata, size_t *outlen) {
-	const uint8_t one[4] = { 1, 0, 0, 0 };	/* NB little-endian */
-	uint8_t expected_tag[POLY1305_TAGLEN], poly_key[POLY1305_KEYLEN];
-
-	/*
-	 * Run ChaCha20 once to generate the Poly1305 key. The IV is the
-	 * packet sequence number.
-	 */
-	memset(poly_key, 0, sizeof(poly_key));
 	chacha_ivsetup_96(&ctx->main_ctx, seqbuf, NULL);
-	chacha_encrypt_bytes(&ctx->main_ctx, poly_key, poly_key, sizeof(poly_key));
-
-	/* Set Chacha's block counter to 1 */
-	chacha_ivsetup_96(&ctx->main_ctx, seqbuf, one);
 
-	/* Check tag before anything else */
 	inlen -= POLY1305_TAGLEN;
-	const uint8_t *tag = (const uint8_t *)indata + inlen;
 
-	poly1305_auth(expected_tag, indata, inlen, poly_key);
-	if (memcmp(expected_tag, tag, POLY1305_TAGLEN))
+	if (!aead_open(&ctx->main_ctx, indata, outdata, inlen))
 		return false;
 
-	chacha_encrypt_bytes(&ctx->main_ctx, indata, outdata, inlen);
-
 	if (outlen)
 		*outlen = inlen;
 
@@ -0,0 +1,263 @@
+/*
+chacha-simd.c -- ChaCha20 processing several blocks in parallel with x86 vector instructions
+Public domain.
+*/
+
+#include "../system.h"
+
+#include "chacha.h"
+
+#ifdef CHACHA_SIMD
+
+#include <immintrin.h>
+
+/* Each vector holds the same state word of consecutive blocks.
+ * After the rounds, the words are transposed back into whole blocks and XORed with the input.
+ * The kernels only process multiples of their number of lanes, the caller handles the rest.
+ */
+
+#define CHACHA_QUARTERROUND(a, b, c, d, ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+	a = ADD(a, b); d = ROT16(XOR(d, a)); \
+	c = ADD(c, d); b = ROT12(XOR(b, c)); \
+	a = ADD(a, b); d = ROT8(XOR(d, a)); \
+	c = ADD(c, d); b = ROT7(XOR(b, c));
+
+#define CHACHA_ROUNDS(v, ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+	for(int round = 0; round < 10; round++) { \
+		CHACHA_QUARTERROUND(v[0], v[4], v[8], v[12], ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+		CHACHA_QUARTERROUND(v[1], v[5], v[9], v[13], ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+		CHACHA_QUARTERROUND(v[2], v[6], v[10], v[14], ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+		CHACHA_QUARTERROUND(v[3], v[7], v[11], v[15], ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+		CHACHA_QUARTERROUND(v[0], v[5], v[10], v[15], ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+		CHACHA_QUARTERROUND(v[1], v[6], v[11], v[12], ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+		CHACHA_QUARTERROUND(v[2], v[7], v[8], v[13], ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+		CHACHA_QUARTERROUND(v[3], v[4], v[9], v[14], ADD, XOR, ROT16, ROT12, ROT8, ROT7) \
+	}
+
+/* Transpose four vectors holding words w..w+3 of several blocks,
+ * so each 128-bit lane of r[j] holds those four words of one block.
+ */
+#define CHACHA_TRANSPOSE(r, a, b, c, d, UNPACKLO32, UNPACKHI32, UNPACKLO64, UNPACKHI64) { \
+		__typeof__(a) t0 = UNPACKLO32(a, b); \
+		__typeof__(a) t1 = UNPACKHI32(a, b); \
+		__typeof__(a) t2 = UNPACKLO32(c, d); \
+		__typeof__(a) t3 = UNPACKHI32(c, d); \
+		r[0] = UNPACKLO64(t0, t2); \
+		r[1] = UNPACKHI64(t0, t2); \
+		r[2] = UNPACKLO64(t1, t3); \
+		r[3] = UNPACKHI64(t1, t3); \
+	}
+
+/* The block counter is 64 bits wide, split over words 12 and 13 */
+static void chacha_lane_counters(const struct chacha_ctx *x, uint32_t *lo, uint32_t *hi, unsigned int lanes) {
+	for(unsigned int i = 0; i < lanes; i++) {
+		lo[i] = x->input[12] + i;
+		hi[i] = x->input[13] + (lo[i] < x->input[12]);
+	}
+}
+
+static void chacha_advance(struct chacha_ctx *x, unsigned int blocks) {
+	uint32_t lo = x->input[12] + blocks;
+
+	if(lo < x->input[12]) {
+		x->input[13]++;
+	}
+
+	x->input[12] = lo;
+}
+
+/* 4 blocks at a time with SSE2 and SSSE3 */
+
+#define ROTL128(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+#define ROTL128_16(v) ROTL128(v, 16)
+#define ROTL128_12(v) ROTL128(v, 12)
+#define ROTL128_8(v) ROTL128(v, 8)
+#define ROTL128_7(v) ROTL128(v, 7)
+#define ROTL128_16_SSSE3(v) _mm_shuffle_epi8(v, rot16)
+#define ROTL128_8_SSSE3(v) _mm_shuffle_epi8(v, rot8)
+
+#define CHACHA_KERNEL_128(ROT16, ROT8) \
+	size_t done = 0; \
+	\
+	for(; blocks - done >= 4; done += 4, m += 4 * 64, c += 4 * 64) { \
+		uint32_t lo[4], hi[4]; \
+		__m128i s[16], v[16]; \
+		chacha_lane_counters(x, lo, hi, 4); \
+		\
+		for(int i = 0; i < 16; i++) { \
+			s[i] = _mm_set1_epi32(x->input[i]); \
+		} \
+		\
+		s[12] = _mm_loadu_si128((const __m128i *)lo); \
+		s[13] = _mm_loadu_si128((const __m128i *)hi); \
+		\
+		for(int i = 0; i < 16; i++) { \
+			v[i] = s[i]; \
+		} \
+		\
+		CHACHA_ROUNDS(v, _mm_add_epi32, _mm_xor_si128, ROT16, ROTL128_12, ROT8, ROTL128_7) \
+		\
+		for(int i = 0; i < 16; i++) { \
+			v[i] = _mm_add_epi32(v[i], s[i]); \
+		} \
+		\
+		for(int k = 0; k < 4; k++) { \
+			__m128i r[4]; \
+			CHACHA_TRANSPOSE(r, v[4 * k], v[4 * k + 1], v[4 * k + 2], v[4 * k + 3], _mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64) \
+			\
+			for(int j = 0; j < 4; j++) { \
+				__m128i in = _mm_loadu_si128((const __m128i *)(m + 64 * j + 16 * k)); \
+				_mm_storeu_si128((__m128i *)(c + 64 * j + 16 * k), _mm_xor_si128(in, r[j])); \
+			} \
+		} \
+		\
+		chacha_advance(x, 4); \
+	} \
+	\
+	return done;
+
+__attribute__((target("sse2")))
+size_t chacha_blocks_sse2(struct chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t blocks) {
+	CHACHA_KERNEL_128(ROTL128_16, ROTL128_8)
+}
+
+__attribute__((target("ssse3")))
+size_t chacha_blocks_ssse3(struct chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t blocks) {
+	const __m128i rot16 = _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+	const __m128i rot8 = _mm_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+	CHACHA_KERNEL_128(ROTL128_16_SSSE3, ROTL128_8_SSSE3)
+}
+
+/* 8 blocks at a time with AVX2 */
+
+#define ROTL256(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+#define ROTL256_16(v) _mm256_shuffle_epi8(v, rot16)
+#define ROTL256_12(v) ROTL256(v, 12)
+#define ROTL256_8(v) _mm256_shuffle_epi8(v, rot8)
+#define ROTL256_7(v) ROTL256(v, 7)
+
+__attribute__((target("avx2")))
+size_t chacha_blocks_avx2(struct chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t blocks) {
+	const __m256i rot16 = _mm256_broadcastsi128_si256(_mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+	const __m256i rot8 = _mm256_broadcastsi128_si256(_mm_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3));
+	size_t done = 0;
+
+	for(; blocks - done >= 8; done += 8, m += 8 * 64, c += 8 * 64) {
+		uint32_t lo[8], hi[8];
+		__m256i s[16], v[16];
+		chacha_lane_counters(x, lo, hi, 8);
+
+		for(int i = 0; i < 16; i++) {
+			s[i] = _mm256_set1_epi32(x->input[i]);
+		}
+
+		s[12] = _mm256_loadu_si256((const __m256i *)lo);
+		s[13] = _mm256_loadu_si256((const __m256i *)hi);
+
+		for(int i = 0; i < 16; i++) {
+			v[i] = s[i];
+		}
+
+		CHACHA_ROUNDS(v, _mm256_add_epi32, _mm256_xor_si256, ROTL256_16, ROTL256_12, ROTL256_8, ROTL256_7)
+
+		for(int i = 0; i < 16; i++) {
+			v[i] = _mm256_add_epi32(v[i], s[i]);
+		}
+
+		// r[k][j] holds words 4k..4k+3 of block j in the low lane, and of block j + 4 in the high lane
+		__m256i r[4][4];
+
+		for(int k = 0; k < 4; k++) {
+			CHACHA_TRANSPOSE(r[k], v[4 * k], v[4 * k + 1], v[4 * k + 2], v[4 * k + 3], _mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64)
+		}
+
+		for(int j = 0; j < 4; j++) {
+			__m256i out[4] = {
+				_mm256_permute2x128_si256(r[0][j], r[1][j], 0x20),
+				_mm256_permute2x128_si256(r[2][j], r[3][j], 0x20),
+				_mm256_permute2x128_si256(r[0][j], r[1][j], 0x31),
+				_mm256_permute2x128_si256(r[2][j], r[3][j], 0x31),
+			};
+
+			for(int h = 0; h < 2; h++) {
+				for(int i = 0; i < 2; i++) {
+					size_t offset = 64 * (j + 4 * h) + 32 * i;
+					__m256i in = _mm256_loadu_si256((const __m256i *)(m + offset));
+					_mm256_storeu_si256((__m256i *)(c + offset), _mm256_xor_si256(in, out[2 * h + i]));
+				}
+			}
+		}
+
+		chacha_advance(x, 8);
+	}
+
+	return done;
+}
+
+/* 16 blocks at a time with AVX-512 */
+
+#define ROTL512_16(v) _mm512_rol_epi32(v, 16)
+#define ROTL512_12(v) _mm512_rol_epi32(v, 12)
+#define ROTL512_8(v) _mm512_rol_epi32(v, 8)
+#define ROTL512_7(v) _mm512_rol_epi32(v, 7)
+
+__attribute__((target("avx512f")))
+size_t chacha_blocks_avx512(struct chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t blocks) {
+	size_t done = 0;
+
+	for(; blocks - done >= 16; done += 16, m += 16 * 64, c += 16 * 64) {
+		uint32_t lo[16], hi[16];
+		__m512i s[16], v[16];
+		chacha_lane_counters(x, lo, hi, 16);
+
+		for(int i = 0; i < 16; i++) {
+			s[i] = _mm512_set1_epi32(x->input[i]);
+		}
+
+		s[12] = _mm512_loadu_si512(lo);
+		s[13] = _mm512_loadu_si512(hi);
+
+		for(int i = 0; i < 16; i++) {
+			v[i] = s[i];
+		}
+
+		CHACHA_ROUNDS(v, _mm512_add_epi32, _mm512_xor_si512, ROTL512_16, ROTL512_12, ROTL512_8, ROTL512_7)
+
+		for(int i = 0; i < 16; i++) {
+			v[i] = _mm512_add_epi32(v[i], s[i]);
+		}
+
+		// r[k][j] holds words 4k..4k+3 of block j + 4L in 128-bit lane L
+		__m512i r[4][4];
+
+		for(int k = 0; k < 4; k++) {
+			CHACHA_TRANSPOSE(r[k], v[4 * k], v[4 * k + 1], v[4 * k + 2], v[4 * k + 3], _mm512_unpacklo_epi32, _mm512_unpackhi_epi32, _mm512_unpacklo_epi64, _mm512_unpackhi_epi64)
+		}
+
+		for(int j = 0; j < 4; j++) {
+			// Transpose the 128-bit lanes, so each vector holds one whole block
+			__m512i ab_lo = _mm512_shuffle_i32x4(r[0][j], r[1][j], 0x44);
+			__m512i ab_hi = _mm512_shuffle_i32x4(r[0][j], r[1][j], 0xee);
+			__m512i cd_lo = _mm512_shuffle_i32x4(r[2][j], r[3][j], 0x44);
+			__m512i cd_hi = _mm512_shuffle_i32x4(r[2][j], r[3][j], 0xee);
+			__m512i out[4] = {
+				_mm512_shuffle_i32x4(ab_lo, cd_lo, 0x88),
+				_mm512_shuffle_i32x4(ab_lo, cd_lo, 0xdd),
+				_mm512_shuffle_i32x4(ab_hi, cd_hi, 0x88),
+				_mm512_shuffle_i32x4(ab_hi, cd_hi, 0xdd),
+			};
+
+			for(int l = 0; l < 4; l++) {
+				size_t offset = 64 * (j + 4 * l);
+				__m512i in = _mm512_loadu_si512(m + offset);
+				_mm512_storeu_si512(c + offset, _mm512_xor_si512(in, out[l]));
+			}
+		}
+
+		chacha_advance(x, 16);
+	}
+
+	return done;
+}
+
+#endif
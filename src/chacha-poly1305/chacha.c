@@ -87,8 +87,8 @@ void chacha_ivsetup_96(chacha_ctx *x, const uint8_t *iv, const uint8_t *counter)
 	x->input[15] = U8TO32_LITTLE(iv + 8);
 }
 
-void
-chacha_encrypt_bytes(chacha_ctx *x, const uint8_t *m, uint8_t *c, uint32_t bytes)
+static void
+chacha_encrypt_bytes_scalar(chacha_ctx *x, const uint8_t *m, uint8_t *c, uint32_t bytes)
 {
 	uint32_t x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
 	uint32_t j0, j1, j2, j3, j4, j5, j6, j7, j8, j9, j10, j11, j12, j13, j14, j15;
@@ -221,3 +221,91 @@ chacha_encrypt_bytes(chacha_ctx *x, const uint8_t *m, uint8_t *c, uint32_t bytes
 		m += 64;
 	}
 }
+
+static const char *const impl_names[CHACHA_IMPL_COUNT] = {
+	"scalar",
+	"sse2",
+	"ssse3",
+	"avx2",
+	"avx512",
+};
+
+static enum chacha_impl current_impl = CHACHA_IMPL_SCALAR;
+
+#ifdef CHACHA_SIMD
+typedef size_t (*chacha_blocks_t)(chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t blocks);
+
+static const chacha_blocks_t kernels[CHACHA_IMPL_COUNT] = {
+	NULL,
+	chacha_blocks_sse2,
+	chacha_blocks_ssse3,
+	chacha_blocks_avx2,
+	chacha_blocks_avx512,
+};
+
+static bool supported[CHACHA_IMPL_COUNT] = {true};
+
+__attribute__((constructor)) static void chacha_select_impl(void)
+{
+	__builtin_cpu_init();
+	supported[CHACHA_IMPL_SSE2] = __builtin_cpu_supports("sse2");
+	supported[CHACHA_IMPL_SSSE3] = __builtin_cpu_supports("ssse3");
+	supported[CHACHA_IMPL_AVX2] = __builtin_cpu_supports("avx2");
+	supported[CHACHA_IMPL_AVX512] = __builtin_cpu_supports("avx512f");
+
+	for (int i = CHACHA_IMPL_COUNT - 1; i > CHACHA_IMPL_SCALAR; i--) {
+		if (supported[i]) {
+			current_impl = i;
+			break;
+		}
+	}
+}
+#endif
+
+void
+chacha_encrypt_bytes(chacha_ctx *x, const uint8_t *m, uint8_t *c, uint32_t bytes)
+{
+#ifdef CHACHA_SIMD
+	/* Use the widest kernel first, then narrower ones for what is left, and finally the scalar code */
+	for (int i = current_impl; i > CHACHA_IMPL_SCALAR && bytes >= 4 * 64; i--) {
+		if (!supported[i])
+			continue;
+
+		size_t done = kernels[i](x, m, c, bytes / 64) * 64;
+		m += done;
+		c += done;
+		bytes -= done;
+	}
+#endif
+
+	chacha_encrypt_bytes_scalar(x, m, c, bytes);
+}
+
+bool chacha_impl_supported(enum chacha_impl impl)
+{
+#ifdef CHACHA_SIMD
+	return impl < CHACHA_IMPL_COUNT && supported[impl];
+#else
+	return impl == CHACHA_IMPL_SCALAR;
+#endif
+}
+
+/* Select an implementation, used by tests and benchmarks. Not safe while other threads are encrypting. */
+bool chacha_set_impl(enum chacha_impl impl)
+{
+	if (!chacha_impl_supported(impl))
+		return false;
+
+	current_impl = impl;
+	return true;
+}
+
+enum chacha_impl chacha_get_impl(void)
+{
+	return current_impl;
+}
+
+const char *chacha_impl_name(enum chacha_impl impl)
+{
+	return impl < CHACHA_IMPL_COUNT ? impl_names[impl] : NULL;
+}
@@ -22,4 +22,31 @@ void chacha_ivsetup(struct chacha_ctx *x, const uint8_t *iv, const uint8_t *ctr)
 void chacha_ivsetup_96(struct chacha_ctx *x, const uint8_t *iv, const uint8_t *ctr);
 void chacha_encrypt_bytes(struct chacha_ctx *x, const uint8_t *m, uint8_t * c, uint32_t bytes);
 
+/* Implementations of chacha_encrypt_bytes(), from slowest to fastest.
+ * The fastest one supported by the CPU is selected at startup.
+ */
+enum chacha_impl {
+	CHACHA_IMPL_SCALAR,
+	CHACHA_IMPL_SSE2,
+	CHACHA_IMPL_SSSE3,
+	CHACHA_IMPL_AVX2,
+	CHACHA_IMPL_AVX512,
+	CHACHA_IMPL_COUNT
+};
+
+bool chacha_impl_supported(enum chacha_impl impl);
+bool chacha_set_impl(enum chacha_impl impl);
+enum chacha_impl chacha_get_impl(void);
+const char *chacha_impl_name(enum chacha_impl impl);
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CHACHA_SIMD 1
+
+/* Kernels processing whole multiples of 4, 8 or 16 blocks, they return the number of blocks processed */
+size_t chacha_blocks_sse2(struct chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t blocks);
+size_t chacha_blocks_ssse3(struct chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t blocks);
+size_t chacha_blocks_avx2(struct chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t blocks);
+size_t chacha_blocks_avx512(struct chacha_ctx *x, const uint8_t *m, uint8_t *c, size_t blocks);
+#endif
+
 #endif /* CHACHA_H */
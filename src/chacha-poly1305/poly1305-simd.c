@@ -0,0 +1,128 @@
+/*
+poly1305-simd.c -- Poly1305 processing four blocks in parallel with AVX2
+Public domain.
+*/
+
+#include "../system.h"
+
+#include "poly1305.h"
+
+#ifdef POLY1305_SIMD
+
+#include <immintrin.h>
+
+/* Each 64-bit lane holds a separate accumulator in five 26-bit limbs, one vector per limb.
+ * Lane i accumulates blocks 4k + i, multiplying by r^4 between groups of four blocks.
+ * At the end each lane is multiplied by the power of r it still lacks, and the lanes are summed.
+ * The message is loaded so that the lanes hold blocks 0, 2, 1 and 3 of each group.
+ */
+
+#define MASK26 _mm256_set1_epi64x(0x3ffffff)
+
+__attribute__((target("avx2")))
+static inline void poly1305_load4(__m256i h[5], const uint8_t *m)
+{
+	__m256i a = _mm256_loadu_si256((const __m256i *)m);
+	__m256i b = _mm256_loadu_si256((const __m256i *)(m + 32));
+	__m256i lo = _mm256_unpacklo_epi64(a, b);
+	__m256i hi = _mm256_unpackhi_epi64(a, b);
+
+	h[0] = _mm256_add_epi64(h[0], _mm256_and_si256(lo, MASK26));
+	h[1] = _mm256_add_epi64(h[1], _mm256_and_si256(_mm256_srli_epi64(lo, 26), MASK26));
+	h[2] = _mm256_add_epi64(h[2], _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(lo, 52), _mm256_slli_epi64(hi, 12)), MASK26));
+	h[3] = _mm256_add_epi64(h[3], _mm256_and_si256(_mm256_srli_epi64(hi, 14), MASK26));
+	h[4] = _mm256_add_epi64(h[4], _mm256_or_si256(_mm256_srli_epi64(hi, 40), _mm256_set1_epi64x(1 << 24)));
+}
+
+/* h = h * r, where s = 5 * r. All limbs of the result are carried. */
+__attribute__((target("avx2")))
+static inline void poly1305_mul4(__m256i h[5], const __m256i r[5], const __m256i s[5])
+{
+	__m256i t[5], c;
+
+#define MUL(a, b) _mm256_mul_epu32(a, b)
+	t[0] = _mm256_add_epi64(_mm256_add_epi64(MUL(h[0], r[0]), MUL(h[1], s[4])), _mm256_add_epi64(_mm256_add_epi64(MUL(h[2], s[3]), MUL(h[3], s[2])), MUL(h[4], s[1])));
+	t[1] = _mm256_add_epi64(_mm256_add_epi64(MUL(h[0], r[1]), MUL(h[1], r[0])), _mm256_add_epi64(_mm256_add_epi64(MUL(h[2], s[4]), MUL(h[3], s[3])), MUL(h[4], s[2])));
+	t[2] = _mm256_add_epi64(_mm256_add_epi64(MUL(h[0], r[2]), MUL(h[1], r[1])), _mm256_add_epi64(_mm256_add_epi64(MUL(h[2], r[0]), MUL(h[3], s[4])), MUL(h[4], s[3])));
+	t[3] = _mm256_add_epi64(_mm256_add_epi64(MUL(h[0], r[3]), MUL(h[1], r[2])), _mm256_add_epi64(_mm256_add_epi64(MUL(h[2], r[1]), MUL(h[3], r[0])), MUL(h[4], s[4])));
+	t[4] = _mm256_add_epi64(_mm256_add_epi64(MUL(h[0], r[4]), MUL(h[1], r[3])), _mm256_add_epi64(_mm256_add_epi64(MUL(h[2], r[2]), MUL(h[3], r[1])), MUL(h[4], r[0])));
+#undef MUL
+
+	for (int i = 0; i < 4; i++) {
+		c = _mm256_srli_epi64(t[i], 26);
+		h[i] = _mm256_and_si256(t[i], MASK26);
+		t[i + 1] = _mm256_add_epi64(t[i + 1], c);
+	}
+
+	c = _mm256_srli_epi64(t[4], 26);
+	h[4] = _mm256_and_si256(t[4], MASK26);
+	h[0] = _mm256_add_epi64(h[0], _mm256_add_epi64(c, _mm256_slli_epi64(c, 2)));
+	c = _mm256_srli_epi64(h[0], 26);
+	h[0] = _mm256_and_si256(h[0], MASK26);
+	h[1] = _mm256_add_epi64(h[1], c);
+}
+
+__attribute__((target("avx2")))
+size_t poly1305_blocks_avx2(poly1305_ctx *ctx, const uint8_t *m, size_t blocks)
+{
+	const uint32_t *r1 = ctx->r[0], *r2 = ctx->r[1], *r3 = ctx->r[2], *r4 = ctx->r[3];
+	__m256i h[5], r[5], s[5];
+	uint64_t c, sum[5];
+
+	blocks &= ~(size_t)3;
+
+	if (!blocks)
+		return 0;
+
+	/* carry the scalar accumulator, so all limbs fit in 32 bits, and put it in the first lane */
+	h[0] = _mm256_setr_epi64x(ctx->h[0] & 0x3ffffff, 0, 0, 0);
+	h[1] = _mm256_setr_epi64x(ctx->h[1] + (ctx->h[0] >> 26), 0, 0, 0);
+	h[2] = _mm256_setr_epi64x(ctx->h[2], 0, 0, 0);
+	h[3] = _mm256_setr_epi64x(ctx->h[3], 0, 0, 0);
+	h[4] = _mm256_setr_epi64x(ctx->h[4], 0, 0, 0);
+
+	poly1305_load4(h, m);
+
+	for (int i = 0; i < 5; i++) {
+		r[i] = _mm256_set1_epi64x(r4[i]);
+		s[i] = _mm256_set1_epi64x(r4[i] * 5);
+	}
+
+	for (size_t i = 4; i < blocks; i += 4) {
+		poly1305_mul4(h, r, s);
+		poly1305_load4(h, m + i * POLY1305_BLOCKLEN);
+	}
+
+	/* the lanes hold blocks 0, 2, 1 and 3 of the last group */
+	for (int i = 0; i < 5; i++) {
+		r[i] = _mm256_setr_epi64x(r4[i], r2[i], r3[i], r1[i]);
+		s[i] = _mm256_setr_epi64x(r4[i] * 5, r2[i] * 5, r3[i] * 5, r1[i] * 5);
+	}
+
+	poly1305_mul4(h, r, s);
+
+	for (int i = 0; i < 5; i++) {
+		uint64_t lanes[4];
+		_mm256_storeu_si256((__m256i *)lanes, h[i]);
+		sum[i] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+
+	for (int i = 0; i < 4; i++) {
+		sum[i + 1] += sum[i] >> 26;
+		sum[i] &= 0x3ffffff;
+	}
+
+	c = sum[4] >> 26;
+	sum[4] &= 0x3ffffff;
+	sum[0] += c * 5;
+	c = sum[0] >> 26;
+	sum[0] &= 0x3ffffff;
+	sum[1] += c;
+
+	for (int i = 0; i < 5; i++)
+		ctx->h[i] = (uint32_t)sum[i];
+
+	return blocks;
+}
+
+#endif
@@ -23,20 +23,33 @@
 		(p)[3] = (uint8_t)((v) >> 24); \
 	} while (0)
 
+/* Use the AVX2 path only if there are enough blocks to make up for computing the powers of r */
+#define POLY1305_AVX2_MIN_BLOCKS 16
+
+static const char *const impl_names[POLY1305_IMPL_COUNT] = {
+	"scalar",
+	"avx2",
+};
+
+static enum poly1305_impl current_impl = POLY1305_IMPL_SCALAR;
+
+#ifdef POLY1305_SIMD
+static bool avx2_supported;
+
+__attribute__((constructor)) static void poly1305_select_impl(void)
+{
+	__builtin_cpu_init();
+	avx2_supported = __builtin_cpu_supports("avx2");
+
+	if (avx2_supported)
+		current_impl = POLY1305_IMPL_AVX2;
+}
+#endif
+
 void
-poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t inlen, const unsigned char key[POLY1305_KEYLEN])
+poly1305_init(poly1305_ctx *ctx, const unsigned char key[POLY1305_KEYLEN])
 {
 	uint32_t t0, t1, t2, t3;
-	uint32_t h0, h1, h2, h3, h4;
-	uint32_t r0, r1, r2, r3, r4;
-	uint32_t s1, s2, s3, s4;
-	uint32_t b, nb;
-	size_t j;
-	uint64_t t[5];
-	uint64_t f0, f1, f2, f3;
-	uint32_t g0, g1, g2, g3, g4;
-	uint64_t c;
-	unsigned char mp[16];
 
 	/* clamp key */
 	t0 = U8TO32_LE(key + 0);
@@ -45,102 +58,198 @@ poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t
 	t3 = U8TO32_LE(key + 12);
 
 	/* precompute multipliers */
-	r0 = t0 & 0x3ffffff;
+	ctx->r[0][0] = t0 & 0x3ffffff;
 	t0 >>= 26;
 	t0 |= t1 << 6;
-	r1 = t0 & 0x3ffff03;
+	ctx->r[0][1] = t0 & 0x3ffff03;
 	t1 >>= 20;
 	t1 |= t2 << 12;
-	r2 = t1 & 0x3ffc0ff;
+	ctx->r[0][2] = t1 & 0x3ffc0ff;
 	t2 >>= 14;
 	t2 |= t3 << 18;
-	r3 = t2 & 0x3f03fff;
+	ctx->r[0][3] = t2 & 0x3f03fff;
 	t3 >>= 8;
-	r4 = t3 & 0x00fffff;
-
-	s1 = r1 * 5;
-	s2 = r2 * 5;
-	s3 = r3 * 5;
-	s4 = r4 * 5;
+	ctx->r[0][4] = t3 & 0x00fffff;
 
 	/* init state */
-	h0 = 0;
-	h1 = 0;
-	h2 = 0;
-	h3 = 0;
-	h4 = 0;
-
-	/* full blocks */
-	if (inlen < 16)
-		goto poly1305_donna_atmost15bytes;
-
- poly1305_donna_16bytes:
-	m += 16;
-	inlen -= 16;
-
-	t0 = U8TO32_LE(m - 16);
-	t1 = U8TO32_LE(m - 12);
-	t2 = U8TO32_LE(m - 8);
-	t3 = U8TO32_LE(m - 4);
-
-	h0 += t0 & 0x3ffffff;
-	h1 += ((((uint64_t) t1 << 32) | t0) >> 26) & 0x3ffffff;
-	h2 += ((((uint64_t) t2 << 32) | t1) >> 20) & 0x3ffffff;
-	h3 += ((((uint64_t) t3 << 32) | t2) >> 14) & 0x3ffffff;
-	h4 += (t3 >> 8) | (1 << 24);
-
- poly1305_donna_mul:
-	t[0] = mul32x32_64(h0, r0) + mul32x32_64(h1, s4) + mul32x32_64(h2, s3) + mul32x32_64(h3, s2) + mul32x32_64(h4, s1);
-	t[1] = mul32x32_64(h0, r1) + mul32x32_64(h1, r0) + mul32x32_64(h2, s4) + mul32x32_64(h3, s3) + mul32x32_64(h4, s2);
-	t[2] = mul32x32_64(h0, r2) + mul32x32_64(h1, r1) + mul32x32_64(h2, r0) + mul32x32_64(h3, s4) + mul32x32_64(h4, s3);
-	t[3] = mul32x32_64(h0, r3) + mul32x32_64(h1, r2) + mul32x32_64(h2, r1) + mul32x32_64(h3, r0) + mul32x32_64(h4, s4);
-	t[4] = mul32x32_64(h0, r4) + mul32x32_64(h1, r3) + mul32x32_64(h2, r2) + mul32x32_64(h3, r1) + mul32x32_64(h4, r0);
-
-	h0 = (uint32_t) t[0] & 0x3ffffff;
-	c = (t[0] >> 26);
+	memset(ctx->h, 0, sizeof(ctx->h));
+
+	ctx->pad[0] = U8TO32_LE(&key[16]);
+	ctx->pad[1] = U8TO32_LE(&key[20]);
+	ctx->pad[2] = U8TO32_LE(&key[24]);
+	ctx->pad[3] = U8TO32_LE(&key[28]);
+
+	ctx->have_powers = false;
+	ctx->leftover = 0;
+}
+
+/* out = a * b mod 2^130 - 5, with all limbs of the result carried */
+static void
+poly1305_mul(uint32_t out[5], const uint32_t a[5], const uint32_t b[5])
+{
+	uint32_t s1 = b[1] * 5, s2 = b[2] * 5, s3 = b[3] * 5, s4 = b[4] * 5;
+	uint64_t t[5], c;
+
+	t[0] = mul32x32_64(a[0], b[0]) + mul32x32_64(a[1], s4) + mul32x32_64(a[2], s3) + mul32x32_64(a[3], s2) + mul32x32_64(a[4], s1);
+	t[1] = mul32x32_64(a[0], b[1]) + mul32x32_64(a[1], b[0]) + mul32x32_64(a[2], s4) + mul32x32_64(a[3], s3) + mul32x32_64(a[4], s2);
+	t[2] = mul32x32_64(a[0], b[2]) + mul32x32_64(a[1], b[1]) + mul32x32_64(a[2], b[0]) + mul32x32_64(a[3], s4) + mul32x32_64(a[4], s3);
+	t[3] = mul32x32_64(a[0], b[3]) + mul32x32_64(a[1], b[2]) + mul32x32_64(a[2], b[1]) + mul32x32_64(a[3], b[0]) + mul32x32_64(a[4], s4);
+	t[4] = mul32x32_64(a[0], b[4]) + mul32x32_64(a[1], b[3]) + mul32x32_64(a[2], b[2]) + mul32x32_64(a[3], b[1]) + mul32x32_64(a[4], b[0]);
+
+	c = t[0] >> 26;
 	t[1] += c;
-	h1 = (uint32_t) t[1] & 0x3ffffff;
-	b = (uint32_t) (t[1] >> 26);
-	t[2] += b;
-	h2 = (uint32_t) t[2] & 0x3ffffff;
-	b = (uint32_t) (t[2] >> 26);
-	t[3] += b;
-	h3 = (uint32_t) t[3] & 0x3ffffff;
-	b = (uint32_t) (t[3] >> 26);
-	t[4] += b;
-	h4 = (uint32_t) t[4] & 0x3ffffff;
-	b = (uint32_t) (t[4] >> 26);
-	h0 += b * 5;
+	c = t[1] >> 26;
+	t[2] += c;
+	c = t[2] >> 26;
+	t[3] += c;
+	c = t[3] >> 26;
+	t[4] += c;
+	c = t[4] >> 26;
+	t[0] = (t[0] & 0x3ffffff) + c * 5;
+	c = t[0] >> 26;
+
+	out[0] = (uint32_t) t[0] & 0x3ffffff;
+	out[1] = ((uint32_t) t[1] & 0x3ffffff) + (uint32_t) c;
+	out[2] = (uint32_t) t[2] & 0x3ffffff;
+	out[3] = (uint32_t) t[3] & 0x3ffffff;
+	out[4] = (uint32_t) t[4] & 0x3ffffff;
+}
+
+static void
+poly1305_blocks(poly1305_ctx *ctx, const unsigned char *m, size_t blocks, uint32_t hibit)
+{
+	const uint32_t r0 = ctx->r[0][0], r1 = ctx->r[0][1], r2 = ctx->r[0][2], r3 = ctx->r[0][3], r4 = ctx->r[0][4];
+	const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+	uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], h3 = ctx->h[3], h4 = ctx->h[4];
+	uint32_t t0, t1, t2, t3;
+	uint32_t b;
+	uint64_t t[5];
+	uint64_t c;
+
+	for (; blocks; blocks--, m += POLY1305_BLOCKLEN) {
+		t0 = U8TO32_LE(m);
+		t1 = U8TO32_LE(m + 4);
+		t2 = U8TO32_LE(m + 8);
+		t3 = U8TO32_LE(m + 12);
+
+		h0 += t0 & 0x3ffffff;
+		h1 += ((((uint64_t) t1 << 32) | t0) >> 26) & 0x3ffffff;
+		h2 += ((((uint64_t) t2 << 32) | t1) >> 20) & 0x3ffffff;
+		h3 += ((((uint64_t) t3 << 32) | t2) >> 14) & 0x3ffffff;
+		h4 += (t3 >> 8) | hibit;
+
+		t[0] = mul32x32_64(h0, r0) + mul32x32_64(h1, s4) + mul32x32_64(h2, s3) + mul32x32_64(h3, s2) + mul32x32_64(h4, s1);
+		t[1] = mul32x32_64(h0, r1) + mul32x32_64(h1, r0) + mul32x32_64(h2, s4) + mul32x32_64(h3, s3) + mul32x32_64(h4, s2);
+		t[2] = mul32x32_64(h0, r2) + mul32x32_64(h1, r1) + mul32x32_64(h2, r0) + mul32x32_64(h3, s4) + mul32x32_64(h4, s3);
+		t[3] = mul32x32_64(h0, r3) + mul32x32_64(h1, r2) + mul32x32_64(h2, r1) + mul32x32_64(h3, r0) + mul32x32_64(h4, s4);
+		t[4] = mul32x32_64(h0, r4) + mul32x32_64(h1, r3) + mul32x32_64(h2, r2) + mul32x32_64(h3, r1) + mul32x32_64(h4, r0);
+
+		h0 = (uint32_t) t[0] & 0x3ffffff;
+		c = (t[0] >> 26);
+		t[1] += c;
+		h1 = (uint32_t) t[1] & 0x3ffffff;
+		b = (uint32_t) (t[1] >> 26);
+		t[2] += b;
+		h2 = (uint32_t) t[2] & 0x3ffffff;
+		b = (uint32_t) (t[2] >> 26);
+		t[3] += b;
+		h3 = (uint32_t) t[3] & 0x3ffffff;
+		b = (uint32_t) (t[3] >> 26);
+		t[4] += b;
+		h4 = (uint32_t) t[4] & 0x3ffffff;
+		b = (uint32_t) (t[4] >> 26);
+		h0 += b * 5;
+	}
+
+	ctx->h[0] = h0;
+	ctx->h[1] = h1;
+	ctx->h[2] = h2;
+	ctx->h[3] = h3;
+	ctx->h[4] = h4;
+}
+
+void
+poly1305_update(poly1305_ctx *ctx, const unsigned char *m, size_t len)
+{
+	size_t blocks;
+
+	/* complete a partial block left over from the previous call */
+	if (ctx->leftover) {
+		size_t want = POLY1305_BLOCKLEN - ctx->leftover;
 
-	if (inlen >= 16)
-		goto poly1305_donna_16bytes;
+		if (want > len)
+			want = len;
+
+		memcpy(ctx->buffer + ctx->leftover, m, want);
+		ctx->leftover += want;
+		m += want;
+		len -= want;
+
+		if (ctx->leftover < POLY1305_BLOCKLEN)
+			return;
+
+		poly1305_blocks(ctx, ctx->buffer, 1, 1 << 24);
+		ctx->leftover = 0;
+	}
+
+	blocks = len / POLY1305_BLOCKLEN;
+
+#ifdef POLY1305_SIMD
+	if (current_impl == POLY1305_IMPL_AVX2 && blocks >= POLY1305_AVX2_MIN_BLOCKS) {
+		size_t done;
+
+		if (!ctx->have_powers) {
+			poly1305_mul(ctx->r[1], ctx->r[0], ctx->r[0]);
+			poly1305_mul(ctx->r[2], ctx->r[1], ctx->r[0]);
+			poly1305_mul(ctx->r[3], ctx->r[2], ctx->r[0]);
+			ctx->have_powers = true;
+		}
+
+		done = poly1305_blocks_avx2(ctx, m, blocks);
+		m += done * POLY1305_BLOCKLEN;
+		len -= done * POLY1305_BLOCKLEN;
+		blocks -= done;
+	}
+#endif
+
+	if (blocks) {
+		poly1305_blocks(ctx, m, blocks, 1 << 24);
+		m += blocks * POLY1305_BLOCKLEN;
+		len -= blocks * POLY1305_BLOCKLEN;
+	}
+
+	/* keep the rest for the next call */
+	if (len) {
+		memcpy(ctx->buffer, m, len);
+		ctx->leftover = len;
+	}
+}
+
+void
+poly1305_finish(poly1305_ctx *ctx, unsigned char out[POLY1305_TAGLEN])
+{
+	uint32_t h0, h1, h2, h3, h4;
+	uint32_t b, nb;
+	uint64_t f0, f1, f2, f3;
+	uint32_t g0, g1, g2, g3, g4;
 
 	/* final bytes */
- poly1305_donna_atmost15bytes:
-	if (!inlen)
-		goto poly1305_donna_finish;
-
-	for (j = 0; j < inlen; j++)
-		mp[j] = m[j];
-	mp[j++] = 1;
-	for (; j < 16; j++)
-		mp[j] = 0;
-	inlen = 0;
-
-	t0 = U8TO32_LE(mp + 0);
-	t1 = U8TO32_LE(mp + 4);
-	t2 = U8TO32_LE(mp + 8);
-	t3 = U8TO32_LE(mp + 12);
-
-	h0 += t0 & 0x3ffffff;
-	h1 += ((((uint64_t) t1 << 32) | t0) >> 26) & 0x3ffffff;
-	h2 += ((((uint64_t) t2 << 32) | t1) >> 20) & 0x3ffffff;
-	h3 += ((((uint64_t) t3 << 32) | t2) >> 14) & 0x3ffffff;
-	h4 += (t3 >> 8);
-
-	goto poly1305_donna_mul;
-
- poly1305_donna_finish:
+	if (ctx->leftover) {
+		size_t j = ctx->leftover;
+
+		ctx->buffer[j++] = 1;
+		for (; j < POLY1305_BLOCKLEN; j++)
+			ctx->buffer[j] = 0;
+
+		poly1305_blocks(ctx, ctx->buffer, 1, 0);
+	}
+
+	h0 = ctx->h[0];
+	h1 = ctx->h[1];
+	h2 = ctx->h[2];
+	h3 = ctx->h[3];
+	h4 = ctx->h[4];
+
 	b = h0 >> 26;
 	h0 = h0 & 0x3ffffff;
 	h1 += b;
@@ -182,10 +291,10 @@ poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t
 	h3 = (h3 & nb) | (g3 & b);
 	h4 = (h4 & nb) | (g4 & b);
 
-	f0 = ((h0) | (h1 << 26)) + (uint64_t) U8TO32_LE(&key[16]);
-	f1 = ((h1 >> 6) | (h2 << 20)) + (uint64_t) U8TO32_LE(&key[20]);
-	f2 = ((h2 >> 12) | (h3 << 14)) + (uint64_t) U8TO32_LE(&key[24]);
-	f3 = ((h3 >> 18) | (h4 << 8)) + (uint64_t) U8TO32_LE(&key[28]);
+	f0 = ((h0) | (h1 << 26)) + (uint64_t) ctx->pad[0];
+	f1 = ((h1 >> 6) | (h2 << 20)) + (uint64_t) ctx->pad[1];
+	f2 = ((h2 >> 12) | (h3 << 14)) + (uint64_t) ctx->pad[2];
+	f3 = ((h3 >> 18) | (h4 << 8)) + (uint64_t) ctx->pad[3];
 
 	U32TO8_LE(&out[0], f0);
 	f1 += (f0 >> 32);
@@ -195,3 +304,42 @@ poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t
 	f3 += (f2 >> 32);
 	U32TO8_LE(&out[12], f3);
 }
+
+void
+poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t inlen, const unsigned char key[POLY1305_KEYLEN])
+{
+	poly1305_ctx ctx;
+
+	poly1305_init(&ctx, key);
+	poly1305_update(&ctx, m, inlen);
+	poly1305_finish(&ctx, out);
+}
+
+bool poly1305_impl_supported(enum poly1305_impl impl)
+{
+#ifdef POLY1305_SIMD
+	return impl == POLY1305_IMPL_SCALAR || (impl == POLY1305_IMPL_AVX2 && avx2_supported);
+#else
+	return impl == POLY1305_IMPL_SCALAR;
+#endif
+}
+
+/* Select an implementation, used by tests and benchmarks. Not safe while other threads are authenticating. */
+bool poly1305_set_impl(enum poly1305_impl impl)
+{
+	if (!poly1305_impl_supported(impl))
+		return false;
+
+	current_impl = impl;
+	return true;
+}
+
+enum poly1305_impl poly1305_get_impl(void)
+{
+	return current_impl;
+}
+
+const char *poly1305_impl_name(enum poly1305_impl impl)
+{
+	return impl < POLY1305_IMPL_COUNT ? impl_names[impl] : NULL;
+}
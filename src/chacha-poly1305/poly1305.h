@@ -10,7 +10,43 @@
 
 #define POLY1305_KEYLEN		32
 #define POLY1305_TAGLEN		16
+#define POLY1305_BLOCKLEN	16
+
+/* State of a MAC computation. Numbers are stored as five 26-bit limbs. */
+typedef struct poly1305_ctx {
+	uint32_t r[4][5];	/* r, r^2, r^3 and r^4, the powers are only computed for the AVX2 path */
+	uint32_t h[5];		/* accumulator */
+	uint32_t pad[4];	/* s */
+	bool have_powers;
+	size_t leftover;
+	uint8_t buffer[POLY1305_BLOCKLEN];
+} poly1305_ctx;
+
+void poly1305_init(poly1305_ctx *ctx, const uint8_t key[POLY1305_KEYLEN]);
+void poly1305_update(poly1305_ctx *ctx, const uint8_t *m, size_t len);
+void poly1305_finish(poly1305_ctx *ctx, uint8_t out[POLY1305_TAGLEN]);
 
 void poly1305_auth(uint8_t out[POLY1305_TAGLEN], const uint8_t *m, size_t inlen, const uint8_t key[POLY1305_KEYLEN]);
 
+/* Implementations of poly1305_update(), from slowest to fastest.
+ * The fastest one supported by the CPU is selected at startup.
+ */
+enum poly1305_impl {
+	POLY1305_IMPL_SCALAR,
+	POLY1305_IMPL_AVX2,
+	POLY1305_IMPL_COUNT
+};
+
+bool poly1305_impl_supported(enum poly1305_impl impl);
+bool poly1305_set_impl(enum poly1305_impl impl);
+enum poly1305_impl poly1305_get_impl(void);
+const char *poly1305_impl_name(enum poly1305_impl impl);
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define POLY1305_SIMD 1
+
+/* Processes whole multiples of 4 blocks, returns the number of blocks processed */
+size_t poly1305_blocks_avx2(poly1305_ctx *ctx, const uint8_t *m, size_t blocks);
+#endif
+
 #endif				/* POLY1305_H */
@@ -33,11 +33,18 @@ void init_connections(meshlink_handle_t *mesh) {
 	assert(!mesh->everyone);
 
 	mesh->connections = list_alloc((list_action_t) free_connection);
+	mesh->pending_verifications = list_alloc(NULL);
 	mesh->everyone = new_connection();
 	mesh->everyone->name = xstrdup("mesh->everyone");
 }
 
 void exit_connections(meshlink_handle_t *mesh) {
+	timeout_del(&mesh->loop, &mesh->verify_timeout);
+
+	if(mesh->pending_verifications) {
+		list_delete_list(mesh->pending_verifications);
+	}
+
 	if(mesh->connections) {
 		list_delete_list(mesh->connections);
 	}
@@ -47,6 +54,7 @@ void exit_connections(meshlink_handle_t *mesh) {
 	}
 
 	mesh->connections = NULL;
+	mesh->pending_verifications = NULL;
 	mesh->everyone = NULL;
 }
 
@@ -80,6 +88,7 @@ void connection_add(meshlink_handle_t *mesh, connection_t *c) {
 	assert(c);
 
 	c->mesh = mesh;
+	c->key_renewal_jitter = prng(mesh, KEY_RENEWAL_JITTER);
 	list_insert_tail(mesh->connections, c);
 }
 
@@ -87,5 +96,6 @@ void connection_del(meshlink_handle_t *mesh, connection_t *c) {
 	assert(c);
 
 	io_del(&mesh->loop, &c->io);
+	list_delete(mesh->pending_verifications, c);
 	list_delete(mesh->connections, c);
 }
@@ -69,6 +69,8 @@ typedef struct connection_t {
 	int allow_request;              /* defined if there's only one request possible */
 	time_t last_ping_time;          /* last time we saw some activity from the other end or pinged them */
 	time_t last_key_renewal;        /* last time we renewed the SPTPS key */
+	uint16_t key_renewal_jitter;    /* seconds before KEY_RENEWAL_INTERVAL at which the next key renewal is due */
+	uint64_t renewal_traffic;       /* meta traffic at the time of the last key renewal */
 
 	struct outgoing_t *outgoing;    /* used to keep track of outgoing connections */
 
@@ -0,0 +1,168 @@
+/*
+    crypto_worker.c -- verifying handshakes on a worker thread
+    Copyright (C) 2026 MeshLink contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "system.h"
+
+#include <pthread.h>
+
+#include "crypto_worker.h"
+#include "ecdsa.h"
+#include "logger.h"
+
+/* The worker verifies the peer's signature and computes the ECDH shared secret of SPTPS handshakes.
+ * Jobs that are queued at the same time have their signatures verified as a batch.
+ * Continuing the handshake with the results is done by the MeshLink thread.
+ */
+
+#define CRYPTO_WORKER_BATCH 64
+
+// Tells the worker to stop. NULL cannot be used, since meshlink_queue_pop() returns that for an empty queue.
+static char stop_marker;
+
+static void *crypto_worker_loop(void *data) {
+	meshlink_handle_t *mesh = data;
+	bool stop = false;
+
+	while(!stop) {
+		sptps_job_t *jobs[CRYPTO_WORKER_BATCH];
+		size_t count = 0;
+
+		for(void *item = meshlink_queue_pop_cond(&mesh->crypto_queue, &mesh->crypto_cond); item; item = count < CRYPTO_WORKER_BATCH ? meshlink_queue_pop(&mesh->crypto_queue) : NULL) {
+			if(item == &stop_marker) {
+				stop = true;
+				break;
+			}
+
+			jobs[count++] = item;
+		}
+
+		if(!count) {
+			continue;
+		}
+
+		ecdsa_t *keys[CRYPTO_WORKER_BATCH];
+		const void *msgs[CRYPTO_WORKER_BATCH];
+		size_t msglens[CRYPTO_WORKER_BATCH];
+		const void *sigs[CRYPTO_WORKER_BATCH];
+		bool valid[CRYPTO_WORKER_BATCH];
+
+		for(size_t i = 0; i < count; i++) {
+			keys[i] = jobs[i]->hiskey;
+			msgs[i] = jobs[i]->msg;
+			msglens[i] = jobs[i]->msglen;
+			sigs[i] = jobs[i]->sig;
+		}
+
+		if(!ecdsa_verify_batch(keys, msgs, msglens, sigs, count, valid)) {
+			logger(mesh, MESHLINK_DEBUG, "Batch of %zu handshake signatures contained invalid ones", count);
+		}
+
+		for(size_t i = 0; i < count; i++) {
+			jobs[i]->valid = valid[i];
+			sptps_finish_job(jobs[i]);
+
+			if(!meshlink_queue_push(&mesh->crypto_done_queue, jobs[i])) {
+				abort();
+			}
+		}
+
+		signal_trigger(&mesh->loop, &mesh->crypto_signal);
+	}
+
+	return NULL;
+}
+
+static void crypto_worker_handler(event_loop_t *loop, void *data) {
+	(void)loop;
+	meshlink_handle_t *mesh = data;
+
+	for(sptps_job_t *job; (job = meshlink_queue_pop(&mesh->crypto_done_queue));) {
+		// The session might have been stopped while the job was running
+		sptps_t *s = job->s;
+
+		if(s) {
+			bool result = sptps_job_done(s, job);
+
+			if(job->done) {
+				job->done(s, result);
+			}
+		}
+
+		sptps_free_job(job);
+	}
+}
+
+void init_crypto_worker(meshlink_handle_t *mesh) {
+	if(!mesh->crypto_worker) {
+		return;
+	}
+
+	meshlink_queue_init(&mesh->crypto_queue);
+	meshlink_queue_init(&mesh->crypto_done_queue);
+
+	if(pthread_create(&mesh->crypto_thread, NULL, crypto_worker_loop, mesh) != 0) {
+		logger(mesh, MESHLINK_WARNING, "Could not start crypto worker thread: %s", strerror(errno));
+		meshlink_queue_exit(&mesh->crypto_done_queue);
+		meshlink_queue_exit(&mesh->crypto_queue);
+		return;
+	}
+
+	signal_add(&mesh->loop, &mesh->crypto_signal, crypto_worker_handler, mesh, 4);
+}
+
+void exit_crypto_worker(meshlink_handle_t *mesh) {
+	if(!mesh->crypto_signal.cb) {
+		return;
+	}
+
+	/* Let the worker finish the jobs that are already queued, so no session is left waiting for one */
+	if(!meshlink_queue_push(&mesh->crypto_queue, &stop_marker)) {
+		abort();
+	}
+
+	pthread_cond_signal(&mesh->crypto_cond);
+	pthread_join(mesh->crypto_thread, NULL);
+
+	crypto_worker_handler(&mesh->loop, mesh);
+
+	signal_del(&mesh->loop, &mesh->crypto_signal);
+	meshlink_queue_exit(&mesh->crypto_done_queue);
+	meshlink_queue_exit(&mesh->crypto_queue);
+}
+
+bool crypto_worker_submit(meshlink_handle_t *mesh, sptps_t *s, void (*done)(sptps_t *s, bool result)) {
+	if(!mesh->crypto_signal.cb) {
+		return false;
+	}
+
+	sptps_job_t *job = sptps_take_job(s);
+
+	if(!job) {
+		return false;
+	}
+
+	job->done = done;
+
+	if(!meshlink_queue_push(&mesh->crypto_queue, job)) {
+		abort();
+	}
+
+	pthread_cond_signal(&mesh->crypto_cond);
+	return true;
+}
@@ -0,0 +1,30 @@
+#ifndef MESHLINK_CRYPTO_WORKER_H
+#define MESHLINK_CRYPTO_WORKER_H
+
+/*
+    crypto_worker.h -- header file for crypto_worker.c
+    Copyright (C) 2026 MeshLink contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "meshlink_internal.h"
+#include "sptps.h"
+
+void init_crypto_worker(meshlink_handle_t *mesh);
+void exit_crypto_worker(meshlink_handle_t *mesh);
+bool crypto_worker_submit(meshlink_handle_t *mesh, sptps_t *s, void (*done)(sptps_t *s, bool result)) __attribute__((__warn_unused_result__));
+
+#endif
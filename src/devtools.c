@@ -25,6 +25,7 @@
 #include "node.h"
 #include "submesh.h"
 #include "splay_tree.h"
+#include "net.h"
 #include "netutl.h"
 #include "xalloc.h"
 
@@ -49,11 +50,20 @@ static void sptps_renewal_nop_probe(meshlink_node_t *node) {
 	return;
 }
 
+static bool udp_receive_nop_probe(meshlink_handle_t *mesh, const struct sockaddr *from, const void *data, size_t len) {
+	(void)mesh;
+	(void)from;
+	(void)data;
+	(void)len;
+	return true;
+}
+
 void (*devtool_trybind_probe)(void) = nop_probe;
 void (*devtool_keyrotate_probe)(int stage) = keyrotate_nop_probe;
 void (*devtool_set_inviter_commits_first)(bool inviter_commited_first) = inviter_commits_first_nop_probe;
 void (*devtool_adns_resolve_probe)(void) = nop_probe;
 void (*devtool_sptps_renewal_probe)(meshlink_node_t *node) = sptps_renewal_nop_probe;
+bool (*devtool_udp_receive_probe)(meshlink_handle_t *mesh, const struct sockaddr *from, const void *data, size_t len) = udp_receive_nop_probe;
 
 /* Return an array of edges in the current network graph.
  * Data captures the current state and will not be updated.
@@ -279,6 +289,14 @@ static void devtool_get_reset_node_status(meshlink_handle_t *mesh, meshlink_node
 		status->out_forward = internal->out_forward;
 		status->in_meta = internal->in_meta;
 		status->out_meta = internal->out_meta;
+		status->in_replayed = internal->in_replayed;
+
+		if(internal != mesh->self && internal->status.validkey) {
+			time_t renewal = node_key_renewal_time(internal) - mesh->loop.now.tv_sec;
+			status->key_renewal_in = renewal > 0 ? renewal : 0;
+		} else {
+			status->key_renewal_in = -1;
+		}
 
 		// External address information (from REQ_EXTERNAL messages)
 		status->external_ip_address = internal->external_ip_address ? xstrdup(internal->external_ip_address) : NULL;
@@ -309,6 +327,7 @@ static void devtool_get_reset_node_status(meshlink_handle_t *mesh, meshlink_node
 		internal->out_forward = 0;
 		internal->in_meta = 0;
 		internal->out_meta = 0;
+		internal->in_replayed = 0;
 	}
 
 	pthread_mutex_unlock(&mesh->mutex);
@@ -332,6 +351,169 @@ void devtool_reset_node_counters(meshlink_handle_t *mesh, meshlink_node_t *node,
 	devtool_get_reset_node_status(mesh, node, status, true);
 }
 
+void devtool_get_udp_receive_stats(meshlink_handle_t *mesh, devtool_udp_receive_stats_t *stats) {
+	if(!mesh || !stats) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	stats->packets = mesh->udp_rx_packets;
+	stats->syscalls = mesh->udp_rx_syscalls;
+	stats->batch = mesh->udp_rx_batch;
+	stats->tx_packets = mesh->udp_tx_packets;
+	stats->tx_syscalls = mesh->udp_tx_syscalls;
+	stats->tx_gso = mesh->udp_tx_gso;
+	stats->unknown = mesh->udp_rx_unknown;
+	stats->full_scans = mesh->udp_rx_hard_tries;
+
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+bool devtool_inject_udp_packet(meshlink_handle_t *mesh, const struct sockaddr *from, const void *data, size_t len) {
+	if(!mesh || !from || !data || !len || len > MAXSIZE) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	sockaddr_t sa;
+	memset(&sa, 0, sizeof(sa));
+
+	if(from->sa_family == AF_INET) {
+		memcpy(&sa.in, from, sizeof(sa.in));
+	} else if(from->sa_family == AF_INET6) {
+		memcpy(&sa.in6, from, sizeof(sa.in6));
+	} else {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	vpn_packet_t *packet = xzalloc(sizeof(*packet));
+	memcpy(packet->data, data, len);
+	packet->len = len;
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	bool handled = handle_injected_udp_packet(mesh, &sa, packet);
+	pthread_mutex_unlock(&mesh->mutex);
+	free(packet);
+
+	if(!handled) {
+		meshlink_errno = MESHLINK_EINVAL;
+	}
+
+	return handled;
+}
+
+size_t devtool_get_channel_memory_used(meshlink_handle_t *mesh) {
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return 0;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	size_t used = mesh->channel_memory.used;
+	pthread_mutex_unlock(&mesh->mutex);
+	return used;
+}
+
+void devtool_set_udp_receive_batch(meshlink_handle_t *mesh, unsigned int batch) {
+	if(!mesh || !batch || batch > 1024) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	// The receive buffers are resized the next time a packet arrives
+	mesh->udp_rx_batch = batch;
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void devtool_set_udp_gso_error(meshlink_handle_t *mesh, int error) {
+	if(!mesh || error < 0) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	mesh->udp_tx_gso_error = error;
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void devtool_set_packet_workers(meshlink_handle_t *mesh, unsigned int workers) {
+	if(!mesh || workers > 64) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	mesh->packet_worker_threads = workers;
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void devtool_set_crypto_worker(meshlink_handle_t *mesh, bool enabled) {
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	mesh->crypto_worker = enabled;
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void devtool_get_key_renewal_stats(meshlink_handle_t *mesh, devtool_key_renewal_stats_t *stats) {
+	if(!mesh || !stats) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	stats->rate = mesh->key_renewal_rate;
+	stats->in_flight = key_renewals_in_flight(mesh);
+	stats->postponed = mesh->key_renewals_postponed;
+	stats->renewals = mesh->key_renewals;
+
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void devtool_set_key_renewal_rate(meshlink_handle_t *mesh, unsigned int rate) {
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	mesh->key_renewal_rate = rate;
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
 meshlink_submesh_t **devtool_get_all_submeshes(meshlink_handle_t *mesh, meshlink_submesh_t **submeshes, size_t *nmemb) {
 	if(!mesh || !nmemb || (*nmemb && !submeshes)) {
 		meshlink_errno = MESHLINK_EINVAL;
@@ -107,6 +107,8 @@ struct devtool_node_status {
 	uint64_t out_forward;                /// Bytes forwarded from channel from other nodes
 	uint64_t in_meta;                    /// Bytes received from meta-connections, heartbeat packets etc.
 	uint64_t out_meta;                   /// Bytes sent on meta-connections, heartbeat packets etc.
+	uint64_t in_replayed;                /// UDP packets dropped by the replay window before being decrypted
+	int key_renewal_in;                  /// Seconds until the key of the UDP session is renewed, or -1 if there is no session
 
 	// External address information (from REQ_EXTERNAL messages)
 	char *external_ip_address;            /// External IP address and port in "IP PORT" format
@@ -152,6 +154,131 @@ void devtool_free_node_status(devtool_node_status_t *status);
  */
 void devtool_reset_node_counters(meshlink_handle_t *mesh, meshlink_node_t *node, devtool_node_status_t *status);
 
+/// UDP receive statistics.
+typedef struct devtool_udp_receive_stats devtool_udp_receive_stats_t;
+
+/// UDP receive statistics.
+struct devtool_udp_receive_stats {
+	uint64_t packets;                    /// UDP packets received
+	uint64_t syscalls;                   /// System calls used to receive them
+	unsigned int batch;                  /// Maximum number of packets read per wakeup
+	uint64_t tx_packets;                 /// UDP packets sent
+	uint64_t tx_syscalls;                /// System calls used to send them
+	uint64_t tx_gso;                     /// Messages sent with UDP segmentation offload, each carrying several packets
+	uint64_t unknown;                    /// UDP packets received from an address not associated with a node
+	uint64_t full_scans;                 /// Times all nodes were tried to find the sender of such a packet
+};
+
+/// Get the UDP receive statistics.
+/** This function returns how many UDP packets have been received and sent, and with how many system calls.
+ *  Dividing packets by syscalls gives the average number of packets read per system call.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param stats        A pointer to a devtool_udp_receive_stats_t variable that has
+ *                      to be provided by the caller.
+ *                      The contents of this variable will be changed to reflect
+ *                      the current statistics.
+ */
+void devtool_get_udp_receive_stats(meshlink_handle_t *mesh, devtool_udp_receive_stats_t *stats);
+
+/// Inject a UDP packet.
+/** This function makes MeshLink handle a packet as if it was received on its UDP listening socket.
+ *  It can be used to replay packets, or to make packets appear to come from another address.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param from         The address the packet appears to come from. It must be an IPv4 or IPv6 address.
+ *  @param data         A pointer to the contents of the packet.
+ *  @param len          The length of the packet in bytes.
+ *
+ *  @return             This function returns true if the packet was handled, false if there is no listening socket
+ *                      for the address family of @a from, or if the arguments are invalid.
+ *                      Handled packets can still be dropped, for example if their sender is unknown.
+ */
+bool devtool_inject_udp_packet(meshlink_handle_t *mesh, const struct sockaddr *from, const void *data, size_t len);
+
+/// Get the memory used by automatically grown channel buffers.
+/** This returns how many bytes the buffers of all channels together currently use beyond their default sizes.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *
+ *  @return             The number of bytes used.
+ */
+size_t devtool_get_channel_memory_used(meshlink_handle_t *mesh);
+
+/// Set the UDP receive batch size.
+/** This sets the maximum number of UDP packets MeshLink reads from a socket each time it becomes readable.
+ *  Where available, the whole batch is read using a single system call.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param batch        The maximum number of packets to read at once. Must be between 1 and 1024.
+ */
+void devtool_set_udp_receive_batch(meshlink_handle_t *mesh, unsigned int batch);
+
+/// Make UDP segmentation offload fail.
+/** This makes every attempt to send several UDP packets as one message fail with the given error,
+ *  as if the kernel rejected UDP_SEGMENT. MeshLink then sends those packets one by one.
+ *  After EIO, MeshLink stops using segmentation offload on that socket.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param error        The errno value to fail with, or 0 to let the kernel decide again.
+ */
+void devtool_set_udp_gso_error(meshlink_handle_t *mesh, int error);
+
+/// Set the number of packet worker threads.
+/** This sets the number of threads that decrypt incoming UDP packets, in addition to the MeshLink thread.
+ *  Packets from a given node are always decrypted by the same worker thread, and are handled in the order they were received.
+ *  Only decryption is offloaded, the rest of SPTPS and all UTCP processing still happen on the MeshLink thread.
+ *  The new value takes effect the next time meshlink_start() is called.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param workers      The number of worker threads, between 0 and 64. If 0 (the default), packets are decrypted by the MeshLink thread.
+ */
+void devtool_set_packet_workers(meshlink_handle_t *mesh, unsigned int workers);
+
+/// Enable or disable the crypto worker thread.
+/** When enabled, the signature verification and ECDH computation of SPTPS handshakes
+ *  are done by a separate thread, batching handshakes that arrive at the same time.
+ *  This applies to meta-connections and to key renewals of UDP sessions with other nodes.
+ *  The new value takes effect the next time meshlink_start() is called.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param enabled      True to use the crypto worker thread, false (the default) to do all handshakes on the MeshLink thread.
+ */
+void devtool_set_crypto_worker(meshlink_handle_t *mesh, bool enabled);
+
+/// SPTPS key renewal statistics.
+typedef struct devtool_key_renewal_stats devtool_key_renewal_stats_t;
+
+/// SPTPS key renewal statistics.
+struct devtool_key_renewal_stats {
+	unsigned int rate;                   /// Maximum number of key renewals started per second, 0 if unlimited
+	unsigned int in_flight;              /// Key renewals that have been started but not finished yet
+	unsigned int postponed;              /// Key renewals that were due but postponed by the rate limit the last time the scheduler ran
+	uint64_t renewals;                   /// Key renewals started since meshlink_open()
+};
+
+/// Get the SPTPS key renewal statistics.
+/** This function returns how many key renewals of meta-connections and UDP sessions are in progress and have been done.
+ *  The time until the next renewal of a given node's UDP session is returned by devtool_get_node_status().
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param stats        A pointer to a devtool_key_renewal_stats_t variable that has
+ *                      to be provided by the caller.
+ *                      The contents of this variable will be changed to reflect
+ *                      the current statistics.
+ */
+void devtool_get_key_renewal_stats(meshlink_handle_t *mesh, devtool_key_renewal_stats_t *stats);
+
+/// Set the maximum rate of SPTPS key renewals.
+/** Keys are renewed about once per hour, at a random moment for each session.
+ *  This limits the number of renewals started per second, to avoid a burst of handshakes in a large mesh.
+ *  When more renewals are due, the sessions that carried the least traffic since their previous renewal go first.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param rate         The maximum number of renewals per second, or 0 for no limit. The default is 10.
+ */
+void devtool_set_key_renewal_rate(meshlink_handle_t *mesh, unsigned int rate);
+
 /// Get the list of all submeshes of a meshlink instance.
 /** This function returns an array of submesh handles.
  *  These pointers are the same pointers that are present in the submeshes list
@@ -211,6 +338,21 @@ extern void (*devtool_adns_resolve_probe)(void);
  */
 extern void (*devtool_sptps_renewal_probe)(meshlink_node_t *node);
 
+/// Debug function pointer variable for received UDP packets
+/** This function pointer variable is a userspace tracepoint or debugger callback which
+ *  is invoked for every UDP packet MeshLink receives, before it is processed.
+ *  It is called from MeshLink's own thread.
+ *
+ *  @param mesh A handle which represents an instance of MeshLink.
+ *  @param from The address the packet was received from.
+ *  @param data A pointer to the contents of the packet.
+ *  @param len  The length of the packet in bytes.
+ *
+ *  @return     This function should return true if the packet should be processed normally,
+ *              false if it should be dropped.
+ */
+extern bool (*devtool_udp_receive_probe)(meshlink_handle_t *mesh, const struct sockaddr *from, const void *data, size_t len);
+
 /// Force renewal of SPTPS sessions with the given node.
 /** This causes the SPTPS sessions for both the UDP and TCP connections to renew their keys.
  *
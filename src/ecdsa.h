@@ -35,6 +35,7 @@ ecdsa_t *ecdsa_read_pem_private_key(FILE *fp) __attribute__((__malloc__));
 size_t ecdsa_size(ecdsa_t *ecdsa);
 bool ecdsa_sign(ecdsa_t *ecdsa, const void *in, size_t inlen, void *out) __attribute__((__warn_unused_result__));
 bool ecdsa_verify(ecdsa_t *ecdsa, const void *in, size_t inlen, const void *out) __attribute__((__warn_unused_result__));
+bool ecdsa_verify_batch(ecdsa_t *const *ecdsa, const void *const *in, const size_t *inlen, const void *const *out, size_t count, bool *valid) __attribute__((__warn_unused_result__));
 bool ecdsa_active(ecdsa_t *ecdsa);
 void ecdsa_free(ecdsa_t *ecdsa);
 
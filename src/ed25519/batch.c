@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ed25519.h"
+#include "sha512.h"
+#include "ge.h"
+#include "sc.h"
+
+/*
+Verify several signatures at once by checking a random linear combination of the verification equations:
+
+  8 * ((sum z_i S_i) B - sum z_i R_i - sum (z_i h_i) A_i) = 0
+
+This needs one multi-scalar multiplication instead of one double scalar multiplication per signature.
+The 128-bit z_i are derived from a hash of all the signatures, public keys and messages,
+so they are only known after all inputs have been chosen.
+Because of the factor 8, a signature that only differs from a valid one by a small order component,
+which requires the private key to create, may pass here while ed25519_verify() rejects it.
+*/
+
+#define ED25519_BATCH_MAX 64
+
+typedef struct {
+    ge_p3 *points;
+    unsigned char (*scalars)[32];
+    ge_cached (*multiples)[8];
+    signed char (*slides)[256];
+} batch_scratch;
+
+static int verify_chunk(batch_scratch *b, const unsigned char *const *signatures, const unsigned char *const *messages, const size_t *message_lens, const unsigned char *const *public_keys, size_t count) {
+    static const unsigned char zero[32];
+    unsigned char h[ED25519_BATCH_MAX][64];
+    unsigned char seed[64];
+    unsigned char z[64];
+    unsigned char bsum[32];
+    sha512_context hash;
+    ge_p2 R;
+    ge_p1p1 t;
+    fe check;
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        if (signatures[i][63] & 224) {
+            return 0;
+        }
+
+        /* both points are negated */
+        if (ge_frombytes_negate_vartime(&b->points[2 * i], signatures[i]) != 0 || ge_frombytes_negate_vartime(&b->points[2 * i + 1], public_keys[i]) != 0) {
+            return 0;
+        }
+
+        sha512_init(&hash);
+        sha512_update(&hash, signatures[i], 32);
+        sha512_update(&hash, public_keys[i], 32);
+        sha512_update(&hash, messages[i], message_lens[i]);
+        sha512_final(&hash, h[i]);
+        sc_reduce(h[i]);
+    }
+
+    sha512_init(&hash);
+
+    for (i = 0; i < count; ++i) {
+        sha512_update(&hash, signatures[i], 64);
+        sha512_update(&hash, public_keys[i], 32);
+        sha512_update(&hash, h[i], 32);
+    }
+
+    sha512_final(&hash, seed);
+
+    memset(bsum, 0, sizeof(bsum));
+
+    for (i = 0; i < count; ++i) {
+        unsigned char *zi = b->scalars[2 * i];
+
+        /* each hash gives four z values */
+        if (i % 4 == 0) {
+            unsigned char counter[4] = {i, i >> 8, i >> 16, i >> 24};
+            sha512_init(&hash);
+            sha512_update(&hash, seed, sizeof(seed));
+            sha512_update(&hash, counter, sizeof(counter));
+            sha512_final(&hash, z);
+        }
+
+        memcpy(zi, z + 16 * (i % 4), 16);
+        memset(zi + 16, 0, 16);
+        zi[0] |= 1;
+
+        sc_muladd(b->scalars[2 * i + 1], zi, h[i], zero);
+        sc_muladd(bsum, zi, signatures[i] + 32, bsum);
+    }
+
+    ge_multi_scalarmult_vartime(&R, bsum, 2 * count, (const unsigned char (*)[32])b->scalars, b->points, b->multiples, b->slides);
+
+    for (i = 0; i < 3; ++i) {
+        ge_p2_dbl(&t, &R);
+        ge_p1p1_to_p2(&R, &t);
+    }
+
+    /* the result must be the neutral element (0:1) */
+    if (fe_isnonzero(R.X)) {
+        return 0;
+    }
+
+    fe_sub(check, R.Y, R.Z);
+    return !fe_isnonzero(check);
+}
+
+int ed25519_verify_batch(const unsigned char *const *signatures, const unsigned char *const *messages, const size_t *message_lens, const unsigned char *const *public_keys, size_t count, int *valid) {
+    batch_scratch scratch, *b = NULL;
+    int all_valid = 1;
+    size_t i, j, n;
+
+    /* room for two points per signature */
+    n = count < ED25519_BATCH_MAX ? count : ED25519_BATCH_MAX;
+
+    if (n > 1) {
+        scratch.points = malloc(2 * n * sizeof(*scratch.points));
+        scratch.scalars = malloc(2 * n * sizeof(*scratch.scalars));
+        scratch.multiples = malloc(2 * n * sizeof(*scratch.multiples));
+        scratch.slides = malloc(2 * n * sizeof(*scratch.slides));
+
+        if (scratch.points && scratch.scalars && scratch.multiples && scratch.slides) {
+            b = &scratch;
+        }
+    }
+
+    for (i = 0; i < count; i += n) {
+        n = count - i < ED25519_BATCH_MAX ? count - i : ED25519_BATCH_MAX;
+
+        if (b && n > 1 && verify_chunk(b, signatures + i, messages + i, message_lens + i, public_keys + i, n)) {
+            if (valid) {
+                for (j = 0; j < n; ++j) {
+                    valid[i + j] = 1;
+                }
+            }
+
+            continue;
+        }
+
+        /* find out which signatures are bad */
+        for (j = 0; j < n; ++j) {
+            int result = ed25519_verify(signatures[i + j], messages[i + j], message_lens[i + j], public_keys[i + j]);
+
+            if (valid) {
+                valid[i + j] = result;
+            }
+
+            if (!result) {
+                all_valid = 0;
+            }
+        }
+    }
+
+    if (count > 1) {
+        free(scratch.points);
+        free(scratch.scalars);
+        free(scratch.multiples);
+        free(scratch.slides);
+    }
+
+    return all_valid;
+}
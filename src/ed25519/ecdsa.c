@@ -121,6 +121,31 @@ bool ecdsa_verify(ecdsa_t *ecdsa, const void *in, size_t len, const void *sig) {
 	return ed25519_verify(sig, in, len, ecdsa->public);
 }
 
+bool ecdsa_verify_batch(ecdsa_t *const *ecdsa, const void *const *in, const size_t *len, const void *const *sig, size_t count, bool *valid) {
+	if(!count) {
+		return true;
+	}
+
+	const unsigned char **public_keys = xmalloc(count * sizeof(*public_keys));
+	int *results = xmalloc(count * sizeof(*results));
+
+	for(size_t i = 0; i < count; i++) {
+		public_keys[i] = ecdsa[i]->public;
+	}
+
+	bool all_valid = ed25519_verify_batch((const unsigned char *const *)sig, (const unsigned char *const *)in, len, public_keys, count, results);
+
+	if(valid) {
+		for(size_t i = 0; i < count; i++) {
+			valid[i] = results[i];
+		}
+	}
+
+	free(results);
+	free(public_keys);
+	return all_valid;
+}
+
 bool ecdsa_active(ecdsa_t *ecdsa) {
 	return ecdsa;
 }
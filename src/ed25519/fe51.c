@@ -0,0 +1,327 @@
+#include "fe51.h"
+
+#ifdef HAVE_FE51
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+#define MASK51 0x7ffffffffffffULL
+
+
+/*
+    helper functions
+*/
+static uint64_t load_8(const unsigned char *in) {
+    uint64_t result = 0;
+    int i;
+
+    for (i = 7; i >= 0; --i) {
+        result = (result << 8) | in[i];
+    }
+
+    return result;
+}
+
+static void store_8(unsigned char *out, uint64_t in) {
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+        out[i] = (unsigned char) (in >> (8 * i));
+    }
+}
+
+/*
+    carry the 128-bit products of fe51_mul() and fe51_sq() into h
+*/
+static void carry_wide(fe51 h, uint128_t r0, uint128_t r1, uint128_t r2, uint128_t r3, uint128_t r4) {
+    uint64_t c;
+
+    c = (uint64_t) (r0 >> 51);
+    r1 += c;
+    c = (uint64_t) (r1 >> 51);
+    r2 += c;
+    c = (uint64_t) (r2 >> 51);
+    r3 += c;
+    c = (uint64_t) (r3 >> 51);
+    r4 += c;
+    c = (uint64_t) (r4 >> 51);
+
+    h[0] = ((uint64_t) r0 & MASK51) + c * 19;
+    h[1] = (uint64_t) r1 & MASK51;
+    h[2] = (uint64_t) r2 & MASK51;
+    h[3] = (uint64_t) r3 & MASK51;
+    h[4] = (uint64_t) r4 & MASK51;
+
+    h[1] += h[0] >> 51;
+    h[0] &= MASK51;
+}
+
+
+
+/*
+    h = 0
+*/
+
+void fe51_0(fe51 h) {
+    h[0] = 0;
+    h[1] = 0;
+    h[2] = 0;
+    h[3] = 0;
+    h[4] = 0;
+}
+
+
+
+/*
+    h = 1
+*/
+
+void fe51_1(fe51 h) {
+    h[0] = 1;
+    h[1] = 0;
+    h[2] = 0;
+    h[3] = 0;
+    h[4] = 0;
+}
+
+
+
+/*
+    Ignores top bit of s.
+*/
+
+void fe51_frombytes(fe51 h, const unsigned char *s) {
+    uint64_t x0 = load_8(s);
+    uint64_t x1 = load_8(s + 8);
+    uint64_t x2 = load_8(s + 16);
+    uint64_t x3 = load_8(s + 24);
+
+    h[0] = x0 & MASK51;
+    h[1] = ((x0 >> 51) | (x1 << 13)) & MASK51;
+    h[2] = ((x1 >> 38) | (x2 << 26)) & MASK51;
+    h[3] = ((x2 >> 25) | (x3 << 39)) & MASK51;
+    h[4] = (x3 >> 12) & MASK51;
+}
+
+
+
+/*
+    Writes the unique representative of h in [0, 2^255 - 19).
+
+    After two carry passes h < 2^255 + 2^14.
+    q = 1 exactly when h + 19 >= 2^255, in which case 2^255 - 19 is subtracted.
+*/
+
+void fe51_tobytes(unsigned char *s, const fe51 h) {
+    uint64_t t0 = h[0];
+    uint64_t t1 = h[1];
+    uint64_t t2 = h[2];
+    uint64_t t3 = h[3];
+    uint64_t t4 = h[4];
+    uint64_t q;
+    int i;
+
+    for (i = 0; i < 2; ++i) {
+        t1 += t0 >> 51;
+        t0 &= MASK51;
+        t2 += t1 >> 51;
+        t1 &= MASK51;
+        t3 += t2 >> 51;
+        t2 &= MASK51;
+        t4 += t3 >> 51;
+        t3 &= MASK51;
+        t0 += 19 * (t4 >> 51);
+        t4 &= MASK51;
+    }
+
+    q = (t0 + 19) >> 51;
+    q = (t1 + q) >> 51;
+    q = (t2 + q) >> 51;
+    q = (t3 + q) >> 51;
+    q = (t4 + q) >> 51;
+
+    t0 += 19 * q;
+    t1 += t0 >> 51;
+    t0 &= MASK51;
+    t2 += t1 >> 51;
+    t1 &= MASK51;
+    t3 += t2 >> 51;
+    t2 &= MASK51;
+    t4 += t3 >> 51;
+    t3 &= MASK51;
+    t4 &= MASK51;
+
+    store_8(s, t0 | (t1 << 51));
+    store_8(s + 8, (t1 >> 13) | (t2 << 38));
+    store_8(s + 16, (t2 >> 26) | (t3 << 25));
+    store_8(s + 24, (t3 >> 39) | (t4 << 12));
+}
+
+
+
+/*
+    h = f
+*/
+
+void fe51_copy(fe51 h, const fe51 f) {
+    h[0] = f[0];
+    h[1] = f[1];
+    h[2] = f[2];
+    h[3] = f[3];
+    h[4] = f[4];
+}
+
+
+
+/*
+    Replace (f,g) with (g,f) if b == 1;
+    replace (f,g) with (f,g) if b == 0.
+
+    Preconditions: b in {0,1}.
+*/
+
+void fe51_cswap(fe51 f, fe51 g, unsigned int b) {
+    uint64_t mask = (uint64_t) 0 - b;
+    uint64_t x;
+    int i;
+
+    for (i = 0; i < 5; ++i) {
+        x = mask & (f[i] ^ g[i]);
+        f[i] ^= x;
+        g[i] ^= x;
+    }
+}
+
+
+
+/*
+    h = f + g
+*/
+
+void fe51_add(fe51 h, const fe51 f, const fe51 g) {
+    h[0] = f[0] + g[0];
+    h[1] = f[1] + g[1];
+    h[2] = f[2] + g[2];
+    h[3] = f[3] + g[3];
+    h[4] = f[4] + g[4];
+}
+
+
+
+/*
+    h = f - g
+    Adds 2p first, so the limbs of h cannot become negative.
+*/
+
+void fe51_sub(fe51 h, const fe51 f, const fe51 g) {
+    h[0] = (f[0] + 0xfffffffffffdaULL) - g[0];
+    h[1] = (f[1] + 0xffffffffffffeULL) - g[1];
+    h[2] = (f[2] + 0xffffffffffffeULL) - g[2];
+    h[3] = (f[3] + 0xffffffffffffeULL) - g[3];
+    h[4] = (f[4] + 0xffffffffffffeULL) - g[4];
+}
+
+
+
+/*
+    h = f * g
+    Products of limbs wrapping around 2^255 are multiplied by 19.
+*/
+
+void fe51_mul(fe51 h, const fe51 f, const fe51 g) {
+    uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+    uint64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+    uint64_t g1_19 = 19 * g1;
+    uint64_t g2_19 = 19 * g2;
+    uint64_t g3_19 = 19 * g3;
+    uint64_t g4_19 = 19 * g4;
+    uint128_t r0, r1, r2, r3, r4;
+
+    r0 = (uint128_t) f0 * g0 + (uint128_t) f1 * g4_19 + (uint128_t) f2 * g3_19 + (uint128_t) f3 * g2_19 + (uint128_t) f4 * g1_19;
+    r1 = (uint128_t) f0 * g1 + (uint128_t) f1 * g0 + (uint128_t) f2 * g4_19 + (uint128_t) f3 * g3_19 + (uint128_t) f4 * g2_19;
+    r2 = (uint128_t) f0 * g2 + (uint128_t) f1 * g1 + (uint128_t) f2 * g0 + (uint128_t) f3 * g4_19 + (uint128_t) f4 * g3_19;
+    r3 = (uint128_t) f0 * g3 + (uint128_t) f1 * g2 + (uint128_t) f2 * g1 + (uint128_t) f3 * g0 + (uint128_t) f4 * g4_19;
+    r4 = (uint128_t) f0 * g4 + (uint128_t) f1 * g3 + (uint128_t) f2 * g2 + (uint128_t) f3 * g1 + (uint128_t) f4 * g0;
+
+    carry_wide(h, r0, r1, r2, r3, r4);
+}
+
+
+
+/*
+    h = f * f
+*/
+
+void fe51_sq(fe51 h, const fe51 f) {
+    uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+    uint64_t f0_2 = 2 * f0;
+    uint64_t f1_2 = 2 * f1;
+    uint64_t f2_2 = 2 * f2;
+    uint64_t f3_2 = 2 * f3;
+    uint64_t f3_19 = 19 * f3;
+    uint64_t f4_19 = 19 * f4;
+    uint128_t r0, r1, r2, r3, r4;
+
+    r0 = (uint128_t) f0 * f0 + (uint128_t) f1_2 * f4_19 + (uint128_t) f2_2 * f3_19;
+    r1 = (uint128_t) f0_2 * f1 + (uint128_t) f2_2 * f4_19 + (uint128_t) f3 * f3_19;
+    r2 = (uint128_t) f0_2 * f2 + (uint128_t) f1 * f1 + (uint128_t) f3_2 * f4_19;
+    r3 = (uint128_t) f0_2 * f3 + (uint128_t) f1_2 * f2 + (uint128_t) f4 * f4_19;
+    r4 = (uint128_t) f0_2 * f4 + (uint128_t) f1_2 * f3 + (uint128_t) f2 * f2;
+
+    carry_wide(h, r0, r1, r2, r3, r4);
+}
+
+
+
+/*
+    h = f * 121666
+*/
+
+void fe51_mul121666(fe51 h, const fe51 f) {
+    carry_wide(h, (uint128_t) f[0] * 121666, (uint128_t) f[1] * 121666, (uint128_t) f[2] * 121666, (uint128_t) f[3] * 121666, (uint128_t) f[4] * 121666);
+}
+
+
+
+/*
+    out = z^(p - 2) = z^(2^255 - 21), using the same addition chain as fe_invert()
+*/
+
+static void sq_times(fe51 h, const fe51 f, int n) {
+    fe51_sq(h, f);
+
+    while (--n) {
+        fe51_sq(h, h);
+    }
+}
+
+void fe51_invert(fe51 out, const fe51 z) {
+    fe51 t0;
+    fe51 t1;
+    fe51 t2;
+    fe51 t3;
+
+    fe51_sq(t0, z);                /* 2 */
+    sq_times(t1, t0, 2);           /* 8 */
+    fe51_mul(t1, z, t1);           /* 9 */
+    fe51_mul(t0, t0, t1);          /* 11 */
+    fe51_sq(t2, t0);               /* 22 */
+    fe51_mul(t1, t1, t2);          /* 2^5 - 1 */
+    sq_times(t2, t1, 5);
+    fe51_mul(t1, t2, t1);          /* 2^10 - 1 */
+    sq_times(t2, t1, 10);
+    fe51_mul(t2, t2, t1);          /* 2^20 - 1 */
+    sq_times(t3, t2, 20);
+    fe51_mul(t2, t3, t2);          /* 2^40 - 1 */
+    sq_times(t2, t2, 10);
+    fe51_mul(t1, t2, t1);          /* 2^50 - 1 */
+    sq_times(t2, t1, 50);
+    fe51_mul(t2, t2, t1);          /* 2^100 - 1 */
+    sq_times(t3, t2, 100);
+    fe51_mul(t2, t3, t2);          /* 2^200 - 1 */
+    sq_times(t2, t2, 50);
+    fe51_mul(t1, t2, t1);          /* 2^250 - 1 */
+    sq_times(t1, t1, 5);           /* 2^255 - 32 */
+    fe51_mul(out, t1, t0);         /* 2^255 - 21 */
+}
+
+#endif
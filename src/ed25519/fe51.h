@@ -0,0 +1,38 @@
+#ifndef FE51_H
+#define FE51_H
+
+#include "fixedint.h"
+
+/*
+    64-bit version of the field arithmetic in fe.h, for compilers with 128-bit integers.
+    An element t, entries t[0]...t[4], represents the integer
+    t[0]+2^51 t[1]+2^102 t[2]+2^153 t[3]+2^204 t[4].
+    The results of fe51_mul(), fe51_sq() and fe51_mul121666() have t[i] bounded by 2^51 + 2^13,
+    fe51_add() and fe51_sub() accept such elements and return elements bounded by 2^53,
+    which are again valid inputs for the multiplication functions.
+*/
+
+#if defined(__SIZEOF_INT128__)
+#define HAVE_FE51 1
+
+typedef uint64_t fe51[5];
+
+void fe51_0(fe51 h);
+void fe51_1(fe51 h);
+
+void fe51_frombytes(fe51 h, const unsigned char *s);
+void fe51_tobytes(unsigned char *s, const fe51 h);
+
+void fe51_copy(fe51 h, const fe51 f);
+void fe51_cswap(fe51 f, fe51 g, unsigned int b);
+
+void fe51_add(fe51 h, const fe51 f, const fe51 g);
+void fe51_sub(fe51 h, const fe51 f, const fe51 g);
+void fe51_mul(fe51 h, const fe51 f, const fe51 g);
+void fe51_sq(fe51 h, const fe51 f);
+void fe51_mul121666(fe51 h, const fe51 f);
+void fe51_invert(fe51 out, const fe51 z);
+
+#endif
+
+#endif
@@ -130,6 +130,86 @@ void ge_double_scalarmult_vartime(ge_p2 *r, const unsigned char *a, const ge_p3
 }
 
 
+/*
+Ai = A,3A,5A,7A,9A,11A,13A,15A
+*/
+
+static void ge_precompute_odd_multiples(ge_cached Ai[8], const ge_p3 *A) {
+    ge_p1p1 t;
+    ge_p3 u;
+    ge_p3 A2;
+    int i;
+    ge_p3_to_cached(&Ai[0], A);
+    ge_p3_dbl(&t, A);
+    ge_p1p1_to_p3(&A2, &t);
+
+    for (i = 1; i < 8; ++i) {
+        ge_add(&t, &A2, &Ai[i - 1]);
+        ge_p1p1_to_p3(&u, &t);
+        ge_p3_to_cached(&Ai[i], &u);
+    }
+}
+
+/*
+r = b * B + a[0] * A[0] + ... + a[count-1] * A[count-1]
+where B is the Ed25519 base point.
+The caller provides scratch space for count sets of precomputed multiples and count sliding windows.
+*/
+
+void ge_multi_scalarmult_vartime(ge_p2 *r, const unsigned char *b, size_t count, const unsigned char (*a)[32], const ge_p3 *A, ge_cached (*Ai)[8], signed char (*aslide)[256]) {
+    signed char bslide[256];
+    ge_p1p1 t;
+    ge_p3 u;
+    size_t j;
+    int i;
+    int top = -1;
+
+    slide(bslide, b);
+
+    for (i = 255; i > top; --i) {
+        if (bslide[i]) {
+            top = i;
+        }
+    }
+
+    for (j = 0; j < count; ++j) {
+        slide(aslide[j], a[j]);
+        ge_precompute_odd_multiples(Ai[j], &A[j]);
+
+        for (i = 255; i > top; --i) {
+            if (aslide[j][i]) {
+                top = i;
+            }
+        }
+    }
+
+    ge_p2_0(r);
+
+    for (i = top; i >= 0; --i) {
+        ge_p2_dbl(&t, r);
+
+        for (j = 0; j < count; ++j) {
+            if (aslide[j][i] > 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_add(&t, &u, &Ai[j][aslide[j][i] / 2]);
+            } else if (aslide[j][i] < 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_sub(&t, &u, &Ai[j][(-aslide[j][i]) / 2]);
+            }
+        }
+
+        if (bslide[i] > 0) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_madd(&t, &u, &Bi[bslide[i] / 2]);
+        } else if (bslide[i] < 0) {
+            ge_p1p1_to_p3(&u, &t);
+            ge_msub(&t, &u, &Bi[(-bslide[i]) / 2]);
+        }
+
+        ge_p1p1_to_p2(r, &t);
+    }
+}
+
 static const fe d = {
     -10913610, 13857413, -15372611, 6949391, 114729, -8787816, -6275908, -3247719, -18696448, -12055116
 };
@@ -1,17 +1,53 @@
 #include "ed25519.h"
+#include "fe51.h"
+
+/*
+    The Montgomery ladder below is written once for both field implementations.
+    With 128-bit integers the radix 2^51 arithmetic from fe51.h is used, which needs about half the multiplications.
+*/
+
+#ifdef HAVE_FE51
+typedef fe51 lfe;
+#define lfe_0 fe51_0
+#define lfe_1 fe51_1
+#define lfe_frombytes fe51_frombytes
+#define lfe_tobytes fe51_tobytes
+#define lfe_copy fe51_copy
+#define lfe_cswap fe51_cswap
+#define lfe_add fe51_add
+#define lfe_sub fe51_sub
+#define lfe_mul fe51_mul
+#define lfe_sq fe51_sq
+#define lfe_mul121666 fe51_mul121666
+#define lfe_invert fe51_invert
+#else
 #include "fe.h"
+typedef fe lfe;
+#define lfe_0 fe_0
+#define lfe_1 fe_1
+#define lfe_frombytes fe_frombytes
+#define lfe_tobytes fe_tobytes
+#define lfe_copy fe_copy
+#define lfe_cswap fe_cswap
+#define lfe_add fe_add
+#define lfe_sub fe_sub
+#define lfe_mul fe_mul
+#define lfe_sq fe_sq
+#define lfe_mul121666 fe_mul121666
+#define lfe_invert fe_invert
+#endif
 
-void ed25519_key_exchange(unsigned char *shared_secret, const unsigned char *public_key, const unsigned char *private_key) {
+/* multiply the Montgomery u-coordinate x1 by the private key, in constant time */
+static void scalarmult(unsigned char *shared_secret, const unsigned char *private_key, lfe x1) {
     unsigned char e[32];
     unsigned int i;
-    
-    fe x1;
-    fe x2;
-    fe z2;
-    fe x3;
-    fe z3;
-    fe tmp0;
-    fe tmp1;
+
+    lfe x2;
+    lfe z2;
+    lfe x3;
+    lfe z3;
+    lfe tmp0;
+    lfe tmp1;
 
     int pos;
     unsigned int swap;
@@ -26,54 +62,69 @@ void ed25519_key_exchange(unsigned char *shared_secret, const unsigned char *pub
     e[31] &= 63;
     e[31] |= 64;
 
-    /* unpack the public key and convert edwards to montgomery */
-    /* due to CodesInChaos: montgomeryX = (edwardsY + 1)*inverse(1 - edwardsY) mod p */
-    fe_frombytes(x1, public_key);
-    fe_1(tmp1);
-    fe_add(tmp0, x1, tmp1);
-    fe_sub(tmp1, tmp1, x1);
-    fe_invert(tmp1, tmp1);
-    fe_mul(x1, tmp0, tmp1);
-
-    fe_1(x2);
-    fe_0(z2);
-    fe_copy(x3, x1);
-    fe_1(z3);
+    lfe_1(x2);
+    lfe_0(z2);
+    lfe_copy(x3, x1);
+    lfe_1(z3);
 
     swap = 0;
     for (pos = 254; pos >= 0; --pos) {
         b = e[pos / 8] >> (pos & 7);
         b &= 1;
         swap ^= b;
-        fe_cswap(x2, x3, swap);
-        fe_cswap(z2, z3, swap);
+        lfe_cswap(x2, x3, swap);
+        lfe_cswap(z2, z3, swap);
         swap = b;
 
         /* from montgomery.h */
-        fe_sub(tmp0, x3, z3);
-        fe_sub(tmp1, x2, z2);
-        fe_add(x2, x2, z2);
-        fe_add(z2, x3, z3);
-        fe_mul(z3, tmp0, x2);
-        fe_mul(z2, z2, tmp1);
-        fe_sq(tmp0, tmp1);
-        fe_sq(tmp1, x2);
-        fe_add(x3, z3, z2);
-        fe_sub(z2, z3, z2);
-        fe_mul(x2, tmp1, tmp0);
-        fe_sub(tmp1, tmp1, tmp0);
-        fe_sq(z2, z2);
-        fe_mul121666(z3, tmp1);
-        fe_sq(x3, x3);
-        fe_add(tmp0, tmp0, z3);
-        fe_mul(z3, x1, z2);
-        fe_mul(z2, tmp1, tmp0);
+        lfe_sub(tmp0, x3, z3);
+        lfe_sub(tmp1, x2, z2);
+        lfe_add(x2, x2, z2);
+        lfe_add(z2, x3, z3);
+        lfe_mul(z3, tmp0, x2);
+        lfe_mul(z2, z2, tmp1);
+        lfe_sq(tmp0, tmp1);
+        lfe_sq(tmp1, x2);
+        lfe_add(x3, z3, z2);
+        lfe_sub(z2, z3, z2);
+        lfe_mul(x2, tmp1, tmp0);
+        lfe_sub(tmp1, tmp1, tmp0);
+        lfe_sq(z2, z2);
+        lfe_mul121666(z3, tmp1);
+        lfe_sq(x3, x3);
+        lfe_add(tmp0, tmp0, z3);
+        lfe_mul(z3, x1, z2);
+        lfe_mul(z2, tmp1, tmp0);
     }
 
-    fe_cswap(x2, x3, swap);
-    fe_cswap(z2, z3, swap);
+    lfe_cswap(x2, x3, swap);
+    lfe_cswap(z2, z3, swap);
+
+    lfe_invert(z2, z2);
+    lfe_mul(x2, x2, z2);
+    lfe_tobytes(shared_secret, x2);
+}
+
+void ed25519_key_exchange(unsigned char *shared_secret, const unsigned char *public_key, const unsigned char *private_key) {
+    lfe x1;
+    lfe tmp0;
+    lfe tmp1;
+
+    /* unpack the public key and convert edwards to montgomery */
+    /* due to CodesInChaos: montgomeryX = (edwardsY + 1)*inverse(1 - edwardsY) mod p */
+    lfe_frombytes(x1, public_key);
+    lfe_1(tmp1);
+    lfe_add(tmp0, x1, tmp1);
+    lfe_sub(tmp1, tmp1, x1);
+    lfe_invert(tmp1, tmp1);
+    lfe_mul(x1, tmp0, tmp1);
+
+    scalarmult(shared_secret, private_key, x1);
+}
+
+void ed25519_x25519(unsigned char *shared_secret, const unsigned char *public_key, const unsigned char *private_key) {
+    lfe x1;
 
-    fe_invert(z2, z2);
-    fe_mul(x2, x2, z2);
-    fe_tobytes(shared_secret, x2);
+    lfe_frombytes(x1, public_key);
+    scalarmult(shared_secret, private_key, x1);
 }
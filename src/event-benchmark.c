@@ -0,0 +1,270 @@
+/*
+    event-benchmark.c -- Benchmark the event loop
+    Copyright (C) 2026 MeshLink contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "system.h"
+
+#include "event.h"
+#include "logger.h"
+#include "meshlink_internal.h"
+#include "splay_tree.h"
+
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+// The event loop wants to log errors, but we don't care about them here.
+void logger(meshlink_handle_t *mesh, meshlink_log_level_t level, const char *format, ...) {
+	(void)mesh;
+	(void)level;
+	(void)format;
+}
+
+static long wakeups;
+static long iterations;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void idle_cb(event_loop_t *loop, void *data, int flags) {
+	(void)loop;
+	(void)data;
+	(void)flags;
+	abort();
+}
+
+static void ready_cb(event_loop_t *loop, void *data, int flags) {
+	(void)data;
+	(void)flags;
+
+	// We never drain the pipe, so it stays readable and we wake up immediately again.
+	if(++wakeups >= iterations) {
+		event_loop_stop(loop);
+	}
+}
+
+static void use_select(event_loop_t *loop) {
+#ifdef HAVE_SYS_EPOLL_H
+
+	if(loop->epollfd != -1) {
+		close(loop->epollfd);
+		loop->epollfd = -1;
+	}
+
+#else
+	(void)loop;
+#endif
+}
+
+static void benchmark_wakeups(meshlink_handle_t *mesh, bool select, int nfds) {
+	event_loop_t loop;
+	memset(&loop, 0, sizeof(loop));
+	event_loop_init(&loop);
+
+	if(select) {
+		use_select(&loop);
+	}
+
+	// All idle fds are duplicates of one pipe's read end that never becomes readable.
+	int idle_pipe[2], ready_pipe[2];
+
+	if(pipe(idle_pipe) || pipe(ready_pipe)) {
+		perror("pipe");
+		exit(1);
+	}
+
+	io_t *ios = calloc(nfds, sizeof(*ios));
+	assert(ios);
+
+	for(int i = 0; i < nfds - 1; i++) {
+		int fd = dup(idle_pipe[0]);
+
+		if(fd == -1) {
+			perror("dup");
+			exit(1);
+		}
+
+		io_add(&loop, &ios[i], idle_cb, NULL, fd, IO_READ);
+	}
+
+	if(write(ready_pipe[1], "x", 1) != 1) {
+		abort();
+	}
+
+	io_add(&loop, &ios[nfds - 1], ready_cb, NULL, ready_pipe[0], IO_READ);
+
+	wakeups = 0;
+	event_loop_start(&loop);
+	double start = now();
+
+	if(!event_loop_run(&loop, mesh)) {
+		abort();
+	}
+
+	double elapsed = now() - start;
+
+	printf("%-6s %5d fds: %8.3f us/wakeup\n", select ? "select" : "epoll", nfds, elapsed * 1e6 / wakeups);
+
+	for(int i = 0; i < nfds - 1; i++) {
+		io_del(&loop, &ios[i]);
+		close(ios[i].fd);
+	}
+
+	io_del(&loop, &ios[nfds - 1]);
+	free(ios);
+
+	close(idle_pipe[0]);
+	close(idle_pipe[1]);
+	close(ready_pipe[0]);
+	close(ready_pipe[1]);
+
+	event_loop_exit(&loop);
+}
+
+static void timer_cb(event_loop_t *loop, void *data) {
+	(void)loop;
+	(void)data;
+}
+
+// Rearm timers the way the event loop did before it used a heap, for comparison.
+typedef struct splay_timeout_t {
+	splay_node_t node;
+	struct timespec tv;
+} splay_timeout_t;
+
+static int splay_timeout_compare(const splay_timeout_t *a, const splay_timeout_t *b) {
+	if(a->tv.tv_sec != b->tv.tv_sec) {
+		return a->tv.tv_sec < b->tv.tv_sec ? -1 : 1;
+	} else if(a->tv.tv_nsec != b->tv.tv_nsec) {
+		return a->tv.tv_nsec < b->tv.tv_nsec ? -1 : 1;
+	} else {
+		return a < b ? -1 : a > b ? 1 : 0;
+	}
+}
+
+static struct timespec random_delay(void) {
+	// Timers are typically rearmed to somewhere between now and a minute from now
+	long ms = random() % 60000;
+	return (struct timespec) {
+		ms / 1000, (ms % 1000) * 1000000
+	};
+}
+
+static void benchmark_splay_rearm(int ntimers, long rearms) {
+	splay_tree_t tree = {.compare = (splay_compare_t)splay_timeout_compare};
+	splay_timeout_t *timers = calloc(ntimers, sizeof(*timers));
+	assert(timers);
+	struct timespec base;
+	clock_gettime(CLOCK_MONOTONIC, &base);
+
+	for(int i = 0; i < ntimers; i++) {
+		timers[i].node.data = &timers[i];
+		timers[i].tv = random_delay();
+		splay_insert_node(&tree, &timers[i].node);
+	}
+
+	srandom(1);
+	double start = now();
+
+	for(long i = 0; i < rearms; i++) {
+		splay_timeout_t *t = &timers[random() % ntimers];
+		splay_unlink_node(&tree, &t->node);
+		t->tv = random_delay();
+		t->tv.tv_sec += base.tv_sec + i / ntimers;
+		splay_insert_node(&tree, &t->node);
+	}
+
+	double elapsed = now() - start;
+	printf("splay  %6d timers: %8.3f us/rearm\n", ntimers, elapsed * 1e6 / rearms);
+
+	free(timers);
+}
+
+static void benchmark_heap_rearm(int ntimers, long rearms) {
+	event_loop_t loop;
+	memset(&loop, 0, sizeof(loop));
+	event_loop_init(&loop);
+
+	timeout_t *timers = calloc(ntimers, sizeof(*timers));
+	assert(timers);
+
+	for(int i = 0; i < ntimers; i++) {
+		struct timespec tv = random_delay();
+		timeout_add(&loop, &timers[i], timer_cb, NULL, &tv);
+	}
+
+	srandom(1);
+	double start = now();
+
+	for(long i = 0; i < rearms; i++) {
+		struct timespec tv = random_delay();
+		tv.tv_sec += i / ntimers;
+		timeout_set(&loop, &timers[random() % ntimers], &tv);
+	}
+
+	double elapsed = now() - start;
+	printf("heap   %6d timers: %8.3f us/rearm\n", ntimers, elapsed * 1e6 / rearms);
+
+	for(int i = 0; i < ntimers; i++) {
+		timeout_del(&loop, &timers[i]);
+	}
+
+	free(timers);
+	event_loop_exit(&loop);
+}
+
+int main(int argc, char *argv[]) {
+	iterations = argc > 1 ? atol(argv[1]) : 100000;
+
+#ifdef HAVE_SYS_RESOURCE_H
+	struct rlimit rl;
+
+	if(!getrlimit(RLIMIT_NOFILE, &rl)) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+#endif
+
+	static meshlink_handle_t mesh;
+	pthread_mutex_init(&mesh.mutex, NULL);
+	pthread_mutex_lock(&mesh.mutex);
+
+	static const int sizes[] = {10, 100, 1000};
+
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		benchmark_wakeups(&mesh, true, sizes[i]);
+#ifdef HAVE_SYS_EPOLL_H
+		benchmark_wakeups(&mesh, false, sizes[i]);
+#endif
+	}
+
+	pthread_mutex_unlock(&mesh.mutex);
+
+	static const int timers[] = {100, 10000, 100000};
+
+	for(size_t i = 0; i < sizeof(timers) / sizeof(*timers); i++) {
+		benchmark_splay_rearm(timers[i], iterations * 10);
+		benchmark_heap_rearm(timers[i], iterations * 10);
+	}
+
+	return 0;
+}
@@ -70,21 +70,91 @@ static int io_compare(const io_t *a, const io_t *b) {
 	return a->fd - b->fd;
 }
 
-static int timeout_compare(const timeout_t *a, const timeout_t *b) {
-	if(a->tv.tv_sec < b->tv.tv_sec) {
-		return -1;
-	} else if(a->tv.tv_sec > b->tv.tv_sec) {
-		return 1;
-	} else if(a->tv.tv_nsec < b->tv.tv_nsec) {
-		return -1;
-	} else if(a->tv.tv_nsec > b->tv.tv_nsec) {
-		return 1;
-	} else if(a < b) {
-		return -1;
-	} else if(a > b) {
-		return 1;
+/* Timeouts are kept in a 4-ary min-heap. Compared to a binary heap it halves
+   the depth of the tree, and a node's children share a cache line. Every
+   timeout knows its own position in the heap, so rearming or deleting one
+   is a single sift up or down. */
+
+#define HEAP_ARITY 4
+
+static void heap_place(event_loop_t *loop, timeout_t *timeout, unsigned int i) {
+	loop->timeouts[i] = timeout;
+	timeout->heap_index = i + 1;
+}
+
+static void heap_sift_up(event_loop_t *loop, unsigned int i) {
+	timeout_t *timeout = loop->timeouts[i];
+
+	while(i) {
+		unsigned int parent = (i - 1) / HEAP_ARITY;
+
+		if(!timespec_lt(&timeout->tv, &loop->timeouts[parent]->tv)) {
+			break;
+		}
+
+		heap_place(loop, loop->timeouts[parent], i);
+		i = parent;
+	}
+
+	heap_place(loop, timeout, i);
+}
+
+static void heap_sift_down(event_loop_t *loop, unsigned int i) {
+	timeout_t *timeout = loop->timeouts[i];
+
+	while(true) {
+		unsigned int first = i * HEAP_ARITY + 1;
+
+		if(first >= loop->timeouts_count) {
+			break;
+		}
+
+		unsigned int last = first + HEAP_ARITY < loop->timeouts_count ? first + HEAP_ARITY : loop->timeouts_count;
+		unsigned int min = first;
+
+		for(unsigned int child = first + 1; child < last; child++) {
+			if(timespec_lt(&loop->timeouts[child]->tv, &loop->timeouts[min]->tv)) {
+				min = child;
+			}
+		}
+
+		if(!timespec_lt(&loop->timeouts[min]->tv, &timeout->tv)) {
+			break;
+		}
+
+		heap_place(loop, loop->timeouts[min], i);
+		i = min;
+	}
+
+	heap_place(loop, timeout, i);
+}
+
+static void heap_insert(event_loop_t *loop, timeout_t *timeout) {
+	if(loop->timeouts_count == loop->timeouts_size) {
+		loop->timeouts_size = loop->timeouts_size ? loop->timeouts_size * 2 : 64;
+		loop->timeouts = xrealloc(loop->timeouts, loop->timeouts_size * sizeof(*loop->timeouts));
+	}
+
+	heap_place(loop, timeout, loop->timeouts_count++);
+	heap_sift_up(loop, loop->timeouts_count - 1);
+}
+
+static void heap_remove(event_loop_t *loop, timeout_t *timeout) {
+	unsigned int i = timeout->heap_index - 1;
+	timeout->heap_index = 0;
+
+	timeout_t *last = loop->timeouts[--loop->timeouts_count];
+
+	if(last == timeout) {
+		return;
+	}
+
+	heap_place(loop, last, i);
+
+	if(i && timespec_lt(&last->tv, &loop->timeouts[(i - 1) / HEAP_ARITY]->tv)) {
+		heap_sift_up(loop, i);
 	} else {
-		return 0;
+		heap_sift_down(loop, i);
 	}
 }
 
@@ -94,6 +164,7 @@ void io_add(event_loop_t *loop, io_t *io, io_cb_t cb, void *data, int fd, int fl
 	io->fd = fd;
 	io->cb = cb;
 	io->data = data;
+	io->flags = 0;
 	io->node.data = io;
 
 	io_set(loop, io, flags);
@@ -103,9 +174,49 @@ void io_add(event_loop_t *loop, io_t *io, io_cb_t cb, void *data, int fd, int fl
 	(void)node;
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+static void epoll_update(event_loop_t *loop, io_t *io, int flags) {
+	if(flags == io->flags) {
+		return;
+	}
+
+	struct epoll_event ev = {
+		.events = ((flags & IO_READ) ? EPOLLIN : 0) | ((flags & IO_WRITE) ? EPOLLOUT : 0),
+		.data.fd = io->fd,
+	};
+
+	if(!flags) {
+		// The fd might already have been closed, in which case the kernel removed it for us.
+		epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, io->fd, &ev);
+		return;
+	}
+
+	int op = io->flags ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+	if(epoll_ctl(loop->epollfd, op, io->fd, &ev) != 0) {
+		// Our idea of what is registered can be stale if an fd was closed and reused.
+		if(op == EPOLL_CTL_ADD && errno == EEXIST) {
+			epoll_ctl(loop->epollfd, EPOLL_CTL_MOD, io->fd, &ev);
+		} else if(op == EPOLL_CTL_MOD && errno == ENOENT) {
+			epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, io->fd, &ev);
+		}
+	}
+}
+#endif
+
 void io_set(event_loop_t *loop, io_t *io, int flags) {
 	assert(io->cb);
 
+#ifdef HAVE_SYS_EPOLL_H
+
+	if(loop->epollfd != -1) {
+		epoll_update(loop, io, flags);
+		io->flags = flags;
+		return;
+	}
+
+#endif
+
 	io->flags = flags;
 
 	if(flags & IO_READ) {
@@ -142,29 +253,27 @@ void timeout_add(event_loop_t *loop, timeout_t *timeout, timeout_cb_t cb, void *
 void timeout_set(event_loop_t *loop, timeout_t *timeout, struct timespec *tv) {
 	assert(timeout->cb);
 
-	if(timeout->node.data) {
-		splay_unlink_node(&loop->timeouts, &timeout->node);
-	} else {
-		timeout->node.data = timeout;
-	}
-
 	if(!loop->now.tv_sec) {
 		clock_gettime(EVENT_CLOCK, &loop->now);
 	}
 
+	struct timespec old = timeout->tv;
 	timespec_add(&loop->now, tv, &timeout->tv);
 
-	if(!splay_insert_node(&loop->timeouts, &timeout->node)) {
-		abort();
+	if(!timeout->heap_index) {
+		heap_insert(loop, timeout);
+	} else if(timespec_lt(&timeout->tv, &old)) {
+		heap_sift_up(loop, timeout->heap_index - 1);
+	} else {
+		heap_sift_down(loop, timeout->heap_index - 1);
 	}
 
 	loop->deletion = true;
 }
 
 static void timeout_disable(event_loop_t *loop, timeout_t *timeout) {
-	if(timeout->node.data) {
-		splay_unlink_node(&loop->timeouts, &timeout->node);
-		timeout->node.data = NULL;
+	if(timeout->heap_index) {
+		heap_remove(loop, timeout);
 	}
 
 	timespec_clear(&timeout->tv);
@@ -175,7 +284,7 @@ void timeout_del(event_loop_t *loop, timeout_t *timeout) {
 		return;
 	}
 
-	if(timeout->node.data) {
+	if(timeout->heap_index) {
 		timeout_disable(loop, timeout);
 	}
 
@@ -284,6 +393,27 @@ void idle_set(event_loop_t *loop, idle_cb_t cb, void *data) {
 	loop->idle_data = data;
 }
 
+void flush_set(event_loop_t *loop, flush_cb_t cb, void *data) {
+	loop->flush_cb = cb;
+	loop->flush_data = data;
+}
+
+void event_loop_flush_output(event_loop_t *loop) {
+	if(loop->flush_cb) {
+		loop->flush_cb(loop, loop->flush_data);
+	}
+}
+
+// Output produced by callbacks may be batched until we are about to wait for events again.
+static void begin_batch(event_loop_t *loop) {
+	loop->batching = true;
+}
+
+static void end_batch(event_loop_t *loop) {
+	event_loop_flush_output(loop);
+	loop->batching = false;
+}
+
 static void check_bad_fds(event_loop_t *loop, meshlink_handle_t *mesh) {
 	// Just call all registered callbacks and have them check their fds
 
@@ -340,36 +470,128 @@ static void check_bad_fds(event_loop_t *loop, meshlink_handle_t *mesh) {
 	}
 }
 
-bool event_loop_run(event_loop_t *loop, meshlink_handle_t *mesh) {
-	assert(mesh);
+static struct timespec run_timeouts(event_loop_t *loop) {
+	clock_gettime(EVENT_CLOCK, &loop->now);
+	struct timespec it, ts = {3600, 0};
 
-	fd_set readable;
-	fd_set writable;
+	while(loop->timeouts_count) {
+		timeout_t *timeout = loop->timeouts[0];
+
+		if(timespec_lt(&timeout->tv, &loop->now)) {
+			timeout_disable(loop, timeout);
+			timeout->cb(loop, timeout->data);
+		} else {
+			timespec_sub(&timeout->tv, &loop->now, &ts);
+			break;
+		}
+	}
+
+	if(loop->idle_cb) {
+		it = loop->idle_cb(loop, loop->idle_data);
+
+		if(it.tv_sec >= 0 && timespec_lt(&it, &ts)) {
+			ts = it;
+		}
+	}
+
+	return ts;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+#define MAX_EPOLL_EVENTS 64
+
+static bool event_loop_run_epoll(event_loop_t *loop, meshlink_handle_t *mesh) {
+	struct epoll_event events[MAX_EPOLL_EVENTS];
 	int errors = 0;
 
+	begin_batch(loop);
+
 	while(loop->running) {
+		struct timespec ts = run_timeouts(loop);
+
+		// Round up, otherwise we would wake up just before a timeout expires and spin
+		int ms = ts.tv_sec * 1000 + (ts.tv_nsec + 999999) / 1000000;
+
+		end_batch(loop);
+
+		// release mesh mutex during epoll_wait
+		pthread_mutex_unlock(&mesh->mutex);
+
+		int n = epoll_wait(loop->epollfd, events, MAX_EPOLL_EVENTS, ms);
+
+		if(pthread_mutex_lock(&mesh->mutex) != 0) {
+			abort();
+		}
+
+		begin_batch(loop);
+
 		clock_gettime(EVENT_CLOCK, &loop->now);
-		struct timespec it, ts = {3600, 0};
 
-		while(loop->timeouts.head) {
-			timeout_t *timeout = loop->timeouts.head->data;
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
 
-			if(timespec_lt(&timeout->tv, &loop->now)) {
-				timeout_disable(loop, timeout);
-				timeout->cb(loop, timeout->data);
-			} else {
-				timespec_sub(&timeout->tv, &loop->now, &ts);
-				break;
+			if(++errors > 10) {
+				logger(mesh, MESHLINK_ERROR, "Unrecoverable error from epoll_wait(): %s", strerror(errno));
+				end_batch(loop);
+				return false;
 			}
+
+			logger(mesh, MESHLINK_WARNING, "Error from epoll_wait(): %s", strerror(errno));
+			continue;
 		}
 
-		if(loop->idle_cb) {
-			it = loop->idle_cb(loop, loop->idle_data);
+		errors = 0;
+
+		// Only the ready fds are dispatched. Since other threads can delete ios while we
+		// are waiting, look each one up again instead of trusting a pointer in the event.
 
-			if(it.tv_sec >= 0 && timespec_lt(&it, &ts)) {
-				ts = it;
+		for(int i = 0; i < n; i++) {
+			io_t *io = splay_search(&loop->ios, &(io_t) {
+				.fd = events[i].data.fd
+			});
+
+			if(io && io->cb && (io->flags & IO_WRITE) && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+				io->cb(loop, io->data, IO_WRITE);
+
+				// The callback may have deleted this io
+				io = splay_search(&loop->ios, &(io_t) {
+					.fd = events[i].data.fd
+				});
+			}
+
+			if(io && io->cb && (io->flags & IO_READ) && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+				io->cb(loop, io->data, IO_READ);
 			}
 		}
+	}
+
+	end_batch(loop);
+
+	return true;
+}
+#endif
+
+bool event_loop_run(event_loop_t *loop, meshlink_handle_t *mesh) {
+	assert(mesh);
+
+#ifdef HAVE_SYS_EPOLL_H
+
+	if(loop->epollfd != -1) {
+		return event_loop_run_epoll(loop, mesh);
+	}
+
+#endif
+
+	fd_set readable;
+	fd_set writable;
+	int errors = 0;
+
+	begin_batch(loop);
+
+	while(loop->running) {
+		struct timespec ts = run_timeouts(loop);
 
 		memcpy(&readable, &loop->readfds, sizeof(readable));
 		memcpy(&writable, &loop->writefds, sizeof(writable));
@@ -381,6 +603,8 @@ bool event_loop_run(event_loop_t *loop, meshlink_handle_t *mesh) {
 			fds = last->fd + 1;
 		}
 
+		end_batch(loop);
+
 		// release mesh mutex during select
 		pthread_mutex_unlock(&mesh->mutex);
 
@@ -395,6 +619,8 @@ bool event_loop_run(event_loop_t *loop, meshlink_handle_t *mesh) {
 			abort();
 		}
 
+		begin_batch(loop);
+
 		clock_gettime(EVENT_CLOCK, &loop->now);
 
 		if(n < 0) {
@@ -405,6 +631,7 @@ bool event_loop_run(event_loop_t *loop, meshlink_handle_t *mesh) {
 
 				if(errors > 10) {
 					logger(mesh, MESHLINK_ERROR, "Unrecoverable error from select(): %s", strerror(errno));
+					end_batch(loop);
 					return false;
 				}
 
@@ -445,6 +672,8 @@ bool event_loop_run(event_loop_t *loop, meshlink_handle_t *mesh) {
 		}
 	}
 
+	end_batch(loop);
+
 	return true;
 }
 
@@ -458,27 +687,43 @@ void event_loop_stop(event_loop_t *loop) {
 
 void event_loop_init(event_loop_t *loop) {
 	loop->ios.compare = (splay_compare_t)io_compare;
-	loop->timeouts.compare = (splay_compare_t)timeout_compare;
 	loop->signals.compare = (splay_compare_t)signal_compare;
 	loop->pipefd[0] = -1;
 	loop->pipefd[1] = -1;
+#ifdef HAVE_SYS_EPOLL_H
+	// If epoll is not available at runtime, we fall back to select()
+	loop->epollfd = epoll_create1(EPOLL_CLOEXEC);
+#endif
 	clock_gettime(EVENT_CLOCK, &loop->now);
 }
 
 void event_loop_exit(event_loop_t *loop) {
 	assert(!loop->ios.count);
-	assert(!loop->timeouts.count);
+	assert(!loop->timeouts_count);
 	assert(!loop->signals.count);
 
 	for splay_each(io_t, io, &loop->ios) {
 		splay_unlink_node(&loop->ios, splay_node);
 	}
 
-	for splay_each(timeout_t, timeout, &loop->timeouts) {
-		splay_unlink_node(&loop->timeouts, splay_node);
+	while(loop->timeouts_count) {
+		timeout_disable(loop, loop->timeouts[0]);
 	}
 
+	free(loop->timeouts);
+	loop->timeouts = NULL;
+	loop->timeouts_size = 0;
+
 	for splay_each(signal_t, signal, &loop->signals) {
 		splay_unlink_node(&loop->signals, splay_node);
 	}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+	if(loop->epollfd != -1) {
+		close(loop->epollfd);
+		loop->epollfd = -1;
+	}
+
+#endif
 }
@@ -34,6 +34,7 @@ typedef void (*io_cb_t)(event_loop_t *loop, void *data, int flags);
 typedef void (*timeout_cb_t)(event_loop_t *loop, void *data);
 typedef void (*signal_cb_t)(event_loop_t *loop, void *data);
 typedef struct timespec(*idle_cb_t)(event_loop_t *loop, void *data);
+typedef void (*flush_cb_t)(event_loop_t *loop, void *data);
 
 typedef struct io_t {
 	struct splay_node_t node;
@@ -44,7 +45,7 @@ typedef struct io_t {
 } io_t;
 
 typedef struct timeout_t {
-	struct splay_node_t node;
+	unsigned int heap_index;        /* 1-based position in the timeout heap, 0 if not scheduled */
 	struct timespec tv;
 	timeout_cb_t cb;
 	void *data;
@@ -68,14 +69,22 @@ struct event_loop_t {
 
 	struct timespec now;
 
-	splay_tree_t timeouts;
+	timeout_t **timeouts;           /* 4-ary min-heap ordered by expiry time */
+	unsigned int timeouts_count;
+	unsigned int timeouts_size;
 	idle_cb_t idle_cb;
 	void *idle_data;
+	flush_cb_t flush_cb;
+	void *flush_data;
+	bool batching;                  /* true while the loop runs callbacks, output may be deferred until the next flush */
 	splay_tree_t ios;
 	splay_tree_t signals;
 
 	fd_set readfds;
 	fd_set writefds;
+#ifdef HAVE_SYS_EPOLL_H
+	int epollfd;
+#endif
 
 	io_t signalio;
 	int pipefd[2];
@@ -94,6 +103,7 @@ void signal_trigger(event_loop_t *loop, signal_t *sig);
 void signal_del(event_loop_t *loop, signal_t *sig);
 
 void idle_set(event_loop_t *loop, idle_cb_t cb, void *data);
+void flush_set(event_loop_t *loop, flush_cb_t cb, void *data);
 
 void event_loop_init(event_loop_t *loop);
 void event_loop_exit(event_loop_t *loop);
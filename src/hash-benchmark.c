@@ -0,0 +1,161 @@
+/*
+    hash-benchmark.c -- Benchmark the hash table used for the UDP address cache
+    Copyright (C) 2026 MeshLink contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "system.h"
+
+#include <time.h>
+
+#include "hash.h"
+#include "sockaddr.h"
+#include "xalloc.h"
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The direct-mapped table that was used before, with full sockaddr_t keys, for comparison.
+typedef struct direct_hash {
+	size_t n;
+	size_t size;
+	char *keys;
+	const void **values;
+} direct_hash_t;
+
+static uint32_t direct_hash_function(const void *p, size_t len) {
+	const uint8_t *q = p;
+	uint32_t hash = 0;
+
+	while(true) {
+		for(int i = len > 4 ? 4 : len; --i;) {
+			hash += q[len - i] << (8 * i);
+		}
+
+		hash *= 0x9e370001UL;
+
+		if(len <= 4) {
+			break;
+		}
+
+		len -= 4;
+	}
+
+	return hash;
+}
+
+static uint32_t direct_slot(const direct_hash_t *hash, const void *key) {
+	uint32_t h = direct_hash_function(key, hash->size);
+	return (h >> 24) ^ ((h >> 16) & 0xff) ^ ((h >> 8) & 0xff) ^ (h & 0xff);
+}
+
+static void direct_insert(direct_hash_t *hash, const void *key, const void *value) {
+	uint32_t i = direct_slot(hash, key);
+	memcpy(hash->keys + i * hash->size, key, hash->size);
+	hash->values[i] = value;
+}
+
+static void *direct_search(const direct_hash_t *hash, const void *key) {
+	uint32_t i = direct_slot(hash, key);
+
+	if(hash->values[i] && !memcmp(key, hash->keys + i * hash->size, hash->size)) {
+		return (void *)hash->values[i];
+	}
+
+	return NULL;
+}
+
+// The key used by the UDP address cache
+typedef struct udp_cache_key {
+	uint16_t family;
+	uint16_t port;
+	uint32_t scope_id;
+	uint8_t address[16];
+} udp_cache_key_t;
+
+static void make_address(sockaddr_t *sa, int i) {
+	memset(sa, 0, sizeof(*sa));
+	sa->in.sin_family = AF_INET;
+	sa->in.sin_port = htons(655 + i % 7);
+	sa->in.sin_addr.s_addr = htonl(0xc0a80000 + i * 13);
+}
+
+static void make_key(udp_cache_key_t *key, const sockaddr_t *sa) {
+	memset(key, 0, sizeof(*key));
+	key->family = sa->sa.sa_family;
+	key->port = sa->in.sin_port;
+	memcpy(key->address, &sa->in.sin_addr, sizeof(sa->in.sin_addr));
+}
+
+static void benchmark(int peers, long lookups) {
+	sockaddr_t *addresses = xzalloc(peers * sizeof(*addresses));
+	udp_cache_key_t *keys = xzalloc(peers * sizeof(*keys));
+
+	direct_hash_t direct = {.n = 0x100, .size = sizeof(sockaddr_t)};
+	direct.keys = xzalloc(direct.n * direct.size);
+	direct.values = xzalloc(direct.n * sizeof(*direct.values));
+	hash_t *hash = hash_alloc(0x100, sizeof(udp_cache_key_t));
+
+	for(int i = 0; i < peers; i++) {
+		make_address(&addresses[i], i);
+		make_key(&keys[i], &addresses[i]);
+		direct_insert(&direct, &addresses[i], &addresses[i]);
+		hash_insert(hash, &keys[i], &addresses[i]);
+	}
+
+	long hits = 0;
+	double start = now();
+
+	for(long i = 0; i < lookups; i++) {
+		hits += direct_search(&direct, &addresses[i % peers]) != NULL;
+	}
+
+	double elapsed = now() - start;
+	printf("direct      %5d peers: %7.2f ns/lookup, %6.2f%% hits\n", peers, elapsed * 1e9 / lookups, 100.0 * hits / lookups);
+
+	hits = 0;
+	start = now();
+
+	for(long i = 0; i < lookups; i++) {
+		udp_cache_key_t key;
+		make_key(&key, &addresses[i % peers]);
+		hits += hash_search(hash, &key) != NULL;
+	}
+
+	elapsed = now() - start;
+	printf("robin hood  %5d peers: %7.2f ns/lookup, %6.2f%% hits\n", peers, elapsed * 1e9 / lookups, 100.0 * hits / lookups);
+
+	hash_free(hash);
+	free(direct.keys);
+	free(direct.values);
+	free(keys);
+	free(addresses);
+}
+
+int main(int argc, char *argv[]) {
+	long lookups = argc > 1 ? atol(argv[1]) : 10000000;
+
+	static const int sizes[] = {10, 100, 1000, 10000};
+
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		benchmark(sizes[i], lookups);
+	}
+
+	return 0;
+}
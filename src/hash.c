@@ -22,85 +22,225 @@
 #include "hash.h"
 #include "xalloc.h"
 
-/* Generic hash function */
+/* Generic hash function, mixing the key 8 bytes at a time */
 
-static uint32_t hash_function(const void *p, size_t len) {
-	const uint8_t *q = p;
-	uint32_t hash = 0;
+static const uint64_t prime1 = 0x9e3779b97f4a7c15ULL;
+static const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
 
-	while(true) {
-		for(int i = len > 4 ? 4 : len; --i;) {
-			hash += q[len - i] << (8 * i);
-		}
+static uint64_t mix(uint64_t x) {
+	x ^= x >> 32;
+	x *= prime2;
+	x ^= x >> 29;
+	x *= prime1;
+	x ^= x >> 32;
+	return x;
+}
 
-		hash *= 0x9e370001UL; // Golden ratio prime.
+uint64_t hash_function(const void *p, size_t len) {
+	const uint8_t *q = p;
+	uint64_t hash = len * prime1;
 
-		if(len <= 4) {
-			break;
-		}
+	for(; len >= 8; len -= 8, q += 8) {
+		uint64_t word;
+		memcpy(&word, q, 8);
+		hash = (hash ^ mix(word)) * prime1;
+	}
 
-		len -= 4;
+	if(len) {
+		uint64_t word = 0;
+		memcpy(&word, q, len);
+		hash = (hash ^ mix(word)) * prime1;
 	}
 
-	return hash;
+	return mix(hash);
 }
 
-/* Map 32 bits int onto 0..n-1, without throwing away too many bits if n is 2^8 or 2^16 */
+/* The maximum load factor is 7/8. Entries can be at most 254 slots away from their home slot. */
+
+#define MAX_DISTANCE 255
 
-static uint32_t modulo(uint32_t hash, size_t n) {
-	if(n == 0x100) {
-		return (hash >> 24) ^ ((hash >> 16) & 0xff) ^ ((hash >> 8) & 0xff) ^ (hash & 0xff);
-	} else if(n == 0x10000) {
-		return (hash >> 16) ^ (hash & 0xffff);
-	} else {
-		return hash % n;
+static size_t round_up(size_t n) {
+	size_t result = 8;
+
+	while(result < n) {
+		result *= 2;
 	}
+
+	return result;
+}
+
+static size_t home(const hash_t *hash, const void *key) {
+	return hash_function(key, hash->size) & (hash->n - 1);
+}
+
+static char *key_at(const hash_t *hash, size_t i) {
+	return hash->keys + i * hash->size;
 }
 
 /* (De)allocation */
 
+static void alloc_slots(hash_t *hash, size_t n) {
+	hash->n = n;
+	hash->count = 0;
+	hash->keys = xmalloc(n * hash->size);
+	hash->values = xzalloc(n * sizeof(*hash->values));
+	hash->distances = xzalloc(n);
+}
+
 hash_t *hash_alloc(size_t n, size_t size) {
 	hash_t *hash = xzalloc(sizeof(*hash));
-	hash->n = n;
 	hash->size = size;
-	hash->keys = xzalloc(hash->n * hash->size);
-	hash->values = xzalloc(hash->n * sizeof(*hash->values));
+	alloc_slots(hash, round_up(n));
 	return hash;
 }
 
 void hash_free(hash_t *hash) {
 	free(hash->keys);
 	free(hash->values);
+	free(hash->distances);
 	free(hash);
 }
 
 /* Searching and inserting */
 
+static bool find(const hash_t *hash, const void *key, size_t *slot) {
+	size_t mask = hash->n - 1;
+	size_t i = home(hash, key);
+
+	// An entry further away from its home slot than the one we are looking for would have displaced it
+	for(unsigned int distance = 1; hash->distances[i] >= distance; distance++, i = (i + 1) & mask) {
+		if(hash->distances[i] == distance && !memcmp(key_at(hash, i), key, hash->size)) {
+			*slot = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Put an entry in the table. If it does not fit, the entry that could not be placed is returned in key and value.
+static bool place(hash_t *hash, char *key, const void **value) {
+	size_t mask = hash->n - 1;
+	size_t i = home(hash, key);
+	unsigned int distance = 1;
+	char swapkey[hash->size];
+
+	while(hash->distances[i]) {
+		// Robin Hood: take the slot from an entry that is closer to its home slot than we are
+		if(hash->distances[i] < distance) {
+			memcpy(swapkey, key_at(hash, i), hash->size);
+			memcpy(key_at(hash, i), key, hash->size);
+			memcpy(key, swapkey, hash->size);
+
+			const void *swapvalue = hash->values[i];
+			hash->values[i] = *value;
+			*value = swapvalue;
+
+			unsigned int swapdistance = hash->distances[i];
+			hash->distances[i] = distance;
+			distance = swapdistance;
+		}
+
+		i = (i + 1) & mask;
+
+		if(++distance == MAX_DISTANCE) {
+			return false;
+		}
+	}
+
+	memcpy(key_at(hash, i), key, hash->size);
+	hash->values[i] = *value;
+	hash->distances[i] = distance;
+	hash->count++;
+	return true;
+}
+
+static void rehash(hash_t *hash, size_t n) {
+	size_t old_n = hash->n;
+	char *old_keys = hash->keys;
+	const void **old_values = hash->values;
+	uint8_t *old_distances = hash->distances;
+	char key[hash->size];
+
+retry:
+	alloc_slots(hash, n);
+
+	for(size_t i = 0; i < old_n; i++) {
+		if(!old_distances[i]) {
+			continue;
+		}
+
+		memcpy(key, old_keys + i * hash->size, hash->size);
+		const void *value = old_values[i];
+
+		if(!place(hash, key, &value)) {
+			// Too many keys with the same home slot, start again with a larger table
+			free(hash->keys);
+			free(hash->values);
+			free(hash->distances);
+			n *= 2;
+			goto retry;
+		}
+	}
+
+	free(old_keys);
+	free(old_values);
+	free(old_distances);
+}
+
 void hash_insert(hash_t *hash, const void *key, const void *value) {
-	uint32_t i = modulo(hash_function(key, hash->size), hash->n);
-	memcpy(hash->keys + i * hash->size, key, hash->size);
-	hash->values[i] = value;
+	size_t i;
+
+	if(find(hash, key, &i)) {
+		hash->values[i] = value;
+		return;
+	}
+
+	if((hash->count + 1) * 8 > hash->n * 7) {
+		rehash(hash, hash->n * 2);
+	}
+
+	char tmpkey[hash->size];
+	memcpy(tmpkey, key, hash->size);
+
+	while(!place(hash, tmpkey, &value)) {
+		rehash(hash, hash->n * 2);
+	}
 }
 
-void *hash_search(const hash_t *hash, const void *key) {
-	uint32_t i = modulo(hash_function(key, hash->size), hash->n);
+void hash_delete(hash_t *hash, const void *key) {
+	size_t mask = hash->n - 1;
+	size_t i;
 
-	if(hash->values[i] && !memcmp(key, hash->keys + i * hash->size, hash->size)) {
-		return (void *)hash->values[i];
+	if(!find(hash, key, &i)) {
+		return;
 	}
 
-	return NULL;
+	// Shift the following entries back one slot, until one is found that is already in its home slot
+	for(size_t next = (i + 1) & mask; hash->distances[next] > 1; i = next, next = (next + 1) & mask) {
+		memcpy(key_at(hash, i), key_at(hash, next), hash->size);
+		hash->values[i] = hash->values[next];
+		hash->distances[i] = hash->distances[next] - 1;
+	}
+
+	hash->values[i] = NULL;
+	hash->distances[i] = 0;
+	hash->count--;
+}
+
+void *hash_search(const hash_t *hash, const void *key) {
+	size_t i;
+	return find(hash, key, &i) ? (void *)hash->values[i] : NULL;
 }
 
 void *hash_search_or_insert(hash_t *hash, const void *key, const void *value) {
-	uint32_t i = modulo(hash_function(key, hash->size), hash->n);
+	size_t i;
 
-	if(hash->values[i] && !memcmp(key, hash->keys + i * hash->size, hash->size)) {
+	if(find(hash, key, &i)) {
 		return (void *)hash->values[i];
 	}
 
-	memcpy(hash->keys + i * hash->size, key, hash->size);
-	hash->values[i] = value;
+	hash_insert(hash, key, value);
 	return NULL;
 }
 
@@ -108,14 +248,18 @@ void *hash_search_or_insert(hash_t *hash, const void *key, const void *value) {
 
 void hash_clear(hash_t *hash) {
 	memset(hash->values, 0, hash->n * sizeof(*hash->values));
+	memset(hash->distances, 0, hash->n);
+	hash->count = 0;
 }
 
 void hash_resize(hash_t *hash, size_t n) {
-	hash->keys = xrealloc(hash->keys, n * hash->size);
-	hash->values = xrealloc(hash->values, n * sizeof(*hash->values));
+	n = round_up(n);
+
+	while(n * 7 < hash->count * 8) {
+		n *= 2;
+	}
 
-	if(n > hash->n) {
-		memset(hash->keys + hash->n * hash->size, 0, (n - hash->n) * hash->size);
-		memset(hash->values + hash->n, 0, (n - hash->n) * sizeof(*hash->values));
+	if(n != hash->n) {
+		rehash(hash, n);
 	}
 }
@@ -20,17 +20,26 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <stddef.h>
+#include <stdint.h>
+
+/* An open addressing hash table with Robin Hood probing.
+ * Keys are fixed size byte strings, values must not be NULL.
+ */
 typedef struct hash_t {
-	size_t n;
-	size_t size;
+	size_t n;                       /* Number of slots, always a power of two */
+	size_t size;                    /* Size of a key in bytes */
+	size_t count;                   /* Number of entries */
 	char *keys;
 	const void **values;
+	uint8_t *distances;             /* Distance of each entry from its home slot plus one, 0 if the slot is empty */
 } hash_t;
 
 hash_t *hash_alloc(size_t n, size_t size) __attribute__((__malloc__));
 void hash_free(hash_t *);
 
 void hash_insert(hash_t *, const void *key, const void *value);
+void hash_delete(hash_t *, const void *key);
 
 void *hash_search(const hash_t *, const void *key);
 void *hash_search_or_insert(hash_t *, const void *key, const void *value);
@@ -38,4 +47,6 @@ void *hash_search_or_insert(hash_t *, const void *key, const void *value);
 void hash_clear(hash_t *);
 void hash_resize(hash_t *, size_t n);
 
+uint64_t hash_function(const void *key, size_t len) __attribute__((__warn_unused_result__));
+
 #endif
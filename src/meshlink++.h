@@ -548,6 +548,25 @@ public:
 		return meshlink_verify(handle, source, data, len, signature, siglen);
 	}
 
+	/// Verify multiple signatures generated by other nodes at once.
+	/** This function verifies a number of signatures that other nodes generated for pieces of data.
+	 *  Multiple signatures are checked together with the cofactored Ed25519 verification equation,
+	 *  so a signature that differs from a valid one only by a small order component may be accepted here but rejected by verify().
+	 *
+	 *  @param sources      An array of @a count pointers to nodes describing the source of each signature.
+	 *  @param data         An array of @a count pointers to the data to be verified.
+	 *  @param lens         An array of @a count lengths of the data to be verified.
+	 *  @param signatures   An array of @a count pointers to the signatures.
+	 *  @param siglens      An array of @a count sizes of the signatures.
+	 *  @param count        The number of signatures to verify.
+	 *  @param valid        An array of @a count booleans indicating which signatures are valid, or NULL.
+	 *
+	 *  @return             This function returns true if all signatures are valid, false otherwise.
+	 */
+	bool verify_batch(node **sources, const void *const *data, const size_t *lens, const void *const *signatures, const size_t *siglens, size_t count, bool *valid) {
+		return meshlink_verify_batch(handle, (meshlink_node_t **)sources, data, lens, signatures, siglens, count, valid);
+	}
+
 	/// Set the canonical Address for a node.
 	/** This function sets the canonical Address for a node.
 	 *  This address is stored permanently until it is changed by another call to this function,
@@ -930,6 +949,74 @@ public:
 		meshlink_set_channel_flags(handle, channel, flags);
 	}
 
+	/// Set the congestion control algorithm of a channel.
+	/** This function selects the algorithm that determines how fast data is sent on a channel.
+	 *  It only affects data sent by the local side of the channel.
+	 *  The change takes effect immediately, and resets the algorithm's estimate of the path.
+	 *
+	 *  @param channel   A handle for the channel.
+	 *  @param cc        The congestion control algorithm to use.
+	 *
+	 *  @return          This function will return true if the algorithm was changed, false otherwise.
+	 */
+	bool set_channel_congestion_control(channel *channel, meshlink_congestion_control_t cc) {
+		return meshlink_set_channel_congestion_control(handle, channel, cc);
+	}
+
+	/// Set the maximum rate at which data is sent on a channel.
+	/** Data sent on reliable channels is paced, so that it is spread evenly over time instead of being sent in bursts.
+	 *  This function additionally limits the rate to the given value, even if the network could handle more.
+	 *  It only affects data sent by the local side of the channel, and has no effect on UDP channels.
+	 *
+	 *  @param channel   A handle for the channel.
+	 *  @param rate      The maximum rate in bytes per second, or 0 for no limit.
+	 */
+	void set_channel_max_rate(channel *channel, size_t rate) {
+		meshlink_set_channel_max_rate(handle, channel, rate);
+	}
+
+	/// Enable or disable delayed acknowledgements on a channel.
+	/** When data is received on a reliable channel, the acknowledgement is normally held back for a short time,
+	 *  until a second packet arrives or the application sends data back that can carry it.
+	 *  This halves the number of packets sent in the reverse direction during bulk transfers.
+	 *  Out-of-order data is always acknowledged immediately.
+	 *  Delayed acknowledgements are enabled by default, and are only used if the peer supports them.
+	 *  Disabling them can reduce latency for applications that send single messages and wait for them to be acknowledged.
+	 *
+	 *  @param channel      A handle for the channel.
+	 *  @param delayed_ack  True if acknowledgements may be delayed, false if they should be sent immediately.
+	 */
+	void set_channel_delayed_ack(channel *channel, bool delayed_ack) {
+		meshlink_set_channel_delayed_ack(handle, channel, delayed_ack);
+	}
+
+	/// Set the maximum size to which the buffers of a channel may grow automatically.
+	/** Unless the application sets their sizes explicitly, the send and receive buffers of a reliable channel
+	 *  start at their default size and are grown automatically as needed to keep the network path full,
+	 *  based on the measured round-trip time and the amount of data in flight.
+	 *  This function limits how large each of the buffers may become. The default limit is 4 MiB.
+	 *  Buffers that have already grown beyond the new limit are shrunk as far as their contents allow.
+	 *  Buffers never shrink below their default size, so a limit of 0 disables automatic growth.
+	 *
+	 *  @param channel   A handle for the channel.
+	 *  @param size      The maximum size of each buffer in bytes.
+	 */
+	void set_channel_buffer_limit(channel *channel, size_t size) {
+		meshlink_set_channel_buffer_limit(handle, channel, size);
+	}
+
+	/// Limit the total memory used by automatically grown channel buffers.
+	/** This limits the memory that all channels of a MeshLink instance together may use beyond their default buffer sizes.
+	 *  When the limit is reached, buffers are no longer grown, and channels shrink their buffers back towards what they need.
+	 *  Buffers whose sizes have been set explicitly by the application do not count towards this limit.
+	 *  The default limit is 64 MiB.
+	 *
+	 *  @param size      The maximum amount of memory in bytes, or 0 for no limit.
+	 */
+	void set_channel_memory_limit(size_t size) {
+		meshlink_set_channel_memory_limit(handle, size);
+	}
+
 	/// Set the send buffer storage of a channel.
 	/** This function provides MeshLink with a send buffer allocated by the application.
 	*
@@ -21,6 +21,7 @@
 #include <pthread.h>
 
 #include "adns.h"
+#include "crypto_worker.h"
 #include "crypto.h"
 #include "ecdsagen.h"
 #include "logger.h"
@@ -29,6 +30,7 @@
 #include "netutl.h"
 #include "node.h"
 #include "submesh.h"
+#include "packet_workers.h"
 #include "packmsg.h"
 #include "prf.h"
 #include "protocol.h"
@@ -994,6 +996,7 @@ static const char *errstr[] = {
 	[MESHLINK_ENOTSUP] = "Operation not supported",
 	[MESHLINK_EBUSY] = "MeshLink instance already in use",
 	[MESHLINK_EBLACKLISTED] = "Node is blacklisted",
+	[MESHLINK_EAGAIN] = "Resource temporarily unavailable",
 };
 
 const char *meshlink_strerror(meshlink_errno_t err) {
@@ -1021,34 +1024,6 @@ static bool ecdsa_keygen(meshlink_handle_t *mesh) {
 	return true;
 }
 
-static bool timespec_lt(const struct timespec *a, const struct timespec *b) {
-	if(a->tv_sec == b->tv_sec) {
-		return a->tv_nsec < b->tv_nsec;
-	} else {
-		return a->tv_sec < b->tv_sec;
-	}
-}
-
-static struct timespec idle(event_loop_t *loop, void *data) {
-	(void)loop;
-	meshlink_handle_t *mesh = data;
-	struct timespec t, tmin = {3600, 0};
-
-	for splay_each(node_t, n, mesh->nodes) {
-		if(!n->utcp) {
-			continue;
-		}
-
-		t = utcp_timeout(n->utcp);
-
-		if(timespec_lt(&t, &tmin)) {
-			tmin = t;
-		}
-	}
-
-	return tmin;
-}
-
 // Get our local address(es) by simulating connecting to an Internet host.
 static void add_local_addresses(meshlink_handle_t *mesh) {
 	sockaddr_t sa;
@@ -1290,6 +1265,26 @@ bool meshlink_open_params_set_storage_policy(meshlink_open_params_t *params, mes
 	return true;
 }
 
+bool meshlink_open_params_set_send_queue_size(meshlink_open_params_t *params, size_t size) {
+	logger(NULL, MESHLINK_DEBUG, "meshlink_open_params_set_send_queue_size(%zu)", size);
+
+	if(!params || !size || size > MAX_OUTPACKETQUEUE_SIZE) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	// The queue is a ring whose size must be a power of two
+	size_t rounded = 1;
+
+	while(rounded < size) {
+		rounded *= 2;
+	}
+
+	params->send_queue_size = rounded;
+
+	return true;
+}
+
 bool meshlink_open_params_set_lock_filename(meshlink_open_params_t *params, const char *filename) {
 	logger(NULL, MESHLINK_DEBUG, "meshlink_open_params_set_lock_filename(%s)", filename);
 
@@ -1549,6 +1544,9 @@ meshlink_handle_t *meshlink_open_ex(const meshlink_open_params_t *params) {
 	mesh->log_cb = global_log_cb;
 	mesh->log_level = global_log_level;
 	mesh->packet = xmalloc(sizeof(vpn_packet_t));
+	mesh->udp_rx_batch = DEFAULT_UDP_RX_BATCH;
+	mesh->key_renewal_rate = DEFAULT_KEY_RENEWAL_RATE;
+	mesh->channel_memory.limit = DEFAULT_CHANNEL_MEMORY_LIMIT;
 
 	randomize(&mesh->prng_state, sizeof(mesh->prng_state));
 
@@ -1581,15 +1579,22 @@ meshlink_handle_t *meshlink_open_ex(const meshlink_open_params_t *params) {
 	}
 
 	pthread_mutex_init(&mesh->mutex, &attr);
+	pthread_mutex_init(&mesh->staging_mutex, NULL);
 	pthread_cond_init(&mesh->cond, NULL);
 
 	pthread_cond_init(&mesh->adns_cond, NULL);
+	pthread_cond_init(&mesh->crypto_cond, NULL);
 
 	mesh->threadstarted = false;
 	event_loop_init(&mesh->loop);
 	mesh->loop.data = mesh;
+	flush_set(&mesh->loop, flush_udp_output, mesh);
 
-	meshlink_queue_init(&mesh->outpacketqueue);
+	if(!meshlink_ring_init(&mesh->outpacketqueue, params->send_queue_size ? params->send_queue_size : OUTPACKETQUEUE_SIZE, sizeof(vpn_packet_t))) {
+		meshlink_errno = MESHLINK_ENOMEM;
+		meshlink_close(mesh);
+		return NULL;
+	}
 
 	// Atomically lock the configuration directory.
 	if(!main_config_lock(mesh, params->lock_filename)) {
@@ -1680,8 +1685,6 @@ meshlink_handle_t *meshlink_open_ex(const meshlink_open_params_t *params) {
 		return NULL;
 	}
 
-	idle_set(&mesh->loop, idle, mesh);
-
 	logger(NULL, MESHLINK_DEBUG, "meshlink_open returning\n");
 	return mesh;
 }
@@ -1809,6 +1812,8 @@ bool meshlink_start(meshlink_handle_t *mesh) {
 
 	init_outgoings(mesh);
 	init_adns(mesh);
+	init_packet_workers(mesh);
+	init_crypto_worker(mesh);
 
 	// Start the main thread
 
@@ -1894,6 +1899,8 @@ void meshlink_stop(meshlink_handle_t *mesh) {
 	}
 
 	exit_adns(mesh);
+	exit_packet_workers(mesh);
+	exit_crypto_worker(mesh);
 	exit_outgoings(mesh);
 
 	// Ensure we are considered unreachable
@@ -1953,11 +1960,7 @@ void meshlink_close(meshlink_handle_t *mesh) {
 		close(mesh->netns);
 	}
 
-	for(vpn_packet_t *packet; (packet = meshlink_queue_pop(&mesh->outpacketqueue));) {
-		free(packet);
-	}
-
-	meshlink_queue_exit(&mesh->outpacketqueue);
+	meshlink_ring_exit(&mesh->outpacketqueue);
 
 	free(mesh->name);
 	free(mesh->appname);
@@ -1965,6 +1968,7 @@ void meshlink_close(meshlink_handle_t *mesh) {
 	free(mesh->config_key);
 	free(mesh->external_address_url);
 	free(mesh->packet);
+	free_udp_rx_ring(mesh);
 	ecdsa_free(mesh->private_key);
 
 	if(mesh->invitation_addresses) {
@@ -1975,6 +1979,7 @@ void meshlink_close(meshlink_handle_t *mesh) {
 
 	pthread_mutex_unlock(&mesh->mutex);
 	pthread_mutex_destroy(&mesh->mutex);
+	pthread_mutex_destroy(&mesh->staging_mutex);
 
 	memset(mesh, 0, sizeof(*mesh));
 
@@ -2207,10 +2212,10 @@ void meshlink_set_thread_status_cb(struct meshlink_handle *mesh, meshlink_thread
 	pthread_mutex_unlock(&mesh->mutex);
 }
 
-static bool prepare_packet(meshlink_handle_t *mesh, meshlink_node_t *destination, const void *data, size_t len, vpn_packet_t *packet) {
-	meshlink_packethdr_t *hdr;
-
-	if(len > MAXSIZE - sizeof(*hdr)) {
+// Fill in everything except the payload, which the caller has already put behind the header.
+// Locally queued packets always get a compact header if possible, route() converts it if the destination needs the legacy one.
+static bool prepare_packet_header(meshlink_handle_t *mesh, meshlink_node_t *destination, size_t len, vpn_packet_t *packet, bool compact) {
+	if(len > MAXSIZE - sizeof(meshlink_packethdr_t)) {
 		meshlink_errno = MESHLINK_EINVAL;
 		return false;
 	}
@@ -2226,20 +2231,38 @@ static bool prepare_packet(meshlink_handle_t *mesh, meshlink_node_t *destination
 	// Prepare the packet
 	packet->probe = false;
 	packet->tcp = false;
-	packet->len = len + sizeof(*hdr);
 
-	hdr = (meshlink_packethdr_t *)packet->data;
-	memset(hdr, 0, sizeof(*hdr));
-	// leave the last byte as 0 to make sure strings are always
-	// null-terminated if they are longer than the buffer
-	strncpy((char *)hdr->destination, destination->name, sizeof(hdr->destination) - 1);
-	strncpy((char *)hdr->source, mesh->self->name, sizeof(hdr->source) - 1);
-
-	memcpy(packet->data + sizeof(*hdr), data, len);
+	if(!write_packet_header(mesh, n, packet, len, compact)) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
 
 	return true;
 }
 
+static bool prepare_packet(meshlink_handle_t *mesh, meshlink_node_t *destination, const void *data, size_t len, vpn_packet_t *packet) {
+	// Check the length before the payload is copied into the packet
+	if(len > MAXSIZE - sizeof(meshlink_packethdr_t)) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	node_t *n = (node_t *)destination;
+	bool compact = n->id && mesh->self->id;
+
+	memcpy(packet->data + (compact ? sizeof(meshlink_compacthdr_t) : sizeof(meshlink_packethdr_t)), data, len);
+	return prepare_packet_header(mesh, destination, len, packet, compact);
+}
+
+static void route_sent_packet(meshlink_handle_t *mesh, vpn_packet_t *packet) {
+	// Packets for ourself are delivered to the callbacks right away, while the packet is still in use.
+	// meshlink_send() calls from those callbacks queue their packets instead of sending them directly.
+	bool routing = mesh->routing_sent_packet;
+	mesh->routing_sent_packet = true;
+	route(mesh, mesh->self, packet);
+	mesh->routing_sent_packet = routing;
+}
+
 static bool meshlink_send_immediate(meshlink_handle_t *mesh, meshlink_node_t *destination, const void *data, size_t len) {
 	assert(mesh);
 	assert(destination);
@@ -2252,7 +2275,7 @@ static bool meshlink_send_immediate(meshlink_handle_t *mesh, meshlink_node_t *de
 	}
 
 	// Send it immediately
-	route(mesh, mesh->self, mesh->packet);
+	route_sent_packet(mesh, mesh->packet);
 
 	return true;
 }
@@ -2275,29 +2298,44 @@ bool meshlink_send(meshlink_handle_t *mesh, meshlink_node_t *destination, const
 		return false;
 	}
 
-	// Prepare the packet
-	vpn_packet_t *packet = malloc(sizeof(*packet));
+	// Callbacks run on the MeshLink thread, which would never see the queue drain, so send directly from there,
+	// unless the callback is handling a packet we sent ourself
+	if(pthread_equal(pthread_self(), mesh->thread) && !mesh->routing_sent_packet) {
+		if(pthread_mutex_lock(&mesh->mutex) != 0) {
+			abort();
+		}
+
+		// Keep packets queued earlier by other threads in order
+		meshlink_send_from_queue(&mesh->loop, mesh);
+		bool sent = meshlink_send_immediate(mesh, destination, data, len);
+		pthread_mutex_unlock(&mesh->mutex);
+		return sent;
+	}
+
+	// Prepare the packet directly in a free slot of the queue
+	vpn_packet_t *packet = meshlink_ring_reserve(&mesh->outpacketqueue);
 
 	if(!packet) {
-		meshlink_errno = MESHLINK_ENOMEM;
+		meshlink_errno = MESHLINK_EAGAIN;
 		return false;
 	}
 
-	if(!prepare_packet(mesh, destination, data, len, packet)) {
-		free(packet);
-		return false;
+	bool prepared = prepare_packet(mesh, destination, data, len, packet);
+
+	if(!prepared) {
+		// A claimed slot cannot be given back, the event loop will skip it
+		packet->len = 0;
 	}
 
-	// Queue it
-	if(!meshlink_queue_push(&mesh->outpacketqueue, packet)) {
-		free(packet);
-		meshlink_errno = MESHLINK_ENOMEM;
+	meshlink_ring_commit(&mesh->outpacketqueue, packet);
+
+	if(!prepared) {
 		return false;
 	}
 
 	logger(mesh, MESHLINK_DEBUG, "Adding packet of %zu bytes to packet queue", len);
 
-	// Notify event loop
+	// Notify event loop, triggers from other threads are coalesced until it has run
 	signal_trigger(&mesh->loop, &mesh->datafromapp);
 
 	return true;
@@ -2309,10 +2347,13 @@ void meshlink_send_from_queue(event_loop_t *loop, void *data) {
 
 	logger(mesh, MESHLINK_DEBUG, "Flushing the packet queue");
 
-	for(vpn_packet_t *packet; (packet = meshlink_queue_pop(&mesh->outpacketqueue));) {
-		logger(mesh, MESHLINK_DEBUG, "Removing packet of %d bytes from packet queue", packet->len);
-		route(mesh, mesh->self, packet);
-		free(packet);
+	for(vpn_packet_t *packet; (packet = meshlink_ring_peek(&mesh->outpacketqueue));) {
+		if(packet->len) {
+			logger(mesh, MESHLINK_DEBUG, "Removing packet of %d bytes from packet queue", packet->len);
+			route_sent_packet(mesh, packet);
+		}
+
+		meshlink_ring_release(&mesh->outpacketqueue);
 	}
 }
 
@@ -2745,6 +2786,54 @@ bool meshlink_verify(meshlink_handle_t *mesh, meshlink_node_t *source, const voi
 	return rval;
 }
 
+bool meshlink_verify_batch(meshlink_handle_t *mesh, meshlink_node_t **sources, const void *const *data, const size_t *lens, const void *const *signatures, const size_t *siglens, size_t count, bool *valid) {
+	logger(mesh, MESHLINK_DEBUG, "meshlink_verify_batch(%zu)", count);
+
+	if(!mesh || !sources || !data || !lens || !signatures || !siglens) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	for(size_t i = 0; i < count; i++) {
+		if(!sources[i] || !data[i] || !lens[i] || !signatures[i] || siglens[i] != MESHLINK_SIGLEN) {
+			meshlink_errno = MESHLINK_EINVAL;
+			return false;
+		}
+	}
+
+	if(!count) {
+		return true;
+	}
+
+	ecdsa_t **keys = xmalloc(count * sizeof(*keys));
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	bool rval = true;
+
+	for(size_t i = 0; i < count; i++) {
+		node_t *n = (node_t *)sources[i];
+
+		if(!node_read_public_key(mesh, n)) {
+			meshlink_errno = MESHLINK_EINTERNAL;
+			rval = false;
+			break;
+		}
+
+		keys[i] = n->ecdsa;
+	}
+
+	if(rval) {
+		rval = ecdsa_verify_batch(keys, data, lens, signatures, count, valid);
+	}
+
+	pthread_mutex_unlock(&mesh->mutex);
+	free(keys);
+	return rval;
+}
+
 static bool refresh_invitation_key(meshlink_handle_t *mesh) {
 	if(pthread_mutex_lock(&mesh->mutex) != 0) {
 		abort();
@@ -3946,6 +4035,35 @@ static bool channel_pre_accept(struct utcp *utcp, uint16_t port) {
 	}
 }
 
+static meshlink_channel_t *new_channel(node_t *n) {
+	meshlink_channel_t *channel = xzalloc(sizeof(*channel));
+	channel->node = n;
+	pthread_mutex_init(&channel->staging_mutex, NULL);
+	return channel;
+}
+
+static void free_channel(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
+	if(pthread_mutex_lock(&mesh->staging_mutex) != 0) {
+		abort();
+	}
+
+	if(channel->staging_queued) {
+		meshlink_channel_t **p = &mesh->staged_channels;
+
+		while(*p != channel) {
+			p = &(*p)->staging_next;
+		}
+
+		*p = channel->staging_next;
+	}
+
+	pthread_mutex_unlock(&mesh->staging_mutex);
+
+	pthread_mutex_destroy(&channel->staging_mutex);
+	free(channel->staging);
+	free(channel);
+}
+
 /* Finish one AIO buffer, return true if the channel is still open. */
 static bool aio_finish_one(meshlink_handle_t *mesh, meshlink_channel_t *channel, meshlink_aio_buffer_t **head) {
 	meshlink_aio_buffer_t *aio = *head;
@@ -3968,7 +4086,7 @@ static bool aio_finish_one(meshlink_handle_t *mesh, meshlink_channel_t *channel,
 
 		if(!channel->c) {
 			free(aio);
-			free(channel);
+			free_channel(mesh, channel);
 			return false;
 		}
 	}
@@ -4081,14 +4199,13 @@ static void channel_accept(struct utcp_connection *utcp_connection, uint16_t por
 		return;
 	}
 
-	meshlink_channel_t *channel = xzalloc(sizeof(*channel));
-	channel->node = n;
+	meshlink_channel_t *channel = new_channel(n);
 	channel->c = utcp_connection;
 
 	if(mesh->channel_accept_cb(mesh, channel, port, NULL, 0)) {
 		utcp_accept(utcp_connection, channel_recv, channel);
 	} else {
-		free(channel);
+		free_channel(mesh, channel);
 	}
 }
 
@@ -4111,7 +4228,57 @@ static ssize_t channel_send(struct utcp *utcp, const void *data, size_t len) {
 	}
 
 	meshlink_handle_t *mesh = n->mesh;
-	return meshlink_send_immediate(mesh, (meshlink_node_t *)n, data, len) ? (ssize_t)len : -1;
+
+	if(n == mesh->self) {
+		return meshlink_send_immediate(mesh, (meshlink_node_t *)n, data, len) ? (ssize_t)len : -1;
+	}
+
+	// UTCP built the segment in its packet buffer, which has room for the vpn_packet_t and our header in front of it,
+	// and for the SPTPS tag behind it. Wrap the packet around it instead of copying it.
+	size_t hdrsize = packet_header_size(n);
+	vpn_packet_t *packet = (vpn_packet_t *)((uint8_t *)data - hdrsize - offsetof(vpn_packet_t, data));
+
+	if(!prepare_packet_header(mesh, (meshlink_node_t *)n, len, packet, hdrsize == sizeof(meshlink_compacthdr_t))) {
+		return -1;
+	}
+
+	route(mesh, mesh->self, packet);
+
+	return len;
+}
+
+static void channel_timeout(event_loop_t *loop, void *data) {
+	node_t *n = data;
+	struct timespec next = utcp_timeout(n->utcp);
+	timeout_set(loop, &n->utcptimeout, &next);
+}
+
+static void channel_deadline(struct utcp *utcp, const struct timespec *timeout) {
+	node_t *n = utcp->priv;
+	struct timespec next = *timeout;
+	timeout_set(&n->mesh->loop, &n->utcptimeout, &next);
+}
+
+static bool channel_init_utcp(meshlink_handle_t *mesh, node_t *n) {
+	n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
+
+	if(!n->utcp) {
+		return false;
+	}
+
+	// Reserve room for the largest header, so we can switch headers without reallocating
+	utcp_set_packet_headroom(n->utcp, offsetof(vpn_packet_t, data) + sizeof(meshlink_packethdr_t), SPTPS_DATAGRAM_TAILROOM);
+	utcp_set_mtu(n->utcp, n->mtu - packet_header_size(n));
+	utcp_set_retransmit_cb(n->utcp, channel_retransmit);
+	utcp_set_deadline_cb(n->utcp, channel_deadline);
+	utcp_set_memory(n->utcp, &mesh->channel_memory);
+
+	// UTCP tells us when it needs to be called earlier than this
+	timeout_add(&mesh->loop, &n->utcptimeout, channel_timeout, n, &(struct timespec) {
+		3600, 0
+	});
+
+	return true;
 }
 
 void meshlink_set_channel_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, meshlink_channel_receive_cb_t cb) {
@@ -4136,6 +4303,120 @@ void channel_receive(meshlink_handle_t *mesh, meshlink_node_t *source, const voi
 	utcp_recv(n->utcp, data, len);
 }
 
+static void channel_poll(struct utcp_connection *connection, size_t len);
+
+// Only plain reliable streams can stage data. Datagrams and framed data must keep their boundaries,
+// and with MESHLINK_CHANNEL_NO_PARTIAL, meshlink_channel_send() must know right away whether everything fits.
+static bool channel_can_stage(const meshlink_channel_t *channel) {
+	return channel->c && !channel->aio_send && (channel->c->flags & (UTCP_RELIABLE | UTCP_FRAMED | UTCP_NO_PARTIAL)) == UTCP_RELIABLE;
+}
+
+// Hand data queued by meshlink_channel_send() to UTCP, and update how much more it may queue.
+// Must be called with mesh->mutex held. Returns the number of bytes that are still queued.
+// The staging mutex is not held while calling utcp_send(), application threads can keep appending data meanwhile.
+static size_t channel_flush_staging(meshlink_channel_t *channel) {
+	if(channel->staging_flushing) {
+		return channel->staging_len;
+	}
+
+	if(pthread_mutex_lock(&channel->staging_mutex) != 0) {
+		abort();
+	}
+
+	size_t head = channel->staging_head;
+	size_t len = channel->staging_len;
+	pthread_mutex_unlock(&channel->staging_mutex);
+
+	size_t sent = 0;
+	bool failed = false;
+
+	if(len) {
+		channel->staging_flushing = true;
+
+		while(sent < len) {
+			size_t offset = (head + sent) % channel->staging_size;
+			size_t todo = MIN(len - sent, channel->staging_size - offset);
+			ssize_t result = channel->c ? utcp_send(channel->c, channel->staging + offset, todo) : -1;
+
+			if(result < 0) {
+				failed = true;
+				break;
+			}
+
+			sent += result;
+
+			if((size_t)result < todo) {
+				break;
+			}
+		}
+
+		channel->staging_flushing = false;
+	}
+
+	if(pthread_mutex_lock(&channel->staging_mutex) != 0) {
+		abort();
+	}
+
+	if(failed) {
+		// Data dropped after meshlink_channel_close() or meshlink_channel_abort() was expected to be lost,
+		// otherwise the application has to find out that data it was told was sent never made it to UTCP
+		if(channel->c) {
+			logger(channel->node->mesh, MESHLINK_WARNING, "Could not send %zu bytes of staged data on channel %p", channel->staging_len - sent, (void *)channel);
+			channel->staging_failed = true;
+		}
+
+		sent = channel->staging_len;
+	}
+
+	channel->staging_len -= sent;
+	channel->staging_head = channel->staging_len ? (head + sent) % channel->staging_size : 0;
+	channel->staging_room = channel_can_stage(channel) && !channel->staging_failed ? utcp_get_sndbuf_free(channel->c) + channel->staging_len : 0;
+
+	// Only grow the buffer while it is empty, so nothing has to be moved around
+	if(!channel->staging_len && channel->staging_size < channel->staging_room) {
+		free(channel->staging);
+		channel->staging = malloc(channel->staging_room);
+		channel->staging_size = channel->staging ? channel->staging_room : 0;
+	}
+
+	size_t left = channel->staging_len;
+
+	if(left) {
+		// Try again when UTCP has room
+		utcp_set_poll_cb(channel->c, channel_poll);
+	}
+
+	pthread_mutex_unlock(&channel->staging_mutex);
+	return left;
+}
+
+void meshlink_send_from_channels(event_loop_t *loop, void *data) {
+	(void)loop;
+	meshlink_handle_t *mesh = data;
+
+	for(;;) {
+		if(pthread_mutex_lock(&mesh->staging_mutex) != 0) {
+			abort();
+		}
+
+		meshlink_channel_t *channel = mesh->staged_channels;
+
+		if(channel) {
+			mesh->staged_channels = channel->staging_next;
+			channel->staging_next = NULL;
+			channel->staging_queued = false;
+		}
+
+		pthread_mutex_unlock(&mesh->staging_mutex);
+
+		if(!channel) {
+			break;
+		}
+
+		channel_flush_staging(channel);
+	}
+}
+
 static void channel_poll(struct utcp_connection *connection, size_t len) {
 	meshlink_channel_t *channel = connection->priv;
 
@@ -4146,6 +4427,19 @@ static void channel_poll(struct utcp_connection *connection, size_t len) {
 	node_t *n = channel->node;
 	meshlink_handle_t *mesh = n->mesh;
 
+	/* Data queued by meshlink_channel_send() goes out before anything else. */
+	if(len) {
+		if(channel_flush_staging(channel)) {
+			return;
+		}
+
+		len = utcp_get_sndbuf_free(connection);
+
+		if(!len) {
+			return;
+		}
+	}
+
 	while(channel->aio_send) {
 		if(!len) {
 			/* This poll callback signalled an error, abort all outstanding AIO buffers. */
@@ -4282,9 +4576,7 @@ void meshlink_set_channel_accept_cb(meshlink_handle_t *mesh, meshlink_channel_ac
 
 	for splay_each(node_t, n, mesh->nodes) {
 		if(!n->utcp && n != mesh->self) {
-			n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
-			utcp_set_mtu(n->utcp, n->mtu - sizeof(meshlink_packethdr_t));
-			utcp_set_retransmit_cb(n->utcp, channel_retransmit);
+			channel_init_utcp(mesh, n);
 		}
 	}
 
@@ -4347,7 +4639,123 @@ void meshlink_set_channel_flags(meshlink_handle_t *mesh, meshlink_channel_t *cha
 		abort();
 	}
 
+	/* Data staged under the old flags goes out first, then staging follows the new flags */
+	if(channel->c) {
+		channel_flush_staging(channel);
+	}
+
 	utcp_set_flags(channel->c, flags);
+
+	if(channel->c) {
+		channel_flush_staging(channel);
+	}
+
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+bool meshlink_set_channel_congestion_control(meshlink_handle_t *mesh, meshlink_channel_t *channel, meshlink_congestion_control_t cc) {
+	logger(mesh, MESHLINK_DEBUG, "meshlink_set_channel_congestion_control(%p, %d)", (void *)channel, cc);
+
+	if(!mesh || !channel) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	enum utcp_cc utcp_cc;
+
+	switch(cc) {
+	case MESHLINK_CC_NEWRENO:
+		utcp_cc = UTCP_CC_NEWRENO;
+		break;
+
+	case MESHLINK_CC_CUBIC:
+		utcp_cc = UTCP_CC_CUBIC;
+		break;
+
+	case MESHLINK_CC_BBR:
+		utcp_cc = UTCP_CC_BBR;
+		break;
+
+	default:
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	bool result = utcp_set_congestion_control(channel->c, utcp_cc);
+
+	if(!result) {
+		meshlink_errno = MESHLINK_EINVAL;
+	}
+
+	pthread_mutex_unlock(&mesh->mutex);
+	return result;
+}
+
+void meshlink_set_channel_max_rate(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t rate) {
+	logger(mesh, MESHLINK_DEBUG, "meshlink_set_channel_max_rate(%p, %zu)", (void *)channel, rate);
+
+	if(!mesh || !channel) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	utcp_set_max_rate(channel->c, rate);
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void meshlink_set_channel_delayed_ack(meshlink_handle_t *mesh, meshlink_channel_t *channel, bool delayed_ack) {
+	logger(mesh, MESHLINK_DEBUG, "meshlink_set_channel_delayed_ack(%p, %d)", (void *)channel, delayed_ack);
+
+	if(!mesh || !channel) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	utcp_set_delayed_ack(channel->c, delayed_ack);
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void meshlink_set_channel_buffer_limit(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t size) {
+	logger(mesh, MESHLINK_DEBUG, "meshlink_set_channel_buffer_limit(%p, %zu)", (void *)channel, size);
+
+	if(!mesh || !channel) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	utcp_set_buffer_limit(channel->c, size);
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void meshlink_set_channel_memory_limit(meshlink_handle_t *mesh, size_t size) {
+	logger(mesh, MESHLINK_DEBUG, "meshlink_set_channel_memory_limit(%zu)", size);
+
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	mesh->channel_memory.limit = size;
 	pthread_mutex_unlock(&mesh->mutex);
 }
 
@@ -4370,11 +4778,7 @@ meshlink_channel_t *meshlink_channel_open_ex(meshlink_handle_t *mesh, meshlink_n
 	node_t *n = (node_t *)node;
 
 	if(!n->utcp) {
-		n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
-		utcp_set_mtu(n->utcp, n->mtu - sizeof(meshlink_packethdr_t));
-		utcp_set_retransmit_cb(n->utcp, channel_retransmit);
-
-		if(!n->utcp) {
+		if(!channel_init_utcp(mesh, n)) {
 			meshlink_errno = errno == ENOMEM ? MESHLINK_ENOMEM : MESHLINK_EINTERNAL;
 			pthread_mutex_unlock(&mesh->mutex);
 			return NULL;
@@ -4388,8 +4792,7 @@ meshlink_channel_t *meshlink_channel_open_ex(meshlink_handle_t *mesh, meshlink_n
 		return NULL;
 	}
 
-	meshlink_channel_t *channel = xzalloc(sizeof(*channel));
-	channel->node = n;
+	meshlink_channel_t *channel = new_channel(n);
 	channel->receive_cb = cb;
 
 	if(data && !len) {
@@ -4402,7 +4805,7 @@ meshlink_channel_t *meshlink_channel_open_ex(meshlink_handle_t *mesh, meshlink_n
 
 	if(!channel->c) {
 		meshlink_errno = errno == ENOMEM ? MESHLINK_ENOMEM : MESHLINK_EINTERNAL;
-		free(channel);
+		free_channel(mesh, channel);
 		return NULL;
 	}
 
@@ -4427,6 +4830,11 @@ void meshlink_channel_shutdown(meshlink_handle_t *mesh, meshlink_channel_t *chan
 		abort();
 	}
 
+	/* Data accepted by meshlink_channel_send() still has to be sent before the FIN. */
+	if(channel->c && direction != SHUT_RD) {
+		channel_flush_staging(channel);
+	}
+
 	utcp_shutdown(channel->c, direction);
 	pthread_mutex_unlock(&mesh->mutex);
 }
@@ -4444,8 +4852,12 @@ void meshlink_channel_close(meshlink_handle_t *mesh, meshlink_channel_t *channel
 	}
 
 	if(channel->c) {
+		/* Data accepted by meshlink_channel_send() still has to be sent before the FIN. */
+		channel_flush_staging(channel);
+
 		utcp_close(channel->c);
 		channel->c = NULL;
+		channel_flush_staging(channel);
 
 		/* Clean up any outstanding AIO buffers. */
 		aio_abort(mesh, channel, &channel->aio_send);
@@ -4453,7 +4865,7 @@ void meshlink_channel_close(meshlink_handle_t *mesh, meshlink_channel_t *channel
 	}
 
 	if(!channel->in_callback) {
-		free(channel);
+		free_channel(mesh, channel);
 	}
 
 	pthread_mutex_unlock(&mesh->mutex);
@@ -4475,18 +4887,69 @@ void meshlink_channel_abort(meshlink_handle_t *mesh, meshlink_channel_t *channel
 		utcp_abort(channel->c);
 		channel->c = NULL;
 
+		/* Drop staged data, and stop meshlink_channel_send() from staging more */
+		channel_flush_staging(channel);
+
 		/* Clean up any outstanding AIO buffers. */
 		aio_abort(mesh, channel, &channel->aio_send);
 		aio_abort(mesh, channel, &channel->aio_receive);
 	}
 
 	if(!channel->in_callback) {
-		free(channel);
+		free_channel(mesh, channel);
 	}
 
 	pthread_mutex_unlock(&mesh->mutex);
 }
 
+// Copy data into the channel's staging buffer, as much as fits in the send buffer according to the MeshLink thread.
+// Returns the number of bytes staged, 0 if the caller should take the slow path, or -1 if staged data could not be sent earlier.
+static ssize_t channel_stage(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	if(pthread_mutex_lock(&channel->staging_mutex) != 0) {
+		abort();
+	}
+
+	if(channel->staging_failed) {
+		pthread_mutex_unlock(&channel->staging_mutex);
+		return -1;
+	}
+
+	size_t room = MIN(channel->staging_room, channel->staging_size) - channel->staging_len;
+
+	if(len > room) {
+		len = room;
+	}
+
+	if(len) {
+		size_t tail = (channel->staging_head + channel->staging_len) % channel->staging_size;
+		size_t first = MIN(len, channel->staging_size - tail);
+		memcpy(channel->staging + tail, data, first);
+		memcpy(channel->staging, (const char *)data + first, len - first);
+		channel->staging_len += len;
+
+		if(pthread_mutex_lock(&mesh->staging_mutex) != 0) {
+			abort();
+		}
+
+		bool wakeup = !channel->staging_queued;
+
+		if(wakeup) {
+			channel->staging_next = mesh->staged_channels;
+			mesh->staged_channels = channel;
+			channel->staging_queued = true;
+		}
+
+		pthread_mutex_unlock(&mesh->staging_mutex);
+
+		if(wakeup) {
+			signal_trigger(&mesh->loop, &mesh->datafromchannels);
+		}
+	}
+
+	pthread_mutex_unlock(&channel->staging_mutex);
+	return len;
+}
+
 ssize_t meshlink_channel_send(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
 	logger(mesh, MESHLINK_DEBUG, "meshlink_channel_send(%p, %p, %zu)", (void *)channel, data, len);
 
@@ -4504,17 +4967,27 @@ ssize_t meshlink_channel_send(meshlink_handle_t *mesh, meshlink_channel_t *chann
 		return -1;
 	}
 
-	// TODO: more finegrained locking.
-	// Ideally we want to put the data into the UTCP connection's send buffer.
-	// Then, preferably only if there is room in the receiver window,
-	// kick the meshlink thread to go send packets.
+	// If the MeshLink thread is busy, don't wait for it.
+	// Copy the data to the channel's staging buffer instead, and let the MeshLink thread put it in the send buffer.
+	if(pthread_mutex_trylock(&mesh->mutex) != 0) {
+		ssize_t staged = channel_stage(mesh, channel, data, len);
 
-	ssize_t retval;
+		if(staged < 0) {
+			meshlink_errno = MESHLINK_ENETWORK;
+			return -1;
+		}
 
-	if(pthread_mutex_lock(&mesh->mutex) != 0) {
-		abort();
+		if(staged > 0) {
+			return staged;
+		}
+
+		if(pthread_mutex_lock(&mesh->mutex) != 0) {
+			abort();
+		}
 	}
 
+	ssize_t retval;
+
 	/* Disallow direct calls to utcp_send() while we still have AIO active. */
 	if(channel->aio_send) {
 		retval = 0;
@@ -4524,7 +4997,21 @@ ssize_t meshlink_channel_send(meshlink_handle_t *mesh, meshlink_channel_t *chann
 			meshlink_errno = MESHLINK_ENETWORK;
 			retval = -1;
 		} else {
-			retval = utcp_send(channel->c, data, len);
+			size_t staged = channel_flush_staging(channel);
+
+			if(channel->staging_failed) {
+				/* Data accepted earlier without holding the mutex could not be sent */
+				retval = -1;
+			} else if((channel->c->flags & UTCP_NO_PARTIAL) && len > utcp_get_sndbuf(channel->c)) {
+				/* The message would never fit, even if the send buffer was empty */
+				retval = -1;
+			} else if(staged) {
+				/* Staged data has to go first, and it already fills the send buffer */
+				retval = 0;
+			} else {
+				retval = utcp_send(channel->c, data, len);
+				channel_flush_staging(channel);
+			}
 		}
 	}
 
@@ -4569,6 +5056,9 @@ bool meshlink_channel_aio_send(meshlink_handle_t *mesh, meshlink_channel_t *chan
 
 	*p = aio;
 
+	/* Stop meshlink_channel_send() from queueing data without holding the mutex */
+	channel_flush_staging(channel);
+
 	/* Ensure the poll callback is set, and call it right now to push data if possible */
 	utcp_set_poll_cb(channel->c, channel_poll);
 	size_t todo = MIN(len, utcp_get_sndbuf_free(channel->c));
@@ -4614,6 +5104,9 @@ bool meshlink_channel_aio_fd_send(meshlink_handle_t *mesh, meshlink_channel_t *c
 
 	*p = aio;
 
+	/* Stop meshlink_channel_send() from queueing data without holding the mutex */
+	channel_flush_staging(channel);
+
 	/* Ensure the poll callback is set, and call it right now to push data if possible */
 	utcp_set_poll_cb(channel->c, channel_poll);
 	size_t left = utcp_get_sndbuf_free(channel->c);
@@ -4752,9 +5245,7 @@ void meshlink_set_node_channel_timeout(meshlink_handle_t *mesh, meshlink_node_t
 	}
 
 	if(!n->utcp) {
-		n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
-		utcp_set_mtu(n->utcp, n->mtu - sizeof(meshlink_packethdr_t));
-		utcp_set_retransmit_cb(n->utcp, channel_retransmit);
+		channel_init_utcp(mesh, n);
 	}
 
 	utcp_set_user_timeout(n->utcp, timeout);
@@ -4764,9 +5255,7 @@ void meshlink_set_node_channel_timeout(meshlink_handle_t *mesh, meshlink_node_t
 
 void update_node_status(meshlink_handle_t *mesh, node_t *n) {
 	if(n->status.reachable && mesh->channel_accept_cb && !n->utcp) {
-		n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
-		utcp_set_mtu(n->utcp, n->mtu - sizeof(meshlink_packethdr_t));
-		utcp_set_retransmit_cb(n->utcp, channel_retransmit);
+		channel_init_utcp(mesh, n);
 	}
 
 	if(mesh->node_status_cb) {
@@ -4778,8 +5267,19 @@ void update_node_status(meshlink_handle_t *mesh, node_t *n) {
 	}
 }
 
+void set_node_compact(node_t *n, bool compact) {
+	size_t oldsize = packet_header_size(n);
+	n->status.compact = compact;
+	size_t newsize = packet_header_size(n);
+
+	// Keep channel segments within the same packet size when the header size changes
+	if(n->utcp && newsize != oldsize) {
+		utcp_set_mtu(n->utcp, utcp_get_mtu(n->utcp) + oldsize - newsize);
+	}
+}
+
 void update_node_pmtu(meshlink_handle_t *mesh, node_t *n) {
-	utcp_set_mtu(n->utcp, (n->minmtu > MINMTU ? n->minmtu : MINMTU) - sizeof(meshlink_packethdr_t));
+	utcp_set_mtu(n->utcp, (n->minmtu > MINMTU ? n->minmtu : MINMTU) - packet_header_size(n));
 
 	if(mesh->node_pmtu_cb && !n->status.blacklisted) {
 		mesh->node_pmtu_cb(mesh, (meshlink_node_t *)n, n->minmtu);
@@ -71,7 +71,8 @@ typedef enum {
 	MESHLINK_EPEER,        ///< A peer caused an error
 	MESHLINK_ENOTSUP,      ///< The operation is not supported in the current configuration of MeshLink
 	MESHLINK_EBUSY,        ///< The MeshLink instance is already in use by another process
-	MESHLINK_EBLACKLISTED  ///< The operation is not allowed because the node is blacklisted
+	MESHLINK_EBLACKLISTED, ///< The operation is not allowed because the node is blacklisted
+	MESHLINK_EAGAIN        ///< The operation could not be completed right now, but might succeed if retried later
 } meshlink_errno_t;
 
 /// Device class
@@ -90,6 +91,13 @@ typedef enum {
 	MESHLINK_STORAGE_KEYS_ONLY   ///< Only store updates when a node's key has changed.
 } meshlink_storage_policy_t;
 
+/// Channel congestion control algorithms
+typedef enum {
+	MESHLINK_CC_NEWRENO,         ///< Loss based NewReno, the default.
+	MESHLINK_CC_CUBIC,           ///< Loss based CUBIC, which recovers faster on paths with a large bandwidth-delay product.
+	MESHLINK_CC_BBR              ///< Delivery rate based, which does not back off on random packet loss.
+} meshlink_congestion_control_t;
+
 /// Invitation flags
 static const uint32_t MESHLINK_INVITE_LOCAL = 1;    // Only use local addresses in the URL
 static const uint32_t MESHLINK_INVITE_PUBLIC = 2;   // Only use public or canonical addresses in the URL
@@ -217,6 +225,19 @@ bool meshlink_open_params_set_storage_policy(meshlink_open_params_t *params, mes
  */
 bool meshlink_open_params_set_lock_filename(meshlink_open_params_t *params, const char *filename) __attribute__((__warn_unused_result__));
 
+/// Set the size of the queue of packets sent with meshlink_send().
+/** This function changes the number of packets that meshlink_send() can queue when called from other threads than MeshLink's own,
+ *  before the MeshLink thread has had a chance to send them. When the queue is full, meshlink_send() fails with MESHLINK_EAGAIN.
+ *  The memory for the queue is allocated up front, each entry takes a bit more than the maximum packet size.
+ *  The default size is 256 packets.
+ *
+ *  @param params   A pointer to a meshlink_open_params_t which must have been created earlier with meshlink_open_params_init().
+ *  @param size     The number of packets that can be queued, between 1 and 65536. It is rounded up to a power of two.
+ *
+ *  @return         This function will return true if the open parameters have been successfully updated, false otherwise.
+ */
+bool meshlink_open_params_set_send_queue_size(meshlink_open_params_t *params, size_t size) __attribute__((__warn_unused_result__));
+
 /// Open or create a MeshLink instance.
 /** This function opens or creates a MeshLink instance.
  *  All parameters needed by MeshLink are passed via a meshlink_open_params_t struct,
@@ -650,6 +671,10 @@ void meshlink_set_thread_status_cb(struct meshlink_handle *mesh, meshlink_thread
  *  @param len          The length of the data.
  *  @return             This function will return true if MeshLink has queued the message for transmission, and false otherwise.
  *                      A return value of true does not guarantee that the message will actually arrive at the destination.
+ *                      Packets sent from other threads than MeshLink's own are queued, see meshlink_open_params_set_send_queue_size().
+ *                      If this queue is full, meshlink_errno is set to MESHLINK_EAGAIN.
+ *                      The application can then retry later, or drop the packet.
+ *                      Packets sent from callbacks called by MeshLink are sent immediately, and never fail with MESHLINK_EAGAIN.
  */
 bool meshlink_send(struct meshlink_handle *mesh, struct meshlink_node *destination, const void *data, size_t len) __attribute__((__warn_unused_result__));
 
@@ -922,6 +947,30 @@ bool meshlink_get_node_reachability(struct meshlink_handle *mesh, struct meshlin
  */
 bool meshlink_verify(struct meshlink_handle *mesh, struct meshlink_node *source, const void *data, size_t len, const void *signature, size_t siglen) __attribute__((__warn_unused_result__));
 
+/// Verify multiple signatures generated by other nodes at once.
+/** This function verifies a number of signatures that other nodes generated for pieces of data.
+ *  This is faster than calling meshlink_verify() for each signature separately.
+ *
+ *  Multiple signatures are checked together with the cofactored Ed25519 verification equation, while meshlink_verify() uses the cofactorless one.
+ *  A signature that differs from a valid one only by a small order component may therefore be accepted here but rejected by meshlink_verify().
+ *  Creating such a signature requires the signer's private key, so it does not allow forgeries.
+ *  Applications that need every signature to have exactly one valid encoding should use meshlink_verify() instead.
+ *
+ *  \memberof meshlink_handle
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param sources      An array of @a count pointers to struct meshlink_node describing the source of each signature.
+ *  @param data         An array of @a count pointers to buffers containing the data to be verified.
+ *  @param lens         An array of @a count lengths of the data to be verified.
+ *  @param signatures   An array of @a count pointers to buffers where the signatures are stored.
+ *  @param siglens      An array of @a count sizes of the signatures.
+ *  @param count        The number of signatures to verify.
+ *  @param valid        A pointer to an array of @a count booleans that will be set to indicate which signatures are valid.
+ *                      Pass NULL to only check whether all signatures are valid.
+ *
+ *  @return             This function returns true if all signatures are valid, false otherwise.
+ */
+bool meshlink_verify_batch(struct meshlink_handle *mesh, struct meshlink_node **sources, const void *const *data, const size_t *lens, const void *const *signatures, const size_t *siglens, size_t count, bool *valid) __attribute__((__warn_unused_result__));
+
 /// Set the canonical Address for a node.
 /** This function sets the canonical Address for a node.
  *  This address is stored permanently until it is changed by another call to this function,
@@ -1501,6 +1550,75 @@ void meshlink_set_channel_rcvbuf_storage(struct meshlink_handle *mesh, struct me
  */
 void meshlink_set_channel_flags(struct meshlink_handle *mesh, struct meshlink_channel *channel, uint32_t flags);
 
+/// Set the congestion control algorithm of a channel.
+/** This function selects the algorithm that determines how fast data is sent on a channel.
+ *  It only affects data sent by the local side of the channel.
+ *  The change takes effect immediately, and resets the algorithm's estimate of the path.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param channel   A handle for the channel.
+ *  @param cc        The congestion control algorithm to use.
+ *
+ *  @return          This function will return true if the algorithm was changed, false otherwise.
+ */
+bool meshlink_set_channel_congestion_control(struct meshlink_handle *mesh, struct meshlink_channel *channel, meshlink_congestion_control_t cc);
+
+/// Set the maximum rate at which data is sent on a channel.
+/** Data sent on reliable channels is paced, so that it is spread evenly over time instead of being sent in bursts.
+ *  This function additionally limits the rate to the given value, even if the network could handle more.
+ *  It only affects data sent by the local side of the channel, and has no effect on UDP channels.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param channel   A handle for the channel.
+ *  @param rate      The maximum rate in bytes per second, or 0 for no limit.
+ */
+void meshlink_set_channel_max_rate(struct meshlink_handle *mesh, struct meshlink_channel *channel, size_t rate);
+
+/// Enable or disable delayed acknowledgements on a channel.
+/** When data is received on a reliable channel, the acknowledgement is normally held back for a short time,
+ *  until a second packet arrives or the application sends data back that can carry it.
+ *  This halves the number of packets sent in the reverse direction during bulk transfers.
+ *  Out-of-order data is always acknowledged immediately.
+ *  Delayed acknowledgements are enabled by default, and are only used if the peer supports them.
+ *  Disabling them can reduce latency for applications that send single messages and wait for them to be acknowledged.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param channel      A handle for the channel.
+ *  @param delayed_ack  True if acknowledgements may be delayed, false if they should be sent immediately.
+ */
+void meshlink_set_channel_delayed_ack(struct meshlink_handle *mesh, struct meshlink_channel *channel, bool delayed_ack);
+
+/// Set the maximum size to which the buffers of a channel may grow automatically.
+/** Unless the application sets their sizes explicitly, the send and receive buffers of a reliable channel
+ *  start at their default size and are grown automatically as needed to keep the network path full,
+ *  based on the measured round-trip time and the amount of data in flight.
+ *  This function limits how large each of the buffers may become. The default limit is 4 MiB.
+ *  Buffers that have already grown beyond the new limit are shrunk as far as their contents allow.
+ *  Buffers never shrink below their default size, so a limit of 0 disables automatic growth.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param channel   A handle for the channel.
+ *  @param size      The maximum size of each buffer in bytes.
+ */
+void meshlink_set_channel_buffer_limit(struct meshlink_handle *mesh, struct meshlink_channel *channel, size_t size);
+
+/// Limit the total memory used by automatically grown channel buffers.
+/** This limits the memory that all channels of a MeshLink instance together may use beyond their default buffer sizes.
+ *  When the limit is reached, buffers are no longer grown, and channels shrink their buffers back towards what they need.
+ *  Buffers whose sizes have been set explicitly by the application do not count towards this limit.
+ *  Like the tcp_mem setting of the Linux kernel, this protects the system from running out of memory when many channels are busy.
+ *  The default limit is 64 MiB, which lets 8 channels grow both of their buffers to the default per-buffer limit of 4 MiB.
+ *
+ *  \memberof meshlink_handle
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param size      The maximum amount of memory in bytes, or 0 for no limit.
+ */
+void meshlink_set_channel_memory_limit(struct meshlink_handle *mesh, size_t size);
+
 /// Open a reliable stream channel to another node.
 /** This function is called whenever a remote node wants to open a channel to the local node.
  *  The application then has to decide whether to accept or reject this channel.
@@ -1609,6 +1727,9 @@ void meshlink_channel_abort(struct meshlink_handle *mesh, struct meshlink_channe
  *  @return             The amount of data that was queued, which can be less than len, or a negative value in case of an error.
  *                      If MESHLINK_CHANNEL_NO_PARTIAL is set, then the result will either be len,
  *                      0 if the buffer is currently too full, or -1 if len is too big even for an empty buffer.
+ *                      While the MeshLink thread is busy, data sent on reliable stream channels is handed over to it later.
+ *                      If that fails, for example because the remote node has closed the channel in the meantime,
+ *                      this and all further calls return -1.
  */
 ssize_t meshlink_channel_send(struct meshlink_handle *mesh, struct meshlink_channel *channel, const void *data, size_t len) __attribute__((__warn_unused_result__));
 
@@ -30,14 +30,21 @@
 #include "hash.h"
 #include "meshlink.h"
 #include "meshlink_queue.h"
+#include "meshlink_ring.h"
 #include "sockaddr.h"
 #include "sptps.h"
+#include "utcp.h"
 #include "xoshiro.h"
 
 #include <pthread.h>
 
 #define MAXSOCKETS 4    /* Probably overkill... */
 
+#define OUTPACKETQUEUE_SIZE 256 /* Default number of packets meshlink_send() can queue, must be a power of two */
+#define MAX_OUTPACKETQUEUE_SIZE 65536
+
+#define DEFAULT_CHANNEL_MEMORY_LIMIT 67108864 /* Default memory all channel buffers together may grow beyond their default sizes */
+
 static const char meshlink_invitation_label[] = "MeshLink invitation";
 static const char meshlink_tcp_label[] = "MeshLink TCP";
 static const char meshlink_udp_label[] = "MeshLink UDP";
@@ -50,6 +57,7 @@ typedef struct listen_socket_t {
 	struct io_t udp;
 	sockaddr_t sa;
 	sockaddr_t broadcast_sa;
+	struct udp_tx_queue *txq;
 } listen_socket_t;
 
 struct meshlink_open_params {
@@ -64,6 +72,7 @@ struct meshlink_open_params {
 	const void *key;
 	size_t keylen;
 	meshlink_storage_policy_t storage_policy;
+	size_t send_queue_size;
 };
 
 /// Device class traits
@@ -97,18 +106,53 @@ struct meshlink_handle {
 	listen_socket_t listen_socket[MAXSOCKETS];
 
 	meshlink_receive_cb_t receive_cb;
-	meshlink_queue_t outpacketqueue;
+	meshlink_ring_t outpacketqueue;
 	signal_t datafromapp;
+	bool routing_sent_packet;
+
+	// Channels with data queued by meshlink_channel_send() while the MeshLink thread was busy
+	pthread_mutex_t staging_mutex;
+	struct meshlink_channel *staged_channels;
+	signal_t datafromchannels;
 
 	hash_t *node_udp_cache;
 
+	// Batched UDP receive
+	unsigned int udp_rx_batch;
+	struct udp_rx_ring *udp_rx_ring;
+	uint64_t udp_rx_packets;
+	uint64_t udp_rx_syscalls;
+	uint64_t udp_rx_unknown;
+	uint64_t udp_rx_hard_tries;
+	struct node_t *udp_rx_last_node; // Sender of the previous packet in the batch being handled
+	const sockaddr_t *udp_rx_last_from;
+
+	// Batched UDP transmit
+	uint64_t udp_tx_packets;
+	uint64_t udp_tx_syscalls;
+	uint64_t udp_tx_gso;
+	int udp_tx_gso_error; // Makes segmentation offload fail with this error, for testing
+
+	// Memory used by automatically grown channel buffers, shared by all nodes
+	struct utcp_memory channel_memory;
+
 	struct splay_tree_t *nodes;
 	struct splay_tree_t *edges;
 
+	// Node IDs used in compact packet headers
+	struct node_t **node_ids;
+	uint32_t node_ids_size;
+	uint32_t node_ids_count;
+	uint32_t next_node_id;
+
 	struct list_t *connections;
 	struct list_t *outgoings;
 	struct list_t *submeshes;
 
+	// Meta-connections with a handshake signature waiting to be verified in a batch
+	struct list_t *pending_verifications;
+	timeout_t verify_timeout;
+
 	// Meta-connection-related members
 	struct splay_tree_t *past_request_tree;
 	timeout_t past_request_timeout;
@@ -122,6 +166,11 @@ struct meshlink_handle {
 	time_t last_unreachable;
 	timeout_t pingtimer;
 	timeout_t periodictimer;
+	timeout_t renewaltimer;
+
+	unsigned int key_renewal_rate;
+	unsigned int key_renewals_postponed;
+	uint64_t key_renewals;
 
 	struct connection_t *everyone;
 	uint64_t prng_state[4];
@@ -196,6 +245,20 @@ struct meshlink_handle {
 	meshlink_queue_t adns_queue;
 	meshlink_queue_t adns_done_queue;
 	signal_t adns_signal;
+
+	// Packet workers
+	unsigned int packet_worker_threads;
+	unsigned int packet_worker_count;
+	struct packet_worker *packet_workers;
+	signal_t packet_workers_signal;
+
+	// Crypto worker
+	bool crypto_worker;
+	pthread_t crypto_thread;
+	pthread_cond_t crypto_cond;
+	meshlink_queue_t crypto_queue;
+	meshlink_queue_t crypto_done_queue;
+	signal_t crypto_signal;
 };
 
 /// A handle for a MeshLink node.
@@ -235,6 +298,18 @@ struct meshlink_channel {
 	meshlink_aio_buffer_t *aio_receive;
 	meshlink_channel_receive_cb_t receive_cb;
 	meshlink_channel_poll_cb_t poll_cb;
+
+	// Ring buffer with data accepted by meshlink_channel_send() without holding mesh->mutex
+	pthread_mutex_t staging_mutex;
+	char *staging;
+	size_t staging_size;
+	size_t staging_head;
+	size_t staging_len;
+	size_t staging_room;                    /* Free space in the send buffer when the MeshLink thread last looked, including staging_len */
+	bool staging_failed;                    /* Staged data could not be sent, the next meshlink_channel_send() fails */
+	bool staging_flushing;                  /* Protected by mesh->mutex */
+	struct meshlink_channel *staging_next;  /* Protected by mesh->staging_mutex */
+	bool staging_queued;                    /* Protected by mesh->staging_mutex */
 };
 
 /// Header for data packets routed between nodes
@@ -243,9 +318,22 @@ typedef struct meshlink_packethdr {
 	uint8_t source[16];
 } __attribute__((__packed__)) meshlink_packethdr_t;
 
+/// Compact header for data packets, used when the receiver announced support for it.
+/// The marker is always 0, which can never be the first byte of a node name in a meshlink_packethdr_t.
+/// Node IDs are those of the sender, in network byte order.
+typedef struct meshlink_compacthdr {
+	uint8_t marker;
+	uint8_t reserved;
+	uint16_t destination;
+	uint16_t source;
+	uint16_t reserved2;
+} __attribute__((__packed__)) meshlink_compacthdr_t;
+
 void meshlink_send_from_queue(event_loop_t *loop, void *mesh);
+void meshlink_send_from_channels(event_loop_t *loop, void *mesh);
 void update_node_status(meshlink_handle_t *mesh, struct node_t *n);
 void update_node_pmtu(meshlink_handle_t *mesh, struct node_t *n);
+void set_node_compact(struct node_t *n, bool compact);
 extern meshlink_log_level_t global_log_level;
 extern meshlink_log_cb_t global_log_cb;
 void handle_duplicate_node(meshlink_handle_t *mesh, struct node_t *n);
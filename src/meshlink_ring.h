@@ -0,0 +1,206 @@
+#ifndef MESHLINK_RING_H
+#define MESHLINK_RING_H
+
+/*
+    meshlink_ring.h -- Bounded multi-producer, single-consumer ring of fixed-size slots
+    Copyright (C) 2026 MeshLink contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Each slot has a sequence number that tells its state to producers and the consumer.
+ * It is equal to the position a producer can claim it for, one more than that once the data is committed,
+ * and it advances by the size of the ring once the consumer has released it.
+ * Producers claim positions with a compare-and-swap, the single consumer does not need any atomic read-modify-write.
+ * Without <stdatomic.h>, a mutex protects the positions instead.
+ */
+
+typedef struct meshlink_ring_slot {
+#ifdef HAVE_STDATOMIC_H
+	atomic_size_t seq;
+#else
+	size_t seq;
+#endif
+	max_align_t data[];
+} meshlink_ring_slot_t;
+
+typedef struct meshlink_ring {
+	char *slots;
+	size_t stride;
+	size_t mask;
+#ifdef HAVE_STDATOMIC_H
+	atomic_size_t head;
+#else
+	size_t head;
+	pthread_mutex_t mutex;
+#endif
+	size_t tail;
+} meshlink_ring_t;
+
+static inline meshlink_ring_slot_t *meshlink_ring_slot(meshlink_ring_t *ring, size_t pos) {
+	return (meshlink_ring_slot_t *)(ring->slots + (pos & ring->mask) * ring->stride);
+}
+
+static inline meshlink_ring_slot_t *meshlink_ring_data_slot(void *data) {
+	return (meshlink_ring_slot_t *)((char *)data - offsetof(meshlink_ring_slot_t, data));
+}
+
+/// Allocate a ring of size slots of slot_size bytes each. The size must be a power of two.
+static inline __attribute__((__warn_unused_result__)) bool meshlink_ring_init(meshlink_ring_t *ring, size_t size, size_t slot_size) {
+	ring->stride = (sizeof(meshlink_ring_slot_t) + slot_size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+	ring->mask = size - 1;
+	ring->slots = malloc(size * ring->stride);
+
+	if(!ring->slots) {
+		return false;
+	}
+
+	for(size_t i = 0; i < size; i++) {
+#ifdef HAVE_STDATOMIC_H
+		atomic_init(&meshlink_ring_slot(ring, i)->seq, i);
+#else
+		meshlink_ring_slot(ring, i)->seq = i;
+#endif
+	}
+
+#ifdef HAVE_STDATOMIC_H
+	atomic_init(&ring->head, 0);
+#else
+	ring->head = 0;
+	pthread_mutex_init(&ring->mutex, NULL);
+#endif
+	ring->tail = 0;
+	return true;
+}
+
+static inline void meshlink_ring_exit(meshlink_ring_t *ring) {
+	if(!ring->slots) {
+		return;
+	}
+
+#ifndef HAVE_STDATOMIC_H
+	pthread_mutex_destroy(&ring->mutex);
+#endif
+	free(ring->slots);
+	ring->slots = NULL;
+}
+
+/// Claim a free slot and return a pointer to its data, or NULL if the ring is full. Called by producers.
+static inline __attribute__((__warn_unused_result__)) void *meshlink_ring_reserve(meshlink_ring_t *ring) {
+#ifdef HAVE_STDATOMIC_H
+	size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	for(;;) {
+		meshlink_ring_slot_t *slot = meshlink_ring_slot(ring, pos);
+		size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		intptr_t dif = (intptr_t)(seq - pos);
+
+		if(dif == 0) {
+			// The slot is free, try to claim it. On failure, pos is updated to the current head.
+			if(atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+				return slot->data;
+			}
+		} else if(dif < 0) {
+			// The consumer has not released this slot yet
+			return NULL;
+		} else {
+			// Another producer claimed it first
+			pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		}
+	}
+
+#else
+
+	if(pthread_mutex_lock(&ring->mutex) != 0) {
+		abort();
+	}
+
+	meshlink_ring_slot_t *slot = meshlink_ring_slot(ring, ring->head);
+	void *data = NULL;
+
+	if(slot->seq == ring->head) {
+		ring->head++;
+		data = slot->data;
+	}
+
+	pthread_mutex_unlock(&ring->mutex);
+	return data;
+#endif
+}
+
+/// Make the data in a slot returned by meshlink_ring_reserve() available to the consumer.
+static inline void meshlink_ring_commit(meshlink_ring_t *ring, void *data) {
+	(void)ring;
+	meshlink_ring_slot_t *slot = meshlink_ring_data_slot(data);
+
+#ifdef HAVE_STDATOMIC_H
+	size_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+#else
+
+	if(pthread_mutex_lock(&ring->mutex) != 0) {
+		abort();
+	}
+
+	slot->seq++;
+	pthread_mutex_unlock(&ring->mutex);
+#endif
+}
+
+/// Return the data of the oldest committed slot, or NULL if there is none. Called by the consumer.
+static inline __attribute__((__warn_unused_result__)) void *meshlink_ring_peek(meshlink_ring_t *ring) {
+	meshlink_ring_slot_t *slot = meshlink_ring_slot(ring, ring->tail);
+
+#ifdef HAVE_STDATOMIC_H
+	size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+#else
+
+	if(pthread_mutex_lock(&ring->mutex) != 0) {
+		abort();
+	}
+
+	size_t seq = slot->seq;
+	pthread_mutex_unlock(&ring->mutex);
+#endif
+
+	return seq == ring->tail + 1 ? slot->data : NULL;
+}
+
+/// Give the slot returned by meshlink_ring_peek() back to the producers.
+static inline void meshlink_ring_release(meshlink_ring_t *ring) {
+	meshlink_ring_slot_t *slot = meshlink_ring_slot(ring, ring->tail);
+	size_t seq = ring->tail + ring->mask + 1;
+	ring->tail++;
+
+#ifdef HAVE_STDATOMIC_H
+	atomic_store_explicit(&slot->seq, seq, memory_order_release);
+#else
+
+	if(pthread_mutex_lock(&ring->mutex) != 0) {
+		abort();
+	}
+
+	slot->seq = seq;
+	pthread_mutex_unlock(&ring->mutex);
+#endif
+}
+
+#endif
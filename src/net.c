@@ -130,18 +130,6 @@ static void timeout_handler(event_loop_t *loop, void *data) {
 			}
 		}
 
-		if(c->status.active && c->last_key_renewal + 3600 < mesh->loop.now.tv_sec) {
-			devtool_sptps_renewal_probe((meshlink_node_t *)c->node);
-
-			if(!sptps_force_kex(&c->sptps)) {
-				logger(mesh, MESHLINK_ERROR, "SPTPS key renewal for connection with %s failed", c->name);
-				terminate_connection(mesh, c, true);
-				continue;
-			} else {
-				c->last_key_renewal = mesh->loop.now.tv_sec;
-			}
-		}
-
 		if(c->last_ping_time + pingtimeout < mesh->loop.now.tv_sec) {
 			if(c->status.active) {
 				if(c->status.pinged) {
@@ -626,25 +614,161 @@ static void periodic_handler(event_loop_t *loop, void *data) {
 				logger(mesh, MESHLINK_DEBUG, "Could not update %s", n->name);
 			}
 		}
+	}
 
-		if(n->status.reachable && n->status.validkey && n->last_req_key + 3600 < mesh->loop.now.tv_sec) {
-			logger(mesh, MESHLINK_DEBUG, "SPTPS key renewal for node %s", n->name);
-			devtool_sptps_renewal_probe((meshlink_node_t *)n);
+	timeout_set(&mesh->loop, data, &(struct timespec) {
+		timeout, prng(mesh, TIMER_FUDGE)
+	});
+}
 
-			if(!sptps_force_kex(&n->sptps)) {
-				logger(mesh, MESHLINK_ERROR, "SPTPS key renewal for node %s failed", n->name);
-				n->status.validkey = false;
-				sptps_stop(&n->sptps);
-				n->status.waitingforkey = false;
-				n->last_req_key = -3600;
-			} else {
-				n->last_req_key = mesh->loop.now.tv_sec;
-			}
+/* SPTPS keys are renewed once per KEY_RENEWAL_INTERVAL, at a random point in the last KEY_RENEWAL_JITTER seconds of it,
+ * so sessions that were started at the same time do not all renew at the same time.
+ * At most key_renewal_rate renewals are started per second. If more are due, the sessions that
+ * carried the least traffic since their previous renewal go first, the others are postponed.
+ */
+
+typedef struct renewal_candidate {
+	node_t *node;                   // Set for UDP sessions
+	connection_t *connection;       // Set for meta-connections
+	uint64_t traffic;
+} renewal_candidate_t;
+
+static uint64_t node_traffic(const node_t *n) {
+	return n->in_data + n->out_data + n->in_forward + n->out_forward;
+}
+
+static uint64_t connection_traffic(const connection_t *c) {
+	return c->node ? c->node->in_meta + c->node->out_meta : 0;
+}
+
+// The counters can be reset by devtool_reset_node_counters()
+static uint64_t traffic_since(uint64_t now, uint64_t then) {
+	return now >= then ? now - then : now;
+}
+
+time_t node_key_renewal_time(const node_t *n) {
+	return n->last_req_key + KEY_RENEWAL_INTERVAL - n->key_renewal_jitter;
+}
+
+time_t connection_key_renewal_time(const connection_t *c) {
+	return c->last_key_renewal + KEY_RENEWAL_INTERVAL - c->key_renewal_jitter;
+}
+
+static bool renewing(const sptps_t *s) {
+	return s->outstate && s->state != SPTPS_SECONDARY_KEX;
+}
+
+unsigned int key_renewals_in_flight(meshlink_handle_t *mesh) {
+	unsigned int count = 0;
+
+	for splay_each(node_t, n, mesh->nodes) {
+		count += n->status.validkey && renewing(&n->sptps);
+	}
+
+	for list_each(connection_t, c, mesh->connections) {
+		count += c->status.active && renewing(&c->sptps);
+	}
+
+	return count;
+}
+
+static int renewal_candidate_compare(const void *va, const void *vb) {
+	const renewal_candidate_t *a = va, *b = vb;
+	return (a->traffic > b->traffic) - (a->traffic < b->traffic);
+}
+
+static void renew_node_key(meshlink_handle_t *mesh, node_t *n) {
+	logger(mesh, MESHLINK_DEBUG, "SPTPS key renewal for node %s", n->name);
+	devtool_sptps_renewal_probe((meshlink_node_t *)n);
+
+	n->key_renewal_jitter = prng(mesh, KEY_RENEWAL_JITTER);
+	n->renewal_traffic = node_traffic(n);
+
+	if(!sptps_force_kex(&n->sptps)) {
+		logger(mesh, MESHLINK_ERROR, "SPTPS key renewal for node %s failed", n->name);
+		n->status.validkey = false;
+		sptps_stop(&n->sptps);
+		n->status.waitingforkey = false;
+		n->last_req_key = -3600;
+	} else {
+		n->last_req_key = mesh->loop.now.tv_sec;
+	}
+}
+
+static void renew_connection_key(meshlink_handle_t *mesh, connection_t *c) {
+	devtool_sptps_renewal_probe((meshlink_node_t *)c->node);
+
+	c->key_renewal_jitter = prng(mesh, KEY_RENEWAL_JITTER);
+	c->renewal_traffic = connection_traffic(c);
+
+	if(!sptps_force_kex(&c->sptps)) {
+		logger(mesh, MESHLINK_ERROR, "SPTPS key renewal for connection with %s failed", c->name);
+		terminate_connection(mesh, c, true);
+	} else {
+		c->last_key_renewal = mesh->loop.now.tv_sec;
+	}
+}
+
+static void key_renewal_handler(event_loop_t *loop, void *data) {
+	meshlink_handle_t *mesh = loop->data;
+	time_t now = mesh->loop.now.tv_sec;
+
+	renewal_candidate_t *candidates = NULL;
+	size_t count = 0;
+	size_t size = 0;
+
+	for splay_each(node_t, n, mesh->nodes) {
+		if(!n->status.reachable || !n->status.validkey || node_key_renewal_time(n) >= now) {
+			continue;
+		}
+
+		if(count == size) {
+			size = size ? size * 2 : 16;
+			candidates = xrealloc(candidates, size * sizeof(*candidates));
+		}
+
+		candidates[count++] = (renewal_candidate_t) {
+			.node = n, .traffic = traffic_since(node_traffic(n), n->renewal_traffic)
+		};
+	}
+
+	for list_each(connection_t, c, mesh->connections) {
+		if(!c->status.active || connection_key_renewal_time(c) >= now) {
+			continue;
 		}
+
+		if(count == size) {
+			size = size ? size * 2 : 16;
+			candidates = xrealloc(candidates, size * sizeof(*candidates));
+		}
+
+		candidates[count++] = (renewal_candidate_t) {
+			.connection = c, .traffic = traffic_since(connection_traffic(c), c->renewal_traffic)
+		};
 	}
 
+	size_t allowed = count;
+
+	if(mesh->key_renewal_rate && count > mesh->key_renewal_rate) {
+		allowed = mesh->key_renewal_rate;
+		qsort(candidates, count, sizeof(*candidates), renewal_candidate_compare);
+		logger(mesh, MESHLINK_DEBUG, "Postponing %zu SPTPS key renewals", count - allowed);
+	}
+
+	for(size_t i = 0; i < allowed; i++) {
+		if(candidates[i].node) {
+			renew_node_key(mesh, candidates[i].node);
+		} else {
+			renew_connection_key(mesh, candidates[i].connection);
+		}
+	}
+
+	mesh->key_renewals += allowed;
+	mesh->key_renewals_postponed = count - allowed;
+	free(candidates);
+
 	timeout_set(&mesh->loop, data, &(struct timespec) {
-		timeout, prng(mesh, TIMER_FUDGE)
+		1, prng(mesh, TIMER_FUDGE)
 	});
 }
 
@@ -730,17 +854,24 @@ void main_loop(meshlink_handle_t *mesh) {
 	timeout_add(&mesh->loop, &mesh->periodictimer, periodic_handler, &mesh->periodictimer, &(struct timespec) {
 		0, 0
 	});
+	timeout_add(&mesh->loop, &mesh->renewaltimer, key_renewal_handler, &mesh->renewaltimer, &(struct timespec) {
+		1, prng(mesh, TIMER_FUDGE)
+	});
 
 	//Add signal handler
 	mesh->datafromapp.signum = 0;
 	signal_add(&mesh->loop, &mesh->datafromapp, meshlink_send_from_queue, mesh, mesh->datafromapp.signum);
+	mesh->datafromchannels.signum = 2;
+	signal_add(&mesh->loop, &mesh->datafromchannels, meshlink_send_from_channels, mesh, mesh->datafromchannels.signum);
 
 	if(!event_loop_run(&mesh->loop, mesh)) {
 		logger(mesh, MESHLINK_ERROR, "Error while waiting for input: %s", strerror(errno));
 		call_error_cb(mesh, MESHLINK_ENETWORK);
 	}
 
+	signal_del(&mesh->loop, &mesh->datafromchannels);
 	signal_del(&mesh->loop, &mesh->datafromapp);
+	timeout_del(&mesh->loop, &mesh->renewaltimer);
 	timeout_del(&mesh->loop, &mesh->periodictimer);
 	timeout_del(&mesh->loop, &mesh->pingtimer);
 }
@@ -35,6 +35,20 @@
 /* MAXSIZE is the maximum size of an encapsulated packet */
 #define MAXSIZE (MTU + 64)
 
+/* DEFAULT_UDP_RX_BATCH is the default number of UDP packets read per wakeup */
+#ifdef HAVE_RECVMMSG
+#define DEFAULT_UDP_RX_BATCH 32
+#else
+#define DEFAULT_UDP_RX_BATCH 8
+#endif
+
+/* SPTPS keys are renewed every KEY_RENEWAL_INTERVAL seconds, minus a random jitter of up to KEY_RENEWAL_JITTER seconds */
+#define KEY_RENEWAL_INTERVAL 3600
+#define KEY_RENEWAL_JITTER 900
+
+/* DEFAULT_KEY_RENEWAL_RATE is the default maximum number of key renewals started per second */
+#define DEFAULT_KEY_RENEWAL_RATE 10
+
 /* MAXBUFSIZE is the maximum size of a request: enough for a base64 encoded MAXSIZEd packet plus request header */
 #define MAXBUFSIZE ((MAXSIZE * 8) / 6 + 128)
 
@@ -42,6 +56,7 @@ typedef struct vpn_packet_t {
 	uint16_t probe: 1;
 	int16_t tcp: 1;
 	uint16_t len;           /* the actual number of bytes in the `data' field */
+	uint8_t reserved[8];    /* room for the SPTPS datagram header, so data can be encrypted in place */
 	uint8_t data[MAXSIZE];
 } vpn_packet_t;
 
@@ -85,6 +100,10 @@ void exit_outgoings(struct meshlink_handle *mesh);
 
 void retry_outgoing(struct meshlink_handle *mesh, outgoing_t *);
 void handle_incoming_vpn_data(struct event_loop_t *loop, void *, int);
+bool handle_injected_udp_packet(struct meshlink_handle *mesh, sockaddr_t *from, struct vpn_packet_t *pkt) __attribute__((__warn_unused_result__));
+void free_udp_rx_ring(struct meshlink_handle *mesh);
+void flush_udp_output(struct event_loop_t *loop, void *mesh);
+void free_udp_tx_queue(struct listen_socket_t *ls);
 void finish_connecting(struct meshlink_handle *mesh, struct connection_t *);
 void do_outgoing_connection(struct meshlink_handle *mesh, struct outgoing_t *);
 void handle_new_meta_connection(struct event_loop_t *loop, void *, int);
@@ -112,6 +131,9 @@ void handle_meta_connection_data(struct meshlink_handle *mesh, struct connection
 void retry(struct meshlink_handle *mesh);
 int check_port(struct meshlink_handle *mesh);
 void flush_meta(struct meshlink_handle *mesh, struct connection_t *);
+time_t node_key_renewal_time(const struct node_t *);
+time_t connection_key_renewal_time(const struct connection_t *);
+unsigned int key_renewals_in_flight(struct meshlink_handle *mesh) __attribute__((__warn_unused_result__));
 
 #ifndef HAVE_MINGW
 #define closesocket(s) close(s)
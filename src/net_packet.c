@@ -22,11 +22,13 @@
 #include "conf.h"
 #include "connection.h"
 #include "crypto.h"
+#include "devtools.h"
 #include "graph.h"
 #include "logger.h"
 #include "meshlink_internal.h"
 #include "net.h"
 #include "netutl.h"
+#include "packet_workers.h"
 #include "protocol.h"
 #include "route.h"
 #include "sptps.h"
@@ -271,6 +273,18 @@ static void receive_udppacket(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *
 		return;
 	}
 
+	if(!sptps_check_datagram(&n->sptps, inpkt->data, inpkt->len)) {
+		// Don't waste time decrypting packets that the replay window would drop anyway
+		n->in_replayed++;
+		logger(mesh, MESHLINK_DEBUG, "Dropped late or replayed packet from %s", n->name);
+		return;
+	}
+
+	if(mesh->packet_worker_count && n->sptps.instate) {
+		packet_workers_submit(mesh, n, inpkt);
+		return;
+	}
+
 	if(!sptps_receive_data(&n->sptps, inpkt->data, inpkt->len)) {
 		logger(mesh, MESHLINK_ERROR, "Could not process SPTPS data from %s: %s", n->name, strerror(errno));
 	}
@@ -310,7 +324,13 @@ static void send_sptps_packet(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *
 		return;
 	}
 
-	sptps_send_record(&n->sptps, type, origpkt->data, origpkt->len);
+	// Encrypt in place if there is room for the tag, this avoids copying the packet again.
+	if(origpkt->len + SPTPS_DATAGRAM_TAILROOM <= MAXSIZE) {
+		sptps_send_record_in_place(&n->sptps, type, origpkt->data, origpkt->len);
+	} else {
+		sptps_send_record(&n->sptps, type, origpkt->data, origpkt->len);
+	}
+
 	return;
 }
 
@@ -447,6 +467,221 @@ static void send_udppacket(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *ori
 	send_sptps_packet(mesh, n, origpkt);
 }
 
+/* Handle an error from sending a UDP packet, returns false if it was not a transient error */
+static bool udp_send_failed(meshlink_handle_t *mesh, node_t *to, size_t len) {
+	if(sockwouldblock(sockerrno)) {
+		return true;
+	}
+
+	if(sockmsgsize(sockerrno)) {
+		if(to->maxmtu >= len) {
+			to->maxmtu = len - 1;
+		}
+
+		if(to->mtu >= len) {
+			to->mtu = len - 1;
+		}
+
+		return true;
+	}
+
+	logger(mesh, MESHLINK_WARNING, "Error sending UDP SPTPS packet to %s: %s", to->name, sockstrerror(sockerrno));
+	return false;
+}
+
+#ifdef HAVE_SENDMMSG
+#define UDP_TX_QUEUE_SIZE 64
+#define UDP_TX_MAXLEN (MAXSIZE + SPTPS_DATAGRAM_OVERHEAD)
+#define UDP_GSO_MAXLEN 65000
+
+/* Packets waiting to be sent on a listen socket, stored back to back so runs of them can be sent with GSO */
+struct udp_tx_queue {
+	unsigned int count;
+	size_t used;
+	bool gso;
+	struct {
+		node_t *to;
+		sockaddr_t sa;
+		uint16_t len;
+	} slots[UDP_TX_QUEUE_SIZE];
+	uint8_t buf[UDP_TX_QUEUE_SIZE * UDP_TX_MAXLEN];
+};
+
+static void flush_udp_tx_queue(meshlink_handle_t *mesh, listen_socket_t *ls) {
+	struct udp_tx_queue *q = ls->txq;
+
+	if(!q || !q->count) {
+		return;
+	}
+
+	struct mmsghdr msgs[UDP_TX_QUEUE_SIZE];
+	struct iovec iovs[UDP_TX_QUEUE_SIZE];
+	unsigned int first[UDP_TX_QUEUE_SIZE + 1];
+#ifdef UDP_SEGMENT
+	char control[UDP_TX_QUEUE_SIZE][CMSG_SPACE(sizeof(uint16_t))];
+#endif
+	unsigned int nmsgs = 0;
+	uint8_t *p = q->buf;
+
+	memset(msgs, 0, q->count * sizeof(*msgs));
+
+	for(unsigned int i = 0; i < q->count;) {
+		unsigned int j = i + 1;
+		size_t total = q->slots[i].len;
+
+#ifdef UDP_SEGMENT
+
+		/* Coalesce packets to the same destination into one GSO message. All segments
+		   except the last one must have the same size. */
+		if(q->gso) {
+			while(j < q->count
+			                && q->slots[j - 1].len == q->slots[i].len
+			                && q->slots[j].len <= q->slots[i].len
+			                && total + q->slots[j].len <= UDP_GSO_MAXLEN
+			                && !sockaddrcmp(&q->slots[j].sa, &q->slots[i].sa)) {
+				total += q->slots[j].len;
+				j++;
+			}
+		}
+
+#endif
+
+		iovs[nmsgs].iov_base = p;
+		iovs[nmsgs].iov_len = total;
+		msgs[nmsgs].msg_hdr.msg_name = &q->slots[i].sa.sa;
+		msgs[nmsgs].msg_hdr.msg_namelen = SALEN(q->slots[i].sa.sa);
+		msgs[nmsgs].msg_hdr.msg_iov = &iovs[nmsgs];
+		msgs[nmsgs].msg_hdr.msg_iovlen = 1;
+
+#ifdef UDP_SEGMENT
+
+		if(j - i > 1) {
+			msgs[nmsgs].msg_hdr.msg_control = control[nmsgs];
+			msgs[nmsgs].msg_hdr.msg_controllen = sizeof(control[nmsgs]);
+			struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[nmsgs].msg_hdr);
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t segsize = q->slots[i].len;
+			memcpy(CMSG_DATA(cmsg), &segsize, sizeof(segsize));
+		}
+
+#endif
+
+		first[nmsgs++] = i;
+		p += total;
+		i = j;
+	}
+
+	first[nmsgs] = q->count;
+
+	mesh->udp_tx_packets += q->count;
+
+	for(unsigned int sent = 0; sent < nmsgs;) {
+		unsigned int count = nmsgs - sent;
+		int result = -1;
+
+		if(mesh->udp_tx_gso_error) {
+			/* Only send the messages before the next GSO message, that one fails */
+			count = 0;
+
+			while(sent + count < nmsgs && first[sent + count + 1] - first[sent + count] == 1) {
+				count++;
+			}
+
+			errno = mesh->udp_tx_gso_error;
+		}
+
+		if(count) {
+			mesh->udp_tx_syscalls++;
+			result = sendmmsg(ls->udp.fd, msgs + sent, count, 0);
+		}
+
+		if(result > 0) {
+			for(int k = 0; k < result; k++, sent++) {
+				if(first[sent + 1] - first[sent] > 1) {
+					mesh->udp_tx_gso++;
+				}
+			}
+
+			continue;
+		}
+
+		/* The first remaining message could not be sent */
+		unsigned int i = first[sent];
+
+		if(first[sent + 1] - i == 1) {
+			udp_send_failed(mesh, q->slots[i].to, q->slots[i].len);
+		} else {
+			if(sockerrno == EIO) {
+				/* The route to this destination does not support GSO */
+				q->gso = false;
+			}
+
+			/* Send the segments one by one, so errors are handled for each packet */
+			uint8_t *data = msgs[sent].msg_hdr.msg_iov->iov_base;
+
+			for(; i < first[sent + 1]; i++) {
+				mesh->udp_tx_syscalls++;
+
+				if(sendto(ls->udp.fd, data, q->slots[i].len, 0, &q->slots[i].sa.sa, SALEN(q->slots[i].sa.sa)) < 0) {
+					udp_send_failed(mesh, q->slots[i].to, q->slots[i].len);
+				}
+
+				data += q->slots[i].len;
+			}
+		}
+
+		sent++;
+	}
+
+	q->count = 0;
+	q->used = 0;
+}
+
+static void queue_udp_packet(meshlink_handle_t *mesh, listen_socket_t *ls, node_t *to, const sockaddr_t *sa, const void *data, size_t len) {
+	struct udp_tx_queue *q = ls->txq;
+
+	if(!q) {
+		q = ls->txq = xzalloc(sizeof(*q));
+#ifdef UDP_SEGMENT
+		int zero = 0;
+		q->gso = !setsockopt(ls->udp.fd, SOL_UDP, UDP_SEGMENT, (void *)&zero, sizeof(zero));
+#endif
+	}
+
+	if(q->count == UDP_TX_QUEUE_SIZE) {
+		flush_udp_tx_queue(mesh, ls);
+	}
+
+	q->slots[q->count].to = to;
+	q->slots[q->count].sa = *sa;
+	q->slots[q->count].len = len;
+	memcpy(q->buf + q->used, data, len);
+	q->count++;
+	q->used += len;
+}
+#endif
+
+void flush_udp_output(event_loop_t *loop, void *data) {
+	(void)loop;
+#ifdef HAVE_SENDMMSG
+	meshlink_handle_t *mesh = data;
+
+	for(int i = 0; i < mesh->listen_sockets; i++) {
+		flush_udp_tx_queue(mesh, &mesh->listen_socket[i]);
+	}
+
+#else
+	(void)data;
+#endif
+}
+
+void free_udp_tx_queue(listen_socket_t *ls) {
+	free(ls->txq);
+	ls->txq = NULL;
+}
+
 bool send_sptps_data(void *handle, uint8_t type, const void *data, size_t len) {
 	assert(handle);
 	assert(data);
@@ -492,19 +727,21 @@ bool send_sptps_data(void *handle, uint8_t type, const void *data, size_t len) {
 		choose_udp_address(mesh, to, &sa, &sock, &sa_buf);
 	}
 
-	if(sendto(mesh->listen_socket[sock].udp.fd, data, len, 0, &sa->sa, SALEN(sa->sa)) < 0 && !sockwouldblock(sockerrno)) {
-		if(sockmsgsize(sockerrno)) {
-			if(to->maxmtu >= len) {
-				to->maxmtu = len - 1;
-			}
+#ifdef HAVE_SENDMMSG
 
-			if(to->mtu >= len) {
-				to->mtu = len - 1;
-			}
-		} else {
-			logger(mesh, MESHLINK_WARNING, "Error sending UDP SPTPS packet to %s: %s", to->name, sockstrerror(sockerrno));
-			return false;
-		}
+	/* While the event loop is running callbacks, collect packets and send them all at once when it is done. */
+	if(mesh->loop.batching && len <= UDP_TX_MAXLEN) {
+		queue_udp_packet(mesh, &mesh->listen_socket[sock], to, sa, data, len);
+		return true;
+	}
+
+#endif
+
+	mesh->udp_tx_packets++;
+	mesh->udp_tx_syscalls++;
+
+	if(sendto(mesh->listen_socket[sock].udp.fd, data, len, 0, &sa->sa, SALEN(sa->sa)) < 0) {
+		return udp_send_failed(mesh, to, len);
 	}
 
 	return true;
@@ -587,80 +824,213 @@ void send_packet(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *packet) {
 	return;
 }
 
+/* A packet from an unknown address usually comes from a known node whose NAT mapping changed.
+ * Its sequence number, which is sent in the clear, is then close to the one that node's session expects next,
+ * and often only the port number changed. Only the few nodes that match best get a full MAC check.
+ * Trying all nodes is a fallback that is done at most once per second.
+ */
+
+#define TRY_HARDER_CANDIDATES 4
+
 static node_t *try_harder(meshlink_handle_t *mesh, const sockaddr_t *from, const vpn_packet_t *pkt) {
-	node_t *n = NULL;
-	bool hard = false;
+	node_t *candidates[TRY_HARDER_CANDIDATES];
+	uint64_t scores[TRY_HARDER_CANDIDATES];
+	int count = 0;
 
-	for splay_each(edge_t, e, mesh->edges) {
-		if(!e->to->status.reachable || e->to == mesh->self) {
+	for splay_each(node_t, n, mesh->nodes) {
+		uint32_t distance;
+
+		if(!n->status.reachable || n == mesh->self || !sptps_datagram_distance(&n->sptps, pkt->data, pkt->len, &distance)) {
 			continue;
 		}
 
-		if(sockaddrcmp_noport(from, &e->address)) {
-			if(mesh->last_hard_try == mesh->loop.now.tv_sec) {
-				continue;
-			}
+		// A lower score is a better match
+		uint64_t score = (uint64_t)(sockaddrcmp_noport(from, &n->address) != 0) << 32 | distance;
+
+		if(count == TRY_HARDER_CANDIDATES && score >= scores[count - 1]) {
+			continue;
+		}
+
+		int i = count < TRY_HARDER_CANDIDATES ? count++ : count - 1;
+
+		for(; i > 0 && scores[i - 1] > score; i--) {
+			candidates[i] = candidates[i - 1];
+			scores[i] = scores[i - 1];
+		}
+
+		candidates[i] = n;
+		scores[i] = score;
+	}
 
-			hard = true;
+	for(int i = 0; i < count; i++) {
+		if(try_mac(mesh, candidates[i], pkt)) {
+			return candidates[i];
 		}
+	}
+
+	if(mesh->last_hard_try == mesh->loop.now.tv_sec) {
+		return NULL;
+	}
 
-		if(!try_mac(mesh, e->to, pkt)) {
+	mesh->last_hard_try = mesh->loop.now.tv_sec;
+	mesh->udp_rx_hard_tries++;
+
+	for splay_each(node_t, n, mesh->nodes) {
+		if(!n->status.reachable || n == mesh->self) {
 			continue;
 		}
 
-		n = e->to;
-		break;
+		bool tried = false;
+
+		for(int i = 0; i < count; i++) {
+			tried |= candidates[i] == n;
+		}
+
+		if(!tried && try_mac(mesh, n, pkt)) {
+			return n;
+		}
+	}
+
+	return NULL;
+}
+
+/* Preallocated buffers for receiving a batch of UDP packets */
+struct udp_rx_ring {
+	unsigned int size;
+	vpn_packet_t *packets;
+	sockaddr_t *addresses;
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr *msgs;
+	struct iovec *iovs;
+#endif
+};
+
+void free_udp_rx_ring(meshlink_handle_t *mesh) {
+	struct udp_rx_ring *ring = mesh->udp_rx_ring;
+
+	if(!ring) {
+		return;
 	}
 
-	if(hard) {
-		mesh->last_hard_try = mesh->loop.now.tv_sec;
+	free(ring->packets);
+	free(ring->addresses);
+#ifdef HAVE_RECVMMSG
+	free(ring->msgs);
+	free(ring->iovs);
+#endif
+	free(ring);
+	mesh->udp_rx_ring = NULL;
+}
+
+static struct udp_rx_ring *get_udp_rx_ring(meshlink_handle_t *mesh) {
+	unsigned int size = mesh->udp_rx_batch ? mesh->udp_rx_batch : 1;
+
+	if(mesh->udp_rx_ring && mesh->udp_rx_ring->size == size) {
+		return mesh->udp_rx_ring;
 	}
 
-	return n;
+	free_udp_rx_ring(mesh);
+
+	struct udp_rx_ring *ring = xzalloc(sizeof(*ring));
+	ring->size = size;
+	ring->packets = xzalloc(size * sizeof(*ring->packets));
+	ring->addresses = xzalloc(size * sizeof(*ring->addresses));
+#ifdef HAVE_RECVMMSG
+	ring->msgs = xzalloc(size * sizeof(*ring->msgs));
+	ring->iovs = xmalloc(size * sizeof(*ring->iovs));
+
+	for(unsigned int i = 0; i < size; i++) {
+		ring->iovs[i].iov_base = ring->packets[i].data;
+		ring->iovs[i].iov_len = MAXSIZE;
+		ring->msgs[i].msg_hdr.msg_iov = &ring->iovs[i];
+		ring->msgs[i].msg_hdr.msg_iovlen = 1;
+		ring->msgs[i].msg_hdr.msg_name = &ring->addresses[i].sa;
+	}
+
+#endif
+
+	mesh->udp_rx_ring = ring;
+	return ring;
 }
 
-void handle_incoming_vpn_data(event_loop_t *loop, void *data, int flags) {
-	(void)flags;
-	meshlink_handle_t *mesh = loop->data;
-	listen_socket_t *ls = data;
-	vpn_packet_t pkt;
-	char *hostname;
-	sockaddr_t from;
-	socklen_t fromlen = sizeof(from);
-	node_t *n;
-	int len;
+/* Receive up to one batch of packets, returns the number of packets received or -1 on error */
+static int receive_udp_batch(meshlink_handle_t *mesh, int fd, struct udp_rx_ring *ring) {
+#ifdef HAVE_RECVMMSG
+
+	/* Addresses are hashed and compared in full, so clear what a shorter address would leave behind. */
+	memset(ring->addresses, 0, ring->size * sizeof(*ring->addresses));
 
-	memset(&from, 0, sizeof(from));
+	for(unsigned int i = 0; i < ring->size; i++) {
+		ring->msgs[i].msg_hdr.msg_namelen = sizeof(ring->addresses[i]);
+	}
 
-	len = recvfrom(ls->udp.fd, pkt.data, MAXSIZE, 0, &from.sa, &fromlen);
+	mesh->udp_rx_syscalls++;
+	int count = recvmmsg(fd, ring->msgs, ring->size, 0, NULL);
 
-	if(len <= 0 || len > MAXSIZE) {
-		if(!sockwouldblock(sockerrno)) {
-			logger(mesh, MESHLINK_ERROR, "Receiving packet failed: %s", sockstrerror(sockerrno));
+	if(count <= 0) {
+		return -1;
+	}
+
+	for(int i = 0; i < count; i++) {
+		ring->packets[i].len = ring->msgs[i].msg_len;
+	}
+
+	return count;
+#else
+	unsigned int count = 0;
+
+	while(count < ring->size) {
+		socklen_t fromlen = sizeof(ring->addresses[count]);
+		memset(&ring->addresses[count], 0, sizeof(ring->addresses[count]));
+
+		mesh->udp_rx_syscalls++;
+		ssize_t len = recvfrom(fd, ring->packets[count].data, MAXSIZE, 0, &ring->addresses[count].sa, &fromlen);
+
+		if(len <= 0) {
+			break;
 		}
 
-		return;
+		ring->packets[count++].len = len;
 	}
 
-	pkt.len = len;
+	return count ? (int)count : -1;
+#endif
+}
 
-	sockaddrunmap(&from); /* Some braindead IPv6 implementations do stupid things. */
+static void handle_incoming_udp_packet(meshlink_handle_t *mesh, listen_socket_t *ls, vpn_packet_t *pkt, sockaddr_t *from) {
+	node_t *n;
 
-	n = lookup_node_udp(mesh, &from);
+	sockaddrunmap(from); /* Some braindead IPv6 implementations do stupid things. */
 
-	if(!n) {
-		n = try_harder(mesh, &from, &pkt);
+	if(!devtool_udp_receive_probe(mesh, &from->sa, pkt->data, pkt->len)) {
+		return;
+	}
 
-		if(n) {
-			update_node_udp(mesh, n, &from);
-		} else if(mesh->log_level <= MESHLINK_WARNING) {
-			hostname = sockaddr2hostname(&from);
-			logger(mesh, MESHLINK_WARNING, "Received UDP packet from unknown source %s", hostname);
-			free(hostname);
-			return;
-		} else {
-			return;
+	/* Consecutive packets in a batch usually come from the same peer, so skip the lookup for those.
+	   Any change to the UDP address cache, including deleting a node, clears udp_rx_last_node. */
+	if(mesh->udp_rx_last_node && !sockaddrcmp(from, mesh->udp_rx_last_from)) {
+		n = mesh->udp_rx_last_node;
+	} else {
+		n = lookup_node_udp(mesh, from);
+
+		if(!n) {
+			mesh->udp_rx_unknown++;
+			n = try_harder(mesh, from, pkt);
+
+			if(n) {
+				update_node_udp(mesh, n, from);
+			} else if(mesh->log_level <= MESHLINK_WARNING) {
+				char *hostname = sockaddr2hostname(from);
+				logger(mesh, MESHLINK_WARNING, "Received UDP packet from unknown source %s", hostname);
+				free(hostname);
+				return;
+			} else {
+				return;
+			}
 		}
+
+		mesh->udp_rx_last_node = n;
+		mesh->udp_rx_last_from = from;
 	}
 
 	if(n->status.blacklisted) {
@@ -670,5 +1040,50 @@ void handle_incoming_vpn_data(event_loop_t *loop, void *data, int flags) {
 
 	n->sock = ls - mesh->listen_socket;
 
-	receive_udppacket(mesh, n, &pkt);
+	receive_udppacket(mesh, n, pkt);
+}
+
+void handle_incoming_vpn_data(event_loop_t *loop, void *data, int flags) {
+	(void)flags;
+	meshlink_handle_t *mesh = loop->data;
+	listen_socket_t *ls = data;
+	struct udp_rx_ring *ring = get_udp_rx_ring(mesh);
+
+	int count = receive_udp_batch(mesh, ls->udp.fd, ring);
+
+	if(count < 0) {
+		if(!sockwouldblock(sockerrno)) {
+			logger(mesh, MESHLINK_ERROR, "Receiving packet failed: %s", sockstrerror(sockerrno));
+		}
+
+		return;
+	}
+
+	mesh->udp_rx_packets += count;
+
+	mesh->udp_rx_last_node = NULL;
+
+	for(int i = 0; i < count; i++) {
+		if(!ring->packets[i].len) {
+			continue;
+		}
+
+		handle_incoming_udp_packet(mesh, ls, &ring->packets[i], &ring->addresses[i]);
+	}
+
+	mesh->udp_rx_last_node = NULL;
+}
+
+// Handle a packet that did not come from a socket as if it was received on a UDP listening socket.
+bool handle_injected_udp_packet(meshlink_handle_t *mesh, sockaddr_t *from, vpn_packet_t *pkt) {
+	for(int i = 0; i < mesh->listen_sockets; i++) {
+		if(mesh->listen_socket[i].sa.sa.sa_family == from->sa.sa_family) {
+			mesh->udp_rx_last_node = NULL;
+			handle_incoming_udp_packet(mesh, &mesh->listen_socket[i], pkt, from);
+			mesh->udp_rx_last_node = NULL;
+			return true;
+		}
+	}
+
+	return false;
 }
@@ -612,6 +612,7 @@ static bool add_listen_sockets(meshlink_handle_t *mesh) {
 			io_del(&mesh->loop, &mesh->listen_socket[i].udp);
 			closesocket(mesh->listen_socket[i].tcp.fd);
 			closesocket(mesh->listen_socket[i].udp.fd);
+			free_udp_tx_queue(&mesh->listen_socket[i]);
 		}
 
 		mesh->listen_sockets = 0;
@@ -701,6 +702,7 @@ void close_network_connections(meshlink_handle_t *mesh) {
 		io_del(&mesh->loop, &mesh->listen_socket[i].udp);
 		closesocket(mesh->listen_socket[i].tcp.fd);
 		closesocket(mesh->listen_socket[i].udp.fd);
+		free_udp_tx_queue(&mesh->listen_socket[i]);
 	}
 
 	exit_requests(mesh);
@@ -25,6 +25,7 @@
 #include "net.h"
 #include "netutl.h"
 #include "node.h"
+#include "packet_workers.h"
 #include "splay_tree.h"
 #include "utils.h"
 #include "xalloc.h"
@@ -33,9 +34,46 @@ static int node_compare(const node_t *a, const node_t *b) {
 	return strcmp(a->name, b->name);
 }
 
+/* The UDP cache is keyed on just the parts of a sockaddr_t that identify a peer,
+ * so bytes that are not used by its address family cannot cause a lookup to fail.
+ */
+typedef struct udp_cache_key {
+	uint16_t family;
+	uint16_t port;
+	uint32_t scope_id;
+	uint8_t address[16];
+} udp_cache_key_t;
+
+static void get_udp_cache_key(udp_cache_key_t *key, const sockaddr_t *sa) {
+	memset(key, 0, sizeof(*key));
+	key->family = sa->sa.sa_family;
+
+	if(sa->sa.sa_family == AF_INET) {
+		key->port = sa->in.sin_port;
+		memcpy(key->address, &sa->in.sin_addr, sizeof(sa->in.sin_addr));
+	} else if(sa->sa.sa_family == AF_INET6) {
+		key->port = sa->in6.sin6_port;
+		key->scope_id = sa->in6.sin6_scope_id;
+		memcpy(key->address, &sa->in6.sin6_addr, sizeof(sa->in6.sin6_addr));
+	}
+}
+
+static void forget_udp_address(meshlink_handle_t *mesh, node_t *n) {
+	udp_cache_key_t key;
+	get_udp_cache_key(&key, &n->address);
+
+	// Another node might be using this address by now
+	if(hash_search(mesh->node_udp_cache, &key) == n) {
+		hash_delete(mesh->node_udp_cache, &key);
+	}
+
+	// Nodes can be deleted or change addresses while a batch of UDP packets is being handled
+	mesh->udp_rx_last_node = NULL;
+}
+
 void init_nodes(meshlink_handle_t *mesh) {
 	mesh->nodes = splay_alloc_tree((splay_compare_t) node_compare, (splay_action_t) free_node);
-	mesh->node_udp_cache = hash_alloc(0x100, sizeof(sockaddr_t));
+	mesh->node_udp_cache = hash_alloc(0x100, sizeof(udp_cache_key_t));
 }
 
 void exit_nodes(meshlink_handle_t *mesh) {
@@ -47,8 +85,14 @@ void exit_nodes(meshlink_handle_t *mesh) {
 		splay_delete_tree(mesh->nodes);
 	}
 
+	free(mesh->node_ids);
+
 	mesh->node_udp_cache = NULL;
 	mesh->nodes = NULL;
+	mesh->node_ids = NULL;
+	mesh->node_ids_size = 0;
+	mesh->node_ids_count = 0;
+	mesh->next_node_id = 0;
 }
 
 node_t *new_node(void) {
@@ -67,6 +111,10 @@ void free_node(node_t *n) {
 
 	utcp_exit(n->utcp);
 
+	if(n->utcptimeout.cb) {
+		timeout_del(&n->mesh->loop, &n->utcptimeout);
+	}
+
 	if(n->edge_tree) {
 		free_edge_tree(n->edge_tree);
 	}
@@ -87,18 +135,65 @@ void free_node(node_t *n) {
 	free(n);
 }
 
+static void node_id_add(meshlink_handle_t *mesh, node_t *n) {
+	// ID 0 is never used, so the table always has one slot more than there are IDs in use
+	if(mesh->node_ids_count + 1 >= mesh->node_ids_size) {
+		if(mesh->node_ids_size >= 0x10000) {
+			// Out of IDs, this node can only be reached using the legacy packet header
+			return;
+		}
+
+		uint32_t size = mesh->node_ids_size ? mesh->node_ids_size * 2 : 0x100;
+		mesh->node_ids = xrealloc(mesh->node_ids, size * sizeof(*mesh->node_ids));
+		memset(mesh->node_ids + mesh->node_ids_size, 0, (size - mesh->node_ids_size) * sizeof(*mesh->node_ids));
+		mesh->node_ids_size = size;
+	}
+
+	// Continue after the last assigned ID, so IDs of deleted nodes are not reused right away
+	uint32_t id = mesh->next_node_id;
+
+	do {
+		if(++id >= mesh->node_ids_size) {
+			id = 1;
+		}
+	} while(mesh->node_ids[id]);
+
+	mesh->node_ids[id] = n;
+	mesh->node_ids_count++;
+	mesh->next_node_id = id;
+	n->id = id;
+}
+
+static void node_id_del(meshlink_handle_t *mesh, node_t *n) {
+	if(!n->id) {
+		return;
+	}
+
+	mesh->node_ids[n->id] = NULL;
+	mesh->node_ids_count--;
+	n->id = 0;
+}
+
 void node_add(meshlink_handle_t *mesh, node_t *n) {
 	n->mesh = mesh;
+	n->key_renewal_jitter = prng(mesh, KEY_RENEWAL_JITTER);
 	splay_insert(mesh->nodes, n);
+	node_id_add(mesh, n);
 }
 
 void node_del(meshlink_handle_t *mesh, node_t *n) {
+	// Queued UDP packets may still refer to this node
+	event_loop_flush_output(&mesh->loop);
+
 	timeout_del(&mesh->loop, &n->mtutimeout);
 
 	for splay_each(edge_t, e, n->edge_tree) {
 		edge_del(mesh, e);
 	}
 
+	packet_workers_forget_node(mesh, n);
+	forget_udp_address(mesh, n);
+	node_id_del(mesh, n);
 	splay_delete(mesh->nodes, n);
 }
 
@@ -111,8 +206,14 @@ node_t *lookup_node(meshlink_handle_t *mesh, const char *name) {
 	return result;
 }
 
+node_t *lookup_node_id(meshlink_handle_t *mesh, uint16_t id) {
+	return id < mesh->node_ids_size ? mesh->node_ids[id] : NULL;
+}
+
 node_t *lookup_node_udp(meshlink_handle_t *mesh, const sockaddr_t *sa) {
-	return hash_search(mesh->node_udp_cache, sa);
+	udp_cache_key_t key;
+	get_udp_cache_key(&key, sa);
+	return hash_search(mesh->node_udp_cache, &key);
 }
 
 void update_node_udp(meshlink_handle_t *mesh, node_t *n, const sockaddr_t *sa) {
@@ -121,7 +222,7 @@ void update_node_udp(meshlink_handle_t *mesh, node_t *n, const sockaddr_t *sa) {
 		return;
 	}
 
-	hash_insert(mesh->node_udp_cache, &n->address, NULL);
+	forget_udp_address(mesh, n);
 
 	if(sa) {
 		n->address = *sa;
@@ -134,7 +235,9 @@ void update_node_udp(meshlink_handle_t *mesh, node_t *n, const sockaddr_t *sa) {
 			}
 		}
 
-		hash_insert(mesh->node_udp_cache, sa, n);
+		udp_cache_key_t key;
+		get_udp_cache_key(&key, sa);
+		hash_insert(mesh->node_udp_cache, &key, n);
 
 		node_add_recent_address(mesh, n, sa);
 
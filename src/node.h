@@ -39,6 +39,7 @@ typedef struct node_status_t {
 	uint16_t dirty: 1;                  /* 1 if the configuration of the node is dirty and needs to be written out */
 	uint16_t want_udp: 1;               /* 1 if we want working UDP because we have data to send */
 	uint16_t tiny: 1;                   /* 1 if this is a tiny node */
+	uint16_t compact: 1;                /* 1 if this node accepts packets with a compact header */
 } node_status_t;
 
 #define MAX_RECENT 5
@@ -54,12 +55,16 @@ typedef struct node_t {
 	dev_class_t devclass;
 
 	// Used for packet I/O
+	uint16_t id;                            /* Our ID for this node in compact packet headers, 0 if none */
+	uint16_t compact_source;                /* His ID for himself in compact packet headers */
+	uint16_t compact_destination;           /* His ID for us in compact packet headers */
 	int sock;                               /* Socket to use for outgoing UDP packets */
 	uint32_t session_id;                    /* Unique ID for this node's currently running process */
 	sptps_t sptps;
 	sockaddr_t address;                     /* his real (internet) ip to send UDP packets to */
 
 	struct utcp *utcp;
+	timeout_t utcptimeout;                  /* Wakes up UTCP when one of its connections has something to do */
 
 	// Traffic counters
 	uint64_t in_data;                       /* Bytes received from channels */
@@ -68,6 +73,7 @@ typedef struct node_t {
 	uint64_t out_forward;                   /* Bytes forwarded from channel from other nodes */
 	uint64_t in_meta;                       /* Bytes received from meta-connections, heartbeat packets etc. */
 	uint64_t out_meta;                      /* Bytes sent on meta-connections, heartbeat packets etc. */
+	uint64_t in_replayed;                   /* UDP packets dropped by the replay window before being decrypted */
 
 	// MTU probes
 	timeout_t mtutimeout;                   /* Probe event */
@@ -80,6 +86,8 @@ typedef struct node_t {
 	struct submesh_t *submesh;              /* Nodes Sub-Mesh Handle*/
 
 	time_t last_req_key;
+	uint16_t key_renewal_jitter;            /* Seconds before KEY_RENEWAL_INTERVAL at which the next key renewal is due */
+	uint64_t renewal_traffic;               /* Channel traffic at the time of the last key renewal */
 
 	struct ecdsa *ecdsa;                    /* His public ECDSA key */
 
@@ -110,6 +118,7 @@ void free_node(node_t *n);
 void node_add(struct meshlink_handle *mesh, node_t *n);
 void node_del(struct meshlink_handle *mesh, node_t *n);
 node_t *lookup_node(struct meshlink_handle *mesh, const char *name) __attribute__((__warn_unused_result__));
+node_t *lookup_node_id(struct meshlink_handle *mesh, uint16_t id) __attribute__((__warn_unused_result__));
 node_t *lookup_node_udp(struct meshlink_handle *mesh, const sockaddr_t *sa) __attribute__((__warn_unused_result__));
 void update_node_udp(struct meshlink_handle *mesh, node_t *n, const sockaddr_t *sa);
 bool node_add_recent_address(struct meshlink_handle *mesh, node_t *n, const sockaddr_t *addr);
@@ -0,0 +1,270 @@
+/*
+    packet_workers.c -- decrypting incoming UDP packets on worker threads
+    Copyright (C) 2026 MeshLink contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "system.h"
+
+#include <pthread.h>
+
+#include "logger.h"
+#include "packet_workers.h"
+#include "sptps.h"
+#include "xalloc.h"
+
+/* Only decryption is offloaded to the workers.
+ * Packets from a given node are always handled by the same worker, in the order they were received.
+ * The worker only decrypts and authenticates them, using a copy of the node's incoming cipher.
+ * The replay window check, the rest of SPTPS and UTCP all still run on the MeshLink thread.
+ * If the node's key was renewed while a packet was queued, and the packet could not be decrypted
+ * with the old key, the MeshLink thread decrypts it again with the new key.
+ */
+
+#define PACKET_WORKER_JOBS 64
+
+typedef struct packet_job {
+	node_t *node;                   // NULL if the node was deleted before the job was completed
+	uint32_t generation;            // The node's SPTPS session generation at the time the packet was received
+	uint32_t key_generation;        // The generation of the key copied into cipher
+	uint32_t seqno;
+	bool ok;
+	chacha_poly1305_ctx_t *cipher;
+	vpn_packet_t packet;            // The encrypted packet, left intact so it can be decrypted again
+	uint8_t decrypted[MAXSIZE];     // Written by the worker
+} packet_job_t;
+
+/* The MeshLink thread adds jobs at the head, the worker decrypts them up to done,
+ * and the MeshLink thread then completes them up to the tail. The positions only increase.
+ * Only the worker accesses the packets of jobs between done and head.
+ */
+typedef struct packet_worker {
+	meshlink_handle_t *mesh;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;            // Signals the worker that there are new jobs
+	pthread_cond_t done_cond;       // Signals the MeshLink thread that a job is done
+	packet_job_t *jobs;
+	unsigned int head;
+	unsigned int done;
+	unsigned int tail;
+	bool stop;
+} packet_worker_t;
+
+static void *packet_worker_loop(void *data) {
+	packet_worker_t *worker = data;
+
+	if(pthread_mutex_lock(&worker->mutex) != 0) {
+		abort();
+	}
+
+	while(true) {
+		while(worker->done == worker->head && !worker->stop) {
+			pthread_cond_wait(&worker->cond, &worker->mutex);
+		}
+
+		if(worker->stop) {
+			break;
+		}
+
+		packet_job_t *job = &worker->jobs[worker->done % PACKET_WORKER_JOBS];
+		pthread_mutex_unlock(&worker->mutex);
+
+		job->ok = sptps_decrypt_datagram(job->cipher, job->packet.data, job->packet.len, job->decrypted, &job->seqno);
+
+		if(pthread_mutex_lock(&worker->mutex) != 0) {
+			abort();
+		}
+
+		worker->done++;
+		pthread_cond_signal(&worker->done_cond);
+		signal_trigger(&worker->mesh->loop, &worker->mesh->packet_workers_signal);
+	}
+
+	pthread_mutex_unlock(&worker->mutex);
+	return NULL;
+}
+
+static void complete_jobs(meshlink_handle_t *mesh, packet_worker_t *worker) {
+	if(pthread_mutex_lock(&worker->mutex) != 0) {
+		abort();
+	}
+
+	unsigned int done = worker->done;
+	pthread_mutex_unlock(&worker->mutex);
+
+	while(worker->tail != done) {
+		packet_job_t *job = &worker->jobs[worker->tail % PACKET_WORKER_JOBS];
+		node_t *n = job->node;
+		worker->tail++;
+
+		if(!n || n->sptps.generation != job->generation) {
+			// The SPTPS session this packet belonged to no longer exists
+			continue;
+		}
+
+		if(!job->ok && job->key_generation != n->sptps.key_generation) {
+			// The key was renewed after this packet was queued, try again with the new key
+			if(!sptps_receive_data(&n->sptps, job->packet.data, job->packet.len)) {
+				logger(mesh, MESHLINK_ERROR, "Could not process SPTPS data from %s: %s", n->name, strerror(errno));
+			}
+		} else if(!job->ok) {
+			logger(mesh, MESHLINK_ERROR, "Could not decrypt SPTPS data from %s", n->name);
+		} else if(!sptps_receive_decrypted_datagram(&n->sptps, job->seqno, (char *)job->decrypted, job->packet.len)) {
+			logger(mesh, MESHLINK_ERROR, "Could not process SPTPS data from %s: %s", n->name, strerror(errno));
+		}
+	}
+}
+
+static void packet_workers_handler(event_loop_t *loop, void *data) {
+	(void)loop;
+	meshlink_handle_t *mesh = data;
+
+	for(unsigned int i = 0; i < mesh->packet_worker_count; i++) {
+		complete_jobs(mesh, &mesh->packet_workers[i]);
+	}
+}
+
+void packet_workers_submit(meshlink_handle_t *mesh, node_t *n, const vpn_packet_t *packet) {
+	packet_worker_t *worker = &mesh->packet_workers[n->id % mesh->packet_worker_count];
+
+	if(worker->head - worker->tail == PACKET_WORKER_JOBS) {
+		// Wait for the worker to finish the oldest job, so we don't have to process this packet out of order
+		if(pthread_mutex_lock(&worker->mutex) != 0) {
+			abort();
+		}
+
+		while(worker->done == worker->tail) {
+			pthread_cond_wait(&worker->done_cond, &worker->mutex);
+		}
+
+		pthread_mutex_unlock(&worker->mutex);
+		complete_jobs(mesh, worker);
+	}
+
+	packet_job_t *job = &worker->jobs[worker->head % PACKET_WORKER_JOBS];
+	job->node = n;
+	job->generation = n->sptps.generation;
+	job->key_generation = n->sptps.key_generation;
+	chacha_poly1305_copy(job->cipher, n->sptps.incipher);
+	job->packet.len = packet->len;
+	memcpy(job->packet.data, packet->data, packet->len);
+
+	if(pthread_mutex_lock(&worker->mutex) != 0) {
+		abort();
+	}
+
+	if(worker->done == worker->head) {
+		pthread_cond_signal(&worker->cond);
+	}
+
+	worker->head++;
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+void packet_workers_forget_node(meshlink_handle_t *mesh, node_t *n) {
+	if(!mesh->packet_worker_count) {
+		return;
+	}
+
+	packet_worker_t *worker = &mesh->packet_workers[n->id % mesh->packet_worker_count];
+
+	for(unsigned int i = worker->tail; i != worker->head; i++) {
+		packet_job_t *job = &worker->jobs[i % PACKET_WORKER_JOBS];
+
+		if(job->node == n) {
+			job->node = NULL;
+		}
+	}
+}
+
+static void free_worker(packet_worker_t *worker) {
+	for(unsigned int i = 0; i < PACKET_WORKER_JOBS; i++) {
+		chacha_poly1305_exit(worker->jobs[i].cipher);
+	}
+
+	free(worker->jobs);
+	pthread_cond_destroy(&worker->done_cond);
+	pthread_cond_destroy(&worker->cond);
+	pthread_mutex_destroy(&worker->mutex);
+}
+
+void init_packet_workers(meshlink_handle_t *mesh) {
+	unsigned int count = mesh->packet_worker_threads;
+
+	if(!count) {
+		return;
+	}
+
+	mesh->packet_workers = xzalloc(count * sizeof(*mesh->packet_workers));
+
+	for(unsigned int i = 0; i < count; i++) {
+		packet_worker_t *worker = &mesh->packet_workers[i];
+		worker->mesh = mesh;
+		pthread_mutex_init(&worker->mutex, NULL);
+		pthread_cond_init(&worker->cond, NULL);
+		pthread_cond_init(&worker->done_cond, NULL);
+		worker->jobs = xzalloc(PACKET_WORKER_JOBS * sizeof(*worker->jobs));
+
+		for(unsigned int j = 0; j < PACKET_WORKER_JOBS; j++) {
+			worker->jobs[j].cipher = chacha_poly1305_init();
+		}
+
+		if(pthread_create(&worker->thread, NULL, packet_worker_loop, worker) != 0) {
+			logger(mesh, MESHLINK_WARNING, "Could not start packet worker thread: %s", strerror(errno));
+			free_worker(worker);
+			break;
+		}
+
+		mesh->packet_worker_count++;
+	}
+
+	if(!mesh->packet_worker_count) {
+		free(mesh->packet_workers);
+		mesh->packet_workers = NULL;
+		return;
+	}
+
+	signal_add(&mesh->loop, &mesh->packet_workers_signal, packet_workers_handler, mesh, 3);
+}
+
+void exit_packet_workers(meshlink_handle_t *mesh) {
+	if(!mesh->packet_workers) {
+		return;
+	}
+
+	signal_del(&mesh->loop, &mesh->packet_workers_signal);
+
+	// Any jobs that were not completed yet are dropped
+	for(unsigned int i = 0; i < mesh->packet_worker_count; i++) {
+		packet_worker_t *worker = &mesh->packet_workers[i];
+
+		if(pthread_mutex_lock(&worker->mutex) != 0) {
+			abort();
+		}
+
+		worker->stop = true;
+		pthread_cond_signal(&worker->cond);
+		pthread_mutex_unlock(&worker->mutex);
+
+		pthread_join(worker->thread, NULL);
+		free_worker(worker);
+	}
+
+	free(mesh->packet_workers);
+	mesh->packet_workers = NULL;
+	mesh->packet_worker_count = 0;
+}
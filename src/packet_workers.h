@@ -0,0 +1,32 @@
+#ifndef MESHLINK_PACKET_WORKERS_H
+#define MESHLINK_PACKET_WORKERS_H
+
+/*
+    packet_workers.h -- decrypting incoming UDP packets on worker threads
+    Copyright (C) 2026 MeshLink contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "meshlink_internal.h"
+#include "net.h"
+#include "node.h"
+
+void init_packet_workers(meshlink_handle_t *mesh);
+void exit_packet_workers(meshlink_handle_t *mesh);
+void packet_workers_submit(meshlink_handle_t *mesh, node_t *n, const vpn_packet_t *packet);
+void packet_workers_forget_node(meshlink_handle_t *mesh, node_t *n);
+
+#endif
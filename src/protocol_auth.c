@@ -21,6 +21,7 @@
 
 #include "conf.h"
 #include "connection.h"
+#include "crypto_worker.h"
 #include "devtools.h"
 #include "ecdsa.h"
 #include "edge.h"
@@ -182,6 +183,92 @@ static bool receive_invitation_sptps(void *handle, uint8_t type, const void *dat
 	return false;
 }
 
+#define VERIFY_BATCH_MAX 64
+
+/* Handshake signatures of meta-connections that arrive in the same event loop iteration are verified together.
+ * The connections are kept in a list until a zero timeout fires at the start of the next iteration.
+ */
+
+static bool take_pending_verification(meshlink_handle_t *mesh, connection_t *c) {
+	for list_each(connection_t, other, mesh->pending_verifications) {
+		if(other == c) {
+			list_delete_node(mesh->pending_verifications, list_node);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void verify_handshakes(event_loop_t *loop, void *data) {
+	(void)loop;
+	meshlink_handle_t *mesh = data;
+
+	while(mesh->pending_verifications->count) {
+		connection_t *batch[VERIFY_BATCH_MAX];
+		ecdsa_t *keys[VERIFY_BATCH_MAX];
+		const void *msgs[VERIFY_BATCH_MAX];
+		size_t msglens[VERIFY_BATCH_MAX];
+		const void *sigs[VERIFY_BATCH_MAX];
+		bool valid[VERIFY_BATCH_MAX];
+		size_t count = 0;
+
+		for list_each(connection_t, c, mesh->pending_verifications) {
+			if(count == VERIFY_BATCH_MAX) {
+				break;
+			}
+
+			batch[count] = c;
+			keys[count] = c->sptps.hiskey;
+			msgs[count] = c->sptps.pending_msg;
+			msglens[count] = c->sptps.pending_msglen;
+			sigs[count] = c->sptps.pending_sig;
+			count++;
+		}
+
+		if(!ecdsa_verify_batch(keys, msgs, msglens, sigs, count, valid)) {
+			logger(mesh, MESHLINK_DEBUG, "Batch of %zu handshake signatures contained invalid ones", count);
+		}
+
+		for(size_t i = 0; i < count; i++) {
+			connection_t *c = batch[i];
+
+			// Continuing an earlier handshake might have terminated this connection
+			if(!take_pending_verification(mesh, c)) {
+				continue;
+			}
+
+			if(!sptps_verify_done(&c->sptps, valid[i])) {
+				terminate_connection(mesh, c, c->status.active);
+			}
+		}
+	}
+}
+
+static void meta_verify_done(sptps_t *s, bool result) {
+	connection_t *c = s->handle;
+
+	if(!result) {
+		terminate_connection(c->mesh, c, c->status.active);
+	}
+}
+
+static bool defer_meta_verify(void *handle) {
+	connection_t *c = handle;
+	meshlink_handle_t *mesh = c->mesh;
+
+	if(crypto_worker_submit(mesh, &c->sptps, meta_verify_done)) {
+		return true;
+	}
+
+	list_insert_tail(mesh->pending_verifications, c);
+	timeout_add(&mesh->loop, &mesh->verify_timeout, verify_handshakes, mesh, &(struct timespec) {
+		0, 0
+	});
+
+	return true;
+}
+
 bool id_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 	assert(request);
 	assert(*request);
@@ -303,7 +390,12 @@ bool id_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 		logger(mesh, MESHLINK_DEBUG, "Connection to %s mykey %s hiskey %s", c->name, buf1, buf2);
 	}
 
-	return sptps_start(&c->sptps, c, c->outgoing, false, mesh->private_key, n->ecdsa, label, sizeof(label) - 1, send_meta_sptps, receive_meta_sptps);
+	if(!sptps_start(&c->sptps, c, c->outgoing, false, mesh->private_key, n->ecdsa, label, sizeof(label) - 1, send_meta_sptps, receive_meta_sptps)) {
+		return false;
+	}
+
+	c->sptps.defer_verify = defer_meta_verify;
+	return true;
 }
 
 bool send_ack(meshlink_handle_t *mesh, connection_t *c) {
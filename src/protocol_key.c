@@ -20,6 +20,7 @@
 #include "system.h"
 
 #include "connection.h"
+#include "crypto_worker.h"
 #include "logger.h"
 #include "meshlink_internal.h"
 #include "net.h"
@@ -99,6 +100,35 @@ bool send_canonical_address(meshlink_handle_t *mesh, node_t *to) {
 	return send_request(mesh, to->nexthop->connection, NULL, "%d %s %s %d %s", REQ_KEY, mesh->self->name, to->name, REQ_CANONICAL, mesh->self->canonical_address);
 }
 
+static bool send_compact_ids(meshlink_handle_t *mesh, node_t *to) {
+	if(!mesh->self->id || !to->id) {
+		return true;
+	}
+
+	return send_request(mesh, to->nexthop->connection, NULL, "%d %s %s %d %hu %hu", REQ_KEY, mesh->self->name, to->name, REQ_COMPACT, mesh->self->id, to->id);
+}
+
+static void node_verify_done(sptps_t *s, bool result) {
+	node_t *n = s->handle;
+
+	if(!result) {
+		logger(n->mesh, MESHLINK_ERROR, "Could not renew SPTPS session with %s: %s", n->name, strerror(errno));
+	}
+}
+
+/* Key renewals of an established session are done on the crypto worker, if there is one.
+ * The initial handshake is not deferred, since ANS_KEY expects it to have finished synchronously.
+ */
+static bool defer_node_verify(void *handle) {
+	node_t *n = handle;
+
+	if(!n->status.validkey) {
+		return false;
+	}
+
+	return crypto_worker_submit(n->mesh, &n->sptps, node_verify_done);
+}
+
 bool send_req_key(meshlink_handle_t *mesh, node_t *to) {
 	if(!node_read_public_key(mesh, to)) {
 		logger(mesh, MESHLINK_DEBUG, "No ECDSA key known for %s", to->name);
@@ -129,8 +159,17 @@ bool send_req_key(meshlink_handle_t *mesh, node_t *to) {
 	sptps_stop(&to->sptps);
 	to->status.validkey = false;
 	to->status.waitingforkey = true;
+	set_node_compact(to, false);
 	to->last_req_key = mesh->loop.now.tv_sec;
-	return sptps_start(&to->sptps, to, true, true, mesh->private_key, to->ecdsa, label, sizeof(label) - 1, send_initial_sptps_data, receive_sptps_record);
+
+	if(!sptps_start(&to->sptps, to, true, true, mesh->private_key, to->ecdsa, label, sizeof(label) - 1, send_initial_sptps_data, receive_sptps_record)) {
+		return false;
+	}
+
+	to->sptps.defer_verify = defer_node_verify;
+
+	/* Tell him which node IDs to use in compact packet headers */
+	return send_compact_ids(mesh, to);
 }
 
 /* REQ_KEY is overloaded to allow arbitrary requests to be routed between two nodes. */
@@ -237,6 +276,7 @@ static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *
 		sptps_stop(&from->sptps);
 		from->status.validkey = false;
 		from->status.waitingforkey = true;
+		set_node_compact(from, false);
 		from->last_req_key = mesh->loop.now.tv_sec;
 
 		/* Send our canonical address to help with UDP hole punching */
@@ -250,11 +290,16 @@ static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *
 			return true;
 		}
 
+		from->sptps.defer_verify = defer_node_verify;
+
 		if(!sptps_receive_data(&from->sptps, buf, len)) {
 			logger(mesh, MESHLINK_ERROR, "Could not process SPTPS data from %s: %s", from->name, strerror(errno));
 			return true;
 		}
 
+		/* Tell him which node IDs to use in compact packet headers */
+		send_compact_ids(mesh, from);
+
 		return true;
 	}
 
@@ -323,6 +368,21 @@ static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *
 		return true;
 	}
 
+	case REQ_COMPACT: {
+		uint16_t source, destination;
+
+		if(sscanf(request, "%*d %*s %*s %*d %hu %hu", &source, &destination) != 2 || !source || !destination) {
+			logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "REQ_COMPACT", from->name, request);
+			return true;
+		}
+
+		/* From now on he accepts compact packet headers, and we know which IDs to expect in the ones he sends */
+		from->compact_source = source;
+		from->compact_destination = destination;
+		set_node_compact(from, true);
+		return true;
+	}
+
 	default:
 		logger(mesh, MESHLINK_ERROR, "Unknown extended REQ_KEY request from %s: %s", from->name, request);
 		return true;
@@ -147,7 +147,7 @@ bool tcppacket_h(meshlink_handle_t *mesh, connection_t *c, const char *request)
 }
 
 bool send_raw_packet(meshlink_handle_t *mesh, connection_t *c, const vpn_packet_t *packet) {
-	size_t hdrsize = sizeof(meshlink_packethdr_t);
+	size_t hdrsize = packet->len && !packet->data[0] ? sizeof(meshlink_compacthdr_t) : sizeof(meshlink_packethdr_t);
 	assert(packet->len >= hdrsize);
 	return send_request(mesh, c, NULL, "%d", PACKET) && send_meta(mesh, c, (const char *)packet->data + hdrsize, packet->len - hdrsize);
 }
@@ -36,28 +36,112 @@ static bool checklength(node_t *source, vpn_packet_t *packet, uint16_t length) {
 	}
 }
 
+// The size of the header of packets we build for n
+size_t packet_header_size(const node_t *n) {
+	return n->status.compact && n->id && n->mesh->self->id ? sizeof(meshlink_compacthdr_t) : sizeof(meshlink_packethdr_t);
+}
+
+// Write the header of a packet with a payload of len bytes, which must already be at packet->data + the header size.
+bool write_packet_header(meshlink_handle_t *mesh, node_t *dest, vpn_packet_t *packet, size_t len, bool compact) {
+	if(compact) {
+		meshlink_compacthdr_t *hdr = (meshlink_compacthdr_t *)packet->data;
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->destination = htons(dest->id);
+		hdr->source = htons(mesh->self->id);
+		packet->len = len + sizeof(*hdr);
+		return true;
+	}
+
+	meshlink_packethdr_t *hdr = (meshlink_packethdr_t *)packet->data;
+
+	// The legacy header has no room for long destination names, the receiver would not be able to find itself
+	if(strlen(dest->name) >= sizeof(hdr->destination)) {
+		logger(mesh, MESHLINK_ERROR, "Name of %s is too long to send packets to it using the legacy packet header", dest->name);
+		return false;
+	}
+
+	memset(hdr, 0, sizeof(*hdr));
+	// leave the last byte as 0 to make sure strings are always
+	// null-terminated if they are longer than the buffer
+	strncpy((char *)hdr->destination, dest->name, sizeof(hdr->destination) - 1);
+	strncpy((char *)hdr->source, mesh->self->name, sizeof(hdr->source) - 1);
+	packet->len = len + sizeof(*hdr);
+	return true;
+}
+
+// Convert a locally generated packet with a compact header for a node that only understands the legacy header.
+static bool expand_packet_header(meshlink_handle_t *mesh, node_t *dest, vpn_packet_t *packet) {
+	size_t len = packet->len - sizeof(meshlink_compacthdr_t);
+
+	if(len > MAXSIZE - sizeof(meshlink_packethdr_t)) {
+		logger(mesh, MESHLINK_WARNING, "Packet for %s is too big for the legacy packet header", dest->name);
+		return false;
+	}
+
+	memmove(packet->data + sizeof(meshlink_packethdr_t), packet->data + sizeof(meshlink_compacthdr_t), len);
+	return write_packet_header(mesh, dest, packet, len, false);
+}
+
+static node_t *route_compact(meshlink_handle_t *mesh, node_t *source, vpn_packet_t *packet) {
+	const meshlink_compacthdr_t *hdr = (const meshlink_compacthdr_t *)packet->data;
+	uint16_t destination = ntohs(hdr->destination);
+
+	if(source == mesh->self) {
+		return lookup_node_id(mesh, destination);
+	}
+
+	// Remote nodes only send us compact headers for packets meant for us, using the IDs they announced
+	if(source->status.compact && ntohs(hdr->source) == source->compact_source && destination == source->compact_destination) {
+		return mesh->self;
+	}
+
+	logger(mesh, MESHLINK_WARNING, "Got packet from %s with unknown node IDs %u -> %u", source->name, ntohs(hdr->source), destination);
+	return NULL;
+}
+
 void route(meshlink_handle_t *mesh, node_t *source, vpn_packet_t *packet) {
 	assert(source);
 
-	// TODO: route on name or key
+	node_t *dest;
+	size_t hdrsize;
 
-	meshlink_packethdr_t *hdr = (meshlink_packethdr_t *) packet->data;
-	node_t *dest = lookup_node(mesh, (char *)hdr->destination);
-	logger(mesh, MESHLINK_DEBUG, "Routing packet from \"%s\" to \"%s\"\n", hdr->source, hdr->destination);
+	if(packet->len && !packet->data[0]) {
+		hdrsize = sizeof(meshlink_compacthdr_t);
 
-	//Check Length
-	if(!checklength(source, packet, sizeof(*hdr))) {
-		return;
-	}
+		if(!checklength(source, packet, hdrsize)) {
+			return;
+		}
 
-	if(dest == NULL) {
-		//Lookup failed
-		logger(mesh, MESHLINK_WARNING, "Can't lookup the destination of a packet in the route() function. This should never happen!\n");
-		logger(mesh, MESHLINK_WARNING, "Destination was: %s\n", hdr->destination);
-		return;
+		dest = route_compact(mesh, source, packet);
+
+		if(dest == NULL) {
+			return;
+		}
+
+		logger(mesh, MESHLINK_DEBUG, "Routing packet from \"%s\" to \"%s\"\n", source->name, dest->name);
+	} else {
+		meshlink_packethdr_t *hdr = (meshlink_packethdr_t *) packet->data;
+		hdrsize = sizeof(*hdr);
+
+		//Check Length
+		if(!checklength(source, packet, hdrsize)) {
+			return;
+		}
+
+		// TODO: route on name or key
+
+		dest = lookup_node(mesh, (char *)hdr->destination);
+		logger(mesh, MESHLINK_DEBUG, "Routing packet from \"%s\" to \"%s\"\n", hdr->source, hdr->destination);
+
+		if(dest == NULL) {
+			//Lookup failed
+			logger(mesh, MESHLINK_WARNING, "Can't lookup the destination of a packet in the route() function. This should never happen!\n");
+			logger(mesh, MESHLINK_WARNING, "Destination was: %s\n", hdr->destination);
+			return;
+		}
 	}
 
-	size_t len = packet->len - sizeof(*hdr);
+	size_t len = packet->len - hdrsize;
 
 	// Channel traffic accounting
 	if(source == mesh->self) {
@@ -66,7 +150,7 @@ void route(meshlink_handle_t *mesh, node_t *source, vpn_packet_t *packet) {
 
 	if(dest == mesh->self) {
 		source->in_data += len + SPTPS_OVERHEAD;
-		const void *payload = packet->data + sizeof(*hdr);
+		const void *payload = packet->data + hdrsize;
 
 		char hex[len * 2 + 1];
 
@@ -96,6 +180,10 @@ void route(meshlink_handle_t *mesh, node_t *source, vpn_packet_t *packet) {
 		return;
 	}
 
+	if(hdrsize == sizeof(meshlink_compacthdr_t) && !dest->status.compact && !expand_packet_header(mesh, dest, packet)) {
+		return;
+	}
+
 	send_packet(mesh, dest, packet);
 	return;
 }
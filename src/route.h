@@ -24,5 +24,7 @@
 #include "node.h"
 
 void route(struct meshlink_handle *mesh, struct node_t *, struct vpn_packet_t *);
+size_t packet_header_size(const struct node_t *n) __attribute__((__warn_unused_result__));
+bool write_packet_header(struct meshlink_handle *mesh, struct node_t *dest, struct vpn_packet_t *packet, size_t len, bool compact) __attribute__((__warn_unused_result__));
 
 #endif
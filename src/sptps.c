@@ -94,8 +94,10 @@ static void warning(sptps_t *s, const char *format, ...) {
 }
 
 // Send a record (datagram version, accepts all record types, handles encryption and authentication).
-static bool send_record_priv_datagram(sptps_t *s, uint8_t type, const void *data, uint16_t len) {
-	char buffer[len + SPTPS_DATAGRAM_OVERHEAD];
+// Send a datagram record whose payload is preceded by SPTPS_DATAGRAM_HEADROOM bytes
+// and followed by SPTPS_DATAGRAM_TAILROOM bytes that we are allowed to overwrite.
+static bool send_record_priv_datagram_in_place(sptps_t *s, uint8_t type, uint8_t *data, uint16_t len) {
+	uint8_t *buffer = data - SPTPS_DATAGRAM_HEADROOM;
 
 	// Create header with sequence number, length and record type
 	uint32_t seqno = s->outseqno++;
@@ -103,17 +105,25 @@ static bool send_record_priv_datagram(sptps_t *s, uint8_t type, const void *data
 
 	memcpy(buffer, &netseqno, 4);
 	buffer[4] = type;
-	memcpy(buffer + 5, data, len);
 
 	if(s->outstate) {
 		// If first handshake has finished, encrypt and HMAC
-		chacha_poly1305_encrypt(s->outcipher, seqno, buffer + 4, len + 1, buffer + 4, NULL);
+		chacha_poly1305_encrypt_in_place(s->outcipher, seqno, buffer + 4, len + 1);
 		return s->send_data(s->handle, type, buffer, len + SPTPS_DATAGRAM_OVERHEAD);
 	} else {
 		// Otherwise send as plaintext
 		return s->send_data(s->handle, type, buffer, len + 5UL);
 	}
 }
+
+static bool send_record_priv_datagram(sptps_t *s, uint8_t type, const void *data, uint16_t len) {
+	uint8_t buffer[len + SPTPS_DATAGRAM_OVERHEAD];
+
+	memcpy(buffer + SPTPS_DATAGRAM_HEADROOM, data, len);
+
+	return send_record_priv_datagram_in_place(s, type, buffer + SPTPS_DATAGRAM_HEADROOM, len);
+}
+
 // Send a record (private version, accepts all record types, handles encryption and authentication).
 static bool send_record_priv(sptps_t *s, uint8_t type, const void *data, uint16_t len) {
 	if(s->datagram) {
@@ -132,7 +142,7 @@ static bool send_record_priv(sptps_t *s, uint8_t type, const void *data, uint16_
 
 	if(s->outstate) {
 		// If first handshake has finished, encrypt and HMAC
-		chacha_poly1305_encrypt(s->outcipher, seqno, buffer + 2, len + 1, buffer + 2, NULL);
+		chacha_poly1305_encrypt_in_place(s->outcipher, seqno, buffer + 2, len + 1);
 		return s->send_data(s->handle, type, buffer, len + SPTPS_OVERHEAD);
 	} else {
 		// Otherwise send as plaintext
@@ -157,6 +167,26 @@ bool sptps_send_record(sptps_t *s, uint8_t type, const void *data, uint16_t len)
 	return send_record_priv(s, type, data, len);
 }
 
+// Send an application record, encrypting it in the caller's buffer if possible.
+// In datagram mode, data must be preceded by SPTPS_DATAGRAM_HEADROOM and followed by SPTPS_DATAGRAM_TAILROOM writable bytes.
+bool sptps_send_record_in_place(sptps_t *s, uint8_t type, void *data, uint16_t len) {
+	assert(!len || data);
+
+	if(!s->outstate) {
+		return error(s, EINVAL, "Handshake phase not finished yet");
+	}
+
+	if(type >= SPTPS_HANDSHAKE) {
+		return error(s, EINVAL, "Invalid application record type");
+	}
+
+	if(!s->datagram) {
+		return send_record_priv(s, type, data, len);
+	}
+
+	return send_record_priv_datagram_in_place(s, type, data, len);
+}
+
 // Send a Key EXchange record, containing a random nonce and an ECDHE public key.
 static bool send_kex(sptps_t *s) {
 	size_t keylen = ECDH_SIZE;
@@ -281,6 +311,7 @@ static bool receive_ack(sptps_t *s, const char *data, uint16_t len) {
 	free(s->key);
 	s->key = NULL;
 	s->instate = true;
+	s->key_generation++;
 
 	return true;
 }
@@ -310,33 +341,38 @@ static bool receive_kex(sptps_t *s, const char *data, uint16_t len) {
 	return send_sig(s);
 }
 
-// Receive a SIGnature record, verify it, if it passed, compute the shared secret and calculate the session keys.
-static bool receive_sig(sptps_t *s, const char *data, uint16_t len) {
-	size_t keylen = ECDH_SIZE;
-	size_t siglen = ecdsa_size(s->hiskey);
-
-	// Verify length of KEX record.
-	if(len != siglen) {
-		return error(s, EIO, "Invalid KEX record length");
+// Keep incoming data until a deferred signature verification has been done.
+static bool buffer_pending_data(sptps_t *s, const void *data, size_t len) {
+	if(!len) {
+		return true;
 	}
 
-	// Concatenate both KEX messages, plus tag indicating if it is from the connection originator
-	char msg[(1 + 32 + keylen) * 2 + 1 + s->labellen];
+	char *buf = realloc(s->pending_data, s->pending_datalen + len);
 
-	msg[0] = !s->initiator;
-	memcpy(msg + 1, s->hiskex, 1 + 32 + keylen);
-	memcpy(msg + 1 + 33 + keylen, s->mykex, 1 + 32 + keylen);
-	memcpy(msg + 1 + 2 * (33 + keylen), s->label, s->labellen);
-
-	// Verify signature.
-	if(!ecdsa_verify(s->hiskey, msg, sizeof(msg), data)) {
-		return error(s, EIO, "Failed to verify SIG record");
+	if(!buf) {
+		return error(s, errno, strerror(errno));
 	}
 
-	// Compute shared secret.
+	memcpy(buf + s->pending_datalen, data, len);
+	s->pending_data = buf;
+	s->pending_datalen += len;
+	return true;
+}
+
+// Datagram sessions keep handshake records that arrive while a verification is pending, prefixed with their length.
+static bool buffer_pending_record(sptps_t *s, const char *data, uint16_t len) {
+	uint8_t header[2] = {len >> 8, len};
+	return buffer_pending_data(s, header, sizeof(header)) && buffer_pending_data(s, data, len);
+}
+
+// Calculate the session keys, after the peer's SIGnature record has been verified.
+// If the shared secret has not been computed yet, do that first.
+static bool sig_verified(sptps_t *s, const char *precomputed) {
 	char shared[ECDH_SHARED_SIZE];
 
-	if(!ecdh_compute_shared(s->ecdh, s->hiskex + 1 + 32, shared)) {
+	if(precomputed) {
+		memcpy(shared, precomputed, sizeof(shared));
+	} else if(!ecdh_compute_shared(s->ecdh, s->hiskex + 1 + 32, shared)) {
 		return error(s, EINVAL, "Failed to compute ECDH shared secret");
 	}
 
@@ -369,9 +405,189 @@ static bool receive_sig(sptps_t *s, const char *data, uint16_t len) {
 		}
 	}
 
+	if(s->outstate) {
+		s->state = SPTPS_ACK;
+	} else {
+		s->outstate = true;
+
+		if(!receive_ack(s, NULL, 0)) {
+			return false;
+		}
+
+		s->receive_record(s->handle, SPTPS_HANDSHAKE, NULL, 0);
+		s->state = SPTPS_SECONDARY_KEX;
+	}
+
 	return true;
 }
 
+// Receive a SIGnature record and verify it, or let the application verify it later together with other signatures.
+static bool receive_sig(sptps_t *s, const char *data, uint16_t len) {
+	size_t keylen = ECDH_SIZE;
+	size_t siglen = ecdsa_size(s->hiskey);
+
+	// Verify length of KEX record.
+	if(len != siglen) {
+		return error(s, EIO, "Invalid KEX record length");
+	}
+
+	// Concatenate both KEX messages, plus tag indicating if it is from the connection originator
+	char msg[(1 + 32 + keylen) * 2 + 1 + s->labellen];
+
+	msg[0] = !s->initiator;
+	memcpy(msg + 1, s->hiskex, 1 + 32 + keylen);
+	memcpy(msg + 1 + 33 + keylen, s->mykex, 1 + 32 + keylen);
+	memcpy(msg + 1 + 2 * (33 + keylen), s->label, s->labellen);
+
+	if(s->defer_verify) {
+		s->pending_msg = malloc(sizeof(msg));
+		s->pending_sig = malloc(siglen);
+
+		if(!s->pending_msg || !s->pending_sig) {
+			return error(s, errno, strerror(errno));
+		}
+
+		memcpy(s->pending_msg, msg, sizeof(msg));
+		memcpy(s->pending_sig, data, siglen);
+		s->pending_msglen = sizeof(msg);
+		s->verify_pending = true;
+
+		if(s->defer_verify(s->handle)) {
+			return true;
+		}
+
+		s->verify_pending = false;
+		free(s->pending_msg);
+		free(s->pending_sig);
+		s->pending_msg = NULL;
+		s->pending_sig = NULL;
+	}
+
+	// Verify signature.
+	if(!ecdsa_verify(s->hiskey, msg, sizeof(msg), data)) {
+		return error(s, EIO, "Failed to verify SIG record");
+	}
+
+	return sig_verified(s, NULL);
+}
+
+static bool receive_handshake(sptps_t *s, const char *data, uint16_t len);
+
+static bool continue_handshake(sptps_t *s, bool valid, const char *shared) {
+	if(!s->verify_pending) {
+		return error(s, EIO, "No signature verification pending");
+	}
+
+	s->verify_pending = false;
+	free(s->pending_msg);
+	free(s->pending_sig);
+	s->pending_msg = NULL;
+	s->pending_sig = NULL;
+
+	if(!valid) {
+		return error(s, EIO, "Failed to verify SIG record");
+	}
+
+	if(!sig_verified(s, shared)) {
+		return false;
+	}
+
+	// Process the data that arrived in the mean time.
+	char *data = s->pending_data;
+	size_t len = s->pending_datalen;
+	s->pending_data = NULL;
+	s->pending_datalen = 0;
+
+	bool result = true;
+
+	if(!s->datagram) {
+		result = !len || sptps_receive_data(s, data, len);
+	} else {
+		for(size_t offset = 0; result && offset + 2 <= len;) {
+			uint16_t reclen = (uint8_t)data[offset] << 8 | (uint8_t)data[offset + 1];
+			result = receive_handshake(s, data + offset + 2, reclen);
+			offset += 2 + reclen;
+		}
+	}
+
+	free(data);
+	return result;
+}
+
+// Continue the handshake once a deferred signature verification has been done.
+bool sptps_verify_done(sptps_t *s, bool valid) {
+	return continue_handshake(s, valid, NULL);
+}
+
+// Move a deferred signature verification and the ECDH computation into a job that can be run on another thread.
+sptps_job_t *sptps_take_job(sptps_t *s) {
+	if(!s->verify_pending || s->job || !s->ecdh) {
+		error(s, EIO, "No signature verification pending");
+		return NULL;
+	}
+
+	sptps_job_t *job = calloc(1, sizeof(*job));
+
+	if(!job) {
+		error(s, errno, strerror(errno));
+		return NULL;
+	}
+
+	job->s = s;
+	job->hiskey = ecdsa_set_public_key(ecdsa_get_public_key(s->hiskey));
+	job->msg = s->pending_msg;
+	job->msglen = s->pending_msglen;
+	job->sig = s->pending_sig;
+	job->ecdh = s->ecdh;
+	memcpy(job->hiskex, s->hiskex + 1 + 32, ECDH_SIZE);
+
+	s->pending_msg = NULL;
+	s->pending_sig = NULL;
+	s->ecdh = NULL;
+	s->job = job;
+	return job;
+}
+
+// Do the work of a job. This does not access the SPTPS session, so it is safe to call from any thread.
+void sptps_run_job(sptps_job_t *job) {
+	job->valid = ecdsa_verify(job->hiskey, job->msg, job->msglen, job->sig);
+	sptps_finish_job(job);
+}
+
+// Compute the shared secret of a job whose signature has already been checked, for example in a batch.
+void sptps_finish_job(sptps_job_t *job) {
+	if(job->valid) {
+		job->valid = ecdh_compute_shared(job->ecdh, job->hiskex, job->shared);
+	} else {
+		ecdh_free(job->ecdh);
+	}
+
+	job->ecdh = NULL;
+}
+
+// Continue the handshake with the results of a job. Must be called from the thread that owns the session.
+bool sptps_job_done(sptps_t *s, sptps_job_t *job) {
+	if(s->job != job) {
+		return error(s, EIO, "Job does not belong to this session");
+	}
+
+	s->job = NULL;
+	return continue_handshake(s, job->valid, job->shared);
+}
+
+void sptps_free_job(sptps_job_t *job) {
+	if(!job) {
+		return;
+	}
+
+	ecdsa_free(job->hiskey);
+	ecdh_free(job->ecdh);
+	free(job->msg);
+	free(job->sig);
+	memset(job->shared, 0, sizeof(job->shared));
+	free(job);
+}
+
 // Force another Key EXchange (for testing purposes).
 bool sptps_force_kex(sptps_t *s) {
 	if(!s->outstate) {
@@ -412,24 +628,7 @@ static bool receive_handshake(sptps_t *s, const char *data, uint16_t len) {
 	case SPTPS_SIG:
 
 		// If we already sent our secondary public ECDH key, we expect the peer to send his.
-		if(!receive_sig(s, data, len)) {
-			return false;
-		}
-
-		if(s->outstate) {
-			s->state = SPTPS_ACK;
-		} else {
-			s->outstate = true;
-
-			if(!receive_ack(s, NULL, 0)) {
-				return false;
-			}
-
-			s->receive_record(s->handle, SPTPS_HANDSHAKE, NULL, 0);
-			s->state = SPTPS_SECONDARY_KEX;
-		}
-
-		return true;
+		return receive_sig(s, data, len);
 
 	case SPTPS_ACK:
 
@@ -448,6 +647,93 @@ static bool receive_handshake(sptps_t *s, const char *data, uint16_t len) {
 	}
 }
 
+// Check a sequence number against the replay window.
+// s->inseqno is expected sequence number
+// seqno is received sequence number
+// s->late[] is a circular buffer, a 1 bit means a packet has not been received yet
+// The circular buffer contains bits for sequence numbers from s->inseqno - s->replaywin * 8 to (but excluding) s->inseqno.
+// Without update_state nothing is changed, so this can be used to drop replayed packets before spending time on decrypting them.
+// The window is only updated once a datagram has been authenticated.
+static bool check_seqno(sptps_t *s, uint32_t seqno, bool update_state) {
+	if(!s->replaywin) {
+		return true;
+	}
+
+	if(seqno != s->inseqno) {
+		if(seqno >= s->inseqno + s->replaywin * 8) {
+			// Only give up on the packets in the window if several packets in a row jump far ahead,
+			// so a single stray packet cannot cause all the others to be dropped.
+			if(!update_state) {
+				return true;
+			}
+
+			if(s->farfuture < s->replaywin >> 2) {
+				s->farfuture++;
+				return error(s, EIO, "Packet is %u seqs in the future, dropped (%u)\n", seqno - s->inseqno, s->farfuture);
+			}
+
+			warning(s, "Lost %d packets\n", seqno - s->inseqno);
+			// Mark all packets in the replay window as being late.
+			memset(s->late, 255, s->replaywin);
+		} else if(seqno < s->inseqno) {
+			// If the sequence number is farther in the past than the bitmap goes, or if the packet was already received, drop it.
+			if((s->inseqno >= s->replaywin * 8 && seqno < s->inseqno - s->replaywin * 8) || !(s->late[(seqno / 8) % s->replaywin] & (1 << seqno % 8))) {
+				if(!update_state) {
+					return false;
+				}
+
+				return error(s, EIO, "Received late or replayed packet, seqno %d, last received %d\n", seqno, s->inseqno);
+			}
+		} else if(update_state) {
+			// We missed some packets. Mark them in the bitmap as being late.
+			for(uint32_t i = s->inseqno; i < seqno; i++) {
+				s->late[(i / 8) % s->replaywin] |= 1 << i % 8;
+			}
+		}
+	}
+
+	if(update_state) {
+		// Mark the current packet as not being late.
+		s->late[(seqno / 8) % s->replaywin] &= ~(1 << seqno % 8);
+		s->farfuture = 0;
+	}
+
+	return true;
+}
+
+// Check whether a datagram's sequence number fits in the replay window, without decrypting it.
+bool sptps_check_datagram(sptps_t *s, const void *data, size_t len) {
+	if(!s->instate || len < SPTPS_DATAGRAM_OVERHEAD) {
+		return true;
+	}
+
+	uint32_t seqno;
+	memcpy(&seqno, data, 4);
+	seqno = ntohl(seqno);
+
+	return check_seqno(s, seqno, false);
+}
+
+// Estimate how likely it is that a datagram from an unknown address belongs to this session, without decrypting it.
+// The distance is how far its sequence number is from the next one expected, returns false if it cannot belong to this session.
+bool sptps_datagram_distance(const sptps_t *s, const void *data, size_t len, uint32_t *distance) {
+	if(!s->instate || len < SPTPS_DATAGRAM_OVERHEAD) {
+		return false;
+	}
+
+	uint32_t seqno;
+	memcpy(&seqno, data, 4);
+	seqno = ntohl(seqno);
+
+	if(seqno >= s->inseqno) {
+		*distance = seqno - s->inseqno;
+		return *distance < SPTPS_DATAGRAM_MAX_DISTANCE;
+	}
+
+	*distance = s->inseqno - seqno;
+	return !s->replaywin || *distance <= s->replaywin * 8;
+}
+
 // Check datagram for valid HMAC
 bool sptps_verify_datagram(sptps_t *s, const void *data, size_t len) {
 	if(!s->instate) {
@@ -461,11 +747,59 @@ bool sptps_verify_datagram(sptps_t *s, const void *data, size_t len) {
 	uint32_t seqno;
 	memcpy(&seqno, data, 4);
 	seqno = ntohl(seqno);
-	// TODO: check whether seqno makes sense, to avoid CPU intensive decrypt
+
+	if(!check_seqno(s, seqno, false)) {
+		return false;
+	}
 
 	return chacha_poly1305_verify(s->incipher, seqno, (const char *)data + 4, len - 4);
 }
 
+// Check the sequence number of a decrypted datagram and handle the record it contains.
+// The decrypted buffer must be at least len - 4 bytes long, where len is the length of the original datagram.
+static bool receive_decrypted_datagram(sptps_t *s, uint32_t seqno, char *decrypted, size_t len) {
+	if(!check_seqno(s, seqno, true)) {
+		return false;
+	}
+
+	if(seqno >= s->inseqno) {
+		s->inseqno = seqno + 1;
+	}
+
+	if(!s->inseqno) {
+		s->received = 0;
+	} else {
+		s->received++;
+	}
+
+	// Append a NULL byte for safety.
+	decrypted[len - 20] = 0;
+
+	uint8_t type = decrypted[0];
+
+	if(type < SPTPS_HANDSHAKE) {
+		if(!s->instate) {
+			return error(s, EIO, "Application record received before handshake finished");
+		}
+
+		if(!s->receive_record(s->handle, type, decrypted + 1, len - SPTPS_DATAGRAM_OVERHEAD)) {
+			abort();
+		}
+	} else if(type == SPTPS_HANDSHAKE) {
+		if(s->verify_pending) {
+			return buffer_pending_record(s, decrypted + 1, len - SPTPS_DATAGRAM_OVERHEAD);
+		}
+
+		if(!receive_handshake(s, decrypted + 1, len - SPTPS_DATAGRAM_OVERHEAD)) {
+			abort();
+		}
+	} else {
+		return error(s, EIO, "Invalid record type %d", type);
+	}
+
+	return true;
+}
+
 // Receive incoming data, datagram version.
 static bool sptps_receive_data_datagram(sptps_t *s, const void *vdata, size_t len) {
 	const char *data = vdata;
@@ -491,9 +825,17 @@ static bool sptps_receive_data_datagram(sptps_t *s, const void *vdata, size_t le
 			return error(s, EIO, "Application record received before handshake finished");
 		}
 
+		if(s->verify_pending) {
+			return buffer_pending_record(s, data + 5, len - 5);
+		}
+
 		return receive_handshake(s, data + 5, len - 5);
 	}
 
+	if(!check_seqno(s, seqno, false)) {
+		return error(s, EIO, "Received late or replayed packet, seqno %d, last received %d\n", seqno, s->inseqno);
+	}
+
 	// Decrypt
 
 	if(len > s->decrypted_buffer_len) {
@@ -513,67 +855,31 @@ static bool sptps_receive_data_datagram(sptps_t *s, const void *vdata, size_t le
 		return error(s, EIO, "Failed to decrypt and verify packet");
 	}
 
-	// Replay protection using a sliding window of configurable size.
-	// s->inseqno is expected sequence number
-	// seqno is received sequence number
-	// s->late[] is a circular buffer, a 1 bit means a packet has not been received yet
-	// The circular buffer contains bits for sequence numbers from s->inseqno - s->replaywin * 8 to (but excluding) s->inseqno.
-	if(s->replaywin) {
-		if(seqno != s->inseqno) {
-			if(seqno >= s->inseqno + s->replaywin * 8) {
-				// TODO: Prevent packets that jump far ahead of the queue from causing many others to be dropped.
-				warning(s, "Lost %d packets\n", seqno - s->inseqno);
-				// Mark all packets in the replay window as being late.
-				memset(s->late, 255, s->replaywin);
-			} else if(seqno < s->inseqno) {
-				// If the sequence number is farther in the past than the bitmap goes, or if the packet was already received, drop it.
-				if((s->inseqno >= s->replaywin * 8 && seqno < s->inseqno - s->replaywin * 8) || !(s->late[(seqno / 8) % s->replaywin] & (1 << seqno % 8))) {
-					return error(s, EIO, "Received late or replayed packet, seqno %d, last received %d\n", seqno, s->inseqno);
-				}
-			} else {
-				// We missed some packets. Mark them in the bitmap as being late.
-				for(uint32_t i = s->inseqno; i < seqno; i++) {
-					s->late[(i / 8) % s->replaywin] |= 1 << i % 8;
-				}
-			}
-		}
-
-		// Mark the current packet as not being late.
-		s->late[(seqno / 8) % s->replaywin] &= ~(1 << seqno % 8);
-	}
+	return receive_decrypted_datagram(s, seqno, s->decrypted_buffer, len);
+}
 
-	if(seqno >= s->inseqno) {
-		s->inseqno = seqno + 1;
-	}
+// Decrypt a datagram using a copy of a session's incoming cipher, so this can be done on another thread.
+// The datagram itself is left untouched, the decrypted record is written to decrypted.
+bool sptps_decrypt_datagram(chacha_poly1305_ctx_t *cipher, const void *vdata, size_t len, void *decrypted, uint32_t *seqno) {
+	const char *data = vdata;
 
-	if(!s->inseqno) {
-		s->received = 0;
-	} else {
-		s->received++;
+	if(len < SPTPS_DATAGRAM_OVERHEAD) {
+		return false;
 	}
 
-	// Append a NULL byte for safety.
-	s->decrypted_buffer[len - 20] = 0;
-
-	uint8_t type = s->decrypted_buffer[0];
+	memcpy(seqno, data, 4);
+	*seqno = ntohl(*seqno);
 
-	if(type < SPTPS_HANDSHAKE) {
-		if(!s->instate) {
-			return error(s, EIO, "Application record received before handshake finished");
-		}
+	return chacha_poly1305_decrypt(cipher, *seqno, data + 4, len - 4, decrypted, NULL);
+}
 
-		if(!s->receive_record(s->handle, type, s->decrypted_buffer + 1, len - SPTPS_DATAGRAM_OVERHEAD)) {
-			abort();
-		}
-	} else if(type == SPTPS_HANDSHAKE) {
-		if(!receive_handshake(s, s->decrypted_buffer + 1, len - SPTPS_DATAGRAM_OVERHEAD)) {
-			abort();
-		}
-	} else {
-		return error(s, EIO, "Invalid record type %d", type);
+// Continue processing a datagram that was decrypted with sptps_decrypt_datagram().
+bool sptps_receive_decrypted_datagram(sptps_t *s, uint32_t seqno, char *decrypted, size_t len) {
+	if(!s->instate) {
+		return error(s, EIO, "SPTPS state not ready to receive this datagram");
 	}
 
-	return true;
+	return receive_decrypted_datagram(s, seqno, decrypted, len);
 }
 
 // Receive incoming data. Check if it contains a complete record, if so, handle it.
@@ -586,6 +892,10 @@ bool sptps_receive_data(sptps_t *s, const void *data, size_t len) {
 		return sptps_receive_data_datagram(s, data, len);
 	}
 
+	if(s->verify_pending) {
+		return buffer_pending_data(s, data, len);
+	}
+
 	const char *ptr = data;
 
 	while(len) {
@@ -649,7 +959,7 @@ bool sptps_receive_data(sptps_t *s, const void *data, size_t len) {
 
 		// Check HMAC and decrypt.
 		if(s->instate) {
-			if(!chacha_poly1305_decrypt(s->incipher, seqno, s->inbuf + 2UL, s->reclen + 17UL, s->inbuf + 2UL, NULL)) {
+			if(!chacha_poly1305_decrypt_in_place(s->incipher, seqno, s->inbuf + 2UL, s->reclen + 17UL, NULL)) {
 				return error(s, EINVAL, "Failed to decrypt and verify record");
 			}
 		}
@@ -676,6 +986,11 @@ bool sptps_receive_data(sptps_t *s, const void *data, size_t len) {
 		}
 
 		s->buflen = 0;
+
+		// Records following a SIG record can only be handled once it has been verified.
+		if(s->verify_pending) {
+			return buffer_pending_data(s, ptr, len);
+		}
 	}
 
 	return true;
@@ -688,7 +1003,9 @@ bool sptps_start(sptps_t *s, void *handle, bool initiator, bool datagram, ecdsa_
 	}
 
 	// Initialise struct sptps
+	uint32_t generation = s->generation;
 	memset(s, 0, sizeof(*s));
+	s->generation = generation + 1;
 
 	s->handle = handle;
 	s->initiator = initiator;
@@ -752,8 +1069,19 @@ bool sptps_stop(sptps_t *s) {
 	free(s->key);
 	free(s->label);
 	free(s->late);
+	free(s->pending_msg);
+	free(s->pending_sig);
+	free(s->pending_data);
+
+	// A job that is still running is freed by whoever completes it
+	if(s->job) {
+		s->job->s = NULL;
+	}
+
 	memset(s->decrypted_buffer, 0, s->decrypted_buffer_len);
 	free(s->decrypted_buffer);
+	uint32_t generation = s->generation;
 	memset(s, 0, sizeof(*s));
+	s->generation = generation + 1;
 	return true;
 }
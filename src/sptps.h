@@ -43,8 +43,32 @@
 #define SPTPS_OVERHEAD 19
 #define SPTPS_DATAGRAM_OVERHEAD 21
 
+// How far ahead of the expected sequence number a datagram from an unknown address may be, and still be matched to a session
+#define SPTPS_DATAGRAM_MAX_DISTANCE 65536
+
+// Space needed around a datagram record's payload to encrypt it in place
+#define SPTPS_DATAGRAM_HEADROOM 5
+#define SPTPS_DATAGRAM_TAILROOM 16
+
 typedef bool (*send_data_t)(void *handle, uint8_t type, const void *data, size_t len);
 typedef bool (*receive_record_t)(void *handle, uint8_t type, const void *data, uint16_t len);
+typedef bool (*defer_verify_t)(void *handle);
+
+struct sptps;
+
+// Signature verification and ECDH computation of a handshake, with copies of everything needed to run it on another thread
+typedef struct sptps_job {
+	struct sptps *s;      // NULL if the session was stopped before the job was completed
+	ecdsa_t *hiskey;
+	char *msg;
+	size_t msglen;
+	char *sig;
+	ecdh_t *ecdh;
+	char hiskex[ECDH_SIZE];
+	bool valid;
+	char shared[ECDH_SHARED_SIZE];
+	void (*done)(struct sptps *s, bool result);  // Optional, for use by the application
+} sptps_job_t;
 
 typedef struct sptps {
 	// State
@@ -54,15 +78,18 @@ typedef struct sptps {
 	bool outstate;
 
 	int state;
+	uint32_t generation;  // Incremented every time the session is started or stopped, survives sptps_stop()
 
 	// Main member variables
 	char *inbuf;
 	size_t buflen;
 
 	chacha_poly1305_ctx_t *incipher;
+	uint32_t key_generation;  // Incremented every time the incoming cipher gets a new key
 	uint32_t replaywin;
 	uint32_t inseqno;
 	uint32_t received;
+	uint32_t farfuture;    // Number of authenticated packets in a row that were too far ahead of the replay window
 	uint16_t reclen;
 
 	chacha_poly1305_ctx_t *outcipher;
@@ -77,6 +104,7 @@ typedef struct sptps {
 	void *handle;
 	send_data_t send_data;
 	receive_record_t receive_record;
+	defer_verify_t defer_verify;  // Optional, returns true if the application will call sptps_verify_done() later
 
 	// Variables used for the authentication phase
 	ecdsa_t *mykey;
@@ -89,6 +117,15 @@ typedef struct sptps {
 	char *label;
 	size_t labellen;
 
+	// A SIGnature record waiting to be verified by the application, and stream data received after it
+	bool verify_pending;
+	char *pending_msg;
+	size_t pending_msglen;
+	char *pending_sig;
+	char *pending_data;
+	size_t pending_datalen;
+	sptps_job_t *job;
+
 } sptps_t;
 
 void sptps_log_quiet(sptps_t *s, int s_errno, const char *format, va_list ap);
@@ -97,8 +134,19 @@ extern void (*sptps_log)(sptps_t *s, int s_errno, const char *format, va_list ap
 bool sptps_start(sptps_t *s, void *handle, bool initiator, bool datagram, ecdsa_t *mykey, ecdsa_t *hiskey, const char *label, size_t labellen, send_data_t send_data, receive_record_t receive_record) __attribute__((__warn_unused_result__));
 bool sptps_stop(sptps_t *s);
 bool sptps_send_record(sptps_t *s, uint8_t type, const void *data, uint16_t len);
+bool sptps_send_record_in_place(sptps_t *s, uint8_t type, void *data, uint16_t len);
 bool sptps_receive_data(sptps_t *s, const void *data, size_t len) __attribute__((__warn_unused_result__));
 bool sptps_force_kex(sptps_t *s) __attribute__((__warn_unused_result__));
+bool sptps_verify_done(sptps_t *s, bool valid) __attribute__((__warn_unused_result__));
+sptps_job_t *sptps_take_job(sptps_t *s) __attribute__((__warn_unused_result__));
+void sptps_run_job(sptps_job_t *job);
+void sptps_finish_job(sptps_job_t *job);
+bool sptps_job_done(sptps_t *s, sptps_job_t *job) __attribute__((__warn_unused_result__));
+void sptps_free_job(sptps_job_t *job);
 bool sptps_verify_datagram(sptps_t *s, const void *data, size_t len) __attribute__((__warn_unused_result__));
+bool sptps_check_datagram(sptps_t *s, const void *data, size_t len) __attribute__((__warn_unused_result__));
+bool sptps_datagram_distance(const sptps_t *s, const void *data, size_t len, uint32_t *distance) __attribute__((__warn_unused_result__));
+bool sptps_decrypt_datagram(chacha_poly1305_ctx_t *cipher, const void *data, size_t len, void *decrypted, uint32_t *seqno) __attribute__((__warn_unused_result__));
+bool sptps_receive_decrypted_datagram(sptps_t *s, uint32_t seqno, char *decrypted, size_t len) __attribute__((__warn_unused_result__));
 
 #endif
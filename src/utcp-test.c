@@ -36,11 +36,18 @@ static double reorder;
 static long reorder_dist = 10;
 static double dropin;
 static double dropout;
+static char *dropin_packets;
+static char *dropout_packets;
 static long total_out;
 static long total_in;
 static FILE *reference;
 static long mtu;
 static long bufsize;
+static long buffer_limit;
+static enum utcp_cc cc = UTCP_CC_NEWRENO;
+static bool pacing = true;
+static bool delayed_ack = true;
+static long max_rate;
 
 static char *reorder_data;
 static size_t reorder_len;
@@ -99,6 +106,27 @@ static ssize_t do_recv(struct utcp_connection *rc, const void *data, size_t len)
 	return write(1, data, len);
 }
 
+// Check whether a packet number is in a list like "10,20-25,40"
+static bool in_list(const char *list, long pktno) {
+	while(list && *list) {
+		char *end;
+		long from = strtol(list, &end, 10);
+		long to = from;
+
+		if(*end == '-') {
+			to = strtol(end + 1, &end, 10);
+		}
+
+		if(pktno >= from && pktno <= to) {
+			return true;
+		}
+
+		list = *end == ',' ? end + 1 : NULL;
+	}
+
+	return false;
+}
+
 static void do_accept(struct utcp_connection *nc, uint16_t port) {
 	(void)port;
 	utcp_accept(nc, do_recv, NULL);
@@ -109,6 +137,14 @@ static void do_accept(struct utcp_connection *nc, uint16_t port) {
 		utcp_set_rcvbuf(c, NULL, bufsize);
 	}
 
+	if(buffer_limit) {
+		utcp_set_buffer_limit(c, buffer_limit);
+	}
+
+	utcp_set_congestion_control(c, cc);
+	utcp_set_pacing(c, pacing);
+	utcp_set_delayed_ack(c, delayed_ack);
+	utcp_set_max_rate(c, max_rate);
 	utcp_set_accept_cb(c->utcp, NULL, NULL);
 }
 
@@ -116,6 +152,11 @@ static ssize_t do_send(struct utcp *utcp, const void *data, size_t len) {
 	int s = *(int *)utcp->priv;
 	outpktno++;
 
+	if(in_list(dropout_packets, outpktno)) {
+		debug("Dropped outgoing packet %ld\n", outpktno);
+		return len;
+	}
+
 	if(outpktno >= dropfrom && outpktno < dropto) {
 		if(drand48() < dropout) {
 			debug("Dropped outgoing packet\n");
@@ -198,6 +239,10 @@ int main(int argc, char *argv[]) {
 		dropout = atof(getenv("DROPOUT"));
 	}
 
+	// Deterministic loss patterns
+	dropin_packets = getenv("DROPIN_PACKETS");
+	dropout_packets = getenv("DROPOUT_PACKETS");
+
 	if(getenv("DROPFROM")) {
 		dropfrom = atoi(getenv("DROPFROM"));
 	}
@@ -230,6 +275,37 @@ int main(int argc, char *argv[]) {
 		bufsize = atoi(getenv("BUFSIZE"));
 	}
 
+	if(getenv("BUFFER_LIMIT")) {
+		buffer_limit = atol(getenv("BUFFER_LIMIT"));
+	}
+
+	if(getenv("PACING")) {
+		pacing = atoi(getenv("PACING"));
+	}
+
+	if(getenv("DELAYED_ACK")) {
+		delayed_ack = atoi(getenv("DELAYED_ACK"));
+	}
+
+	if(getenv("MAX_RATE")) {
+		max_rate = atol(getenv("MAX_RATE"));
+	}
+
+	if(getenv("CC")) {
+		const char *name = getenv("CC");
+
+		if(!strcmp(name, "newreno")) {
+			cc = UTCP_CC_NEWRENO;
+		} else if(!strcmp(name, "cubic")) {
+			cc = UTCP_CC_CUBIC;
+		} else if(!strcmp(name, "bbr")) {
+			cc = UTCP_CC_BBR;
+		} else {
+			debug("Unknown congestion control algorithm %s\n", name);
+			return 1;
+		}
+	}
+
 	char *reference_filename = getenv("REFERENCE");
 
 	if(reference_filename) {
@@ -302,6 +378,15 @@ int main(int argc, char *argv[]) {
 			utcp_set_sndbuf(c, NULL, bufsize);
 			utcp_set_rcvbuf(c, NULL, bufsize);
 		}
+
+		if(buffer_limit) {
+			utcp_set_buffer_limit(c, buffer_limit);
+		}
+
+		utcp_set_congestion_control(c, cc);
+		utcp_set_pacing(c, pacing);
+		utcp_set_delayed_ack(c, delayed_ack);
+		utcp_set_max_rate(c, max_rate);
 	}
 
 	struct pollfd fds[2] = {
@@ -384,7 +469,9 @@ int main(int argc, char *argv[]) {
 
 			inpktno++;
 
-			if(inpktno >= dropto || inpktno < dropfrom || drand48() >= dropin) {
+			if(in_list(dropin_packets, inpktno)) {
+				debug("Dropped incoming packet %ld\n", inpktno);
+			} else if(inpktno >= dropto || inpktno < dropfrom || drand48() >= dropin) {
 				total_in += len;
 
 				if(utcp_recv(u, buf, len) == -1) {
@@ -396,6 +483,13 @@ int main(int argc, char *argv[]) {
 		}
 
 		timeout = utcp_timeout(u);
+
+		// UTCP does not allow sending after the peer has closed its end, so close ours as well
+		if(c && !(dir & DIR_WRITE) && fds[0].fd != -1) {
+			fds[0].fd = -1;
+			dir &= ~DIR_READ;
+			utcp_shutdown(c, SHUT_WR);
+		}
 	};
 
 	utcp_close(c);
@@ -405,6 +499,7 @@ int main(int argc, char *argv[]) {
 	free(reorder_data);
 
 	debug("Total bytes in: %ld, out: %ld\n", total_in, total_out);
+	debug("Total packets in: %ld, out: %ld\n", inpktno, outpktno);
 
 	return 0;
 }
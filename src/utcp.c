@@ -51,6 +51,17 @@ static void timespec_sub(const struct timespec *a, const struct timespec *b, str
 	}
 }
 
+static void timespec_add_usec(struct timespec *a, int64_t usec) {
+	a->tv_sec += usec / USEC_PER_SEC;
+	a->tv_nsec += (usec % USEC_PER_SEC) * 1000;
+
+	if(a->tv_nsec >= NSEC_PER_SEC) {
+		a->tv_sec++, a->tv_nsec -= NSEC_PER_SEC;
+	} else if(a->tv_nsec < 0) {
+		a->tv_sec--, a->tv_nsec += NSEC_PER_SEC;
+	}
+}
+
 static int32_t timespec_diff_usec(const struct timespec *a, const struct timespec *b) {
 	return (a->tv_sec - b->tv_sec) * 1000000 + (a->tv_nsec - b->tv_nsec) / 1000;
 }
@@ -156,11 +167,156 @@ static void debug_cwnd(struct utcp_connection *c) {
 #define debug_cwnd(...) do {} while(0)
 #endif
 
+// Connections that have something to do at a certain time are kept in a binary min-heap,
+// ordered by their deadline. A connection's deadline is never later than the time
+// utcp_timeout() really needs to look at it, but it can be earlier, in which case
+// utcp_timeout() will just recalculate it.
+
+static const struct timespec asap = {0, 0};
+
+static void deadline_place(struct utcp *utcp, struct utcp_connection *c, int i) {
+	utcp->deadlines[i] = c;
+	c->deadline_index = i + 1;
+}
+
+static void deadline_sift_up(struct utcp *utcp, int i) {
+	struct utcp_connection *c = utcp->deadlines[i];
+
+	while(i) {
+		int parent = (i - 1) / 2;
+
+		if(!timespec_lt(&c->deadline, &utcp->deadlines[parent]->deadline)) {
+			break;
+		}
+
+		deadline_place(utcp, utcp->deadlines[parent], i);
+		i = parent;
+	}
+
+	deadline_place(utcp, c, i);
+}
+
+static void deadline_sift_down(struct utcp *utcp, int i) {
+	struct utcp_connection *c = utcp->deadlines[i];
+
+	while(2 * i + 1 < utcp->ndeadlines) {
+		int child = 2 * i + 1;
+
+		if(child + 1 < utcp->ndeadlines && timespec_lt(&utcp->deadlines[child + 1]->deadline, &utcp->deadlines[child]->deadline)) {
+			child++;
+		}
+
+		if(!timespec_lt(&utcp->deadlines[child]->deadline, &c->deadline)) {
+			break;
+		}
+
+		deadline_place(utcp, utcp->deadlines[child], i);
+		i = child;
+	}
+
+	deadline_place(utcp, c, i);
+}
+
+static void deadline_remove(struct utcp_connection *c) {
+	struct utcp *utcp = c->utcp;
+	int i = c->deadline_index - 1;
+	c->deadline_index = 0;
+
+	struct utcp_connection *last = utcp->deadlines[--utcp->ndeadlines];
+
+	if(last == c) {
+		return;
+	}
+
+	deadline_place(utcp, last, i);
+	deadline_sift_up(utcp, i);
+	deadline_sift_down(utcp, last->deadline_index - 1);
+}
+
+// Make sure utcp_timeout() looks at this connection no later than the given time.
+static void schedule(struct utcp_connection *c, const struct timespec *when) {
+	struct utcp *utcp = c->utcp;
+
+	if(c->deadline_index) {
+		if(!timespec_lt(when, &c->deadline)) {
+			return;
+		}
+
+		c->deadline = *when;
+		deadline_sift_up(utcp, c->deadline_index - 1);
+	} else {
+		c->deadline = *when;
+		deadline_place(utcp, c, utcp->ndeadlines++);
+		deadline_sift_up(utcp, utcp->ndeadlines - 1);
+	}
+
+	// Tell the application if it has to call utcp_timeout() earlier than it thinks
+
+	if(!utcp->deadline || !timespec_lt(when, &utcp->next_deadline)) {
+		return;
+	}
+
+	utcp->next_deadline = *when;
+
+	struct timespec now, diff = {0, 0};
+
+	if(timespec_isset(when)) {
+		clock_gettime(UTCP_CLOCK, &now);
+
+		if(timespec_lt(&now, when)) {
+			timespec_sub(when, &now, &diff);
+		}
+	}
+
+	utcp->deadline(utcp, &diff);
+}
+
+static void update_deadline(struct utcp_connection *c) {
+	if(c->state == CLOSED) {
+		if(c->reapable) {
+			schedule(c, &asap);
+		}
+
+		return;
+	}
+
+	if(c->do_poll && c->poll && (c->state == ESTABLISHED || c->state == CLOSE_WAIT)) {
+		schedule(c, &asap);
+		return;
+	}
+
+	if(timespec_isset(&c->conn_timeout)) {
+		schedule(c, &c->conn_timeout);
+	}
+
+	if(timespec_isset(&c->rtrx_timeout)) {
+		schedule(c, &c->rtrx_timeout);
+	}
+
+	if(timespec_isset(&c->pace_timeout)) {
+		schedule(c, &c->pace_timeout);
+	}
+
+	if(timespec_isset(&c->reorder_timeout)) {
+		schedule(c, &c->reorder_timeout);
+	}
+
+	if(timespec_isset(&c->probe_timeout)) {
+		schedule(c, &c->probe_timeout);
+	}
+
+	if(timespec_isset(&c->ack_timeout)) {
+		schedule(c, &c->ack_timeout);
+	}
+}
+
 static void set_state(struct utcp_connection *c, enum state state) {
 	c->state = state;
 
 	if(state == ESTABLISHED) {
 		timespec_clear(&c->conn_timeout);
+	} else if(state == CLOSED) {
+		update_deadline(c);
 	}
 
 	debug(c, "state %s\n", strstate[state]);
@@ -505,6 +661,115 @@ static uint32_t buffer_free(const struct buffer *buf) {
 	return buf->maxsize > buf->used ? buf->maxsize - buf->used : 0;
 }
 
+/* Buffer autotuning.
+ *
+ * Unless the application sets their size explicitly, the send and receive buffers start at their
+ * default size and follow the bandwidth-delay product, up to c->buffer_limit. Whenever the application
+ * fills the send buffer, it grows so it can hold two congestion windows, one in flight and one waiting
+ * to be sent, but by at most one congestion window at a time, so a connection whose window opens up
+ * quickly cannot claim a large part of the shared memory before its siblings get a chance. The receive
+ * window grows to twice the amount of data received per round trip, similar to Linux's dynamic
+ * right-sizing. The memory added this way is tracked in a struct utcp_memory that can be shared
+ * between utcp instances. As it gets close to its limit, buffers that are larger than needed are shrunk
+ * back.
+ */
+
+static uint32_t default_maxsize(const struct utcp_connection *c, const struct buffer *buf) {
+	return buf == &c->sndbuf ? DEFAULT_MAXSNDBUFSIZE : DEFAULT_MAXRCVBUFSIZE;
+}
+
+static bool memory_pressure(const struct utcp_memory *memory) {
+	return memory->limit && memory->used >= memory->limit - memory->limit / 8;
+}
+
+static void grow_buffer(struct utcp_connection *c, struct buffer *buf, uint64_t size) {
+	struct utcp_memory *memory = c->utcp->memory;
+
+	if(size > c->buffer_limit) {
+		size = c->buffer_limit;
+	}
+
+	if(!buf->autotune || size <= buf->maxsize) {
+		return;
+	}
+
+	size_t extra = size - buf->maxsize;
+
+	if(memory->limit) {
+		if(memory->used >= memory->limit) {
+			return;
+		}
+
+		extra = min(extra, memory->limit - memory->used);
+	}
+
+	buf->maxsize += extra;
+	memory->used += extra;
+	debug(c, "%s grown to %u\n", buf == &c->sndbuf ? "sndbuf" : "rcvbuf", buf->maxsize);
+}
+
+static void shrink_buffer(struct utcp_connection *c, struct buffer *buf, uint64_t size) {
+	size = max(size, max(default_maxsize(c, buf), buf->used));
+
+	if(!buf->autotune || size >= buf->maxsize) {
+		return;
+	}
+
+	c->utcp->memory->used -= buf->maxsize - size;
+	set_buffer_storage(buf, NULL, size);
+	debug(c, "%s shrunk to %u\n", buf == &c->sndbuf ? "sndbuf" : "rcvbuf", buf->maxsize);
+}
+
+// Return the memory a buffer has grown, and leave its size to the application from now on.
+static void stop_autotune(struct utcp_connection *c, struct buffer *buf) {
+	if(buf->autotune) {
+		c->utcp->memory->used -= buf->maxsize - default_maxsize(c, buf);
+		buf->autotune = false;
+	}
+}
+
+// Called when the application has filled the send buffer.
+static void autotune_sndbuf(struct utcp_connection *c) {
+	if(is_reliable(c)) {
+		uint64_t size = 2 * (uint64_t)c->snd.cwnd;
+		uint64_t step = (uint64_t)c->sndbuf.maxsize + c->snd.cwnd;
+		grow_buffer(c, &c->sndbuf, size < step ? size : step);
+	}
+}
+
+// Called for every in-order segment received.
+static void autotune_rcvbuf(struct utcp_connection *c, size_t len) {
+	if(!c->rcvbuf.autotune || !c->srtt) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(UTCP_CLOCK, &now);
+
+	if(!timespec_isset(&c->rcv_space_time)) {
+		c->rcv_space_time = now;
+		c->rcv_space = 0;
+		return;
+	}
+
+	c->rcv_space += len;
+
+	if(timespec_diff_usec(&now, &c->rcv_space_time) < (int32_t)c->srtt) {
+		return;
+	}
+
+	uint64_t size = 2 * (uint64_t)c->rcv_space;
+
+	if(size > c->rcvbuf.maxsize) {
+		grow_buffer(c, &c->rcvbuf, size);
+	} else if(memory_pressure(c->utcp->memory) && !c->rcvbuf.used) {
+		shrink_buffer(c, &c->rcvbuf, size);
+	}
+
+	c->rcv_space_time = now;
+	c->rcv_space = 0;
+}
+
 // Connections are stored in a sorted list.
 // This gives O(log(N)) lookup time, O(N log(N)) insertion time and O(N) deletion time.
 
@@ -549,145 +814,587 @@ static void free_connection(struct utcp_connection *c) {
 	memmove(cp, cp + 1, (utcp->nconnections - i - 1) * sizeof(*cp));
 	utcp->nconnections--;
 
+	if(c->deadline_index) {
+		deadline_remove(c);
+	}
+
+	stop_autotune(c, &c->rcvbuf);
+	stop_autotune(c, &c->sndbuf);
 	buffer_exit(&c->rcvbuf);
 	buffer_exit(&c->sndbuf);
+	free(c->segs);
 	free(c);
 }
 
-static struct utcp_connection *allocate_connection(struct utcp *utcp, uint16_t src, uint16_t dst) {
-	// Check whether this combination of src and dst is free
-
-	if(src) {
-		if(find_connection(utcp, src, dst)) {
-			errno = EADDRINUSE;
-			return NULL;
-		}
-	} else { // If src == 0, generate a random port number with the high bit set
-		if(utcp->nconnections >= 32767) {
-			errno = ENOMEM;
-			return NULL;
-		}
-
-		src = rand() | 0x8000;
+/* Congestion control algorithms.
+ *
+ * Each connection has a pointer to a table of hooks that adjust snd.cwnd and snd.ssthresh
+ * in response to ACKs, duplicate ACKs and retransmission timeouts. Loss detection,
+ * fast retransmit and clamping the window to the send buffer size are done by the caller.
+ */
 
-		while(find_connection(utcp, src, dst)) {
-			src++;
-		}
+// Pace at a multiple of one congestion window per smoothed RTT.
+static uint64_t cwnd_pacing_rate(struct utcp_connection *c, uint32_t gain) {
+	if(!c->srtt) {
+		return 0;
 	}
 
-	// Allocate memory for the new connection
+	return (uint64_t)c->snd.cwnd * USEC_PER_SEC / c->srtt * gain / 100;
+}
 
-	if(utcp->nconnections >= utcp->nallocated) {
-		if(!utcp->nallocated) {
-			utcp->nallocated = 4;
-		} else {
-			utcp->nallocated *= 2;
-		}
+static uint64_t loss_pacing_rate(struct utcp_connection *c) {
+	return cwnd_pacing_rate(c, c->snd.cwnd < c->snd.ssthresh ? PACING_GAIN_SS : PACING_GAIN_CA);
+}
 
-		struct utcp_connection **new_array = realloc(utcp->connections, utcp->nallocated * sizeof(*utcp->connections));
+// RFC 5681 NewReno
 
-		if(!new_array) {
-			return NULL;
-		}
+static void newreno_init(struct utcp_connection *c) {
+	(void)c;
+}
 
-		utcp->connections = new_array;
+static void newreno_ack(struct utcp_connection *c, uint32_t acked, uint32_t rtt) {
+	(void)rtt;
+	uint32_t mss = c->utcp->mss;
+
+	// Count bytes instead of ACKs, so delayed ACKs do not slow down growth, see RFC 3465
+	if(c->snd.cwnd < c->snd.ssthresh) {
+		c->snd.cwnd += min(acked, 2 * mss); // eq. 2
+	} else {
+		c->snd.cwnd += max(1, (uint64_t)mss * acked / c->snd.cwnd); // eq. 3
 	}
+}
 
-	struct utcp_connection *c = calloc(1, sizeof(*c));
+static void newreno_enter_recovery(struct utcp_connection *c) {
+	uint32_t flightsize = seqdiff(c->snd.nxt, c->snd.una);
+	c->snd.ssthresh = max(flightsize / 2, c->utcp->mss * 2); // eq. 4
+	c->snd.cwnd = c->snd.ssthresh + 3 * c->utcp->mss;
+}
 
-	if(!c) {
-		return NULL;
-	}
+static void newreno_dupack(struct utcp_connection *c) {
+	c->snd.cwnd += c->utcp->mss;
+}
 
-	if(!buffer_set_size(&c->sndbuf, DEFAULT_SNDBUFSIZE, DEFAULT_MAXSNDBUFSIZE)) {
-		free(c);
-		return NULL;
-	}
+static void newreno_exit_recovery(struct utcp_connection *c) {
+	c->snd.cwnd = c->snd.ssthresh;
+}
 
-	if(!buffer_set_size(&c->rcvbuf, DEFAULT_RCVBUFSIZE, DEFAULT_MAXRCVBUFSIZE)) {
-		buffer_exit(&c->sndbuf);
-		free(c);
-		return NULL;
+static void newreno_timeout(struct utcp_connection *c) {
+	// Slow start after timeout
+	uint32_t flightsize = seqdiff(c->snd.nxt, c->snd.una);
+	c->snd.ssthresh = max(flightsize / 2, c->utcp->mss * 2); // eq. 4
+	c->snd.cwnd = c->utcp->mss;
+}
+
+static const struct utcp_cc_ops newreno_ops = {
+	.name = "newreno",
+	.init = newreno_init,
+	.ack = newreno_ack,
+	.enter_recovery = newreno_enter_recovery,
+	.dupack = newreno_dupack,
+	.exit_recovery = newreno_exit_recovery,
+	.timeout = newreno_timeout,
+	.pacing_rate = loss_pacing_rate,
+};
+
+// RFC 9438 CUBIC, with C = 0.4 and beta = 0.7, using only integer arithmetic.
+
+static uint32_t cubic_root(uint64_t a) {
+	uint64_t x = 0;
+
+	for(int s = 63; s >= 0; s -= 3) {
+		x += x;
+		uint64_t b = 3 * x * (x + 1) + 1;
+
+		if((a >> s) >= b) {
+			a -= b << s;
+			x++;
+		}
 	}
 
-	// Fill in the details
+	return x;
+}
 
-	c->src = src;
-	c->dst = dst;
-#ifdef UTCP_DEBUG
-	c->snd.iss = 0;
-#else
-	c->snd.iss = rand();
-#endif
-	c->snd.una = c->snd.iss;
-	c->snd.nxt = c->snd.iss + 1;
-	c->snd.last = c->snd.nxt;
-	c->snd.cwnd = (utcp->mss > 2190 ? 2 : utcp->mss > 1095 ? 3 : 4) * utcp->mss;
-	c->snd.ssthresh = ~0;
-	debug_cwnd(c);
-	c->srtt = 0;
-	c->rttvar = 0;
-	c->rto = START_RTO;
-	c->utcp = utcp;
+static int64_t timespec_diff_msec(const struct timespec *a, const struct timespec *b) {
+	return (int64_t)(a->tv_sec - b->tv_sec) * 1000 + (a->tv_nsec - b->tv_nsec) / 1000000;
+}
 
-	// Add it to the sorted list of connections
+// W_cubic(t) = C * (t - K)^3 + W_max, with t in msec and the result in bytes
+static int64_t cubic_window(struct utcp_connection *c, int64_t t) {
+	int64_t d = t - c->ccs.cubic.k;
 
-	utcp->connections[utcp->nconnections++] = c;
-	qsort(utcp->connections, utcp->nconnections, sizeof(*utcp->connections), compare);
+	if(d > 1000000) {
+		d = 1000000;
+	} else if(d < -1000000) {
+		d = -1000000;
+	}
 
-	return c;
+	int64_t d3 = d * d / 1000 * d / 1000; // in units of 0.001 s^3
+	return (int64_t)c->ccs.cubic.w_max + d3 * c->utcp->mss * 4 / 10000;
 }
 
-static inline uint32_t absdiff(uint32_t a, uint32_t b) {
-	if(a > b) {
-		return a - b;
-	} else {
-		return b - a;
-	}
+static void cubic_init(struct utcp_connection *c) {
+	c->ccs.cubic.w_max = 0;
+	c->ccs.cubic.w_est = 0;
+	c->ccs.cubic.k = 0;
+	timespec_clear(&c->ccs.cubic.epoch);
 }
 
-// Update RTT variables. See RFC 6298.
-static void update_rtt(struct utcp_connection *c, uint32_t rtt) {
-	if(!rtt) {
-		debug(c, "invalid rtt\n");
+static void cubic_ack(struct utcp_connection *c, uint32_t acked, uint32_t rtt) {
+	(void)rtt;
+	uint32_t mss = c->utcp->mss;
+
+	if(c->snd.cwnd < c->snd.ssthresh) {
+		c->snd.cwnd += min(acked, 2 * mss);
 		return;
 	}
 
-	if(!c->srtt) {
-		c->srtt = rtt;
-		c->rttvar = rtt / 2;
-	} else {
-		c->rttvar = (c->rttvar * 3 + absdiff(c->srtt, rtt)) / 4;
-		c->srtt = (c->srtt * 7 + rtt) / 8;
-	}
+	struct timespec now;
+	clock_gettime(UTCP_CLOCK, &now);
 
-	c->rto = c->srtt + max(4 * c->rttvar, CLOCK_GRANULARITY);
+	if(!timespec_isset(&c->ccs.cubic.epoch)) {
+		c->ccs.cubic.epoch = now;
+		c->ccs.cubic.w_est = c->snd.cwnd;
 
-	if(c->rto > MAX_RTO) {
-		c->rto = MAX_RTO;
+		if(c->snd.cwnd < c->ccs.cubic.w_max) {
+			// K = cbrt((W_max - cwnd) / C), with the window difference in 1/1000th segments
+			uint64_t segments = (uint64_t)(c->ccs.cubic.w_max - c->snd.cwnd) * 1000 / mss;
+			c->ccs.cubic.k = cubic_root(segments * 2500000);
+		} else {
+			c->ccs.cubic.w_max = c->snd.cwnd;
+			c->ccs.cubic.k = 0;
+		}
 	}
 
-	debug(c, "rtt %u srtt %u rttvar %u rto %u\n", rtt, c->srtt, c->rttvar, c->rto);
-}
-
-static void start_retransmit_timer(struct utcp_connection *c) {
-	clock_gettime(UTCP_CLOCK, &c->rtrx_timeout);
+	int64_t t = timespec_diff_msec(&now, &c->ccs.cubic.epoch);
 
-	uint32_t rto = c->rto;
+	// Reno-friendly region, alpha = 3 * (1 - beta) / (1 + beta)
+	c->ccs.cubic.w_est += (uint64_t)mss * acked * 529 / 1000 / c->snd.cwnd;
 
-	while(rto > USEC_PER_SEC) {
-		c->rtrx_timeout.tv_sec++;
-		rto -= USEC_PER_SEC;
+	if(cubic_window(c, t) < c->ccs.cubic.w_est) {
+		c->snd.cwnd = c->ccs.cubic.w_est;
+		return;
 	}
 
-	c->rtrx_timeout.tv_nsec += rto * 1000;
+	// Concave and convex regions, aim for where the curve will be one RTT from now
+	int64_t target = cubic_window(c, t + c->srtt / 1000);
 
-	if(c->rtrx_timeout.tv_nsec >= NSEC_PER_SEC) {
-		c->rtrx_timeout.tv_nsec -= NSEC_PER_SEC;
-		c->rtrx_timeout.tv_sec++;
+	if(target < c->snd.cwnd) {
+		target = c->snd.cwnd;
+	} else if(target > (int64_t)c->snd.cwnd * 3 / 2) {
+		target = (int64_t)c->snd.cwnd * 3 / 2;
 	}
 
-	debug(c, "rtrx_timeout %ld.%06lu\n", c->rtrx_timeout.tv_sec, c->rtrx_timeout.tv_nsec);
+	c->snd.cwnd += (target - c->snd.cwnd) * acked / c->snd.cwnd;
+}
+
+static void cubic_reduce(struct utcp_connection *c) {
+	// Fast convergence
+	if(c->snd.cwnd < c->ccs.cubic.w_max) {
+		c->ccs.cubic.w_max = (uint64_t)c->snd.cwnd * 17 / 20;
+	} else {
+		c->ccs.cubic.w_max = c->snd.cwnd;
+	}
+
+	uint32_t flightsize = seqdiff(c->snd.nxt, c->snd.una);
+	c->snd.ssthresh = max((uint64_t)flightsize * 7 / 10, c->utcp->mss * 2);
+	timespec_clear(&c->ccs.cubic.epoch);
+}
+
+static void cubic_enter_recovery(struct utcp_connection *c) {
+	cubic_reduce(c);
+	c->snd.cwnd = c->snd.ssthresh + 3 * c->utcp->mss;
+}
+
+static void cubic_timeout(struct utcp_connection *c) {
+	cubic_reduce(c);
+	c->snd.cwnd = c->utcp->mss;
+}
+
+static const struct utcp_cc_ops cubic_ops = {
+	.name = "cubic",
+	.init = cubic_init,
+	.ack = cubic_ack,
+	.enter_recovery = cubic_enter_recovery,
+	.dupack = newreno_dupack,
+	.exit_recovery = newreno_exit_recovery,
+	.timeout = cubic_timeout,
+	.pacing_rate = loss_pacing_rate,
+};
+
+/* A delivery rate based model along the lines of BBR.
+ *
+ * The bottleneck bandwidth is the maximum of the per-round delivery rate over the last
+ * BBR_BW_ROUNDS rounds, and the propagation delay is the minimum RTT seen in the last
+ * BBR_MIN_RTT_EXPIRY seconds. The congestion window is a multiple of their product.
+ * Random loss does not shrink the window, only a retransmission timeout does.
+ */
+
+static const uint32_t bbr_pacing_gain_cycle[BBR_GAIN_CYCLE] = {
+	BBR_UNIT * 5 / 4, BBR_UNIT * 3 / 4, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT
+};
+
+static bool bbr_filled_pipe(struct utcp_connection *c) {
+	return c->ccs.bbr.full_bw_count >= 3;
+}
+
+static uint32_t bbr_bdp(struct utcp_connection *c, uint32_t gain) {
+	if(!c->bandwidth || !c->ccs.bbr.min_rtt) {
+		return UINT32_MAX;
+	}
+
+	uint64_t bdp = c->bandwidth * c->ccs.bbr.min_rtt / USEC_PER_SEC * gain / BBR_UNIT;
+	return bdp < UINT32_MAX ? bdp : UINT32_MAX;
+}
+
+static void bbr_set_mode(struct utcp_connection *c, enum bbr_mode mode) {
+	c->ccs.bbr.mode = mode;
+
+	switch(mode) {
+	case BBR_STARTUP:
+		c->ccs.bbr.pacing_gain = BBR_HIGH_GAIN;
+		c->ccs.bbr.cwnd_gain = BBR_HIGH_GAIN;
+		break;
+
+	case BBR_DRAIN:
+		c->ccs.bbr.pacing_gain = BBR_DRAIN_GAIN;
+		c->ccs.bbr.cwnd_gain = BBR_HIGH_GAIN;
+		break;
+
+	case BBR_PROBE_BW:
+		c->ccs.bbr.cycle_index = 2;
+		c->ccs.bbr.pacing_gain = bbr_pacing_gain_cycle[c->ccs.bbr.cycle_index];
+		c->ccs.bbr.cwnd_gain = BBR_CWND_GAIN;
+		break;
+
+	case BBR_PROBE_RTT:
+		c->ccs.bbr.pacing_gain = BBR_UNIT;
+		c->ccs.bbr.cwnd_gain = BBR_UNIT;
+		timespec_clear(&c->ccs.bbr.probe_rtt_done);
+		break;
+	}
+
+	debug(c, "bbr mode %d bandwidth %lu min_rtt %u\n", mode, (unsigned long)c->bandwidth, c->ccs.bbr.min_rtt);
+}
+
+static void bbr_init(struct utcp_connection *c) {
+	memset(&c->ccs.bbr, 0, sizeof(c->ccs.bbr));
+	c->ccs.bbr.round_seq = c->snd.nxt;
+	c->bandwidth = 0;
+	c->snd.ssthresh = ~0;
+	clock_gettime(UTCP_CLOCK, &c->tlast);
+	bbr_set_mode(c, BBR_STARTUP);
+}
+
+static void bbr_end_round(struct utcp_connection *c, const struct timespec *now) {
+	int32_t elapsed = timespec_diff_usec(now, &c->tlast);
+	uint64_t sample = elapsed > 0 ? (uint64_t)c->ccs.bbr.delivered * USEC_PER_SEC / elapsed : 0;
+
+	c->ccs.bbr.bw_samples[c->ccs.bbr.round % BBR_BW_ROUNDS] = sample;
+	c->bandwidth = 0;
+
+	for(int i = 0; i < BBR_BW_ROUNDS; i++) {
+		if(c->ccs.bbr.bw_samples[i] > c->bandwidth) {
+			c->bandwidth = c->ccs.bbr.bw_samples[i];
+		}
+	}
+
+	c->ccs.bbr.round++;
+	c->ccs.bbr.round_seq = c->snd.nxt;
+	c->ccs.bbr.delivered = 0;
+	c->tlast = *now;
+
+	switch(c->ccs.bbr.mode) {
+	case BBR_STARTUP:
+
+		// Leave startup when the bandwidth hasn't grown by 25% for three rounds
+		if(c->bandwidth >= c->ccs.bbr.full_bw * 5 / 4) {
+			c->ccs.bbr.full_bw = c->bandwidth;
+			c->ccs.bbr.full_bw_count = 0;
+		} else if(++c->ccs.bbr.full_bw_count >= 3) {
+			bbr_set_mode(c, BBR_DRAIN);
+		}
+
+		break;
+
+	case BBR_PROBE_BW:
+		c->ccs.bbr.cycle_index = (c->ccs.bbr.cycle_index + 1) % BBR_GAIN_CYCLE;
+		c->ccs.bbr.pacing_gain = bbr_pacing_gain_cycle[c->ccs.bbr.cycle_index];
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void bbr_update_min_rtt(struct utcp_connection *c, uint32_t rtt, const struct timespec *now) {
+	bool expired = c->ccs.bbr.min_rtt && now->tv_sec - c->ccs.bbr.min_rtt_stamp.tv_sec > BBR_MIN_RTT_EXPIRY;
+
+	if(rtt && (!c->ccs.bbr.min_rtt || rtt <= c->ccs.bbr.min_rtt || expired)) {
+		c->ccs.bbr.min_rtt = rtt;
+		c->ccs.bbr.min_rtt_stamp = *now;
+	}
+
+	if(expired && c->ccs.bbr.mode != BBR_PROBE_RTT) {
+		// Drain the queue for a while to see the real propagation delay
+		c->ccs.bbr.prior_cwnd = c->snd.cwnd;
+		bbr_set_mode(c, BBR_PROBE_RTT);
+	}
+
+	if(c->ccs.bbr.mode != BBR_PROBE_RTT) {
+		return;
+	}
+
+	if(!timespec_isset(&c->ccs.bbr.probe_rtt_done)) {
+		if(seqdiff(c->snd.nxt, c->snd.una) <= BBR_MIN_CWND_SEGMENTS * c->utcp->mss) {
+			c->ccs.bbr.probe_rtt_done = *now;
+			c->ccs.bbr.probe_rtt_done.tv_nsec += BBR_PROBE_RTT_TIME * 1000;
+
+			if(c->ccs.bbr.probe_rtt_done.tv_nsec >= NSEC_PER_SEC) {
+				c->ccs.bbr.probe_rtt_done.tv_nsec -= NSEC_PER_SEC;
+				c->ccs.bbr.probe_rtt_done.tv_sec++;
+			}
+		}
+	} else if(!timespec_lt(now, &c->ccs.bbr.probe_rtt_done)) {
+		c->ccs.bbr.min_rtt_stamp = *now;
+		c->snd.cwnd = max(c->snd.cwnd, c->ccs.bbr.prior_cwnd);
+		bbr_set_mode(c, bbr_filled_pipe(c) ? BBR_PROBE_BW : BBR_STARTUP);
+	}
+}
+
+static void bbr_ack(struct utcp_connection *c, uint32_t acked, uint32_t rtt) {
+	struct timespec now;
+	clock_gettime(UTCP_CLOCK, &now);
+
+	c->ccs.bbr.delivered += acked;
+
+	if(seqdiff(c->snd.una, c->ccs.bbr.round_seq) >= 0) {
+		bbr_end_round(c, &now);
+	}
+
+	bbr_update_min_rtt(c, rtt, &now);
+
+	if(c->ccs.bbr.mode == BBR_DRAIN && seqdiff(c->snd.nxt, c->snd.una) <= (int32_t)bbr_bdp(c, BBR_UNIT)) {
+		bbr_set_mode(c, BBR_PROBE_BW);
+	}
+
+	uint32_t min_cwnd = BBR_MIN_CWND_SEGMENTS * c->utcp->mss;
+	uint32_t target = max(bbr_bdp(c, c->ccs.bbr.cwnd_gain), min_cwnd);
+
+	if(c->ccs.bbr.mode == BBR_PROBE_RTT) {
+		c->snd.cwnd = min_cwnd;
+	} else if(bbr_filled_pipe(c)) {
+		c->snd.cwnd = min(c->snd.cwnd + acked, target);
+	} else if(c->snd.cwnd < target) {
+		c->snd.cwnd += acked;
+	}
+
+	c->snd.cwnd = max(c->snd.cwnd, min_cwnd);
+}
+
+static void bbr_loss(struct utcp_connection *c) {
+	(void)c;
+}
+
+static void bbr_timeout(struct utcp_connection *c) {
+	c->snd.cwnd = c->utcp->mss;
+}
+
+static uint64_t bbr_pacing_rate(struct utcp_connection *c) {
+	uint64_t rate = c->bandwidth * c->ccs.bbr.pacing_gain / BBR_UNIT;
+
+	// Until the pipe is filled, the bandwidth estimate lags behind the congestion window
+	if(!bbr_filled_pipe(c)) {
+		uint64_t cwnd_rate = cwnd_pacing_rate(c, BBR_HIGH_GAIN * 100 / BBR_UNIT);
+
+		if(cwnd_rate > rate) {
+			rate = cwnd_rate;
+		}
+	}
+
+	return rate;
+}
+
+static const struct utcp_cc_ops bbr_ops = {
+	.name = "bbr",
+	.init = bbr_init,
+	.ack = bbr_ack,
+	.enter_recovery = bbr_loss,
+	.dupack = bbr_loss,
+	.exit_recovery = bbr_loss,
+	.timeout = bbr_timeout,
+	.pacing_rate = bbr_pacing_rate,
+};
+
+static const struct utcp_cc_ops *const cc_ops[] = {
+	[UTCP_CC_NEWRENO] = &newreno_ops,
+	[UTCP_CC_CUBIC] = &cubic_ops,
+	[UTCP_CC_BBR] = &bbr_ops,
+};
+
+static struct utcp_connection *allocate_connection(struct utcp *utcp, uint16_t src, uint16_t dst) {
+	// Check whether this combination of src and dst is free
+
+	if(src) {
+		if(find_connection(utcp, src, dst)) {
+			errno = EADDRINUSE;
+			return NULL;
+		}
+	} else { // If src == 0, generate a random port number with the high bit set
+		if(utcp->nconnections >= 32767) {
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		src = rand() | 0x8000;
+
+		while(find_connection(utcp, src, dst)) {
+			src++;
+		}
+	}
+
+	// Allocate memory for the new connection
+
+	if(utcp->nconnections >= utcp->nallocated) {
+		if(!utcp->nallocated) {
+			utcp->nallocated = 4;
+		} else {
+			utcp->nallocated *= 2;
+		}
+
+		struct utcp_connection **new_array = realloc(utcp->connections, utcp->nallocated * sizeof(*utcp->connections));
+
+		if(!new_array) {
+			return NULL;
+		}
+
+		utcp->connections = new_array;
+
+		struct utcp_connection **new_deadlines = realloc(utcp->deadlines, utcp->nallocated * sizeof(*utcp->deadlines));
+
+		if(!new_deadlines) {
+			return NULL;
+		}
+
+		utcp->deadlines = new_deadlines;
+	}
+
+	struct utcp_connection *c = calloc(1, sizeof(*c));
+
+	if(!c) {
+		return NULL;
+	}
+
+	if(!buffer_set_size(&c->sndbuf, DEFAULT_SNDBUFSIZE, DEFAULT_MAXSNDBUFSIZE)) {
+		free(c);
+		return NULL;
+	}
+
+	if(!buffer_set_size(&c->rcvbuf, DEFAULT_RCVBUFSIZE, DEFAULT_MAXRCVBUFSIZE)) {
+		buffer_exit(&c->sndbuf);
+		free(c);
+		return NULL;
+	}
+
+	c->sndbuf.autotune = true;
+	c->rcvbuf.autotune = true;
+	c->buffer_limit = DEFAULT_BUFFER_LIMIT;
+
+	// Fill in the details
+
+	c->src = src;
+	c->dst = dst;
+#ifdef UTCP_DEBUG
+	c->snd.iss = 0;
+#else
+	c->snd.iss = rand();
+#endif
+	c->snd.una = c->snd.iss;
+	c->snd.nxt = c->snd.iss + 1;
+	c->snd.last = c->snd.nxt;
+	c->snd.cwnd = (utcp->mss > 2190 ? 2 : utcp->mss > 1095 ? 3 : 4) * utcp->mss;
+	c->snd.ssthresh = ~0;
+	c->recover = c->snd.una;
+	c->cc = UTCP_CC_NEWRENO;
+	c->cc_ops = cc_ops[c->cc];
+	c->cc_ops->init(c);
+	debug_cwnd(c);
+	c->pacing = true;
+	c->delayed_ack = true;
+	c->srtt = 0;
+	c->rttvar = 0;
+	c->rto = START_RTO;
+	c->utcp = utcp;
+
+	// Add it to the sorted list of connections
+
+	utcp->connections[utcp->nconnections++] = c;
+	qsort(utcp->connections, utcp->nconnections, sizeof(*utcp->connections), compare);
+
+	return c;
+}
+
+static inline uint32_t absdiff(uint32_t a, uint32_t b) {
+	if(a > b) {
+		return a - b;
+	} else {
+		return b - a;
+	}
+}
+
+// Update RTT variables. See RFC 6298.
+static void update_rtt(struct utcp_connection *c, uint32_t rtt) {
+	if(!rtt) {
+		debug(c, "invalid rtt\n");
+		return;
+	}
+
+	if(!c->srtt) {
+		c->srtt = rtt;
+		c->rttvar = rtt / 2;
+	} else {
+		c->rttvar = (c->rttvar * 3 + absdiff(c->srtt, rtt)) / 4;
+		c->srtt = (c->srtt * 7 + rtt) / 8;
+	}
+
+	c->rto = c->srtt + max(4 * c->rttvar, CLOCK_GRANULARITY);
+
+	// The peer may hold back its ACK for a while, don't mistake that for a loss
+	if(c->ack_delay) {
+		c->rto += MAX_ACK_DELAY;
+	}
+
+	if(c->rto > MAX_RTO) {
+		c->rto = MAX_RTO;
+	}
+
+	debug(c, "rtt %u srtt %u rttvar %u rto %u\n", rtt, c->srtt, c->rttvar, c->rto);
+}
+
+static void start_retransmit_timer(struct utcp_connection *c) {
+	clock_gettime(UTCP_CLOCK, &c->rtrx_timeout);
+
+	uint32_t rto = c->rto;
+
+	while(rto > USEC_PER_SEC) {
+		c->rtrx_timeout.tv_sec++;
+		rto -= USEC_PER_SEC;
+	}
+
+	c->rtrx_timeout.tv_nsec += rto * 1000;
+
+	if(c->rtrx_timeout.tv_nsec >= NSEC_PER_SEC) {
+		c->rtrx_timeout.tv_nsec -= NSEC_PER_SEC;
+		c->rtrx_timeout.tv_sec++;
+	}
+
+	debug(c, "rtrx_timeout %ld.%06lu\n", c->rtrx_timeout.tv_sec, c->rtrx_timeout.tv_nsec);
+	schedule(c, &c->rtrx_timeout);
+}
+
+static void start_connection_timer(struct utcp_connection *c) {
+	clock_gettime(UTCP_CLOCK, &c->conn_timeout);
+	c->conn_timeout.tv_sec += c->utcp->timeout;
+	schedule(c, &c->conn_timeout);
 }
 
 static void stop_retransmit_timer(struct utcp_connection *c) {
@@ -695,6 +1402,13 @@ static void stop_retransmit_timer(struct utcp_connection *c) {
 	debug(c, "rtrx_timeout cleared\n");
 }
 
+// Every packet we send carries our latest ACK, so nothing is left to delay.
+static void ack_sent(struct utcp_connection *c) {
+	c->ack_pending = 0;
+	c->last_ack = c->rcv.nxt;
+	timespec_clear(&c->ack_timeout);
+}
+
 struct utcp_connection *utcp_connect_ex(struct utcp *utcp, uint16_t dst, utcp_recv_t recv, void *priv, uint32_t flags) {
 	struct utcp_connection *c = allocate_connection(utcp, 0, dst);
 
@@ -711,53 +1425,578 @@ struct utcp_connection *utcp_connect_ex(struct utcp *utcp, uint16_t dst, utcp_re
 	struct {
 		struct hdr hdr;
 		uint8_t init[4];
-	} pkt;
-
-	pkt.hdr.src = c->src;
-	pkt.hdr.dst = c->dst;
-	pkt.hdr.seq = c->snd.iss;
-	pkt.hdr.ack = 0;
-	pkt.hdr.wnd = c->rcvbuf.maxsize;
-	pkt.hdr.ctl = SYN;
-	pkt.hdr.aux = 0x0101;
-	pkt.init[0] = 1;
-	pkt.init[1] = 0;
-	pkt.init[2] = 0;
-	pkt.init[3] = flags & 0x7;
+	} *pkt = utcp->pkt;
+
+	pkt->hdr.src = c->src;
+	pkt->hdr.dst = c->dst;
+	pkt->hdr.seq = c->snd.iss;
+	pkt->hdr.ack = 0;
+	pkt->hdr.wnd = c->rcvbuf.maxsize;
+	pkt->hdr.ctl = SYN;
+	pkt->hdr.aux = 0x0101;
+	pkt->init[0] = 1;
+	pkt->init[1] = 0;
+	pkt->init[2] = flags & UTCP_RELIABLE ? INIT_SACK | INIT_DELAYED_ACK : 0;
+	pkt->init[3] = flags & 0x7;
+
+	set_state(c, SYN_SENT);
+
+	print_packet(c, "send", pkt, sizeof(*pkt));
+	utcp->send(utcp, pkt, sizeof(*pkt));
+
+	// The handshake gives us a first RTT sample
+	clock_gettime(UTCP_CLOCK, &c->rtt_start);
+	c->rtt_seq = c->snd.nxt;
+
+	start_connection_timer(c);
+	start_retransmit_timer(c);
+
+	return c;
+}
+
+struct utcp_connection *utcp_connect(struct utcp *utcp, uint16_t dst, utcp_recv_t recv, void *priv) {
+	return utcp_connect_ex(utcp, dst, recv, priv, UTCP_TCP);
+}
+
+void utcp_accept(struct utcp_connection *c, utcp_recv_t recv, void *priv) {
+	if(c->reapable || c->state != SYN_RECEIVED) {
+		debug(c, "accept() called on invalid connection in state %s\n", c, strstate[c->state]);
+		return;
+	}
+
+	debug(c, "accepted %p %p\n", c, recv, priv);
+	c->recv = recv;
+	c->priv = priv;
+	c->do_poll = true;
+	set_state(c, ESTABLISHED);
+	update_deadline(c);
+}
+
+// Returns the rate at which data should be sent, or 0 if it should not be paced.
+static uint64_t pacing_rate(struct utcp_connection *c) {
+	if(!is_reliable(c)) {
+		return 0;
+	}
+
+	uint64_t rate = c->pacing ? c->cc_ops->pacing_rate(c) : 0;
+
+	if(c->max_rate && (!rate || rate > c->max_rate)) {
+		rate = c->max_rate;
+	}
+
+	return rate;
+}
+
+// How far ahead of the pacing schedule we may send, in usec. At low rates this is the time it takes to send one segment.
+static int64_t pacing_quantum(struct utcp_connection *c, uint64_t rate) {
+	int64_t quantum = (int64_t)c->utcp->mss * USEC_PER_SEC / rate;
+	return quantum > PACING_QUANTUM ? quantum : PACING_QUANTUM;
+}
+
+/* Returns how many bytes pacing allows to be sent right now.
+ *
+ * Packets may be sent up to one quantum ahead of the pacing schedule, so we don't
+ * need a timer for every single packet. If we fell behind schedule, for example because
+ * the application had nothing to send, at most one quantum of credit is kept.
+ */
+static uint32_t pacing_budget(struct utcp_connection *c, uint64_t rate, const struct timespec *now) {
+	int64_t quantum = pacing_quantum(c, rate);
+	struct timespec earliest = *now;
+	timespec_add_usec(&earliest, -quantum);
+
+	if(timespec_lt(&c->pace_time, &earliest)) {
+		c->pace_time = earliest;
+	}
+
+	int64_t ahead = timespec_diff_usec(&c->pace_time, now);
+
+	if(ahead >= quantum) {
+		return 0;
+	}
+
+	uint64_t budget = (quantum - ahead) * rate / USEC_PER_SEC;
+	return budget < UINT32_MAX ? budget : UINT32_MAX;
+}
+
+/* SACK scoreboard and RACK loss detection.
+ *
+ * If both sides support AUX_SAK, the receiver tells the sender which out-of-order data it has,
+ * and the sender keeps a record of every segment between snd.una and snd.nxt. A segment is
+ * considered lost if DUPTHRESH segments worth of data after it have been SACKed, or if a segment
+ * that was sent later has been delivered and more than an RTT plus a reordering window has passed
+ * since it was sent (RFC 8985). All lost segments are retransmitted as far as the congestion window
+ * allows before any new data is sent, so multiple holes are repaired in a single round trip.
+ */
+
+static struct segment *segment_at(struct utcp_connection *c, uint32_t i) {
+	return &c->segs[(c->segs_head + i) & (c->segs_size - 1)];
+}
+
+// Returns the number of bytes in the network, not counting SACKed segments and lost segments that have not been retransmitted yet.
+static uint32_t in_flight(struct utcp_connection *c) {
+	uint32_t flight = seqdiff(c->snd.nxt, c->snd.una);
+
+	if(c->sack) {
+		flight -= c->sacked + c->lost - c->rexmit;
+	}
+
+	return flight;
+}
+
+static void segment_account(struct utcp_connection *c, const struct segment *seg, int32_t sign) {
+	if(seg->sacked) {
+		c->sacked += sign * seg->len;
+	} else if(seg->lost) {
+		c->lost += sign * seg->len;
+
+		if(seg->rexmit) {
+			c->rexmit += sign * seg->len;
+		}
+	}
+}
+
+static void segment_set_sacked(struct utcp_connection *c, struct segment *seg) {
+	segment_account(c, seg, -1);
+	seg->sacked = true;
+	seg->lost = false;
+	seg->rexmit = false;
+	segment_account(c, seg, 1);
+}
+
+static void segment_set_lost(struct utcp_connection *c, struct segment *seg) {
+	debug(c, "segment %u len %u lost\n", seg->seq, seg->len);
+	segment_account(c, seg, -1);
+	seg->lost = true;
+	seg->rexmit = false;
+	segment_account(c, seg, 1);
+}
+
+static void forget_segments(struct utcp_connection *c) {
+	free(c->segs);
+	c->segs = NULL;
+	c->segs_head = 0;
+	c->nsegs = 0;
+	c->segs_size = 0;
+	c->sacked = 0;
+	c->lost = 0;
+	c->rexmit = 0;
+}
+
+// Make room for one more segment.
+static bool grow_segments(struct utcp_connection *c) {
+	if(c->nsegs < c->segs_size) {
+		return true;
+	}
+
+	uint32_t newsize = c->segs_size ? c->segs_size * 2 : 16;
+	struct segment *newsegs = malloc(newsize * sizeof(*newsegs));
+
+	if(!newsegs) {
+		// Without a complete scoreboard we cannot use SACK, fall back to duplicate ACKs and timeouts
+		debug(c, "could not grow segment list, disabling SACK\n");
+		forget_segments(c);
+		c->sack = false;
+		c->recovery = false;
+		return false;
+	}
+
+	for(uint32_t i = 0; i < c->nsegs; i++) {
+		newsegs[i] = *segment_at(c, i);
+	}
+
+	free(c->segs);
+	c->segs = newsegs;
+	c->segs_head = 0;
+	c->segs_size = newsize;
+	return true;
+}
+
+static void record_segment(struct utcp_connection *c, uint32_t seq, uint32_t len, const struct timespec *now) {
+	if(!grow_segments(c)) {
+		return;
+	}
+
+	struct segment *seg = segment_at(c, c->nsegs++);
+	memset(seg, 0, sizeof(*seg));
+	seg->seq = seq;
+	seg->len = len;
+	seg->sent = *now;
+}
+
+// Returns the index of the first segment that starts at or after seq.
+static uint32_t find_segment(struct utcp_connection *c, uint32_t seq) {
+	uint32_t lo = 0;
+	uint32_t hi = c->nsegs;
+
+	while(lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if(seqdiff(segment_at(c, mid)->seq, seq) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+// Update the RACK state when a segment has been delivered.
+static void rack_update(struct utcp_connection *c, const struct segment *seg, const struct timespec *now) {
+	int32_t rtt = timespec_diff_usec(now, &seg->sent);
+
+	// If this was retransmitted, the ACK might have been for an earlier transmission
+	if(seg->retransmitted && rtt < (int32_t)c->rack.min_rtt) {
+		return;
+	}
+
+	c->rack.rtt = rtt > 0 ? rtt : 1;
+
+	if(!seg->retransmitted && (!c->rack.min_rtt || c->rack.rtt < c->rack.min_rtt)) {
+		c->rack.min_rtt = c->rack.rtt;
+	}
+
+	if(timespec_lt(&c->rack.xmit, &seg->sent) || (!timespec_lt(&seg->sent, &c->rack.xmit) && seqdiff(seg->seq + seg->len, c->rack.end) > 0)) {
+		c->rack.xmit = seg->sent;
+		c->rack.end = seg->seq + seg->len;
+	}
+}
+
+/* Mark segments as lost, and return true if any new losses were found.
+ *
+ * A segment that was sent before the most recently delivered one, but that has not been
+ * delivered itself, gets a reordering window before it is considered lost. The reorder timer
+ * is set to the earliest time any such segment would expire.
+ */
+static bool detect_loss(struct utcp_connection *c, const struct timespec *now) {
+	timespec_clear(&c->reorder_timeout);
+
+	// Without SACKed data, nothing that was sent later has been delivered yet
+	if(!c->sacked) {
+		return false;
+	}
+
+	bool found = false;
+	uint32_t sacked_above = 0;
+	int32_t reo_wnd = c->rack.min_rtt / 4;
+	int32_t wait = 0;
+
+	for(uint32_t i = c->nsegs; i--;) {
+		struct segment *seg = segment_at(c, i);
+
+		if(seg->sacked) {
+			sacked_above += seg->len;
+			continue;
+		}
+
+		if(seg->lost && !seg->rexmit) {
+			continue;
+		}
+
+		if(!seg->rexmit && sacked_above >= DUPTHRESH * c->utcp->mss) {
+			segment_set_lost(c, seg);
+			found = true;
+			continue;
+		}
+
+		if(timespec_lt(&c->rack.xmit, &seg->sent) || (!timespec_lt(&seg->sent, &c->rack.xmit) && seqdiff(seg->seq + seg->len, c->rack.end) >= 0)) {
+			continue;
+		}
+
+		int32_t remaining = c->rack.rtt + reo_wnd - timespec_diff_usec(now, &seg->sent);
+
+		if(remaining <= 0) {
+			segment_set_lost(c, seg);
+			found = true;
+		} else if(!wait || remaining < wait) {
+			wait = remaining;
+		}
+	}
+
+	if(wait) {
+		c->reorder_timeout = *now;
+		timespec_add_usec(&c->reorder_timeout, wait);
+		schedule(c, &c->reorder_timeout);
+	}
+
+	return found;
+}
+
+static void start_probe_timer(struct utcp_connection *c) {
+	uint32_t pto = max(2 * c->srtt, MIN_PROBE_TIMEOUT);
+
+	if(c->ack_delay) {
+		pto += MAX_ACK_DELAY;
+	}
+
+	if(!c->srtt || pto >= c->rto) {
+		timespec_clear(&c->probe_timeout);
+		return;
+	}
+
+	clock_gettime(UTCP_CLOCK, &c->probe_timeout);
+	timespec_add_usec(&c->probe_timeout, pto);
+	schedule(c, &c->probe_timeout);
+}
+
+static void sack_detect_loss(struct utcp_connection *c, const struct timespec *now) {
+	if(!detect_loss(c, now) || c->recovery || seqdiff(c->snd.una, c->recover) < 0) {
+		return;
+	}
+
+	debug(c, "SACK recovery started\n");
+	c->recovery = true;
+	c->recover = c->snd.nxt;
+	timespec_clear(&c->probe_timeout);
+	c->cc_ops->enter_recovery(c);
+
+	if(c->snd.cwnd > c->sndbuf.maxsize) {
+		c->snd.cwnd = c->sndbuf.maxsize;
+	}
+
+	debug_cwnd(c);
+}
+
+// Process the cumulative ACK and the SACK blocks of an incoming packet, after snd.una has been updated.
+static void sack_update(struct utcp_connection *c, const struct sack_block *blocks, int nblocks) {
+	struct timespec now;
+	clock_gettime(UTCP_CLOCK, &now);
+	bool progress = false;
+
+	while(c->nsegs) {
+		struct segment *seg = segment_at(c, 0);
+
+		if(seqdiff(seg->seq + seg->len, c->snd.una) > 0) {
+			// The receiver might have ACKed part of a segment
+			if(seqdiff(seg->seq, c->snd.una) < 0) {
+				segment_account(c, seg, -1);
+				seg->len -= c->snd.una - seg->seq;
+				seg->seq = c->snd.una;
+				segment_account(c, seg, 1);
+			}
+
+			break;
+		}
+
+		if(!seg->sacked) {
+			rack_update(c, seg, &now);
+		}
+
+		segment_account(c, seg, -1);
+		c->segs_head = (c->segs_head + 1) & (c->segs_size - 1);
+		c->nsegs--;
+		progress = true;
+	}
+
+	for(int i = 0; i < nblocks; i++) {
+		if(seqdiff(blocks[i].end, c->snd.nxt) > 0 || seqdiff(blocks[i].end, blocks[i].start) <= 0) {
+			debug(c, "invalid SACK block %u-%u\n", blocks[i].start, blocks[i].end);
+			continue;
+		}
+
+		for(uint32_t j = find_segment(c, blocks[i].start); j < c->nsegs; j++) {
+			struct segment *seg = segment_at(c, j);
+
+			if(seqdiff(seg->seq + seg->len, blocks[i].end) > 0) {
+				break;
+			}
+
+			if(!seg->sacked) {
+				rack_update(c, seg, &now);
+				segment_set_sacked(c, seg);
+				progress = true;
+			}
+		}
+	}
+
+	if(!progress) {
+		return;
+	}
+
+	sack_detect_loss(c, &now);
+
+	if(c->snd.una == c->snd.nxt) {
+		timespec_clear(&c->probe_timeout);
+		timespec_clear(&c->reorder_timeout);
+		return;
+	}
+
+	// The receiver is still getting our packets, so don't fall back to slow start yet
+	start_retransmit_timer(c);
+
+	if(!c->recovery) {
+		start_probe_timer(c);
+	}
+}
+
+// If the MSS has shrunk since a segment was sent, split it so it fits in a packet again.
+static bool fit_segment(struct utcp_connection *c, uint32_t i) {
+	uint32_t mss = c->utcp->mss;
+
+	while(segment_at(c, i)->len > mss) {
+		if(!grow_segments(c)) {
+			return false;
+		}
+
+		for(uint32_t j = c->nsegs++; j > i + 1; j--) {
+			*segment_at(c, j) = *segment_at(c, j - 1);
+		}
+
+		struct segment *seg = segment_at(c, i);
+		struct segment *rest = segment_at(c, i + 1);
+		*rest = *seg;
+		rest->seq += mss;
+		rest->len -= mss;
+		seg->len = mss;
+		i++;
+	}
+
+	return true;
+}
+
+// Send a segment from the scoreboard again.
+static void resend_segment(struct utcp_connection *c, struct segment *seg, const struct timespec *now) {
+	struct {
+		struct hdr hdr;
+		uint8_t data[];
+	} *pkt = c->utcp->pkt;
+
+	uint32_t len = seg->len;
+
+	pkt->hdr.src = c->src;
+	pkt->hdr.dst = c->dst;
+	pkt->hdr.seq = seg->seq;
+	pkt->hdr.ack = c->rcv.nxt;
+	pkt->hdr.wnd = c->rcvbuf.maxsize;
+	pkt->hdr.ctl = ACK;
+	pkt->hdr.aux = 0;
+
+	if(fin_wanted(c, seg->seq + len)) {
+		len--;
+		pkt->hdr.ctl |= FIN;
+	}
+
+	buffer_copy(&c->sndbuf, pkt->data, seqdiff(seg->seq, c->snd.una), len);
+	print_packet(c, "rtrx", pkt, sizeof(pkt->hdr) + len);
+	c->utcp->send(c->utcp, pkt, sizeof(pkt->hdr) + len);
+	ack_sent(c);
+
+	seg->sent = *now;
+	seg->retransmitted = true;
+	c->rtt_start.tv_sec = 0; // invalidate RTT timer
+}
+
+// Retransmit lost segments, lowest sequence number first, as far as the congestion window allows.
+static void retransmit_lost(struct utcp_connection *c) {
+	if(c->lost == c->rexmit) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(UTCP_CLOCK, &now);
+
+	uint64_t rate = pacing_rate(c);
+
+	if(rate) {
+		pacing_budget(c, rate, &now);
+	}
+
+	for(uint32_t i = 0; i < c->nsegs && c->lost != c->rexmit; i++) {
+		struct segment *seg = segment_at(c, i);
+
+		if(!seg->lost || seg->rexmit) {
+			continue;
+		}
+
+		if(!fit_segment(c, i)) {
+			return;
+		}
+
+		seg = segment_at(c, i);
+
+		if(in_flight(c) + seg->len > c->snd.cwnd) {
+			break;
+		}
 
-	set_state(c, SYN_SENT);
+		resend_segment(c, seg, &now);
+		segment_account(c, seg, -1);
+		seg->rexmit = true;
+		segment_account(c, seg, 1);
 
-	print_packet(c, "send", &pkt, sizeof(pkt));
-	utcp->send(utcp, &pkt, sizeof(pkt));
+		// Retransmissions are not held back by pacing, but they do use up its budget
+		if(rate) {
+			timespec_add_usec(&c->pace_time, (int64_t)seg->len * USEC_PER_SEC / rate);
+		}
+	}
+}
 
-	clock_gettime(UTCP_CLOCK, &c->conn_timeout);
-	c->conn_timeout.tv_sec += utcp->timeout;
+// Tail loss probe: send the last segment that has not been SACKed again, so the receiver will tell us what it is missing.
+static void send_probe(struct utcp_connection *c, const struct timespec *now) {
+	timespec_clear(&c->probe_timeout);
 
-	start_retransmit_timer(c);
+	for(uint32_t i = c->nsegs; i--;) {
+		struct segment *seg = segment_at(c, i);
 
-	return c;
-}
+		if(!seg->sacked) {
+			debug(c, "tail loss probe\n");
 
-struct utcp_connection *utcp_connect(struct utcp *utcp, uint16_t dst, utcp_recv_t recv, void *priv) {
-	return utcp_connect_ex(utcp, dst, recv, priv, UTCP_TCP);
+			if(!fit_segment(c, i)) {
+				return;
+			}
+
+			seg = segment_at(c, i);
+			resend_segment(c, seg, now);
+			start_retransmit_timer(c);
+			return;
+		}
+	}
 }
 
-void utcp_accept(struct utcp_connection *c, utcp_recv_t recv, void *priv) {
-	if(c->reapable || c->state != SYN_RECEIVED) {
-		debug(c, "accept() called on invalid connection in state %s\n", c, strstate[c->state]);
-		return;
+// Fill in SACK blocks describing our out-of-order data, starting with the most recently received one.
+static int get_sack_blocks(struct utcp_connection *c, struct sack_block *blocks) {
+	int32_t recent = seqdiff(c->rcv.recent, c->rcv.nxt);
+	int first = -1;
+	int n = 0;
+
+	for(int i = 0; i < NSACKS && c->sacks[i].len; i++) {
+		if(recent >= (int32_t)c->sacks[i].offset && recent < (int32_t)(c->sacks[i].offset + c->sacks[i].len)) {
+			first = i;
+			blocks[n].start = c->rcv.nxt + c->sacks[i].offset;
+			blocks[n].end = blocks[n].start + c->sacks[i].len;
+			n++;
+			break;
+		}
 	}
 
-	debug(c, "accepted %p %p\n", c, recv, priv);
-	c->recv = recv;
-	c->priv = priv;
-	c->do_poll = true;
-	set_state(c, ESTABLISHED);
+	for(int i = 0; i < NSACKS && c->sacks[i].len && n < MAX_SACK_BLOCKS; i++) {
+		if(i == first) {
+			continue;
+		}
+
+		blocks[n].start = c->rcv.nxt + c->sacks[i].offset;
+		blocks[n].end = blocks[n].start + c->sacks[i].len;
+		n++;
+	}
+
+	return n;
 }
 
 static void ack(struct utcp_connection *c, bool sendatleastone) {
+	if(c->sack) {
+		retransmit_lost(c);
+	}
+
 	int32_t left = seqdiff(c->snd.last, c->snd.nxt);
-	int32_t cwndleft = is_reliable(c) ? min(c->snd.cwnd, c->snd.wnd) - seqdiff(c->snd.nxt, c->snd.una) : MAX_UNRELIABLE_SIZE;
+	int32_t cwndleft = MAX_UNRELIABLE_SIZE;
+
+	if(is_reliable(c)) {
+		int32_t wndleft = c->snd.wnd - seqdiff(c->snd.nxt, c->snd.una);
+		cwndleft = c->snd.cwnd - in_flight(c);
+
+		if(wndleft < cwndleft) {
+			cwndleft = wndleft;
+		}
+	}
 
 	assert(left >= 0);
 
@@ -771,39 +2010,91 @@ static void ack(struct utcp_connection *c, bool sendatleastone) {
 		}
 	}
 
-	debug(c, "cwndleft %d left %d\n", cwndleft, left);
+	uint64_t rate = left ? pacing_rate(c) : 0;
+
+	if(rate) {
+		struct timespec now;
+		clock_gettime(UTCP_CLOCK, &now);
+		uint32_t budget = pacing_budget(c, rate, &now);
+
+		if(budget < (uint32_t)left) {
+			// Wake up again when we can send the next full segment
+			uint32_t next = min(left, c->utcp->mss);
+			left = budget - budget % c->utcp->mss;
+			// Count from where pace_time will be after sending what the budget allows below
+			c->pace_timeout = c->pace_time;
+			timespec_add_usec(&c->pace_timeout, (int64_t)left * USEC_PER_SEC / rate);
+			timespec_add_usec(&c->pace_timeout, (int64_t)next * USEC_PER_SEC / rate - pacing_quantum(c, rate));
+			schedule(c, &c->pace_timeout);
+
+			// Nothing can get lost while we are waiting for the pacing timer
+			if(!left && c->snd.una == c->snd.nxt) {
+				stop_retransmit_timer(c);
+			}
+		} else {
+			timespec_clear(&c->pace_timeout);
+		}
+	} else {
+		timespec_clear(&c->pace_timeout);
+	}
+
+	debug(c, "cwndleft %d left %d rate %lu\n", cwndleft, left, (unsigned long)rate);
 
 	if(!left && !sendatleastone) {
 		return;
 	}
 
+	if(rate) {
+		timespec_add_usec(&c->pace_time, (int64_t)left * USEC_PER_SEC / rate);
+	}
+
 	struct {
 		struct hdr hdr;
 		uint8_t data[];
 	} *pkt = c->utcp->pkt;
 
-	pkt->hdr.src = c->src;
-	pkt->hdr.dst = c->dst;
-	pkt->hdr.ack = c->rcv.nxt;
-	pkt->hdr.wnd = is_reliable(c) ? c->rcvbuf.maxsize : 0;
-	pkt->hdr.ctl = ACK;
-	pkt->hdr.aux = 0;
+	uint32_t wnd = is_reliable(c) ? c->rcvbuf.maxsize : 0;
+
+	// Tell the peer about any out-of-order data we have
+	struct sack_block blocks[MAX_SACK_BLOCKS];
+	uint32_t auxlen = 0;
+
+	if(c->sack && c->sacks[0].len) {
+		auxlen = get_sack_blocks(c, blocks) * sizeof(*blocks);
+	}
+
+	struct timespec now;
+
+	if(c->sack) {
+		clock_gettime(UTCP_CLOCK, &now);
+	}
+
+	uint32_t maxlen = c->utcp->mss - auxlen;
 
 	do {
-		uint32_t seglen = left > c->utcp->mss ? c->utcp->mss : left;
+		uint32_t seglen = (uint32_t)left > maxlen ? maxlen : (uint32_t)left;
+
+		// The send callback is allowed to overwrite the packet, so fill in the whole header every time.
+		pkt->hdr.src = c->src;
+		pkt->hdr.dst = c->dst;
 		pkt->hdr.seq = c->snd.nxt;
+		pkt->hdr.ack = c->rcv.nxt;
+		pkt->hdr.wnd = wnd;
+		pkt->hdr.ctl = ACK;
+		pkt->hdr.aux = auxlen ? (auxlen / 4) << 8 | AUX_SAK : 0;
 
-		buffer_copy(&c->sndbuf, pkt->data, seqdiff(c->snd.nxt, c->snd.una), seglen);
+		memcpy(pkt->data, blocks, auxlen);
+		buffer_copy(&c->sndbuf, pkt->data + auxlen, seqdiff(c->snd.nxt, c->snd.una), seglen);
+
+		if(c->sack && seglen) {
+			record_segment(c, c->snd.nxt, seglen, &now);
+		}
 
 		c->snd.nxt += seglen;
 		left -= seglen;
 
-		if(!is_reliable(c)) {
-			if(left) {
-				pkt->hdr.ctl |= MF;
-			} else {
-				pkt->hdr.ctl &= ~MF;
-			}
+		if(!is_reliable(c) && left) {
+			pkt->hdr.ctl |= MF;
 		}
 
 		if(seglen && fin_wanted(c, c->snd.nxt)) {
@@ -818,13 +2109,22 @@ static void ack(struct utcp_connection *c, bool sendatleastone) {
 			debug(c, "starting RTT measurement, expecting ack %u\n", c->rtt_seq);
 		}
 
-		print_packet(c, "send", pkt, sizeof(pkt->hdr) + seglen);
-		c->utcp->send(c->utcp, pkt, sizeof(pkt->hdr) + seglen);
+		print_packet(c, "send", pkt, sizeof(pkt->hdr) + auxlen + seglen);
+		c->utcp->send(c->utcp, pkt, sizeof(pkt->hdr) + auxlen + seglen);
+		ack_sent(c);
 
 		if(left && !is_reliable(c)) {
-			pkt->hdr.wnd += seglen;
+			wnd += seglen;
 		}
 	} while(left);
+
+	if(rate && !timespec_isset(&c->rtrx_timeout) && c->snd.una != c->snd.nxt) {
+		start_retransmit_timer(c);
+	}
+
+	if(c->sack && !c->recovery && c->snd.una != c->snd.nxt && !timespec_isset(&c->probe_timeout)) {
+		start_probe_timer(c);
+	}
 }
 
 ssize_t utcp_send(struct utcp_connection *c, const void *data, size_t len) {
@@ -891,6 +2191,10 @@ ssize_t utcp_send(struct utcp_connection *c, const void *data, size_t len) {
 
 	if(is_reliable(c)) {
 		len = buffer_put(&c->sndbuf, data, len);
+
+		if(!buffer_free(&c->sndbuf)) {
+			autotune_sndbuf(c);
+		}
 	} else if(c->state != SYN_SENT && c->state != SYN_RECEIVED) {
 		if(len > MAX_UNRELIABLE_SIZE || buffer_put(&c->sndbuf, data, len) != (ssize_t)len) {
 			errno = EMSGSIZE;
@@ -924,13 +2228,12 @@ ssize_t utcp_send(struct utcp_connection *c, const void *data, size_t len) {
 		buffer_discard(&c->sndbuf, c->sndbuf.used);
 	}
 
-	if(is_reliable(c) && !timespec_isset(&c->rtrx_timeout)) {
+	if(is_reliable(c) && !timespec_isset(&c->rtrx_timeout) && !timespec_isset(&c->pace_timeout)) {
 		start_retransmit_timer(c);
 	}
 
 	if(is_reliable(c) && !timespec_isset(&c->conn_timeout)) {
-		clock_gettime(UTCP_CLOCK, &c->conn_timeout);
-		c->conn_timeout.tv_sec += c->utcp->timeout;
+		start_connection_timer(c);
 	}
 
 	return len;
@@ -980,6 +2283,7 @@ static void fast_retransmit(struct utcp_connection *c) {
 		buffer_copy(&c->sndbuf, pkt->data, 0, len);
 		print_packet(c, "rtrx", pkt, sizeof(pkt->hdr) + len);
 		utcp->send(utcp, pkt, sizeof(pkt->hdr) + len);
+		ack_sent(c);
 		break;
 
 	default:
@@ -1019,17 +2323,30 @@ static void retransmit(struct utcp_connection *c) {
 		pkt->hdr.aux = 0x0101;
 		pkt->data[0] = 1;
 		pkt->data[1] = 0;
-		pkt->data[2] = 0;
+		pkt->data[2] = is_reliable(c) ? INIT_SACK | INIT_DELAYED_ACK : 0;
 		pkt->data[3] = c->flags & 0x7;
 		print_packet(c, "rtrx", pkt, sizeof(pkt->hdr) + 4);
 		utcp->send(utcp, pkt, sizeof(pkt->hdr) + 4);
 		break;
 
 	case SYN_RECEIVED:
-		// Send SYNACK again
-		pkt->hdr.seq = c->snd.nxt;
+		// Send SYNACK again, the SYN occupies the sequence number before snd.nxt
+		pkt->hdr.seq = c->snd.iss;
 		pkt->hdr.ack = c->rcv.nxt;
 		pkt->hdr.ctl = SYN | ACK;
+
+		// Repeat the negotiation, the peer would otherwise not know what we agreed to
+		if(c->sack || c->ack_delay) {
+			pkt->hdr.aux = 0x0101;
+			pkt->data[0] = 1;
+			pkt->data[1] = 0;
+			pkt->data[2] = (c->sack ? INIT_SACK : 0) | (c->ack_delay ? INIT_DELAYED_ACK : 0);
+			pkt->data[3] = c->flags & 0x7;
+			print_packet(c, "rtrx", pkt, sizeof(pkt->hdr) + 4);
+			utcp->send(utcp, pkt, sizeof(pkt->hdr) + 4);
+			break;
+		}
+
 		print_packet(c, "rtrx", pkt, sizeof(pkt->hdr));
 		utcp->send(utcp, pkt, sizeof(pkt->hdr));
 		break;
@@ -1039,6 +2356,28 @@ static void retransmit(struct utcp_connection *c) {
 	case CLOSE_WAIT:
 	case CLOSING:
 	case LAST_ACK:
+		if(c->sack && c->snd.una != c->snd.nxt) {
+			// Everything that has not been SACKed is considered lost, and is sent again as the window opens
+			for(uint32_t i = 0; i < c->nsegs; i++) {
+				struct segment *seg = segment_at(c, i);
+
+				if(!seg->sacked) {
+					segment_set_lost(c, seg);
+				}
+			}
+
+			c->recovery = false;
+			c->recover = c->snd.nxt;
+			timespec_clear(&c->probe_timeout);
+			timespec_clear(&c->reorder_timeout);
+
+			c->cc_ops->timeout(c);
+			debug_cwnd(c);
+
+			retransmit_lost(c);
+			break;
+		}
+
 		// Send unacked data again.
 		pkt->hdr.seq = c->snd.una;
 		pkt->hdr.ack = c->rcv.nxt;
@@ -1050,17 +2389,22 @@ static void retransmit(struct utcp_connection *c) {
 			pkt->hdr.ctl |= FIN;
 		}
 
-		// RFC 5681 slow start after timeout
-		uint32_t flightsize = seqdiff(c->snd.nxt, c->snd.una);
-		c->snd.ssthresh = max(flightsize / 2, utcp->mss * 2); // eq. 4
-		c->snd.cwnd = utcp->mss;
+		c->cc_ops->timeout(c);
 		debug_cwnd(c);
 
 		buffer_copy(&c->sndbuf, pkt->data, 0, len);
 		print_packet(c, "rtrx", pkt, sizeof(pkt->hdr) + len);
 		utcp->send(utcp, pkt, sizeof(pkt->hdr) + len);
+		ack_sent(c);
 
 		c->snd.nxt = c->snd.una + len;
+
+		if(c->sack && len) {
+			struct timespec now;
+			clock_gettime(UTCP_CLOCK, &now);
+			record_segment(c, c->snd.una, len, &now);
+		}
+
 		break;
 
 	case CLOSED:
@@ -1157,39 +2501,46 @@ static void handle_out_of_order(struct utcp_connection *c, uint32_t offset, cons
 		len = rxd;
 	}
 
-	// Make note of where we put it.
-	for(int i = 0; i < NSACKS; i++) {
-		if(!c->sacks[i].len) { // nothing to merge, add new entry
-			debug(c, "new SACK entry %d\n", i);
-			c->sacks[i].offset = offset;
-			c->sacks[i].len = rxd;
-			break;
-		} else if(offset < c->sacks[i].offset) {
-			if(offset + rxd < c->sacks[i].offset) { // insert before
-				if(!c->sacks[NSACKS - 1].len) { // only if room left
-					debug(c, "insert SACK entry at %d\n", i);
-					memmove(&c->sacks[i + 1], &c->sacks[i], (NSACKS - i - 1) * sizeof(c->sacks)[i]);
-					c->sacks[i].offset = offset;
-					c->sacks[i].len = rxd;
-				} else {
-					debug(c, "SACK entries full, dropping packet\n");
-				}
+	c->rcv.recent = c->rcv.nxt + offset;
 
-				break;
-			} else { // merge
-				debug(c, "merge with start of SACK entry at %d\n", i);
-				c->sacks[i].offset = offset;
-				break;
-			}
-		} else if(offset <= c->sacks[i].offset + c->sacks[i].len) {
-			if(offset + rxd > c->sacks[i].offset + c->sacks[i].len) { // merge
-				debug(c, "merge with end of SACK entry at %d\n", i);
-				c->sacks[i].len = offset + rxd - c->sacks[i].offset;
-				// TODO: handle potential merge with next entry
-			}
+	// Make note of where we put it, merging it with any entries it overlaps or touches.
+	uint32_t end = offset + rxd;
+	int n = 0;
 
-			break;
+	while(n < NSACKS && c->sacks[n].len && c->sacks[n].offset + c->sacks[n].len < offset) {
+		n++;
+	}
+
+	if(n < NSACKS && c->sacks[n].len && c->sacks[n].offset <= end) {
+		debug(c, "merge with SACK entry at %d\n", n);
+		uint32_t start = min(offset, c->sacks[n].offset);
+		end = max(end, c->sacks[n].offset + c->sacks[n].len);
+
+		// This might also fill the gap to the following entries
+		int j = n + 1;
+
+		while(j < NSACKS && c->sacks[j].len && c->sacks[j].offset <= end) {
+			end = max(end, c->sacks[j].offset + c->sacks[j].len);
+			j++;
+		}
+
+		c->sacks[n].offset = start;
+		c->sacks[n].len = end - start;
+
+		if(j > n + 1) {
+			memmove(&c->sacks[n + 1], &c->sacks[j], (NSACKS - j) * sizeof(c->sacks)[n]);
+
+			for(int k = NSACKS - (j - n - 1); k < NSACKS; k++) {
+				c->sacks[k].len = 0;
+			}
 		}
+	} else if(n < NSACKS && !c->sacks[NSACKS - 1].len) { // only if room left
+		debug(c, "insert SACK entry at %d\n", n);
+		memmove(&c->sacks[n + 1], &c->sacks[n], (NSACKS - n - 1) * sizeof(c->sacks)[n]);
+		c->sacks[n].offset = offset;
+		c->sacks[n].len = rxd;
+	} else {
+		debug(c, "SACK entries full, dropping packet\n");
 	}
 
 	for(int i = 0; i < NSACKS && c->sacks[i].len; i++) {
@@ -1198,6 +2549,23 @@ static void handle_out_of_order(struct utcp_connection *c, uint32_t offset, cons
 }
 
 static void handle_in_order(struct utcp_connection *c, const void *data, size_t len) {
+	// Without out-of-order data to merge, advance rcv.nxt first, so a reply sent from the receive callback carries the ACK for this data
+	if(!c->sacks[0].len) {
+		c->rcv.nxt += len;
+
+		if(c->recv) {
+			ssize_t rxd = c->recv(c, data, len);
+
+			if(rxd != (ssize_t)len) {
+				// TODO: handle the application not accepting all data.
+				abort();
+			}
+		}
+
+		autotune_rcvbuf(c, len);
+		return;
+	}
+
 	if(c->recv) {
 		ssize_t rxd = c->recv(c, data, len);
 
@@ -1229,6 +2597,7 @@ static void handle_in_order(struct utcp_connection *c, const void *data, size_t
 		sack_consume(c, len);
 	}
 
+	autotune_rcvbuf(c, len);
 	c->rcv.nxt += len;
 }
 
@@ -1287,6 +2656,39 @@ static void handle_incoming_data(struct utcp_connection *c, const struct hdr *hd
 	}
 }
 
+// Decide whether the ACK for in-order data can be held back, in the hope that it can be sent
+// together with the next segment or with data going the other way.
+static bool delay_ack(struct utcp_connection *c, const struct hdr *hdr, size_t len, bool had_holes) {
+	// Out-of-order data and data filling a hole must be acknowledged immediately
+	if(!c->ack_delay || !c->delayed_ack || c->nodelay || !len || (hdr->ctl & (SYN | FIN)) || had_holes || c->sacks[0].len) {
+		return false;
+	}
+
+	// The receive callback may already have sent a reply carrying the ACK
+	if(c->last_ack == c->rcv.nxt) {
+		return true;
+	}
+
+	// Acknowledge as soon as more than one full-sized segment is pending, so at least every second one.
+	// Our own MSS can differ from the peer's, so the largest segment it sent so far counts as full-sized.
+	if(len > c->rcv_mss) {
+		c->rcv_mss = len;
+	}
+
+	c->ack_pending += len;
+
+	if(c->ack_pending > c->rcv_mss) {
+		return false;
+	}
+
+	if(!timespec_isset(&c->ack_timeout)) {
+		clock_gettime(UTCP_CLOCK, &c->ack_timeout);
+		timespec_add_usec(&c->ack_timeout, MAX_ACK_DELAY);
+		schedule(c, &c->ack_timeout);
+	}
+
+	return true;
+}
 
 ssize_t utcp_recv(struct utcp *utcp, const void *data, size_t len) {
 	const uint8_t *ptr = data;
@@ -1340,11 +2742,13 @@ ssize_t utcp_recv(struct utcp *utcp, const void *data, size_t len) {
 	// Check for auxiliary headers
 
 	const uint8_t *init = NULL;
+	struct sack_block sack_blocks[MAX_SACK_BLOCKS];
+	int nsack_blocks = 0;
 
 	uint16_t aux = hdr.aux;
 
 	while(aux) {
-		size_t auxlen = 4 * (aux >> 8) & 0xf;
+		size_t auxlen = 4 * ((aux >> 8) & 0x7);
 		uint8_t auxtype = aux & 0xff;
 
 		if(len < auxlen) {
@@ -1362,6 +2766,16 @@ ssize_t utcp_recv(struct utcp *utcp, const void *data, size_t len) {
 			init = ptr;
 			break;
 
+		case AUX_SAK:
+			if((hdr.ctl & SYN) || !auxlen || auxlen % sizeof(*sack_blocks)) {
+				errno = EBADMSG;
+				return -1;
+			}
+
+			nsack_blocks = auxlen / sizeof(*sack_blocks);
+			memcpy(sack_blocks, ptr, auxlen);
+			break;
+
 		default:
 			errno = EBADMSG;
 			return -1;
@@ -1420,10 +2834,16 @@ ssize_t utcp_recv(struct utcp *utcp, const void *data, size_t len) {
 				}
 
 				c->flags = init[3] & 0x7;
+				c->sack = is_reliable(c) && (init[2] & INIT_SACK);
+				c->ack_delay = is_reliable(c) && (init[2] & INIT_DELAYED_ACK);
 			} else {
 				c->flags = UTCP_TCP;
 			}
 
+			// The handshake gives us a first RTT sample
+			clock_gettime(UTCP_CLOCK, &c->rtt_start);
+			c->rtt_seq = c->snd.iss + 1;
+
 synack:
 			// Return SYN+ACK, go to SYN_RECEIVED state
 			c->snd.wnd = hdr.wnd;
@@ -1434,27 +2854,27 @@ synack:
 			struct {
 				struct hdr hdr;
 				uint8_t data[4];
-			} pkt;
+			} *pkt = utcp->pkt;
 
-			pkt.hdr.src = c->src;
-			pkt.hdr.dst = c->dst;
-			pkt.hdr.ack = c->rcv.irs + 1;
-			pkt.hdr.seq = c->snd.iss;
-			pkt.hdr.wnd = c->rcvbuf.maxsize;
-			pkt.hdr.ctl = SYN | ACK;
+			pkt->hdr.src = c->src;
+			pkt->hdr.dst = c->dst;
+			pkt->hdr.ack = c->rcv.irs + 1;
+			pkt->hdr.seq = c->snd.iss;
+			pkt->hdr.wnd = c->rcvbuf.maxsize;
+			pkt->hdr.ctl = SYN | ACK;
 
 			if(init) {
-				pkt.hdr.aux = 0x0101;
-				pkt.data[0] = 1;
-				pkt.data[1] = 0;
-				pkt.data[2] = 0;
-				pkt.data[3] = c->flags & 0x7;
-				print_packet(c, "send", &pkt, sizeof(hdr) + 4);
-				utcp->send(utcp, &pkt, sizeof(hdr) + 4);
+				pkt->hdr.aux = 0x0101;
+				pkt->data[0] = 1;
+				pkt->data[1] = 0;
+				pkt->data[2] = (c->sack ? INIT_SACK : 0) | (c->ack_delay ? INIT_DELAYED_ACK : 0);
+				pkt->data[3] = c->flags & 0x7;
+				print_packet(c, "send", pkt, sizeof(hdr) + 4);
+				utcp->send(utcp, pkt, sizeof(hdr) + 4);
 			} else {
-				pkt.hdr.aux = 0;
-				print_packet(c, "send", &pkt, sizeof(hdr));
-				utcp->send(utcp, &pkt, sizeof(hdr));
+				pkt->hdr.aux = 0;
+				print_packet(c, "send", pkt, sizeof(hdr));
+				utcp->send(utcp, pkt, sizeof(hdr));
 			}
 
 			start_retransmit_timer(c);
@@ -1662,12 +3082,15 @@ synack:
 
 	if(advanced) {
 		// RTT measurement
+		uint32_t rtt = 0;
+
 		if(c->rtt_start.tv_sec) {
 			if(c->rtt_seq == hdr.ack) {
 				struct timespec now;
 				clock_gettime(UTCP_CLOCK, &now);
 				int32_t diff = timespec_diff_usec(&now, &c->rtt_start);
 				update_rtt(c, diff);
+				rtt = diff > 0 ? diff : 0;
 				c->rtt_start.tv_sec = 0;
 			} else if(c->rtt_seq < hdr.ack) {
 				debug(c, "cancelling RTT measurement: %u < %u\n", c->rtt_seq, hdr.ack);
@@ -1700,6 +3123,7 @@ synack:
 
 			if(is_reliable(c)) {
 				c->do_poll = true;
+				update_deadline(c);
 			}
 		}
 
@@ -1713,17 +3137,23 @@ synack:
 		if(c->dupack) {
 			if(c->dupack >= 3) {
 				debug(c, "fast recovery ended\n");
-				c->snd.cwnd = c->snd.ssthresh;
+				c->cc_ops->exit_recovery(c);
 			}
 
 			c->dupack = 0;
 		}
 
-		// Increase the congestion window according to RFC 5681
-		if(c->snd.cwnd < c->snd.ssthresh) {
-			c->snd.cwnd += min(advanced, utcp->mss); // eq. 2
-		} else {
-			c->snd.cwnd += max(1, (utcp->mss * utcp->mss) / c->snd.cwnd); // eq. 3
+		if(c->recovery && seqdiff(c->snd.una, c->recover) >= 0) {
+			debug(c, "SACK recovery ended\n");
+			c->recovery = false;
+			c->cc_ops->exit_recovery(c);
+		}
+
+		c->cc_ops->ack(c, advanced, rtt);
+
+		// Give memory back if other connections need it
+		if(memory_pressure(c->utcp->memory)) {
+			shrink_buffer(c, &c->sndbuf, 2 * (uint64_t)c->snd.cwnd);
 		}
 
 		if(c->snd.cwnd > c->sndbuf.maxsize) {
@@ -1743,8 +3173,7 @@ synack:
 
 		case CLOSING:
 			if(c->snd.una == c->snd.last) {
-				clock_gettime(UTCP_CLOCK, &c->conn_timeout);
-				c->conn_timeout.tv_sec += utcp->timeout;
+				start_connection_timer(c);
 				set_state(c, TIME_WAIT);
 			}
 
@@ -1754,16 +3183,14 @@ synack:
 			break;
 		}
 	} else {
-		if(!len && is_reliable(c) && c->snd.una != c->snd.last) {
+		if(!len && is_reliable(c) && !c->sack && c->snd.una != c->snd.nxt) {
 			c->dupack++;
 			debug(c, "duplicate ACK %d\n", c->dupack);
 
 			if(c->dupack == 3) {
 				// RFC 5681 fast recovery
 				debug(c, "fast recovery started\n", c->dupack);
-				uint32_t flightsize = seqdiff(c->snd.nxt, c->snd.una);
-				c->snd.ssthresh = max(flightsize / 2, utcp->mss * 2); // eq. 4
-				c->snd.cwnd = min(c->snd.ssthresh + 3 * utcp->mss, c->sndbuf.maxsize);
+				c->cc_ops->enter_recovery(c);
 
 				if(c->snd.cwnd > c->sndbuf.maxsize) {
 					c->snd.cwnd = c->sndbuf.maxsize;
@@ -1773,7 +3200,7 @@ synack:
 
 				fast_retransmit(c);
 			} else if(c->dupack > 3) {
-				c->snd.cwnd += utcp->mss;
+				c->cc_ops->dupack(c);
 
 				if(c->snd.cwnd > c->sndbuf.maxsize) {
 					c->snd.cwnd = c->sndbuf.maxsize;
@@ -1789,6 +3216,10 @@ synack:
 		}
 	}
 
+	if(c->sack) {
+		sack_update(c, sack_blocks, nsack_blocks);
+	}
+
 	// 4. Update timers
 
 	if(advanced) {
@@ -1797,8 +3228,7 @@ synack:
 			timespec_clear(&c->conn_timeout);
 		} else if(is_reliable(c)) {
 			start_retransmit_timer(c);
-			clock_gettime(UTCP_CLOCK, &c->conn_timeout);
-			c->conn_timeout.tv_sec += utcp->timeout;
+			start_connection_timer(c);
 		}
 	}
 
@@ -1816,6 +3246,13 @@ skip_ack:
 
 			c->rcv.irs = hdr.seq;
 			c->rcv.nxt = hdr.seq + 1;
+			c->sack = is_reliable(c) && init && (init[2] & INIT_SACK);
+			c->ack_delay = is_reliable(c) && init && (init[2] & INIT_DELAYED_ACK);
+
+			// The RTO was just calculated from the SYN's round trip, before we knew the peer delays its ACKs
+			if(c->ack_delay && c->srtt) {
+				c->rto = min(c->rto + MAX_ACK_DELAY, MAX_RTO);
+			}
 
 			if(c->shut_wr) {
 				c->snd.last++;
@@ -1823,12 +3260,14 @@ skip_ack:
 			} else {
 				c->do_poll = true;
 				set_state(c, ESTABLISHED);
+				update_deadline(c);
 			}
 
 			break;
 
 		case SYN_RECEIVED:
 			// This is a retransmit of a SYN, send back the SYNACK.
+			c->rtt_start.tv_sec = 0; // invalidate RTT timer
 			goto synack;
 
 		case ESTABLISHED:
@@ -1851,6 +3290,8 @@ skip_ack:
 
 	// 6. Process new data
 
+	bool had_holes = c->sacks[0].len;
+
 	if(c->state == SYN_RECEIVED) {
 		// This is the ACK after the SYNACK. It should always have ACKed the SYNACK.
 		if(!advanced) {
@@ -1863,8 +3304,8 @@ skip_ack:
 		}
 
 		if(c->state != ESTABLISHED) {
-			set_state(c, CLOSED);
 			c->reapable = true;
+			set_state(c, CLOSED);
 			goto reset;
 		}
 	}
@@ -1929,8 +3370,7 @@ skip_ack:
 			break;
 
 		case FIN_WAIT_2:
-			clock_gettime(UTCP_CLOCK, &c->conn_timeout);
-			c->conn_timeout.tv_sec += utcp->timeout;
+			start_connection_timer(c);
 			set_state(c, TIME_WAIT);
 			break;
 
@@ -1960,13 +3400,14 @@ skip_ack:
 	}
 
 	// Now we send something back if:
-	// - we received data, so we have to send back an ACK
+	// - we received data, so we have to send back an ACK, unless we can delay it
 	//   -> sendatleastone = true
 	// - or we got an ack, so we should maybe send a bit more data
 	//   -> sendatleastone = false
+	// Any data we send also carries the ACK.
 
 	if(is_reliable(c) || hdr.ctl & SYN || hdr.ctl & FIN) {
-		ack(c, has_data);
+		ack(c, has_data && !delay_ack(c, &hdr, len, had_holes));
 	}
 
 	return 0;
@@ -1985,8 +3426,9 @@ reset:
 		hdr.ctl = RST | ACK;
 	}
 
-	print_packet(c, "send", &hdr, sizeof(hdr));
-	utcp->send(utcp, &hdr, sizeof(hdr));
+	memcpy(utcp->pkt, &hdr, sizeof(hdr));
+	print_packet(c, "send", utcp->pkt, sizeof(hdr));
+	utcp->send(utcp, utcp->pkt, sizeof(hdr));
 	return 0;
 
 }
@@ -2105,28 +3547,31 @@ static bool reset_connection(struct utcp_connection *c) {
 
 	// Send RST
 
-	struct hdr hdr;
+	struct hdr *hdr = c->utcp->pkt;
 
-	hdr.src = c->src;
-	hdr.dst = c->dst;
-	hdr.seq = c->snd.nxt;
-	hdr.ack = c->rcv.nxt;
-	hdr.wnd = 0;
-	hdr.ctl = RST;
-	hdr.aux = 0;
+	hdr->src = c->src;
+	hdr->dst = c->dst;
+	hdr->seq = c->snd.nxt;
+	hdr->ack = c->rcv.nxt;
+	hdr->wnd = 0;
+	hdr->ctl = RST;
+	hdr->aux = 0;
 
-	print_packet(c, "send", &hdr, sizeof(hdr));
-	c->utcp->send(c->utcp, &hdr, sizeof(hdr));
+	print_packet(c, "send", hdr, sizeof(*hdr));
+	c->utcp->send(c->utcp, hdr, sizeof(*hdr));
 	return true;
 }
 
 static void set_reapable(struct utcp_connection *c) {
+	stop_autotune(c, &c->sndbuf);
+	stop_autotune(c, &c->rcvbuf);
 	set_buffer_storage(&c->sndbuf, NULL, min(c->sndbuf.maxsize, DEFAULT_MAXSNDBUFSIZE));
 	set_buffer_storage(&c->rcvbuf, NULL, min(c->rcvbuf.maxsize, DEFAULT_MAXRCVBUFSIZE));
 
 	c->recv = NULL;
 	c->poll = NULL;
 	c->reapable = true;
+	update_deadline(c);
 }
 
 // Resets all connections, but does not invalidate connection handles
@@ -2178,29 +3623,32 @@ int utcp_abort(struct utcp_connection *c) {
 }
 
 /* Handle timeouts.
- * One call to this function will loop through all connections,
+ * One call to this function will handle all connections whose deadline has passed,
  * checking if something needs to be resent or not.
- * The return value is the time to the next timeout in milliseconds,
- * or maybe a negative value if the timeout is infinite.
+ * The return value is the time to the next timeout.
  */
 struct timespec utcp_timeout(struct utcp *utcp) {
 	struct timespec now;
 	clock_gettime(UTCP_CLOCK, &now);
 	struct timespec next = {now.tv_sec + 3600, now.tv_nsec};
 
-	for(int i = 0; i < utcp->nconnections; i++) {
-		struct utcp_connection *c = utcp->connections[i];
+	// Callbacks can make connections due again, handle each at most once per call.
+	int todo = utcp->ndeadlines;
 
-		if(!c) {
-			continue;
+	while(utcp->ndeadlines && todo--) {
+		struct utcp_connection *c = utcp->deadlines[0];
+
+		if(!timespec_lt(&c->deadline, &now)) {
+			break;
 		}
 
+		deadline_remove(c);
+
 		// delete connections that have been utcp_close()d.
 		if(c->state == CLOSED) {
 			if(c->reapable) {
 				debug(c, "reaping\n");
 				free_connection(c);
-				i--;
 			}
 
 			continue;
@@ -2220,6 +3668,7 @@ struct timespec utcp_timeout(struct utcp *utcp) {
 				c->poll(c, 0);
 			}
 
+			update_deadline(c);
 			continue;
 		}
 
@@ -2228,6 +3677,24 @@ struct timespec utcp_timeout(struct utcp *utcp) {
 			retransmit(c);
 		}
 
+		if(timespec_isset(&c->reorder_timeout) && timespec_lt(&c->reorder_timeout, &now)) {
+			sack_detect_loss(c, &now);
+			ack(c, false);
+		}
+
+		if(timespec_isset(&c->probe_timeout) && timespec_lt(&c->probe_timeout, &now)) {
+			send_probe(c, &now);
+		}
+
+		if(timespec_isset(&c->pace_timeout) && timespec_lt(&c->pace_timeout, &now)) {
+			timespec_clear(&c->pace_timeout);
+			ack(c, false);
+		}
+
+		if(timespec_isset(&c->ack_timeout) && timespec_lt(&c->ack_timeout, &now)) {
+			ack(c, true);
+		}
+
 		if(c->poll) {
 			if((c->state == ESTABLISHED || c->state == CLOSE_WAIT) && c->do_poll) {
 				c->do_poll = false;
@@ -2241,15 +3708,19 @@ struct timespec utcp_timeout(struct utcp *utcp) {
 			}
 		}
 
-		if(timespec_isset(&c->conn_timeout) && timespec_lt(&c->conn_timeout, &next)) {
-			next = c->conn_timeout;
-		}
+		update_deadline(c);
+	}
 
-		if(timespec_isset(&c->rtrx_timeout) && timespec_lt(&c->rtrx_timeout, &next)) {
-			next = c->rtrx_timeout;
+	if(utcp->ndeadlines && timespec_lt(&utcp->deadlines[0]->deadline, &next)) {
+		next = utcp->deadlines[0]->deadline;
+
+		if(timespec_lt(&next, &now)) {
+			next = now;
 		}
 	}
 
+	utcp->next_deadline = next;
+
 	struct timespec diff;
 
 	timespec_sub(&next, &now, &diff);
@@ -2300,6 +3771,10 @@ struct utcp *utcp_init(utcp_accept_t accept, utcp_listen_t listen, utcp_send_t s
 	utcp->send = send;
 	utcp->priv = priv;
 	utcp->timeout = DEFAULT_USER_TIMEOUT; // sec
+	utcp->memory = &utcp->own_memory;
+
+	clock_gettime(UTCP_CLOCK, &utcp->next_deadline);
+	utcp->next_deadline.tv_sec += 3600;
 
 	return utcp;
 }
@@ -2309,6 +3784,9 @@ void utcp_exit(struct utcp *utcp) {
 		return;
 	}
 
+	// The application is not interested in deadlines anymore
+	utcp->deadline = NULL;
+
 	for(int i = 0; i < utcp->nconnections; i++) {
 		struct utcp_connection *c = utcp->connections[i];
 
@@ -2325,13 +3803,22 @@ void utcp_exit(struct utcp *utcp) {
 			}
 		}
 
+		// The callbacks might have scheduled this connection again
+		if(c->deadline_index) {
+			deadline_remove(c);
+		}
+
+		stop_autotune(c, &c->rcvbuf);
+		stop_autotune(c, &c->sndbuf);
 		buffer_exit(&c->rcvbuf);
 		buffer_exit(&c->sndbuf);
+		free(c->segs);
 		free(c);
 	}
 
 	free(utcp->connections);
-	free(utcp->pkt);
+	free(utcp->deadlines);
+	free(utcp->pktbuf);
 	free(utcp);
 }
 
@@ -2343,6 +3830,20 @@ uint16_t utcp_get_mss(struct utcp *utcp) {
 	return utcp ? utcp->mss : 0;
 }
 
+static bool resize_packet_buffer(struct utcp *utcp, uint16_t mtu, uint16_t headroom, uint16_t tailroom) {
+	char *new = realloc(utcp->pktbuf, headroom + mtu + sizeof(struct hdr) + tailroom);
+
+	if(!new) {
+		return false;
+	}
+
+	utcp->pktbuf = new;
+	utcp->pkt = new + headroom;
+	utcp->headroom = headroom;
+	utcp->tailroom = tailroom;
+	return true;
+}
+
 void utcp_set_mtu(struct utcp *utcp, uint16_t mtu) {
 	if(!utcp) {
 		return;
@@ -2353,19 +3854,23 @@ void utcp_set_mtu(struct utcp *utcp, uint16_t mtu) {
 	}
 
 	if(mtu > utcp->mtu) {
-		char *new = realloc(utcp->pkt, mtu + sizeof(struct hdr));
-
-		if(!new) {
+		if(!resize_packet_buffer(utcp, mtu, utcp->headroom, utcp->tailroom)) {
 			return;
 		}
-
-		utcp->pkt = new;
 	}
 
 	utcp->mtu = mtu;
 	utcp->mss = mtu - sizeof(struct hdr);
 }
 
+void utcp_set_packet_headroom(struct utcp *utcp, uint16_t headroom, uint16_t tailroom) {
+	if(!utcp) {
+		return;
+	}
+
+	resize_packet_buffer(utcp, utcp->mtu, headroom, tailroom);
+}
+
 void utcp_reset_timers(struct utcp *utcp) {
 	if(!utcp) {
 		return;
@@ -2394,6 +3899,8 @@ void utcp_reset_timers(struct utcp *utcp) {
 			c->conn_timeout = then;
 		}
 
+		update_deadline(c);
+
 		c->rtt_start.tv_sec = 0;
 
 		if(c->rto > START_RTO) {
@@ -2438,9 +3945,11 @@ void utcp_set_sndbuf(struct utcp_connection *c, void *data, size_t size) {
 		return;
 	}
 
+	stop_autotune(c, &c->sndbuf);
 	set_buffer_storage(&c->sndbuf, data, size);
 
 	c->do_poll = is_reliable(c) && buffer_free(&c->sndbuf);
+	update_deadline(c);
 }
 
 size_t utcp_get_rcvbuf(struct utcp_connection *c) {
@@ -2460,9 +3969,24 @@ void utcp_set_rcvbuf(struct utcp_connection *c, void *data, size_t size) {
 		return;
 	}
 
+	stop_autotune(c, &c->rcvbuf);
 	set_buffer_storage(&c->rcvbuf, data, size);
 }
 
+size_t utcp_get_buffer_limit(struct utcp_connection *c) {
+	return c ? c->buffer_limit : 0;
+}
+
+void utcp_set_buffer_limit(struct utcp_connection *c, size_t size) {
+	if(!c) {
+		return;
+	}
+
+	c->buffer_limit = min(size, UINT32_MAX);
+	shrink_buffer(c, &c->sndbuf, c->buffer_limit);
+	shrink_buffer(c, &c->rcvbuf, c->buffer_limit);
+}
+
 size_t utcp_get_sendq(struct utcp_connection *c) {
 	return c->sndbuf.used;
 }
@@ -2478,6 +4002,10 @@ bool utcp_get_nodelay(struct utcp_connection *c) {
 void utcp_set_nodelay(struct utcp_connection *c, bool nodelay) {
 	if(c) {
 		c->nodelay = nodelay;
+
+		if(nodelay && timespec_isset(&c->ack_timeout)) {
+			ack(c, true);
+		}
 	}
 }
 
@@ -2491,6 +4019,40 @@ void utcp_set_keepalive(struct utcp_connection *c, bool keepalive) {
 	}
 }
 
+bool utcp_get_pacing(struct utcp_connection *c) {
+	return c ? c->pacing : false;
+}
+
+void utcp_set_pacing(struct utcp_connection *c, bool pacing) {
+	if(c) {
+		c->pacing = pacing;
+	}
+}
+
+bool utcp_get_delayed_ack(struct utcp_connection *c) {
+	return c ? c->delayed_ack : false;
+}
+
+void utcp_set_delayed_ack(struct utcp_connection *c, bool delayed_ack) {
+	if(c) {
+		c->delayed_ack = delayed_ack;
+
+		if(!delayed_ack && timespec_isset(&c->ack_timeout)) {
+			ack(c, true);
+		}
+	}
+}
+
+uint64_t utcp_get_max_rate(struct utcp_connection *c) {
+	return c ? c->max_rate : 0;
+}
+
+void utcp_set_max_rate(struct utcp_connection *c, uint64_t rate) {
+	if(c) {
+		c->max_rate = rate;
+	}
+}
+
 size_t utcp_get_outq(struct utcp_connection *c) {
 	return c ? seqdiff(c->snd.nxt, c->snd.una) : 0;
 }
@@ -2505,6 +4067,7 @@ void utcp_set_poll_cb(struct utcp_connection *c, utcp_poll_t poll) {
 	if(c) {
 		c->poll = poll;
 		c->do_poll = is_reliable(c) && buffer_free(&c->sndbuf);
+		update_deadline(c);
 	}
 }
 
@@ -2527,8 +4090,7 @@ void utcp_expect_data(struct utcp_connection *c, bool expect) {
 	if(expect) {
 		// If we expect data, start the connection timer.
 		if(!timespec_isset(&c->conn_timeout)) {
-			clock_gettime(UTCP_CLOCK, &c->conn_timeout);
-			c->conn_timeout.tv_sec += c->utcp->timeout;
+			start_connection_timer(c);
 		}
 	} else {
 		// If we want to cancel expecting data, only clear the timer when there is no unACKed data.
@@ -2543,6 +4105,23 @@ void utcp_set_flags(struct utcp_connection *c, uint32_t flags) {
 	c->flags |= flags & UTCP_CHANGEABLE_FLAGS;
 }
 
+enum utcp_cc utcp_get_congestion_control(struct utcp_connection *c) {
+	return c ? c->cc : UTCP_CC_NEWRENO;
+}
+
+bool utcp_set_congestion_control(struct utcp_connection *c, enum utcp_cc cc) {
+	if(!c || (unsigned int)cc >= sizeof(cc_ops) / sizeof(*cc_ops)) {
+		errno = EINVAL;
+		return false;
+	}
+
+	c->cc = cc;
+	c->cc_ops = cc_ops[cc];
+	c->cc_ops->init(c);
+	debug(c, "congestion control %s\n", c->cc_ops->name);
+	return true;
+}
+
 void utcp_offline(struct utcp *utcp, bool offline) {
 	struct timespec now;
 	clock_gettime(UTCP_CLOCK, &now);
@@ -2559,6 +4138,7 @@ void utcp_offline(struct utcp *utcp, bool offline) {
 		if(!offline) {
 			if(timespec_isset(&c->rtrx_timeout)) {
 				c->rtrx_timeout = now;
+				update_deadline(c);
 			}
 
 			utcp->connections[i]->rtt_start.tv_sec = 0;
@@ -2574,6 +4154,35 @@ void utcp_set_retransmit_cb(struct utcp *utcp, utcp_retransmit_t cb) {
 	utcp->retransmit = cb;
 }
 
+void utcp_set_deadline_cb(struct utcp *utcp, utcp_deadline_t cb) {
+	utcp->deadline = cb;
+}
+
+void utcp_set_memory(struct utcp *utcp, struct utcp_memory *memory) {
+	if(!memory) {
+		memory = &utcp->own_memory;
+	}
+
+	// Move the memory existing connections have grown to the new accounting
+	for(int i = 0; i < utcp->nconnections; i++) {
+		struct utcp_connection *c = utcp->connections[i];
+		size_t extra = 0;
+
+		if(c->sndbuf.autotune) {
+			extra += c->sndbuf.maxsize - DEFAULT_MAXSNDBUFSIZE;
+		}
+
+		if(c->rcvbuf.autotune) {
+			extra += c->rcvbuf.maxsize - DEFAULT_MAXRCVBUFSIZE;
+		}
+
+		utcp->memory->used -= extra;
+		memory->used += extra;
+	}
+
+	utcp->memory = memory;
+}
+
 void utcp_set_clock_granularity(long granularity) {
 	CLOCK_GRANULARITY = granularity;
 }
@@ -55,15 +55,30 @@ struct utcp_connection;
 #define UTCP_UDP 0
 #define UTCP_CHANGEABLE_FLAGS 0x18U
 
+enum utcp_cc {
+	UTCP_CC_NEWRENO,
+	UTCP_CC_CUBIC,
+	UTCP_CC_BBR,
+};
+
 typedef bool (*utcp_listen_t)(struct utcp *utcp, uint16_t port);
 typedef void (*utcp_accept_t)(struct utcp_connection *utcp_connection, uint16_t port);
 typedef void (*utcp_retransmit_t)(struct utcp_connection *connection);
+typedef void (*utcp_deadline_t)(struct utcp *utcp, const struct timespec *timeout);
 
+// The packet passed to the send callback is always followed by the tailroom and preceded by the headroom
+// set with utcp_set_packet_headroom(). The callback may use that space and overwrite the packet in place.
 typedef ssize_t (*utcp_send_t)(struct utcp *utcp, const void *data, size_t len);
 typedef ssize_t (*utcp_recv_t)(struct utcp_connection *connection, const void *data, size_t len);
 
 typedef void (*utcp_poll_t)(struct utcp_connection *connection, size_t len);
 
+// Memory used by automatically grown buffers. It can be shared between utcp instances.
+struct utcp_memory {
+	size_t limit; // Maximum number of bytes buffers may grow beyond their default size, 0 if unlimited
+	size_t used; // Number of bytes buffers have currently grown beyond their default size
+};
+
 struct utcp *utcp_init(utcp_accept_t accept, utcp_listen_t listen, utcp_send_t send, void *priv);
 void utcp_exit(struct utcp *utcp);
 
@@ -90,11 +105,14 @@ void utcp_set_user_timeout(struct utcp *utcp, int seconds);
 uint16_t utcp_get_mtu(struct utcp *utcp);
 uint16_t utcp_get_mss(struct utcp *utcp);
 void utcp_set_mtu(struct utcp *utcp, uint16_t mtu);
+void utcp_set_packet_headroom(struct utcp *utcp, uint16_t headroom, uint16_t tailroom);
 
 void utcp_reset_timers(struct utcp *utcp);
 
 void utcp_offline(struct utcp *utcp, bool offline);
 void utcp_set_retransmit_cb(struct utcp *utcp, utcp_retransmit_t retransmit);
+void utcp_set_deadline_cb(struct utcp *utcp, utcp_deadline_t deadline);
+void utcp_set_memory(struct utcp *utcp, struct utcp_memory *memory);
 
 // Per-socket options
 
@@ -106,6 +124,9 @@ size_t utcp_get_rcvbuf(struct utcp_connection *connection);
 void utcp_set_rcvbuf(struct utcp_connection *connection, void *buf, size_t size);
 size_t utcp_get_rcvbuf_free(struct utcp_connection *connection);
 
+size_t utcp_get_buffer_limit(struct utcp_connection *connection);
+void utcp_set_buffer_limit(struct utcp_connection *connection, size_t size);
+
 size_t utcp_get_sendq(struct utcp_connection *connection);
 size_t utcp_get_recvq(struct utcp_connection *connection);
 
@@ -115,12 +136,24 @@ void utcp_set_nodelay(struct utcp_connection *connection, bool nodelay);
 bool utcp_get_keepalive(struct utcp_connection *connection);
 void utcp_set_keepalive(struct utcp_connection *connection, bool keepalive);
 
+bool utcp_get_pacing(struct utcp_connection *connection);
+void utcp_set_pacing(struct utcp_connection *connection, bool pacing);
+
+bool utcp_get_delayed_ack(struct utcp_connection *connection);
+void utcp_set_delayed_ack(struct utcp_connection *connection, bool delayed_ack);
+
+uint64_t utcp_get_max_rate(struct utcp_connection *connection);
+void utcp_set_max_rate(struct utcp_connection *connection, uint64_t rate);
+
 size_t utcp_get_outq(struct utcp_connection *connection);
 
 void utcp_expect_data(struct utcp_connection *connection, bool expect);
 
 void utcp_set_flags(struct utcp_connection *connection, uint32_t flags);
 
+enum utcp_cc utcp_get_congestion_control(struct utcp_connection *connection);
+bool utcp_set_congestion_control(struct utcp_connection *connection, enum utcp_cc cc);
+
 // Completely global options
 
 void utcp_set_clock_granularity(long granularity);
@@ -36,11 +36,20 @@
 #define AUX_SAK 3
 #define AUX_TIMESTAMP 4
 
-#define NSACKS 4
+// Flags in the third byte of AUX_INIT
+#define INIT_SACK 1
+#define INIT_DELAYED_ACK 2
+
+#define NSACKS 16
+#define MAX_SACK_BLOCKS 3 // An auxiliary header is at most 28 bytes long
+#define DUPTHRESH 3 // Segments SACKed above a hole before it is considered lost
+#define MIN_PROBE_TIMEOUT 10000 // usec
+#define MAX_ACK_DELAY 25000 // usec, how long the receiver may hold back an ACK
 #define DEFAULT_SNDBUFSIZE 0
 #define DEFAULT_MAXSNDBUFSIZE 131072
 #define DEFAULT_RCVBUFSIZE 0
 #define DEFAULT_MAXRCVBUFSIZE 131072
+#define DEFAULT_BUFFER_LIMIT 4194304 // Automatically sized buffers grow up to this size
 
 #define MAX_UNRELIABLE_SIZE 16777215
 #define DEFAULT_MTU 1000
@@ -51,6 +60,20 @@
 #define START_RTO (1 * USEC_PER_SEC)
 #define MAX_RTO (3 * USEC_PER_SEC)
 
+#define PACING_QUANTUM 1000 // usec
+#define PACING_GAIN_SS 200 // percent, during slow start
+#define PACING_GAIN_CA 120 // percent, during congestion avoidance
+
+#define BBR_UNIT 256
+#define BBR_HIGH_GAIN (BBR_UNIT * 2885 / 1000 + 1)
+#define BBR_DRAIN_GAIN (BBR_UNIT * 1000 / 2885)
+#define BBR_CWND_GAIN (BBR_UNIT * 2)
+#define BBR_BW_ROUNDS 10
+#define BBR_GAIN_CYCLE 8
+#define BBR_MIN_RTT_EXPIRY 10 // sec
+#define BBR_PROBE_RTT_TIME (200 * 1000) // usec
+#define BBR_MIN_CWND_SEGMENTS 4
+
 struct hdr {
 	uint16_t src; // Source port
 	uint16_t dst; // Destination port
@@ -96,6 +119,7 @@ struct buffer {
 	uint32_t size;
 	uint32_t maxsize;
 	bool external;
+	bool autotune; // maxsize follows the bandwidth-delay product
 };
 
 struct sack {
@@ -103,6 +127,45 @@ struct sack {
 	uint32_t len;
 };
 
+// A SACK block as sent in an AUX_SAK header, in absolute sequence numbers.
+struct sack_block {
+	uint32_t start;
+	uint32_t end;
+};
+
+// A segment that has been sent but not yet cumulatively ACKed.
+struct segment {
+	uint32_t seq;
+	uint32_t len; // Including the FIN, if any
+	struct timespec sent; // Time of the most recent (re)transmission
+	bool sacked;
+	bool lost;
+	bool rexmit; // A retransmission of this lost segment is in flight
+	bool retransmitted; // Sent more than once
+};
+
+struct utcp_connection;
+
+// Congestion control algorithm. The hooks are called after snd.una has been updated,
+// and may change snd.cwnd and snd.ssthresh. The caller clamps snd.cwnd afterwards.
+struct utcp_cc_ops {
+	const char *name;
+	void (*init)(struct utcp_connection *c);
+	void (*ack)(struct utcp_connection *c, uint32_t acked, uint32_t rtt); // rtt is 0 if there was no RTT sample
+	void (*enter_recovery)(struct utcp_connection *c); // after the third duplicate ACK, or when SACK detects a loss
+	void (*dupack)(struct utcp_connection *c); // each further duplicate ACK during fast recovery, not used with SACK
+	void (*exit_recovery)(struct utcp_connection *c);
+	void (*timeout)(struct utcp_connection *c);
+	uint64_t (*pacing_rate)(struct utcp_connection *c); // bytes/second, 0 if unknown
+};
+
+enum bbr_mode {
+	BBR_STARTUP,
+	BBR_DRAIN,
+	BBR_PROBE_BW,
+	BBR_PROBE_RTT,
+};
+
 struct utcp_connection {
 	void *priv;
 	struct utcp *utcp;
@@ -136,6 +199,7 @@ struct utcp_connection {
 	struct {
 		uint32_t nxt;
 		uint32_t irs;
+		uint32_t recent; // Start of the most recently received out-of-order segment
 	} rcv;
 
 	int dupack;
@@ -146,6 +210,11 @@ struct utcp_connection {
 	struct timespec rtrx_timeout;
 	struct timespec rtt_start;
 	uint32_t rtt_seq;
+	struct timespec pace_time; // When the next packet would be sent at exactly the pacing rate
+	struct timespec pace_timeout;
+	struct timespec reorder_timeout; // When a segment that might just be reordered is considered lost
+	struct timespec probe_timeout; // When to send a tail loss probe
+	struct timespec ack_timeout; // When to send a delayed ACK
 
 	// RTT variables
 
@@ -160,16 +229,84 @@ struct utcp_connection {
 	struct buffer rcvbuf;
 	struct sack sacks[NSACKS];
 
+	uint32_t buffer_limit; // Automatically sized buffers grow up to this size
+	uint32_t rcv_space; // In-order bytes received since rcv_space_time
+	struct timespec rcv_space_time; // Start of the current receive window measurement
+
+	// SACK scoreboard and RACK loss detection, see RFC 6675 and RFC 8985
+
+	bool sack; // Both sides support AUX_SAK
+	bool recovery; // In SACK based loss recovery
+	uint32_t recover; // Recovery ends when this is ACKed
+	struct segment *segs; // Ring buffer of segments between snd.una and snd.nxt
+	uint32_t segs_head;
+	uint32_t nsegs;
+	uint32_t segs_size; // Zero or a power of two
+	uint32_t sacked; // Bytes in SACKed segments
+	uint32_t lost; // Bytes in lost segments
+	uint32_t rexmit; // Bytes in retransmissions in flight
+
+	// Delayed ACKs, see RFC 1122 section 4.2.3.2 and RFC 5681 section 4.2
+
+	bool ack_delay; // Both sides support delayed ACKs
+	uint32_t ack_pending; // Bytes of in-order data received since we last sent an ACK
+	uint32_t last_ack; // The ACK number carried by the last packet we sent
+	uint32_t rcv_mss; // The largest segment received so far
+
+	struct {
+		struct timespec xmit; // Send time of the most recently sent segment that has been delivered
+		uint32_t end; // The end of that segment
+		uint32_t rtt; // usec
+		uint32_t min_rtt; // usec
+	} rack;
+
 	// Per-socket options
 
 	bool nodelay;
 	bool keepalive;
 	bool shut_wr;
+	bool pacing;
+	bool delayed_ack;
+	uint64_t max_rate; // bytes/second, 0 if unlimited
 
 	// Congestion avoidance state
 
-	struct timespec tlast;
-	uint64_t bandwidth;
+	enum utcp_cc cc;
+	const struct utcp_cc_ops *cc_ops;
+
+	struct timespec tlast; // Start of the current round
+	uint64_t bandwidth; // Estimated bottleneck bandwidth in bytes/second
+
+	union {
+		struct {
+			uint32_t w_max; // Window size just before the last reduction
+			uint32_t w_est; // Reno-friendly window estimate
+			uint32_t k; // msec
+			struct timespec epoch; // Start of the current congestion avoidance epoch
+		} cubic;
+
+		struct {
+			enum bbr_mode mode;
+			uint32_t round; // Number of round trips since the start
+			uint32_t round_seq; // The round ends when this is ACKed
+			uint32_t delivered; // Bytes ACKed in the current round
+			uint64_t bw_samples[BBR_BW_ROUNDS]; // Per-round delivery rate samples for the max filter
+			uint64_t full_bw;
+			int full_bw_count;
+			uint32_t min_rtt; // usec
+			struct timespec min_rtt_stamp;
+			struct timespec probe_rtt_done;
+			uint32_t prior_cwnd;
+			uint32_t pacing_gain; // In units of BBR_UNIT
+			uint32_t cwnd_gain; // In units of BBR_UNIT
+			int cycle_index;
+		} bbr;
+	} ccs;
+
+	// Position in the deadline heap
+
+	struct timespec deadline;
+	int deadline_index; // 1-based, 0 if not in the heap
 };
 
 struct utcp {
@@ -181,10 +318,14 @@ struct utcp {
 	utcp_listen_t listen;
 	utcp_retransmit_t retransmit;
 	utcp_send_t send;
+	utcp_deadline_t deadline;
 
 	// Packet buffer
 
-	void *pkt;
+	char *pktbuf;
+	void *pkt; // Points into pktbuf, after the headroom
+	uint16_t headroom;
+	uint16_t tailroom;
 
 	// Global socket options
 
@@ -192,11 +333,22 @@ struct utcp {
 	uint16_t mss; // The maximum size of the payload of a UTCP packet.
 	int timeout; // sec
 
+	// Memory used by automatically sized buffers
+
+	struct utcp_memory *memory; // Points to own_memory unless shared with other instances
+	struct utcp_memory own_memory;
+
 	// Connection management
 
 	struct utcp_connection **connections;
 	int nconnections;
 	int nallocated;
+
+	// Timer management
+
+	struct utcp_connection **deadlines; // Min-heap of connections ordered by deadline
+	int ndeadlines;
+	struct timespec next_deadline; // The earliest deadline the application knows about
 };
 
 #endif
@@ -0,0 +1,377 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chacha-poly1305/chacha.h"
+#include "chacha-poly1305/chacha-poly1305.h"
+#include "chacha-poly1305/poly1305.h"
+
+// Known answer tests for the ChaCha20 and Poly1305 implementations, using the test vectors from RFC 8439.
+// Every implementation the CPU supports must also give the same output as the scalar code for all lengths.
+// The fused AEAD must match ChaCha20 and Poly1305 applied separately.
+
+static const char ietf_text[] =
+        "Any submission to the IETF intended by the Contributor for publication as all or part of an IETF Internet-Draft or RFC "
+        "and any statement made within the context of an IETF activity is considered an \"IETF Contribution\". Such statements "
+        "include oral statements in IETF sessions, as well as written and electronic communications made at any time or place, "
+        "which are addressed to";
+
+static void unhex(const char *hex, uint8_t *out, size_t len) {
+	assert(strlen(hex) == len * 2);
+
+	for(size_t i = 0; i < len; i++) {
+		unsigned int byte;
+		assert(sscanf(hex + 2 * i, "%2x", &byte) == 1);
+		out[i] = byte;
+	}
+}
+
+static void check_rfc8439(const char *key_hex, const char *nonce_hex, uint32_t counter, const char *plaintext, const char *ciphertext_hex) {
+	size_t len = strlen(plaintext);
+	uint8_t key[32], nonce[12], expected[len], out[len];
+	uint8_t ctr[4] = {counter, counter >> 8, counter >> 16, counter >> 24};
+	unhex(key_hex, key, sizeof(key));
+	unhex(nonce_hex, nonce, sizeof(nonce));
+	unhex(ciphertext_hex, expected, len);
+
+	struct chacha_ctx ctx;
+	chacha_keysetup(&ctx, key, 256);
+	chacha_ivsetup_96(&ctx, nonce, ctr);
+	chacha_encrypt_bytes(&ctx, (const uint8_t *)plaintext, out, len);
+	assert(!memcmp(out, expected, len));
+
+	// Decrypting in place must give back the plaintext
+	chacha_ivsetup_96(&ctx, nonce, ctr);
+	chacha_encrypt_bytes(&ctx, out, out, len);
+	assert(!memcmp(out, plaintext, len));
+}
+
+static void encrypt_with(enum chacha_impl impl, const uint8_t *key, const uint8_t *iv, const uint8_t *counter, const uint8_t *in, uint8_t *out, size_t len, size_t split) {
+	assert(chacha_set_impl(impl));
+
+	struct chacha_ctx ctx;
+	chacha_keysetup(&ctx, key, 256);
+	chacha_ivsetup(&ctx, iv, counter);
+
+	// Encrypting in two calls must continue where the first call left off, as long as the split is on a block boundary
+	chacha_encrypt_bytes(&ctx, in, out, split);
+	chacha_encrypt_bytes(&ctx, in + split, out + split, len - split);
+}
+
+static void check_against_scalar(enum chacha_impl impl) {
+	static uint8_t in[4096], expected[4096], out[4096];
+	uint8_t key[32], iv[8];
+
+	for(size_t i = 0; i < sizeof(key); i++) {
+		key[i] = rand();
+	}
+
+	for(size_t i = 0; i < sizeof(iv); i++) {
+		iv[i] = rand();
+	}
+
+	for(size_t i = 0; i < sizeof(in); i++) {
+		in[i] = rand();
+	}
+
+	// Also check that the 64-bit block counter carries correctly
+	static const uint8_t counters[][8] = {
+		{0, 0, 0, 0, 0, 0, 0, 0},
+		{0xf0, 0xff, 0xff, 0xff, 0, 0, 0, 0},
+		{0xfd, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff},
+	};
+
+	for(size_t c = 0; c < sizeof(counters) / sizeof(*counters); c++) {
+		for(size_t len = 0; len <= sizeof(in); len += len < 1100 ? 1 : 61) {
+			size_t split = (len / 2) & ~(size_t)63;
+			encrypt_with(CHACHA_IMPL_SCALAR, key, iv, counters[c], in, expected, len, split);
+			encrypt_with(impl, key, iv, counters[c], in, out, len, split);
+			assert(!memcmp(out, expected, len));
+
+			// In place
+			memcpy(out, in, len);
+			encrypt_with(impl, key, iv, counters[c], out, out, len, split);
+			assert(!memcmp(out, expected, len));
+		}
+	}
+}
+
+static void poly1305_stream(const uint8_t *key, const uint8_t *msg, size_t len, size_t chunk, uint8_t tag[POLY1305_TAGLEN]) {
+	poly1305_ctx ctx;
+	poly1305_init(&ctx, key);
+
+	for(size_t i = 0; i < len; i += chunk) {
+		poly1305_update(&ctx, msg + i, len - i < chunk ? len - i : chunk);
+	}
+
+	poly1305_finish(&ctx, tag);
+}
+
+static void check_poly1305(const char *key_hex, const uint8_t *msg, size_t len, const char *tag_hex) {
+	uint8_t key[POLY1305_KEYLEN], expected[POLY1305_TAGLEN], tag[POLY1305_TAGLEN];
+	unhex(key_hex, key, sizeof(key));
+	unhex(tag_hex, expected, sizeof(expected));
+
+	poly1305_auth(tag, msg, len, key);
+	assert(!memcmp(tag, expected, sizeof(tag)));
+
+	// Feeding the message in pieces of any size must give the same tag
+	for(size_t chunk = 1; chunk < len; chunk++) {
+		poly1305_stream(key, msg, len, chunk, tag);
+		assert(!memcmp(tag, expected, sizeof(tag)));
+	}
+}
+
+static void check_poly1305_hex(const char *key_hex, const char *msg_hex, const char *tag_hex) {
+	size_t len = strlen(msg_hex) / 2;
+	uint8_t msg[len];
+	unhex(msg_hex, msg, len);
+	check_poly1305(key_hex, msg, len, tag_hex);
+}
+
+static void check_poly1305_against_scalar(enum poly1305_impl impl) {
+	static uint8_t msg[4096];
+	uint8_t key[POLY1305_KEYLEN], expected[POLY1305_TAGLEN], tag[POLY1305_TAGLEN];
+	static const size_t chunks[] = {1, 13, 64, 300, 1024};
+
+	// Random data, and all ones to get the largest possible limbs
+	for(int fill = 0; fill < 2; fill++) {
+		for(size_t i = 0; i < sizeof(key); i++) {
+			key[i] = fill ? 0xff : rand();
+		}
+
+		for(size_t i = 0; i < sizeof(msg); i++) {
+			msg[i] = fill ? 0xff : rand();
+		}
+
+		for(size_t len = 0; len <= sizeof(msg); len += len < 1100 ? 1 : 61) {
+			assert(poly1305_set_impl(POLY1305_IMPL_SCALAR));
+			poly1305_auth(expected, msg, len, key);
+
+			assert(poly1305_set_impl(impl));
+			poly1305_auth(tag, msg, len, key);
+			assert(!memcmp(tag, expected, sizeof(tag)));
+
+			for(size_t c = 0; c < sizeof(chunks) / sizeof(*chunks); c++) {
+				poly1305_stream(key, msg, len, chunks[c], tag);
+				assert(!memcmp(tag, expected, sizeof(tag)));
+			}
+		}
+	}
+}
+
+static void check_poly1305_impls(void) {
+	enum poly1305_impl best = poly1305_get_impl();
+	printf("Selected Poly1305 implementation: %s\n", poly1305_impl_name(best));
+
+	assert(poly1305_impl_supported(POLY1305_IMPL_SCALAR));
+	assert(!poly1305_set_impl(POLY1305_IMPL_COUNT));
+
+	for(int impl = POLY1305_IMPL_SCALAR; impl < POLY1305_IMPL_COUNT; impl++) {
+		if(!poly1305_impl_supported(impl)) {
+			printf("poly1305 %s: not supported by this CPU, skipped\n", poly1305_impl_name(impl));
+			continue;
+		}
+
+		assert(poly1305_set_impl(impl));
+		assert(poly1305_get_impl() == (enum poly1305_impl)impl);
+
+		// RFC 8439 section 2.5.2
+		check_poly1305("85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b",
+		               (const uint8_t *)"Cryptographic Forum Research Group", 34,
+		               "a8061dc1305136c6c22b8baf0c0127a9");
+
+		// RFC 8439 appendix A.3, test vectors #1 to #4
+		uint8_t zero[64] = {0};
+		check_poly1305("0000000000000000000000000000000000000000000000000000000000000000", zero, sizeof(zero),
+		               "00000000000000000000000000000000");
+		check_poly1305("0000000000000000000000000000000036e5f6b5c5e06070f0efca96227a863e", (const uint8_t *)ietf_text, strlen(ietf_text),
+		               "36e5f6b5c5e06070f0efca96227a863e");
+		check_poly1305("36e5f6b5c5e06070f0efca96227a863e00000000000000000000000000000000", (const uint8_t *)ietf_text, strlen(ietf_text),
+		               "f3477e7cd95417af89a6b8794c310cf0");
+
+		const char *jabberwocky =
+		        "'Twas brillig, and the slithy toves\nDid gyre and gimble in the wabe:\n"
+		        "All mimsy were the borogoves,\nAnd the mome raths outgrabe.";
+		check_poly1305("1c9240a5eb55d38af333888604f6b5f0473917c1402b80099dca5cbc207075c0", (const uint8_t *)jabberwocky, strlen(jabberwocky),
+		               "4541669a7eaaee61e708dc7cbcc5eb62");
+
+		// RFC 8439 appendix A.3, test vectors #5 to #11, which exercise the modular reduction
+		check_poly1305_hex("0200000000000000000000000000000000000000000000000000000000000000",
+		                   "ffffffffffffffffffffffffffffffff",
+		                   "03000000000000000000000000000000");
+		check_poly1305_hex("02000000000000000000000000000000ffffffffffffffffffffffffffffffff",
+		                   "02000000000000000000000000000000",
+		                   "03000000000000000000000000000000");
+		check_poly1305_hex("0100000000000000000000000000000000000000000000000000000000000000",
+		                   "ffffffffffffffffffffffffffffffff"
+		                   "f0ffffffffffffffffffffffffffffff"
+		                   "11000000000000000000000000000000",
+		                   "05000000000000000000000000000000");
+		check_poly1305_hex("0100000000000000000000000000000000000000000000000000000000000000",
+		                   "ffffffffffffffffffffffffffffffff"
+		                   "fbfefefefefefefefefefefefefefefe"
+		                   "01010101010101010101010101010101",
+		                   "00000000000000000000000000000000");
+		check_poly1305_hex("0200000000000000000000000000000000000000000000000000000000000000",
+		                   "fdffffffffffffffffffffffffffffff",
+		                   "faffffffffffffffffffffffffffffff");
+		check_poly1305_hex("0100000000000000040000000000000000000000000000000000000000000000",
+		                   "e33594d7505e43b90000000000000000"
+		                   "3394d7505e4379cd0100000000000000"
+		                   "00000000000000000000000000000000"
+		                   "01000000000000000000000000000000",
+		                   "14000000000000005500000000000000");
+		check_poly1305_hex("0100000000000000040000000000000000000000000000000000000000000000",
+		                   "e33594d7505e43b90000000000000000"
+		                   "3394d7505e4379cd0100000000000000"
+		                   "00000000000000000000000000000000",
+		                   "13000000000000000000000000000000");
+
+		if(impl != POLY1305_IMPL_SCALAR) {
+			check_poly1305_against_scalar(impl);
+		}
+
+		printf("poly1305 %s: OK\n", poly1305_impl_name(impl));
+	}
+
+	assert(poly1305_set_impl(best));
+}
+
+static void check_aead(void) {
+	static uint8_t in[4096], expected[4096 + POLY1305_TAGLEN], out[4096 + POLY1305_TAGLEN];
+	uint8_t key[CHACHA_POLY1305_KEYLEN];
+
+	for(size_t i = 0; i < sizeof(key); i++) {
+		key[i] = rand();
+	}
+
+	for(size_t i = 0; i < sizeof(in); i++) {
+		in[i] = rand();
+	}
+
+	chacha_poly1305_ctx_t *ctx = chacha_poly1305_init();
+	assert(chacha_poly1305_set_key(ctx, key));
+
+	for(size_t len = 0; len <= sizeof(in); len += len < 1100 ? 1 : 61) {
+		uint64_t seqno = len * 0x1234567;
+		uint8_t seqbuf[8], poly_key[64] = {0};
+		size_t outlen;
+
+		for(int i = 0; i < 8; i++) {
+			seqbuf[i] = seqno >> (56 - 8 * i);
+		}
+
+		// Reference: the first keystream block gives the Poly1305 key, the payload is encrypted from block 1
+		struct chacha_ctx chacha;
+		uint8_t one[8] = {1};
+		chacha_keysetup(&chacha, key, 256);
+		chacha_ivsetup(&chacha, seqbuf, NULL);
+		chacha_encrypt_bytes(&chacha, poly_key, poly_key, sizeof(poly_key));
+		chacha_ivsetup(&chacha, seqbuf, one);
+		chacha_encrypt_bytes(&chacha, in, expected, len);
+		poly1305_auth(expected + len, expected, len, poly_key);
+
+		assert(chacha_poly1305_encrypt(ctx, seqno, in, len, out, &outlen));
+		assert(outlen == len + POLY1305_TAGLEN);
+		assert(!memcmp(out, expected, outlen));
+
+		memcpy(out, in, len);
+		assert(chacha_poly1305_encrypt_in_place(ctx, seqno, out, len));
+		assert(!memcmp(out, expected, len + POLY1305_TAGLEN));
+
+		uint8_t decrypted[len + 1];
+		assert(chacha_poly1305_decrypt(ctx, seqno, expected, len + POLY1305_TAGLEN, decrypted, &outlen));
+		assert(outlen == len);
+		assert(!memcmp(decrypted, in, len));
+
+		assert(chacha_poly1305_decrypt_in_place(ctx, seqno, out, len + POLY1305_TAGLEN, &outlen));
+		assert(outlen == len);
+		assert(!memcmp(out, in, len));
+
+		// Any modification must be detected, and no plaintext must be returned
+		memcpy(out, expected, len + POLY1305_TAGLEN);
+		out[(len * 7) % (len + POLY1305_TAGLEN)] ^= 0x10;
+		assert(!chacha_poly1305_decrypt_in_place(ctx, seqno, out, len + POLY1305_TAGLEN, NULL));
+
+		for(size_t i = 0; i < len; i++) {
+			assert(!out[i]);
+		}
+
+		assert(!chacha_poly1305_decrypt(ctx, seqno + 1, expected, len + POLY1305_TAGLEN, decrypted, NULL));
+		assert(chacha_poly1305_verify(ctx, seqno, expected, len + POLY1305_TAGLEN));
+		assert(!chacha_poly1305_verify(ctx, seqno + 1, expected, len + POLY1305_TAGLEN));
+	}
+
+	chacha_poly1305_exit(ctx);
+	printf("chacha-poly1305: OK\n");
+}
+
+int main(void) {
+	enum chacha_impl best = chacha_get_impl();
+	printf("Selected ChaCha20 implementation: %s\n", chacha_impl_name(best));
+
+	assert(chacha_impl_supported(CHACHA_IMPL_SCALAR));
+	assert(!chacha_set_impl(CHACHA_IMPL_COUNT));
+
+	for(int impl = CHACHA_IMPL_SCALAR; impl < CHACHA_IMPL_COUNT; impl++) {
+		if(!chacha_impl_supported(impl)) {
+			printf("chacha %s: not supported by this CPU, skipped\n", chacha_impl_name(impl));
+			continue;
+		}
+
+		assert(chacha_set_impl(impl));
+		assert(chacha_get_impl() == (enum chacha_impl)impl);
+
+		// RFC 8439 section 2.4.2
+		check_rfc8439(
+		        "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+		        "000000000000004a00000000",
+		        1,
+		        "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.",
+		        "6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0b"
+		        "f91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d8"
+		        "07ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab7793736"
+		        "5af90bbf74a35be6b40b8eedf2785e42874d");
+
+		// RFC 8439 appendix A.2, test vector #2
+		check_rfc8439(
+		        "0000000000000000000000000000000000000000000000000000000000000001",
+		        "000000000000000000000002",
+		        1,
+		        ietf_text,
+		        "a3fbf07df3fa2fde4f376ca23e82737041605d9f4f4f57bd8cff2c1d4b7955ec"
+		        "2a97948bd3722915c8f3d337f7d370050e9e96d647b7c39f56e031ca5eb6250d"
+		        "4042e02785ececfa4b4bb5e8ead0440e20b6e8db09d881a7c6132f420e527950"
+		        "42bdfa7773d8a9051447b3291ce1411c680465552aa6c405b7764d5e87bea85a"
+		        "d00f8449ed8f72d0d662ab052691ca66424bc86d2df80ea41f43abf937d3259d"
+		        "c4b2d0dfb48a6c9139ddd7f76966e928e635553ba76c5c879d7b35d49eb2e62b"
+		        "0871cdac638939e25e8a1e0ef9d5280fa8ca328b351c3c765989cbcf3daa8b6c"
+		        "cc3aaf9f3979c92b3720fc88dc95ed84a1be059c6499b9fda236e7e818b04b0b"
+		        "c39c1e876b193bfe5569753f88128cc08aaa9b63d1a16f80ef2554d7189c411f"
+		        "5869ca52c5b83fa36ff216b9c1d30062bebcfd2dc5bce0911934fda79a86f6e6"
+		        "98ced759c3ff9b6477338f3da4f9cd8514ea9982ccafb341b2384dd902f3d1ab"
+		        "7ac61dd29c6f21ba5b862f3730e37cfdc4fd806c22f221"
+		);
+
+		if(impl != CHACHA_IMPL_SCALAR) {
+			check_against_scalar(impl);
+		}
+
+		printf("chacha %s: OK\n", chacha_impl_name(impl));
+	}
+
+	assert(chacha_set_impl(best));
+
+	check_poly1305_impls();
+	check_aead();
+	return 0;
+}
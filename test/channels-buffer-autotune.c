@@ -0,0 +1,128 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that channel buffers grow automatically, that the memory they use is limited, and that it is returned.
+
+static const size_t size = 4 * 1024 * 1024;
+
+static char *in;
+static char *out;
+static size_t received;
+static size_t max_used;
+static meshlink_handle_t *sender;
+static struct sync_flag received_flag;
+static struct sync_flag closed_flag;
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	if(!len) {
+		meshlink_channel_close(mesh, channel);
+		set_sync_flag(&closed_flag, true);
+		return;
+	}
+
+	assert(received + len <= size);
+	memcpy(out + received, data, len);
+	received += len;
+
+	size_t used = devtool_get_channel_memory_used(sender);
+
+	if(used > max_used) {
+		max_used = used;
+	}
+
+	if(received == size) {
+		set_sync_flag(&received_flag, true);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port == 7);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+// Returns the maximum amount of memory the sender's buffers had grown during the transfer.
+static size_t transfer(meshlink_handle_t *mesh_a, meshlink_handle_t *mesh_b) {
+	received = 0;
+	max_used = 0;
+	memset(out, 0, size);
+	reset_sync_flag(&received_flag);
+	reset_sync_flag(&closed_flag);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0);
+	assert(channel);
+
+	assert(meshlink_channel_aio_send(mesh_a, channel, in, size, NULL, NULL));
+	assert(wait_sync_flag(&received_flag, 60));
+	assert(!memcmp(in, out, size));
+
+	// Closing the channels returns all the memory.
+
+	meshlink_channel_close(mesh_a, channel);
+	assert(wait_sync_flag(&closed_flag, 10));
+	assert(devtool_get_channel_memory_used(mesh_a) == 0);
+	assert(devtool_get_channel_memory_used(mesh_b) == 0);
+
+	return max_used;
+}
+
+int main(void) {
+	init_sync_flag(&received_flag);
+	init_sync_flag(&closed_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	in = malloc(size);
+	out = malloc(size);
+	assert(in && out);
+
+	for(size_t i = 0; i < size; i++) {
+		in[i] = i * 7 + i / 251;
+	}
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_buffer_autotune");
+	sender = mesh_a;
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	// With the default limit, the send buffer grows beyond its default size.
+
+	size_t grown = transfer(mesh_a, mesh_b);
+	fprintf(stderr, "buffers grew by %zu bytes with the default limit\n", grown);
+	assert(grown > 0);
+
+	// With a limit, they never grow beyond it.
+
+	meshlink_set_channel_memory_limit(mesh_a, 16384);
+	size_t limited = transfer(mesh_a, mesh_b);
+	fprintf(stderr, "buffers grew by %zu bytes with a limit\n", limited);
+	assert(limited <= 16384);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+	free(in);
+	free(out);
+}
@@ -0,0 +1,107 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that channel data arrives intact with each of the congestion control algorithms.
+
+static const size_t size = 4 * 1024 * 1024;
+
+static char *in;
+static char *out;
+static size_t received;
+static struct sync_flag received_flag;
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	assert(received + len <= size);
+	memcpy(out + received, data, len);
+	received += len;
+
+	if(received == size) {
+		set_sync_flag(&received_flag, true);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port == 7);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+static void transfer(meshlink_handle_t *mesh_a, meshlink_congestion_control_t cc) {
+	received = 0;
+	memset(out, 0, size);
+	reset_sync_flag(&received_flag);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0);
+	assert(channel);
+	assert(meshlink_set_channel_congestion_control(mesh_a, channel, cc));
+
+	assert(meshlink_channel_aio_send(mesh_a, channel, in, size, NULL, NULL));
+	assert(wait_sync_flag(&received_flag, 60));
+	assert(!memcmp(in, out, size));
+
+	meshlink_channel_close(mesh_a, channel);
+}
+
+int main(void) {
+	init_sync_flag(&received_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	in = malloc(size);
+	out = malloc(size);
+	assert(in && out);
+
+	for(size_t i = 0; i < size; i++) {
+		in[i] = i * 7 + i / 251;
+	}
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_congestion_control");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	// Send the same data with each algorithm.
+
+	transfer(mesh_a, MESHLINK_CC_NEWRENO);
+	transfer(mesh_a, MESHLINK_CC_CUBIC);
+	transfer(mesh_a, MESHLINK_CC_BBR);
+
+	// Unknown algorithms are rejected.
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0);
+	assert(channel);
+	assert(!meshlink_set_channel_congestion_control(mesh_a, channel, (meshlink_congestion_control_t)3));
+	assert(meshlink_errno == MESHLINK_EINVAL);
+	meshlink_channel_close(mesh_a, channel);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+	free(in);
+	free(out);
+}
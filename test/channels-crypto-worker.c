@@ -0,0 +1,133 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that handshakes and key renewals work when they are verified by the crypto worker thread.
+
+static const size_t size = 1024 * 1024;
+
+static char *in;
+static char *out;
+static size_t received;
+static struct sync_flag received_flag;
+static struct sync_flag renewal_flag;
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	assert(received + len <= size);
+	memcpy(out + received, data, len);
+	received += len;
+
+	if(received == size) {
+		set_sync_flag(&received_flag, true);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port == 7);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+static void renewal_probe(meshlink_node_t *node) {
+	(void)node;
+	set_sync_flag(&renewal_flag, true);
+}
+
+static void transfer(meshlink_handle_t *mesh_a) {
+	received = 0;
+	memset(out, 0, size);
+	reset_sync_flag(&received_flag);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0);
+	assert(channel);
+
+	assert(meshlink_channel_aio_send(mesh_a, channel, in, size, NULL, NULL));
+	assert(wait_sync_flag(&received_flag, 60));
+	assert(!memcmp(in, out, size));
+
+	meshlink_channel_close(mesh_a, channel);
+}
+
+static void renew(meshlink_handle_t *mesh_a, meshlink_handle_t *mesh_b) {
+	reset_sync_flag(&renewal_flag);
+	devtool_force_sptps_renewal(mesh_a, meshlink_get_node(mesh_a, "b"));
+	devtool_force_sptps_renewal(mesh_b, meshlink_get_node(mesh_b, "a"));
+	assert(wait_sync_flag(&renewal_flag, 15));
+
+	// Give the handshakes time to finish
+	sleep(1);
+}
+
+int main(void) {
+	init_sync_flag(&received_flag);
+	init_sync_flag(&renewal_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	in = malloc(size);
+	out = malloc(size);
+	assert(in && out);
+
+	for(size_t i = 0; i < size; i++) {
+		in[i] = i * 7 + i / 251;
+	}
+
+	// Open two instances that both use the crypto worker.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_crypto_worker");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+
+	devtool_set_crypto_worker(mesh_a, true);
+	devtool_set_crypto_worker(mesh_b, true);
+	devtool_sptps_renewal_probe = renewal_probe;
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+	transfer(mesh_a);
+
+	// Renew the keys of both the meta-connection and the UDP session, twice.
+
+	renew(mesh_a, mesh_b);
+	transfer(mesh_a);
+
+	renew(mesh_a, mesh_b);
+	transfer(mesh_a);
+
+	// Restart the receiver without the crypto worker, and renew again.
+
+	meshlink_stop(mesh_b);
+	devtool_set_crypto_worker(mesh_b, false);
+	assert(meshlink_start(mesh_b));
+	transfer(mesh_a);
+
+	renew(mesh_a, mesh_b);
+	transfer(mesh_a);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+	free(in);
+	free(out);
+}
@@ -0,0 +1,179 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that delayed ACKs reduce the number of packets sent back by the receiver.
+
+static const size_t size = 1024 * 1024;
+static const int rounds = 100;
+
+static char *in;
+static char *out;
+static size_t received;
+static int replies;
+static long pause_time;
+static bool delayed_ack;
+static struct sync_flag received_flag;
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	assert(received + len <= size);
+	memcpy(out + received, data, len);
+	received += len;
+
+	if(received == size) {
+		set_sync_flag(&received_flag, true);
+	}
+}
+
+static void echo_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	if(len) {
+		assert(meshlink_channel_send(mesh, channel, data, len) == (ssize_t)len);
+	}
+}
+
+static void reply_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	if(!len) {
+		return;
+	}
+
+	if(++replies == rounds) {
+		set_sync_flag(&received_flag, true);
+	} else {
+		if(pause_time) {
+			const struct timespec req = {0, pause_time};
+			nanosleep(&req, NULL);
+		}
+
+		assert(meshlink_channel_send(mesh, channel, data, len) == (ssize_t)len);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	meshlink_set_channel_delayed_ack(mesh, channel, delayed_ack);
+	meshlink_set_channel_receive_cb(mesh, channel, port == 7 ? receive_cb : echo_cb);
+	return true;
+}
+
+static uint64_t tx_packets(meshlink_handle_t *mesh) {
+	devtool_udp_receive_stats_t stats;
+	devtool_get_udp_receive_stats(mesh, &stats);
+	return stats.tx_packets;
+}
+
+// Returns the number of packets the receiver sent during a bulk transfer.
+static uint64_t transfer(meshlink_handle_t *mesh_a, meshlink_handle_t *mesh_b, bool delay) {
+	received = 0;
+	delayed_ack = delay;
+	memset(out, 0, size);
+	reset_sync_flag(&received_flag);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0);
+	assert(channel);
+
+	uint64_t before = tx_packets(mesh_b);
+	assert(meshlink_channel_aio_send(mesh_a, channel, in, size, NULL, NULL));
+	assert(wait_sync_flag(&received_flag, 60));
+	assert(!memcmp(in, out, size));
+	uint64_t after = tx_packets(mesh_b);
+
+	meshlink_channel_close(mesh_a, channel);
+
+	return after - before;
+}
+
+// Returns the number of packets the echo server sent while answering a series of small requests,
+// waiting the given number of nanoseconds before sending the next request.
+static uint64_t ping_pong(meshlink_handle_t *mesh_a, meshlink_handle_t *mesh_b, long pause) {
+	replies = 0;
+	pause_time = pause;
+	delayed_ack = true;
+	reset_sync_flag(&received_flag);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 8, reply_cb, NULL, 0);
+	assert(channel);
+
+	uint64_t before = tx_packets(mesh_b);
+	assert(meshlink_channel_send(mesh_a, channel, "ping", 4) == 4);
+	assert(wait_sync_flag(&received_flag, 10));
+	uint64_t after = tx_packets(mesh_b);
+
+	meshlink_channel_close(mesh_a, channel);
+
+	return after - before;
+}
+
+int main(void) {
+	init_sync_flag(&received_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	in = malloc(size);
+	out = malloc(size);
+	assert(in && out);
+
+	for(size_t i = 0; i < size; i++) {
+		in[i] = i * 7 + i / 251;
+	}
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_delayed_ack");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	// The first transfer makes sure the nodes talk to each other directly via UDP.
+
+	transfer(mesh_a, mesh_b, true);
+
+	// With delayed ACKs, the receiver should send about half as many packets.
+
+	uint64_t immediate = transfer(mesh_a, mesh_b, false);
+	uint64_t delayed = transfer(mesh_a, mesh_b, true);
+	fprintf(stderr, "receiver sent %lu packets with immediate ACKs, %lu with delayed ACKs\n", (unsigned long)immediate, (unsigned long)delayed);
+	assert(immediate > 500);
+	assert(delayed < immediate * 3 / 4);
+
+	// ACKs for requests should be sent together with the replies.
+
+	uint64_t replied = ping_pong(mesh_a, mesh_b, 0);
+	fprintf(stderr, "echo server sent %lu packets for %d replies\n", (unsigned long)replied, rounds);
+	assert(replied < rounds * 3 / 2);
+
+	// That should also be the case if the next request only comes after the delayed ACK timer would have expired.
+
+	replied = ping_pong(mesh_a, mesh_b, 30000000);
+	fprintf(stderr, "echo server sent %lu packets for %d slow replies\n", (unsigned long)replied, rounds);
+	assert(replied < rounds * 3 / 2);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+	free(in);
+	free(out);
+}
@@ -0,0 +1,86 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+
+// Node names longer than 15 characters used to be truncated in packet headers, making channels between them impossible.
+
+static const char *a_name = "a_node_with_a_name_longer_than_fifteen_characters";
+static const char *b_name = "b_node_with_a_name_longer_than_fifteen_characters";
+
+static struct sync_flag b_responded;
+
+static void a_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	if(len == 5 && !memcmp(data, "Hello", 5)) {
+		set_sync_flag(&b_responded, true);
+	}
+}
+
+static void b_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	// Echo the data back.
+	assert(meshlink_channel_send(mesh, channel, data, len) == (ssize_t)len);
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(!strcmp(channel->node->name, a_name));
+
+	if(port != 7) {
+		return false;
+	}
+
+	meshlink_set_channel_receive_cb(mesh, channel, b_receive_cb);
+	return true;
+}
+
+int main(void) {
+	init_sync_flag(&b_responded);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Open two new meshlink instances with long names.
+
+	meshlink_handle_t *mesh_a = meshlink_open_ephemeral(a_name, "channels-long-names", DEV_CLASS_BACKBONE);
+	meshlink_handle_t *mesh_b = meshlink_open_ephemeral(b_name, "channels-long-names", DEV_CLASS_BACKBONE);
+	assert(mesh_a);
+	assert(mesh_b);
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+
+	link_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	// Open a channel from a to b, and check that b echoes our data back.
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, b_name);
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, a_receive_cb, NULL, 0);
+	assert(channel);
+
+	assert(meshlink_channel_send(mesh_a, channel, "Hello", 5) == 5);
+	assert(wait_sync_flag(&b_responded, 20));
+
+	meshlink_channel_close(mesh_a, channel);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+}
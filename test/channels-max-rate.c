@@ -0,0 +1,111 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that the maximum rate of a channel is respected.
+
+static const size_t size = 1024 * 1024;
+
+static char *in;
+static char *out;
+static size_t received;
+static struct sync_flag received_flag;
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	assert(received + len <= size);
+	memcpy(out + received, data, len);
+	received += len;
+
+	if(received == size) {
+		set_sync_flag(&received_flag, true);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port == 7);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+// Returns the time it took to send all data, in seconds.
+static double transfer(meshlink_handle_t *mesh_a, size_t rate) {
+	received = 0;
+	memset(out, 0, size);
+	reset_sync_flag(&received_flag);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0);
+	assert(channel);
+	meshlink_set_channel_max_rate(mesh_a, channel, rate);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	assert(meshlink_channel_aio_send(mesh_a, channel, in, size, NULL, NULL));
+	assert(wait_sync_flag(&received_flag, 60));
+	assert(!memcmp(in, out, size));
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	meshlink_channel_close(mesh_a, channel);
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+int main(void) {
+	init_sync_flag(&received_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	in = malloc(size);
+	out = malloc(size);
+	assert(in && out);
+
+	for(size_t i = 0; i < size; i++) {
+		in[i] = i * 7 + i / 251;
+	}
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_max_rate");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	// Limited to 512 kB/s, sending 1 MB should take about two seconds.
+
+	double limited = transfer(mesh_a, size / 2);
+	assert(limited > 1.8);
+	assert(limited < 10);
+
+	// Without a limit, it should be much faster.
+
+	double unlimited = transfer(mesh_a, 0);
+	assert(unlimited < limited / 2);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+	free(in);
+	free(out);
+}
@@ -0,0 +1,128 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that channel data arrives intact and in order when incoming packets are decrypted by worker threads.
+
+static const size_t size = 4 * 1024 * 1024;
+
+static char *in;
+static char *out;
+static size_t received;
+static struct sync_flag received_flag;
+static unsigned int renewals;
+
+static void renewal_probe(meshlink_node_t *node) {
+	(void)node;
+	__atomic_add_fetch(&renewals, 1, __ATOMIC_SEQ_CST);
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	assert(received + len <= size);
+	memcpy(out + received, data, len);
+	received += len;
+
+	if(received == size) {
+		set_sync_flag(&received_flag, true);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port == 7);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+static void transfer(meshlink_handle_t *mesh_a, bool renew) {
+	received = 0;
+	memset(out, 0, size);
+	reset_sync_flag(&received_flag);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0);
+	assert(channel);
+
+	assert(meshlink_channel_aio_send(mesh_a, channel, in, size, NULL, NULL));
+
+	if(renew) {
+		// Slow down the transfer, so the keys are renewed while packets are queued for the workers
+		meshlink_set_channel_max_rate(mesh_a, channel, 1024 * 1024);
+		devtool_force_sptps_renewal(mesh_a, b);
+	}
+
+	assert(wait_sync_flag(&received_flag, 60));
+	assert(!memcmp(in, out, size));
+
+	meshlink_channel_close(mesh_a, channel);
+}
+
+int main(void) {
+	init_sync_flag(&received_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+	devtool_sptps_renewal_probe = renewal_probe;
+
+	in = malloc(size);
+	out = malloc(size);
+	assert(in && out);
+
+	for(size_t i = 0; i < size; i++) {
+		in[i] = i * 7 + i / 251;
+	}
+
+	// Open two instances that both use packet workers.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_packet_workers");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+
+	devtool_set_packet_workers(mesh_a, 2);
+	devtool_set_packet_workers(mesh_b, 3);
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+	transfer(mesh_a, false);
+
+	// Renew the keys during a transfer.
+
+	transfer(mesh_a, true);
+	assert(__atomic_load_n(&renewals, __ATOMIC_SEQ_CST) >= 1);
+
+	// Restart the receiver with a different number of workers, and without any.
+
+	meshlink_stop(mesh_b);
+	devtool_set_packet_workers(mesh_b, 1);
+	assert(meshlink_start(mesh_b));
+	transfer(mesh_a, false);
+
+	meshlink_stop(mesh_b);
+	devtool_set_packet_workers(mesh_b, 0);
+	assert(meshlink_start(mesh_b));
+	transfer(mesh_a, false);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+	free(in);
+	free(out);
+}
@@ -0,0 +1,169 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meshlink.h"
+#include "utils.h"
+
+// Measure how fast multiple application threads can each send on their own channel with meshlink_channel_send(),
+// and check that every channel's data arrives intact and in order.
+// Usage: channels-send-threads [threads [megabytes per thread [chunk size]]]
+
+static meshlink_handle_t *mesh_a;
+static meshlink_node_t *b;
+static size_t bytes_per_thread;
+static size_t chunk_size;
+static size_t nthreads;
+
+static pthread_mutex_t received_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t channels_done;
+static struct sync_flag done_flag;
+
+struct thread_info {
+	pthread_t thread;
+	meshlink_channel_t *channel;
+	size_t retries;
+};
+
+struct receive_info {
+	size_t received;
+};
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+
+	struct receive_info *info = channel->priv;
+	const unsigned char *p = data;
+
+	for(size_t i = 0; i < len; i++) {
+		assert(p[i] == (unsigned char)((info->received + i) % 251));
+	}
+
+	info->received += len;
+	assert(info->received <= bytes_per_thread);
+
+	if(info->received == bytes_per_thread) {
+		pthread_mutex_lock(&received_mutex);
+
+		if(++channels_done == nthreads) {
+			set_sync_flag(&done_flag, true);
+		}
+
+		pthread_mutex_unlock(&received_mutex);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)port;
+	(void)data;
+	(void)len;
+
+	channel->priv = calloc(1, sizeof(struct receive_info));
+	assert(channel->priv);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+static double wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *send_thread(void *arg) {
+	struct thread_info *info = arg;
+	unsigned char data[chunk_size];
+	size_t sent = 0;
+
+	while(sent < bytes_per_thread) {
+		size_t len = bytes_per_thread - sent < chunk_size ? bytes_per_thread - sent : chunk_size;
+
+		for(size_t i = 0; i < len; i++) {
+			data[i] = (sent + i) % 251;
+		}
+
+		ssize_t result = meshlink_channel_send(mesh_a, info->channel, data, len);
+		assert(result >= 0);
+
+		if(!result) {
+			// Back off until the send buffer has room again
+			info->retries++;
+			sched_yield();
+		}
+
+		sent += result;
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	nthreads = argc > 1 ? (size_t)atoi(argv[1]) : 4;
+	bytes_per_thread = (argc > 2 ? (size_t)atoi(argv[2]) : 10) * 1024 * 1024;
+	chunk_size = argc > 3 ? (size_t)atoi(argv[3]) : 1000;
+	assert(nthreads && bytes_per_thread && chunk_size);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+	init_sync_flag(&done_flag);
+
+	meshlink_handle_t *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_send_threads");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	struct thread_info *threads = calloc(nthreads, sizeof(*threads));
+	assert(threads);
+
+	for(size_t i = 0; i < nthreads; i++) {
+		threads[i].channel = meshlink_channel_open(mesh_a, b, 1, NULL, NULL, 0);
+		assert(threads[i].channel);
+		meshlink_set_channel_sndbuf(mesh_a, threads[i].channel, 256 * 1024);
+	}
+
+	double start = wall_time();
+
+	for(size_t i = 0; i < nthreads; i++) {
+		assert(!pthread_create(&threads[i].thread, NULL, send_thread, &threads[i]));
+	}
+
+	size_t retries = 0;
+
+	for(size_t i = 0; i < nthreads; i++) {
+		assert(!pthread_join(threads[i].thread, NULL));
+		retries += threads[i].retries;
+	}
+
+	assert(wait_sync_flag(&done_flag, 600));
+
+	double elapsed = wall_time() - start;
+	double megabytes = nthreads * bytes_per_thread / (1024.0 * 1024.0);
+
+	printf("%zu threads sent %.0f MB in chunks of %zu bytes in %.3f s: %.1f MB/s, %zu retries\n", nthreads, megabytes, chunk_size, elapsed, megabytes / elapsed, retries);
+
+	for(size_t i = 0; i < nthreads; i++) {
+		meshlink_channel_close(mesh_a, threads[i].channel);
+	}
+
+	free(threads);
+	close_meshlink_pair(mesh_a, mesh_b);
+
+	return 0;
+}
@@ -0,0 +1,136 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "meshlink.h"
+#include "devtools.h"
+#include "utils.h"
+
+// Measure how fast and how cheaply a single reliable channel moves bulk data between two local nodes.
+// Usage: channels-throughput [megabytes [udp receive batch size]]
+
+static size_t size;
+static size_t received;
+static struct sync_flag sent_flag;
+static struct sync_flag received_flag;
+
+static void aio_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len, void *priv) {
+	(void)mesh;
+	(void)channel;
+	(void)data;
+	(void)len;
+	(void)priv;
+
+	set_sync_flag(&sent_flag, true);
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+	(void)data;
+
+	received += len;
+
+	if(received >= size) {
+		set_sync_flag(&received_flag, true);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)port;
+	(void)data;
+	(void)len;
+
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+static double cpu_time(void) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+static double wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+	size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : 100;
+	assert(megabytes);
+	size = megabytes * 1024 * 1024;
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	char *data = malloc(size);
+	assert(data);
+
+	for(size_t i = 0; i < size; i++) {
+		data[i] = i;
+	}
+
+	init_sync_flag(&sent_flag);
+	init_sync_flag(&received_flag);
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_throughput");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	if(argc > 2) {
+		devtool_set_udp_receive_batch(mesh_a, atoi(argv[2]));
+		devtool_set_udp_receive_batch(mesh_b, atoi(argv[2]));
+	}
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 1, NULL, NULL, 0);
+	assert(channel);
+	meshlink_set_channel_sndbuf(mesh_a, channel, 1024 * 1024);
+
+	double wall_start = wall_time();
+	double cpu_start = cpu_time();
+
+	assert(meshlink_channel_aio_send(mesh_a, channel, data, size, aio_cb, NULL));
+	assert(wait_sync_flag(&sent_flag, 600));
+	assert(wait_sync_flag(&received_flag, 600));
+
+	double wall = wall_time() - wall_start;
+	double cpu = cpu_time() - cpu_start;
+
+	printf("%zu MB in %.3f s: %.1f MB/s, %.3f ms CPU per MB\n", megabytes, wall, megabytes / wall, cpu * 1e3 / megabytes);
+
+	devtool_udp_receive_stats_t stats;
+	devtool_get_udp_receive_stats(mesh_b, &stats);
+	printf("receiver: %" PRIu64 " UDP packets in %" PRIu64 " syscalls, %.2f packets/syscall (batch %u)\n", stats.packets, stats.syscalls, (double)stats.packets / stats.syscalls, stats.batch);
+	printf("receiver: %" PRIu64 " UDP packets sent back\n", stats.tx_packets);
+
+	devtool_get_udp_receive_stats(mesh_a, &stats);
+	printf("sender: %" PRIu64 " UDP packets in %" PRIu64 " syscalls, %.2f packets/syscall\n", stats.tx_packets, stats.tx_syscalls, (double)stats.tx_packets / stats.tx_syscalls);
+
+	meshlink_channel_close(mesh_a, channel);
+	close_meshlink_pair(mesh_a, mesh_b);
+	free(data);
+
+	return 0;
+}
@@ -0,0 +1,289 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#include "chacha-poly1305/chacha.h"
+#include "chacha-poly1305/chacha-poly1305.h"
+#include "chacha-poly1305/poly1305.h"
+#include "ed25519/ed25519.h"
+
+// Measure the speed of each ChaCha20 and Poly1305 implementation supported by this CPU, for small, typical and large packets,
+// and of the AEAD construction used by SPTPS with the default implementations.
+// On x86 the result is in TSC cycles per byte, elsewhere in nanoseconds per byte.
+// Finally, measure how many Ed25519 signatures per second can be verified one by one and in batches,
+// and how many key exchanges and complete SPTPS handshakes (as seen by one side) can be done per second.
+// Usage: crypto-benchmark [minimum seconds per measurement]
+
+static const size_t sizes[] = {64, 1400, 65536};
+
+static double wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t ticks(void) {
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static double measure_chacha(struct chacha_ctx *ctx, uint8_t *buf, size_t len, double duration) {
+	static const uint8_t iv[8];
+	static const uint8_t counter[8];
+	size_t iterations = 0;
+	double start = wall_time();
+	uint64_t start_ticks = ticks();
+
+	// Encrypt in batches, so reading the clock does not dominate the result for small packets
+	do {
+		for(int i = 0; i < 1000; i++) {
+			chacha_ivsetup(ctx, iv, counter);
+			chacha_encrypt_bytes(ctx, buf, buf, len);
+		}
+
+		iterations += 1000;
+	} while(wall_time() - start < duration);
+
+	return (double)(ticks() - start_ticks) / (iterations * len);
+}
+
+static double measure_poly1305(const uint8_t *key, uint8_t *buf, size_t len, double duration) {
+	size_t iterations = 0;
+	double start = wall_time();
+	uint64_t start_ticks = ticks();
+
+	do {
+		for(int i = 0; i < 1000; i++) {
+			// Chain the tags, so the compiler cannot skip any work
+			poly1305_auth(buf, buf, len, key);
+		}
+
+		iterations += 1000;
+	} while(wall_time() - start < duration);
+
+	return (double)(ticks() - start_ticks) / (iterations * len);
+}
+
+static double measure_aead(chacha_poly1305_ctx_t *ctx, uint8_t *buf, size_t len, double duration) {
+	size_t iterations = 0;
+	double start = wall_time();
+	uint64_t start_ticks = ticks();
+
+	do {
+		for(int i = 0; i < 1000; i++) {
+			chacha_poly1305_encrypt_in_place(ctx, iterations + i, buf, len);
+		}
+
+		iterations += 1000;
+	} while(wall_time() - start < duration);
+
+	return (double)(ticks() - start_ticks) / (iterations * len);
+}
+
+#define MAX_BATCH 64
+
+static double measure_ed25519(const unsigned char *const *sigs, const unsigned char *const *msgs, const size_t *lens, const unsigned char *const *keys, size_t batch, double duration) {
+	size_t verified = 0;
+	double start = wall_time();
+	double now;
+
+	do {
+		if(batch) {
+			assert(ed25519_verify_batch(sigs, msgs, lens, keys, batch, NULL));
+			verified += batch;
+		} else {
+			for(int i = 0; i < MAX_BATCH; i++) {
+				assert(ed25519_verify(sigs[i], msgs[i], lens[i], keys[i]));
+			}
+
+			verified += MAX_BATCH;
+		}
+	} while((now = wall_time()) - start < duration);
+
+	return verified / (now - start);
+}
+
+enum handshake_step {
+	KEYPAIR,
+	KEY_EXCHANGE,
+	HANDSHAKE,
+};
+
+static double measure_handshake(enum handshake_step step, double duration) {
+	unsigned char seed[32], public_key[32], private_key[64], peer_public[32], peer_private[64], shared[32], sig[64];
+	size_t iterations = 0;
+	double start = wall_time();
+	double now;
+
+	memset(seed, 0x42, sizeof(seed));
+	ed25519_create_keypair(peer_public, peer_private, seed);
+	ed25519_create_keypair(public_key, private_key, seed);
+
+	do {
+		for(int i = 0; i < 100; i++) {
+			// Use the previous output as the next input, so the compiler cannot skip any work
+			seed[0]++;
+
+			if(step == KEY_EXCHANGE) {
+				ed25519_key_exchange(shared, peer_public, private_key);
+				memcpy(private_key, shared, sizeof(shared));
+				continue;
+			}
+
+			// Both sides send an ephemeral ECDH public key signed with their long-term key, and verify the peer's
+			ed25519_create_keypair(public_key, private_key, seed);
+
+			if(step == HANDSHAKE) {
+				ed25519_sign(sig, public_key, sizeof(public_key), peer_public, peer_private);
+				assert(ed25519_verify(sig, public_key, sizeof(public_key), peer_public));
+				ed25519_key_exchange(shared, peer_public, private_key);
+				seed[1] ^= shared[0];
+			}
+		}
+
+		iterations += 100;
+	} while((now = wall_time()) - start < duration);
+
+	return iterations / (now - start);
+}
+
+static void print_header(const char *algorithm) {
+#ifdef HAVE_RDTSC
+	printf("%-9s cycles/byte", algorithm);
+#else
+	printf("%-9s ns/byte    ", algorithm);
+#endif
+
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		printf(" %8zu B", sizes[i]);
+	}
+
+	printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+	double duration = argc > 1 ? atof(argv[1]) : 0.5;
+	assert(duration > 0);
+
+	uint8_t key[32];
+	memset(key, 0x42, sizeof(key));
+
+	struct chacha_ctx ctx;
+	chacha_keysetup(&ctx, key, 256);
+
+	uint8_t *buf = calloc(1, sizes[sizeof(sizes) / sizeof(*sizes) - 1] + POLY1305_TAGLEN);
+	assert(buf);
+
+	enum chacha_impl best = chacha_get_impl();
+	print_header("ChaCha20");
+
+	for(int impl = CHACHA_IMPL_SCALAR; impl < CHACHA_IMPL_COUNT; impl++) {
+		if(!chacha_set_impl(impl)) {
+			continue;
+		}
+
+		printf("%-21s", chacha_impl_name(impl));
+
+		for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+			printf(" %10.2f", measure_chacha(&ctx, buf, sizes[i], duration));
+			fflush(stdout);
+		}
+
+		printf("%s\n", impl == (int)best ? " (default)" : "");
+	}
+
+	chacha_set_impl(best);
+
+	enum poly1305_impl best_poly1305 = poly1305_get_impl();
+	print_header("Poly1305");
+
+	for(int impl = POLY1305_IMPL_SCALAR; impl < POLY1305_IMPL_COUNT; impl++) {
+		if(!poly1305_set_impl(impl)) {
+			continue;
+		}
+
+		printf("%-21s", poly1305_impl_name(impl));
+
+		for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+			printf(" %10.2f", measure_poly1305(key, buf, sizes[i], duration));
+			fflush(stdout);
+		}
+
+		printf("%s\n", impl == (int)best_poly1305 ? " (default)" : "");
+	}
+
+	poly1305_set_impl(best_poly1305);
+
+	uint8_t aead_key[CHACHA_POLY1305_KEYLEN];
+	memset(aead_key, 0x42, sizeof(aead_key));
+	chacha_poly1305_ctx_t *aead = chacha_poly1305_init();
+	chacha_poly1305_set_key(aead, aead_key);
+
+	print_header("AEAD");
+	printf("%-21s", "chacha-poly1305");
+
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		printf(" %10.2f", measure_aead(aead, buf, sizes[i], duration));
+		fflush(stdout);
+	}
+
+	printf("\n");
+	chacha_poly1305_exit(aead);
+
+	// Every signature in a batch is made by a different key, like handshakes from different peers
+	static unsigned char ed_keys[MAX_BATCH][32];
+	static unsigned char ed_msgs[MAX_BATCH][131];
+	static unsigned char ed_sigs[MAX_BATCH][64];
+	const unsigned char *sigs[MAX_BATCH], *msgs[MAX_BATCH], *keys[MAX_BATCH];
+	size_t lens[MAX_BATCH];
+
+	for(int i = 0; i < MAX_BATCH; i++) {
+		unsigned char seed[32], private_key[64];
+		memset(seed, i, sizeof(seed));
+		memset(ed_msgs[i], i * 3, sizeof(ed_msgs[i]));
+		ed25519_create_keypair(ed_keys[i], private_key, seed);
+		ed25519_sign(ed_sigs[i], ed_msgs[i], sizeof(ed_msgs[i]), ed_keys[i], private_key);
+		sigs[i] = ed_sigs[i];
+		msgs[i] = ed_msgs[i];
+		keys[i] = ed_keys[i];
+		lens[i] = sizeof(ed_msgs[i]);
+	}
+
+	printf("Ed25519   batch size   verifications/s\n");
+	printf("%-21s %10.0f\n", "single", measure_ed25519(sigs, msgs, lens, keys, 0, duration));
+
+	for(size_t batch = 1; batch <= MAX_BATCH; batch *= 2) {
+		printf("%-21zu %10.0f\n", batch, measure_ed25519(sigs, msgs, lens, keys, batch, duration));
+		fflush(stdout);
+	}
+
+	printf("Handshake                  operations/s\n");
+	printf("%-21s %10.0f\n", "ECDH key generation", measure_handshake(KEYPAIR, duration));
+	printf("%-21s %10.0f\n", "ECDH shared secret", measure_handshake(KEY_EXCHANGE, duration));
+	printf("%-21s %10.0f\n", "SPTPS handshake", measure_handshake(HANDSHAKE, duration));
+
+	free(buf);
+
+	return 0;
+}
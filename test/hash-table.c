@@ -0,0 +1,154 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+// Check that the hash table never loses entries, that deletion works, and that keys that only differ slightly are spread evenly.
+
+typedef struct key {
+	uint16_t family;
+	uint16_t port;
+	uint32_t scope_id;
+	uint8_t address[16];
+} test_key_t;
+
+static test_key_t make_key(uint32_t i) {
+	test_key_t key;
+	memset(&key, 0, sizeof(key));
+	key.family = 2;
+	key.port = 655 + (i >> 16);
+	key.address[0] = 10;
+	key.address[2] = i >> 8;
+	key.address[3] = i;
+	return key;
+}
+
+static void *value(uint32_t i) {
+	return (void *)(uintptr_t)(i + 1);
+}
+
+static void check_all(const hash_t *hash, uint32_t count, uint32_t step, uint32_t offset) {
+	for(uint32_t i = 0; i < count; i++) {
+		test_key_t key = make_key(i);
+		void *expected = (i % step == offset) ? value(i) : NULL;
+		assert(hash_search(hash, &key) == expected);
+	}
+}
+
+static void test_insert_delete(void) {
+	const uint32_t count = 100000;
+	hash_t *hash = hash_alloc(0x100, sizeof(test_key_t));
+
+	// The table grows automatically, without evicting anything
+	for(uint32_t i = 0; i < count; i++) {
+		test_key_t key = make_key(i);
+		hash_insert(hash, &key, value(i));
+	}
+
+	assert(hash->count == count);
+	assert(hash->n >= count);
+	check_all(hash, count, 1, 0);
+
+	// Inserting an existing key replaces its value
+	test_key_t key = make_key(42);
+	hash_insert(hash, &key, value(43));
+	assert(hash_search(hash, &key) == value(43));
+	assert(hash_search_or_insert(hash, &key, value(44)) == value(43));
+	hash_insert(hash, &key, value(42));
+	assert(hash->count == count);
+
+	// Delete two thirds of the entries
+	for(uint32_t i = 0; i < count; i++) {
+		if(i % 3) {
+			key = make_key(i);
+			hash_delete(hash, &key);
+		}
+	}
+
+	assert(hash->count == (count + 2) / 3);
+	check_all(hash, count, 3, 0);
+
+	// Deleting a missing key does nothing
+	key = make_key(count + 1);
+	hash_delete(hash, &key);
+	assert(hash->count == (count + 2) / 3);
+
+	assert(hash_search_or_insert(hash, &key, value(count + 1)) == NULL);
+	assert(hash_search(hash, &key) == value(count + 1));
+	hash_delete(hash, &key);
+
+	// Shrinking keeps all entries
+	hash_resize(hash, 0);
+	assert(hash->n >= hash->count);
+	check_all(hash, count, 3, 0);
+
+	hash_clear(hash);
+	assert(hash->count == 0);
+	check_all(hash, count, count + 1, count);
+
+	hash_free(hash);
+}
+
+static void test_distribution(void) {
+	// Keys that only differ in a few bits should land in home slots as if they were random
+	const uint32_t count = 1 << 16;
+	const uint32_t slots = 1 << 17;
+	uint8_t *used = calloc(slots, 1);
+	assert(used);
+	uint32_t occupied = 0;
+
+	for(uint32_t i = 0; i < count; i++) {
+		test_key_t key = make_key(i);
+		uint32_t slot = hash_function(&key, sizeof(key)) & (slots - 1);
+		occupied += !used[slot];
+		used[slot] = 1;
+	}
+
+	// For random hash values, the expected number of occupied slots is slots * (1 - exp(-count / slots)), about 51572
+	uint32_t expected = 51572;
+	printf("%u keys occupy %u of %u slots, expected %u\n", count, occupied, slots, expected);
+	assert(occupied > expected - expected / 50 && occupied < expected + expected / 50);
+	free(used);
+
+	// At the maximum load factor, entries stay close to their home slots
+	hash_t *hash = hash_alloc(slots, sizeof(test_key_t));
+
+	for(uint32_t i = 0; i < slots / 8 * 7 - 1; i++) {
+		test_key_t key = make_key(i);
+		hash_insert(hash, &key, value(i));
+	}
+
+	assert(hash->n == slots);
+
+	uint64_t total = 0;
+	unsigned int max = 0;
+
+	for(uint32_t i = 0; i < hash->n; i++) {
+		if(hash->distances[i]) {
+			unsigned int distance = hash->distances[i] - 1u;
+			total += distance;
+			max = distance > max ? distance : max;
+		}
+	}
+
+	double mean = (double)total / hash->count;
+	printf("mean probe distance %.2f, maximum %u\n", mean, max);
+	assert(mean < 4);
+	assert(max < 64);
+
+	hash_free(hash);
+}
+
+int main(void) {
+	test_insert_delete();
+	test_distribution();
+	return 0;
+}
@@ -0,0 +1,93 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that SPTPS key renewals are scheduled with jitter and are rate limited.
+
+static unsigned int renewals;
+
+static void renewal_probe(meshlink_node_t *node) {
+	(void)node;
+	__atomic_add_fetch(&renewals, 1, __ATOMIC_SEQ_CST);
+}
+
+static void check_schedule(meshlink_handle_t *mesh, const char *name) {
+	devtool_node_status_t status;
+	devtool_get_node_status(mesh, meshlink_get_node(mesh, name), &status);
+	free(status.external_ip_address);
+	free(status.canonical_address);
+
+	// Renewals are due between 45 and 60 minutes after the previous one
+	assert(status.key_renewal_in >= 2700 - 5);
+	assert(status.key_renewal_in <= 3600);
+}
+
+int main(void) {
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "key_renewal");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+
+	devtool_set_key_renewal_rate(mesh_a, 1);
+	devtool_sptps_renewal_probe = renewal_probe;
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	// Wait for the UDP session to be established.
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+	assert(meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0));
+
+	devtool_node_status_t status;
+	status.key_renewal_in = -1;
+
+	for(int i = 0; i < 20 && status.key_renewal_in < 0; i++) {
+		sleep(1);
+		devtool_get_node_status(mesh_a, b, &status);
+		free(status.external_ip_address);
+		free(status.canonical_address);
+	}
+
+	check_schedule(mesh_a, "b");
+
+	devtool_key_renewal_stats_t stats;
+	devtool_get_key_renewal_stats(mesh_a, &stats);
+	assert(stats.rate == 1);
+	assert(stats.renewals == 0);
+
+	// Make both the meta-connection and the UDP session due for renewal at once.
+	// Only one of them may be renewed per second.
+
+	devtool_force_sptps_renewal(mesh_a, b);
+	assert_after(__atomic_load_n(&renewals, __ATOMIC_SEQ_CST) >= 1, 5);
+	devtool_get_key_renewal_stats(mesh_a, &stats);
+
+	if(stats.renewals == 1) {
+		assert(stats.postponed == 1);
+	}
+
+	assert_after((devtool_get_key_renewal_stats(mesh_a, &stats), stats.renewals == 2), 5);
+	assert_after((devtool_get_key_renewal_stats(mesh_a, &stats), !stats.in_flight), 10);
+	assert(!stats.postponed);
+
+	check_schedule(mesh_a, "b");
+	assert(meshlink_get_node(mesh_a, "b") == b);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+}
@@ -0,0 +1,179 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meshlink.h"
+#include "devtools.h"
+#include "utils.h"
+
+// Measure how many packets one node can receive from several peers at once, with a varying number of packet workers.
+// Usage: packet-workers-throughput [senders [packets per sender [workers...]]]
+
+static meshlink_handle_t *mesh_b;
+static size_t packets_per_sender;
+
+static pthread_mutex_t received_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t received;
+static double last_received;
+static struct sync_flag warmup_flag;
+
+struct sender {
+	meshlink_handle_t *mesh;
+	meshlink_node_t *b;
+	pthread_t thread;
+};
+
+static double wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	(void)mesh;
+	(void)source;
+	(void)data;
+	(void)len;
+
+	pthread_mutex_lock(&received_mutex);
+	received++;
+	last_received = wall_time();
+	pthread_mutex_unlock(&received_mutex);
+
+	set_sync_flag(&warmup_flag, true);
+}
+
+static void *send_thread(void *arg) {
+	struct sender *sender = arg;
+	char data[1000];
+	memset(data, 0x55, sizeof(data));
+
+	for(size_t i = 0; i < packets_per_sender; i++) {
+		while(!meshlink_send(sender->mesh, sender->b, data, sizeof(data))) {
+			assert(meshlink_errno == MESHLINK_EAGAIN);
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+static void warmup(struct sender *sender) {
+	// Wait until packets from this sender get through, so we measure the steady state.
+	reset_sync_flag(&warmup_flag);
+
+	for(int i = 0; i < 100 && !check_sync_flag(&warmup_flag); i++) {
+		assert(meshlink_send(sender->mesh, sender->b, "warmup", 6));
+		wait_sync_flag(&warmup_flag, 1);
+	}
+
+	assert(check_sync_flag(&warmup_flag));
+}
+
+static void run(struct sender *senders, size_t nsenders, unsigned int workers) {
+	meshlink_stop(mesh_b);
+	devtool_set_packet_workers(mesh_b, workers);
+	assert(meshlink_start(mesh_b));
+
+	for(size_t i = 0; i < nsenders; i++) {
+		warmup(&senders[i]);
+	}
+
+	pthread_mutex_lock(&received_mutex);
+	received = 0;
+	pthread_mutex_unlock(&received_mutex);
+
+	double start = wall_time();
+
+	for(size_t i = 0; i < nsenders; i++) {
+		assert(!pthread_create(&senders[i].thread, NULL, send_thread, &senders[i]));
+	}
+
+	for(size_t i = 0; i < nsenders; i++) {
+		assert(!pthread_join(senders[i].thread, NULL));
+	}
+
+	// Give the receiver time to catch up, until no more packets arrive.
+	size_t got = 0;
+	double end = start;
+	struct timespec delay = {0, 200000000};
+
+	for(;;) {
+		nanosleep(&delay, NULL);
+		pthread_mutex_lock(&received_mutex);
+		size_t now = received;
+		end = last_received;
+		pthread_mutex_unlock(&received_mutex);
+
+		if(now == got) {
+			break;
+		}
+
+		got = now;
+	}
+
+	size_t total = nsenders * packets_per_sender;
+	printf("%u workers: received %zu of %zu packets (%.1f%%) in %.3f s: %.0f packets/s\n", workers, got, total, got * 100.0 / total, end - start, got / (end - start));
+}
+
+int main(int argc, char *argv[]) {
+	size_t nsenders = argc > 1 ? (size_t)atoi(argv[1]) : 8;
+	packets_per_sender = argc > 2 ? (size_t)atoi(argv[2]) : 20000;
+	assert(nsenders && packets_per_sender);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+	init_sync_flag(&warmup_flag);
+
+	mesh_b = meshlink_open_ephemeral("b", "packet-workers-throughput", DEV_CLASS_BACKBONE);
+	assert(mesh_b);
+	meshlink_enable_discovery(mesh_b, false);
+	meshlink_set_receive_cb(mesh_b, receive_cb);
+	assert(meshlink_start(mesh_b));
+
+	struct sender *senders = calloc(nsenders, sizeof(*senders));
+	assert(senders);
+
+	for(size_t i = 0; i < nsenders; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "a%zu", i);
+		senders[i].mesh = meshlink_open_ephemeral(name, "packet-workers-throughput", DEV_CLASS_BACKBONE);
+		assert(senders[i].mesh);
+		meshlink_enable_discovery(senders[i].mesh, false);
+		link_meshlink_pair(senders[i].mesh, mesh_b);
+		assert(meshlink_start(senders[i].mesh));
+		senders[i].b = meshlink_get_node(senders[i].mesh, "b");
+		assert(senders[i].b);
+	}
+
+	if(argc > 3) {
+		for(int i = 3; i < argc; i++) {
+			run(senders, nsenders, atoi(argv[i]));
+		}
+	} else {
+		static const unsigned int workers[] = {0, 1, 2, 4, 8};
+
+		for(size_t i = 0; i < sizeof(workers) / sizeof(*workers); i++) {
+			run(senders, nsenders, workers[i]);
+		}
+	}
+
+	for(size_t i = 0; i < nsenders; i++) {
+		meshlink_close(senders[i].mesh);
+	}
+
+	meshlink_close(mesh_b);
+	free(senders);
+
+	return 0;
+}
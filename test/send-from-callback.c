@@ -0,0 +1,91 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+
+// Check that a callback can send more packets than fit in the send queue,
+// and that a callback can echo packets to its own node without recursing.
+
+static const int burst = 1000;
+static const int echoes = 100;
+
+static struct sync_flag received_flag;
+static struct sync_flag echo_flag;
+static meshlink_node_t *self_a;
+static int depth;
+static int expected;
+
+static void receive_cb_a(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	if(source != self_a) {
+		set_sync_flag(&received_flag, true);
+		return;
+	}
+
+	// Every packet must be delivered exactly once, in order, and not from within another callback
+	int counter;
+	assert(len == sizeof(counter));
+	memcpy(&counter, data, sizeof(counter));
+
+	assert(++depth == 1);
+	assert(counter == expected++);
+
+	if(++counter < echoes) {
+		assert(meshlink_send(mesh, source, &counter, sizeof(counter)));
+	} else {
+		set_sync_flag(&echo_flag, true);
+	}
+
+	depth--;
+}
+
+static void receive_cb_b(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	// The MeshLink thread is busy running this callback, it cannot empty the queue in the meantime
+	for(int i = 0; i < burst; i++) {
+		assert(meshlink_send(mesh, source, data, len));
+	}
+}
+
+int main(void) {
+	init_sync_flag(&received_flag);
+	init_sync_flag(&echo_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "send_from_callback");
+
+	meshlink_set_receive_cb(mesh_a, receive_cb_a);
+	meshlink_set_receive_cb(mesh_b, receive_cb_b);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	// Ask b to send a burst of packets back.
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	assert(meshlink_send(mesh_a, b, "ping", 4));
+	assert(wait_sync_flag(&received_flag, 10));
+
+	// Send a packet to ourself, the callback keeps echoing it back.
+
+	self_a = meshlink_get_self(mesh_a);
+	assert(self_a);
+
+	int counter = 0;
+	assert(meshlink_send(mesh_a, self_a, &counter, sizeof(counter)));
+	assert(wait_sync_flag(&echo_flag, 10));
+	assert(expected == echoes);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+}
@@ -0,0 +1,76 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+
+// Check that packets larger than MeshLink can carry are rejected, both when queued and when sent from a callback.
+
+// MAXSIZE with jumbograms enabled, which is larger than MAXSIZE without them
+static const size_t maxsize = 8951 + 64;
+
+static char *big;
+static struct sync_flag received_flag;
+static bool rejected;
+
+static void receive_cb_a(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	(void)mesh;
+	(void)source;
+	(void)data;
+
+	// Only the small reply should ever arrive
+	assert(len == 4);
+	set_sync_flag(&received_flag, true);
+}
+
+static void receive_cb_b(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	// Packets sent from a callback are not queued, they are built directly in MeshLink's packet buffer
+	meshlink_errno = MESHLINK_OK;
+	rejected = !meshlink_send(mesh, source, big, maxsize) && meshlink_errno == MESHLINK_EINVAL;
+	assert(meshlink_send(mesh, source, data, len));
+}
+
+int main(void) {
+	init_sync_flag(&received_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	big = malloc(maxsize);
+	assert(big);
+	memset(big, 'x', maxsize);
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "send_oversized");
+
+	meshlink_set_receive_cb(mesh_a, receive_cb_a);
+	meshlink_set_receive_cb(mesh_b, receive_cb_b);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	// Packets sent from the application thread are queued.
+
+	meshlink_errno = MESHLINK_OK;
+	assert(!meshlink_send(mesh_a, b, big, maxsize));
+	assert(meshlink_errno == MESHLINK_EINVAL);
+
+	// Ask b to send an oversized packet back from its receive callback.
+
+	assert(meshlink_send(mesh_a, b, "ping", 4));
+	assert(wait_sync_flag(&received_flag, 10));
+	assert(rejected);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+	free(big);
+}
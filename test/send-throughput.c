@@ -0,0 +1,146 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meshlink.h"
+#include "utils.h"
+
+// Measure how fast multiple application threads can queue datagrams with meshlink_send().
+// Usage: send-throughput [threads [packets per thread [packet size]]]
+
+static meshlink_handle_t *mesh_a;
+static meshlink_node_t *b;
+static size_t packets_per_thread;
+static size_t packet_size;
+
+static pthread_mutex_t received_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t received;
+static struct sync_flag warmup_flag;
+
+struct thread_info {
+	pthread_t thread;
+	size_t retries;
+};
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	(void)mesh;
+	(void)source;
+	(void)data;
+	(void)len;
+
+	pthread_mutex_lock(&received_mutex);
+	received++;
+	pthread_mutex_unlock(&received_mutex);
+
+	set_sync_flag(&warmup_flag, true);
+}
+
+static double wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *send_thread(void *arg) {
+	struct thread_info *info = arg;
+	char data[packet_size];
+	memset(data, 0x55, sizeof(data));
+
+	for(size_t i = 0; i < packets_per_thread; i++) {
+		while(!meshlink_send(mesh_a, b, data, sizeof(data))) {
+			// Back off until the event loop has drained the queue
+			assert(meshlink_errno == MESHLINK_EAGAIN);
+			info->retries++;
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	size_t nthreads = argc > 1 ? (size_t)atoi(argv[1]) : 4;
+	packets_per_thread = argc > 2 ? (size_t)atoi(argv[2]) : 100000;
+	packet_size = argc > 3 ? (size_t)atoi(argv[3]) : 100;
+	assert(nthreads && packets_per_thread && packet_size);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+	init_sync_flag(&warmup_flag);
+
+	meshlink_handle_t *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "send_throughput");
+	meshlink_set_receive_cb(mesh_b, receive_cb);
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	// Wait until packets get through, so we measure the steady state.
+	for(int i = 0; i < 100 && !check_sync_flag(&warmup_flag); i++) {
+		assert(meshlink_send(mesh_a, b, "warmup", 6));
+		wait_sync_flag(&warmup_flag, 1);
+	}
+
+	assert(check_sync_flag(&warmup_flag));
+
+	pthread_mutex_lock(&received_mutex);
+	received = 0;
+	pthread_mutex_unlock(&received_mutex);
+
+	struct thread_info *threads = calloc(nthreads, sizeof(*threads));
+	assert(threads);
+
+	double start = wall_time();
+
+	for(size_t i = 0; i < nthreads; i++) {
+		assert(!pthread_create(&threads[i].thread, NULL, send_thread, &threads[i]));
+	}
+
+	size_t retries = 0;
+
+	for(size_t i = 0; i < nthreads; i++) {
+		assert(!pthread_join(threads[i].thread, NULL));
+		retries += threads[i].retries;
+	}
+
+	double elapsed = wall_time() - start;
+
+	// Give the receiver time to catch up, until no more packets arrive.
+	size_t total = nthreads * packets_per_thread;
+	size_t got = 0;
+
+	struct timespec delay = {0, 200000000};
+
+	for(;;) {
+		nanosleep(&delay, NULL);
+		pthread_mutex_lock(&received_mutex);
+		size_t now = received;
+		pthread_mutex_unlock(&received_mutex);
+
+		if(now == got) {
+			break;
+		}
+
+		got = now;
+	}
+
+	printf("%zu threads queued %zu packets of %zu bytes in %.3f s: %.0f packets/s, %zu retries after EAGAIN\n", nthreads, total, packet_size, elapsed, total / elapsed, retries);
+	printf("receiver got %zu packets (%.1f%%)\n", got, got * 100.0 / total);
+
+	free(threads);
+	close_meshlink_pair(mesh_a, mesh_b);
+
+	return 0;
+}
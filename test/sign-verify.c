@@ -45,6 +45,55 @@ int main(void) {
 	assert(!meshlink_verify(mesh_b, a, testdata2, sizeof(testdata2), sig, siglen));
 	assert(!meshlink_verify(mesh_b, b, testdata1, sizeof(testdata1), sig, siglen));
 
+	// Verify signatures from both nodes in one batch, more than fit in a single multi-scalar multiplication.
+
+	enum {BATCH = 70};
+	static char batch_data[BATCH][32];
+	static char batch_sigs[BATCH][MESHLINK_SIGLEN];
+	meshlink_node_t *sources[BATCH];
+	const void *data[BATCH];
+	size_t lens[BATCH];
+	const void *sigs[BATCH];
+	size_t siglens[BATCH];
+	bool valid[BATCH];
+
+	for(int i = 0; i < BATCH; i++) {
+		snprintf(batch_data[i], sizeof(batch_data[i]), "Batch test data %d.", i);
+		sources[i] = i % 3 ? a : b;
+		data[i] = batch_data[i];
+		lens[i] = strlen(batch_data[i]);
+		sigs[i] = batch_sigs[i];
+		siglens[i] = MESHLINK_SIGLEN;
+		assert(meshlink_sign(i % 3 ? mesh_a : mesh_b, data[i], lens[i], batch_sigs[i], &siglens[i]));
+	}
+
+	memset(valid, 0, sizeof(valid));
+	assert(meshlink_verify_batch(mesh_b, sources, data, lens, sigs, siglens, BATCH, valid));
+
+	for(int i = 0; i < BATCH; i++) {
+		assert(valid[i]);
+	}
+
+	assert(meshlink_verify_batch(mesh_b, sources, data, lens, sigs, siglens, 1, NULL));
+	assert(meshlink_verify_batch(mesh_b, sources, data, lens, sigs, siglens, 0, NULL));
+
+	// Check that bad signatures are found in a batch.
+
+	batch_sigs[5][10] ^= 1;
+	sources[66] = sources[66] == a ? b : a;
+
+	assert(!meshlink_verify_batch(mesh_b, sources, data, lens, sigs, siglens, BATCH, valid));
+
+	for(int i = 0; i < BATCH; i++) {
+		assert(valid[i] == (i != 5 && i != 66));
+	}
+
+	assert(!meshlink_verify_batch(mesh_b, sources, data, lens, sigs, siglens, BATCH, NULL));
+
+	siglens[3] = MESHLINK_SIGLEN / 2;
+	assert(!meshlink_verify_batch(mesh_b, sources, data, lens, sigs, siglens, BATCH, valid));
+	assert(meshlink_errno == MESHLINK_EINVAL);
+
 	// Clean up.
 
 	close_meshlink_pair(mesh_a, mesh_b);
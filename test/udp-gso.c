@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that batches of UDP packets to several nodes, with sizes changing in the middle of a batch,
+// are delivered correctly, also when the kernel rejects UDP segmentation offload.
+
+#define NPACKETS 48
+
+static const size_t sizes[] = {1000, 600, 1100};
+
+static meshlink_node_t *dests[2];
+static struct sync_flag done_flags[2];
+static int expected[2];
+static int received[2];
+static uint8_t round_no;
+
+static size_t packet_size(int i) {
+	return sizes[(i / 3) % 3];
+}
+
+static int packet_dest(int i) {
+	return (i / 4) % 2;
+}
+
+static void fill_packet(uint8_t *buf, int i) {
+	buf[0] = round_no;
+	buf[1] = i;
+	memset(buf + 2, 'a' + i % 26, packet_size(i) - 2);
+}
+
+// When a gets a request, it sends all packets from its own thread, so they are sent as one batch.
+static void receive_cb_a(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	(void)source;
+
+	if(len != 2 || memcmp(data, "go", 2)) {
+		return;
+	}
+
+	uint8_t buf[1100];
+
+	for(int i = 0; i < NPACKETS; i++) {
+		fill_packet(buf, i);
+		assert(meshlink_send(mesh, dests[packet_dest(i)], buf, packet_size(i)));
+	}
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	(void)source;
+
+	int d = !strcmp(mesh->name, "c");
+	const uint8_t *buf = data;
+
+	if(len < 2 || buf[0] != round_no) {
+		return;
+	}
+
+	int i = buf[1];
+	assert(i < NPACKETS);
+	assert(packet_dest(i) == d);
+	assert(len == packet_size(i));
+
+	uint8_t expected_buf[1100];
+	fill_packet(expected_buf, i);
+	assert(!memcmp(buf, expected_buf, len));
+
+	if(++received[d] == expected[d]) {
+		set_sync_flag(&done_flags[d], true);
+	}
+}
+
+static devtool_node_status_t get_status(meshlink_handle_t *mesh, meshlink_node_t *node) {
+	devtool_node_status_t status;
+	devtool_get_node_status(mesh, node, &status);
+	devtool_free_node_status(&status);
+	return status;
+}
+
+static uint64_t get_tx_gso(meshlink_handle_t *mesh) {
+	devtool_udp_receive_stats_t stats;
+	devtool_get_udp_receive_stats(mesh, &stats);
+	return stats.tx_gso;
+}
+
+int main(void) {
+	init_sync_flag(&done_flags[0]);
+	init_sync_flag(&done_flags[1]);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Open three nodes, a is connected to both b and c.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "udp_gso");
+
+	assert(meshlink_destroy("udp_gso_conf.3"));
+	meshlink_handle_t *mesh_c = meshlink_open("udp_gso_conf.3", "c", "udp_gso", DEV_CLASS_BACKBONE);
+	assert(mesh_c);
+	meshlink_enable_discovery(mesh_c, false);
+	link_meshlink_pair(mesh_a, mesh_c);
+
+	meshlink_set_receive_cb(mesh_a, receive_cb_a);
+	meshlink_set_receive_cb(mesh_b, receive_cb);
+	meshlink_set_receive_cb(mesh_c, receive_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+	assert(meshlink_start(mesh_c));
+
+	dests[0] = meshlink_get_node(mesh_a, "b");
+	dests[1] = meshlink_get_node(mesh_a, "c");
+	meshlink_node_t *a = meshlink_get_node(mesh_b, "a");
+	assert(dests[0] && dests[1] && a);
+
+	for(int i = 0; i < NPACKETS; i++) {
+		expected[packet_dest(i)]++;
+	}
+
+	// Wait until the path MTU to both nodes is large enough to send all packets via UDP.
+
+	for(int d = 0; d < 2; d++) {
+		for(int i = 0; i < 100 && (get_status(mesh_a, dests[d]).udp_status != DEVTOOL_UDP_WORKING || get_status(mesh_a, dests[d]).minmtu < 1200); i++) {
+			assert(meshlink_send(mesh_a, dests[d], "probe", 5));
+			nanosleep(&(struct timespec) {
+				0, 100000000
+			}, NULL);
+		}
+
+		assert(get_status(mesh_a, dests[d]).udp_status == DEVTOOL_UDP_WORKING);
+		assert(get_status(mesh_a, dests[d]).minmtu >= 1200);
+	}
+
+	// Send a batch normally, then while the kernel rejects segmentation offload with EINVAL and with EIO.
+
+	static const int errors[] = {0, EINVAL, EIO};
+
+	for(int r = 0; r < 3; r++) {
+		devtool_set_udp_gso_error(mesh_a, errors[r]);
+		uint64_t tx_gso = get_tx_gso(mesh_a);
+
+		round_no = r + 1;
+		received[0] = received[1] = 0;
+		reset_sync_flag(&done_flags[0]);
+		reset_sync_flag(&done_flags[1]);
+
+		assert(meshlink_send(mesh_b, a, "go", 2));
+		assert(wait_sync_flag(&done_flags[0], 10));
+		assert(wait_sync_flag(&done_flags[1], 10));
+
+		if(errors[r]) {
+			assert(get_tx_gso(mesh_a) == tx_gso);
+		}
+	}
+
+	// Clean up.
+
+	meshlink_close(mesh_c);
+	close_meshlink_pair(mesh_a, mesh_b);
+}
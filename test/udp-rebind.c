@@ -0,0 +1,257 @@
+#define _GNU_SOURCE
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <time.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that when a node's NAT mapping changes, its packets from the new address are accepted
+// by trying only the best matching nodes, and that trying all nodes is only done as a last resort.
+
+#define NPEERS 6
+#define MAXCAPTURED 64
+
+static const char *names[NPEERS] = {"a", "c", "d", "e", "f", "g"};
+
+static meshlink_handle_t *receiver;
+static struct sync_flag received_flag;
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool isolated;
+static in_port_t old_port;
+static char captured[MAXCAPTURED][10000];
+static size_t captured_len[MAXCAPTURED];
+static int ncaptured;
+
+static in_port_t get_port(const struct sockaddr *sa) {
+	if(sa->sa_family == AF_INET) {
+		return ((const struct sockaddr_in *)sa)->sin_port;
+	} else {
+		return ((const struct sockaddr_in6 *)sa)->sin6_port;
+	}
+}
+
+static void set_port(struct sockaddr_storage *ss, in_port_t port) {
+	if(ss->ss_family == AF_INET) {
+		((struct sockaddr_in *)ss)->sin_port = port;
+	} else {
+		((struct sockaddr_in6 *)ss)->sin6_port = port;
+	}
+}
+
+// While isolated, b only sees the packets injected from the fake ports below.
+// Packets a sends from its old port are held back, as if its NAT mapping was lost.
+static bool udp_receive_probe(meshlink_handle_t *mesh, const struct sockaddr *from, const void *data, size_t len) {
+	if(mesh != receiver) {
+		return true;
+	}
+
+	in_port_t port = get_port(from);
+
+	if(port == htons(1) || port == htons(2)) {
+		return true;
+	}
+
+	assert(pthread_mutex_lock(&capture_mutex) == 0);
+	bool drop = isolated;
+
+	if(drop && port == old_port && ncaptured < MAXCAPTURED && len <= sizeof(captured[0])) {
+		memcpy(captured[ncaptured], data, len);
+		captured_len[ncaptured] = len;
+		ncaptured++;
+	}
+
+	assert(pthread_mutex_unlock(&capture_mutex) == 0);
+	return !drop;
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	(void)mesh;
+	(void)source;
+
+	if(len == 4 && !memcmp(data, "ping", 4)) {
+		set_sync_flag(&received_flag, true);
+	}
+}
+
+static devtool_node_status_t get_status(meshlink_handle_t *mesh, meshlink_node_t *node) {
+	devtool_node_status_t status;
+	devtool_get_node_status(mesh, node, &status);
+	devtool_free_node_status(&status);
+	return status;
+}
+
+static uint64_t get_full_scans(meshlink_handle_t *mesh) {
+	devtool_udp_receive_stats_t stats;
+	devtool_get_udp_receive_stats(mesh, &stats);
+	return stats.full_scans;
+}
+
+static uint64_t get_unknown(meshlink_handle_t *mesh) {
+	devtool_udp_receive_stats_t stats;
+	devtool_get_udp_receive_stats(mesh, &stats);
+	return stats.unknown;
+}
+
+static void sleep_ms(long ms) {
+	nanosleep(&(struct timespec) {
+		ms / 1000, (ms % 1000) * 1000000
+	}, NULL);
+}
+
+int main(void) {
+	init_sync_flag(&received_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Connect a number of peers to b, more than will be tried when a packet comes from an unknown address.
+
+	assert(meshlink_destroy("udp_rebind_conf.b"));
+	meshlink_handle_t *mesh_b = meshlink_open("udp_rebind_conf.b", "b", "udp_rebind", DEV_CLASS_BACKBONE);
+	assert(mesh_b);
+	meshlink_enable_discovery(mesh_b, false);
+	meshlink_set_receive_cb(mesh_b, receive_cb);
+	receiver = mesh_b;
+	devtool_udp_receive_probe = udp_receive_probe;
+
+	meshlink_handle_t *peers[NPEERS];
+
+	for(int i = 0; i < NPEERS; i++) {
+		char *path;
+		assert(asprintf(&path, "udp_rebind_conf.%s", names[i]) > 0);
+		assert(meshlink_destroy(path));
+		peers[i] = meshlink_open(path, names[i], "udp_rebind", DEV_CLASS_BACKBONE);
+		assert(peers[i]);
+		free(path);
+		meshlink_enable_discovery(peers[i], false);
+		link_meshlink_pair(peers[i], mesh_b);
+	}
+
+	assert(meshlink_start(mesh_b));
+
+	for(int i = 0; i < NPEERS; i++) {
+		assert(meshlink_start(peers[i]));
+	}
+
+	// Wait until all peers send packets to b via UDP.
+
+	meshlink_node_t *nodes[NPEERS];
+	meshlink_node_t *targets[NPEERS];
+
+	for(int i = 0; i < NPEERS; i++) {
+		nodes[i] = meshlink_get_node(mesh_b, names[i]);
+		targets[i] = meshlink_get_node(peers[i], "b");
+		assert(nodes[i] && targets[i]);
+	}
+
+	for(int i = 0; i < NPEERS; i++) {
+		for(int j = 0; j < 100 && get_status(mesh_b, nodes[i]).udp_status != DEVTOOL_UDP_WORKING; j++) {
+			assert(meshlink_send(peers[i], targets[i], "probe", 5));
+			sleep_ms(100);
+		}
+
+		assert(get_status(mesh_b, nodes[i]).udp_status == DEVTOOL_UDP_WORKING);
+	}
+
+	// Let a send more packets than the others, so its sequence numbers are clearly ahead of theirs.
+
+	meshlink_handle_t *mesh_a = peers[0];
+	meshlink_node_t *a = nodes[0];
+	meshlink_node_t *b = targets[0];
+
+	for(int i = 0; i < 1000; i++) {
+		assert(meshlink_send(mesh_a, b, "data", 4));
+		sleep_ms(1);
+	}
+
+	reset_sync_flag(&received_flag);
+	assert(meshlink_send(mesh_a, b, "ping", 4));
+	assert(wait_sync_flag(&received_flag, 10));
+
+	// Hold back a ping from a, as if its NAT mapping was lost.
+	// Other packets are dropped as well, so they cannot make b try all nodes during the test.
+
+	devtool_node_status_t status = get_status(mesh_b, a);
+	assert(pthread_mutex_lock(&capture_mutex) == 0);
+	old_port = get_port((struct sockaddr *)&status.address);
+	isolated = true;
+	assert(pthread_mutex_unlock(&capture_mutex) == 0);
+
+	reset_sync_flag(&received_flag);
+	assert(meshlink_send(mesh_a, b, "ping", 4));
+	sleep_ms(500);
+	assert(!check_sync_flag(&received_flag));
+
+	assert(pthread_mutex_lock(&capture_mutex) == 0);
+	int count = ncaptured;
+	assert(pthread_mutex_unlock(&capture_mutex) == 0);
+	assert(count > 0);
+
+	// Deliver those packets from a new port. B should find a without trying all nodes.
+
+	uint64_t full_scans_before = get_full_scans(mesh_b);
+	uint64_t unknown_before = get_unknown(mesh_b);
+	in_port_t new_port = htons(1);
+	struct sockaddr_storage from = status.address;
+	set_port(&from, new_port);
+
+	for(int i = 0; i < count; i++) {
+		assert(devtool_inject_udp_packet(mesh_b, (struct sockaddr *)&from, captured[i], captured_len[i]));
+	}
+
+	assert(wait_sync_flag(&received_flag, 10));
+	assert(get_unknown(mesh_b) > unknown_before);
+	assert(get_full_scans(mesh_b) == full_scans_before);
+
+	status = get_status(mesh_b, a);
+	assert(get_port((struct sockaddr *)&status.address) == new_port);
+
+	// A packet that no node can authenticate makes b try all nodes, but at most once per second.
+
+	char forged[sizeof(captured[0])];
+	memcpy(forged, captured[0], captured_len[0]);
+	forged[captured_len[0] - 1] ^= 1;
+	set_port(&from, htons(2));
+
+	for(int i = 0; i < 25; i++) {
+		assert(devtool_inject_udp_packet(mesh_b, (struct sockaddr *)&from, forged, captured_len[0]));
+		sleep_ms(100);
+	}
+
+	uint64_t full_scans = get_full_scans(mesh_b) - full_scans_before;
+	assert(full_scans >= 1 && full_scans <= 4);
+
+	// When a's old port works again, its packets are accepted from there.
+
+	assert(pthread_mutex_lock(&capture_mutex) == 0);
+	isolated = false;
+	assert(pthread_mutex_unlock(&capture_mutex) == 0);
+
+	reset_sync_flag(&received_flag);
+
+	for(int i = 0; i < 100 && !check_sync_flag(&received_flag); i++) {
+		assert(meshlink_send(mesh_a, b, "ping", 4));
+		sleep_ms(100);
+	}
+
+	assert(check_sync_flag(&received_flag));
+
+	// Clean up.
+
+	for(int i = 0; i < NPEERS; i++) {
+		meshlink_close(peers[i]);
+	}
+
+	meshlink_close(mesh_b);
+}
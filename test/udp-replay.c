@@ -0,0 +1,177 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <time.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check that replayed UDP packets are dropped before they are decrypted,
+// and that a packet far ahead of the replay window does not move the window.
+
+static meshlink_handle_t *receiver;
+static struct sync_flag captured_flag;
+static struct sync_flag received_flag;
+static volatile bool capturing;
+static char captured[10000];
+static size_t captured_len;
+static struct sockaddr_storage captured_from;
+static int received;
+
+static bool udp_receive_probe(meshlink_handle_t *mesh, const struct sockaddr *from, const void *data, size_t len) {
+	if(mesh != receiver || !capturing || len > sizeof(captured)) {
+		return true;
+	}
+
+	memcpy(captured, data, len);
+	captured_len = len;
+	memcpy(&captured_from, from, from->sa_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+	capturing = false;
+	set_sync_flag(&captured_flag, true);
+	return true;
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	(void)mesh;
+	(void)source;
+
+	if(len == 4 && !memcmp(data, "ping", 4)) {
+		received++;
+		set_sync_flag(&received_flag, true);
+	}
+}
+
+static bool same_address(const struct sockaddr_storage *a, const struct sockaddr_storage *b) {
+	if(a->ss_family != b->ss_family) {
+		return false;
+	}
+
+	if(a->ss_family == AF_INET) {
+		const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+		const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+		return a4->sin_port == b4->sin_port && !memcmp(&a4->sin_addr, &b4->sin_addr, sizeof(a4->sin_addr));
+	} else {
+		const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+		const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+		return a6->sin6_port == b6->sin6_port && !memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr));
+	}
+}
+
+static devtool_node_status_t get_status(meshlink_handle_t *mesh, meshlink_node_t *node) {
+	devtool_node_status_t status;
+	devtool_get_node_status(mesh, node, &status);
+	devtool_free_node_status(&status);
+	return status;
+}
+
+// Inject a packet as if it came from the address b currently uses for a.
+static void inject(meshlink_node_t *node, const void *data, size_t len) {
+	devtool_node_status_t status = get_status(receiver, node);
+	assert(devtool_inject_udp_packet(receiver, (struct sockaddr *)&status.address, data, len));
+}
+
+int main(void) {
+	init_sync_flag(&captured_flag);
+	init_sync_flag(&received_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "udp_replay");
+	receiver = mesh_b;
+	devtool_udp_receive_probe = udp_receive_probe;
+
+	meshlink_set_receive_cb(mesh_b, receive_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *a = meshlink_get_node(mesh_b, "a");
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(a && b);
+
+	// Wait until packets are exchanged via UDP.
+
+	for(int i = 0; i < 100 && get_status(mesh_b, a).udp_status != DEVTOOL_UDP_WORKING; i++) {
+		assert(meshlink_send(mesh_a, b, "probe", 5));
+		nanosleep(&(struct timespec) {
+			0, 100000000
+		}, NULL);
+	}
+
+	assert(get_status(mesh_b, a).udp_status == DEVTOOL_UDP_WORKING);
+
+	// Capture a packet that b accepted from a's current address.
+
+	bool found = false;
+
+	for(int i = 0; i < 100 && !found; i++) {
+		reset_sync_flag(&captured_flag);
+		reset_sync_flag(&received_flag);
+		capturing = true;
+		assert(meshlink_send(mesh_a, b, "ping", 4));
+		assert(wait_sync_flag(&captured_flag, 10));
+		assert(wait_sync_flag(&received_flag, 10));
+
+		devtool_node_status_t status = get_status(mesh_b, a);
+		found = same_address(&captured_from, &status.address);
+	}
+
+	assert(found);
+
+	// Replaying it is caught by the replay window, before decrypting it.
+
+	int received_before = received;
+	uint64_t replayed_before = get_status(mesh_b, a).in_replayed;
+
+	inject(a, captured, captured_len);
+	inject(a, captured, captured_len);
+	assert(get_status(mesh_b, a).in_replayed == replayed_before + 2);
+
+	// Even if its authentication tag is corrupt, which would have made decryption fail.
+
+	char corrupted[sizeof(captured)];
+	memcpy(corrupted, captured, captured_len);
+	corrupted[captured_len - 1] ^= 1;
+	inject(a, corrupted, captured_len);
+	assert(get_status(mesh_b, a).in_replayed == replayed_before + 3);
+	assert(received == received_before);
+
+	// A forged packet far in the future cannot be authenticated, and must not move the replay window.
+
+	uint32_t seqno;
+	memcpy(&seqno, captured, sizeof(seqno));
+	seqno = htonl(ntohl(seqno) + 0x1000000);
+
+	char future[sizeof(captured)];
+	memcpy(future, captured, captured_len);
+	memcpy(future, &seqno, sizeof(seqno));
+
+	for(int i = 0; i < 10; i++) {
+		inject(a, future, captured_len);
+	}
+
+	assert(received == received_before);
+
+	// New packets from a are still accepted, and the old one is still recognized as a replay.
+
+	reset_sync_flag(&received_flag);
+	assert(meshlink_send(mesh_a, b, "ping", 4));
+	assert(wait_sync_flag(&received_flag, 10));
+
+	uint64_t replayed_after = get_status(mesh_b, a).in_replayed;
+	inject(a, captured, captured_len);
+	assert(get_status(mesh_b, a).in_replayed == replayed_after + 1);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+}
@@ -0,0 +1,199 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#include "ed25519/ed25519.h"
+
+// Known answer tests for X25519 from RFC 7748, and for the Edwards key exchange used by SPTPS.
+// Also check that the time taken does not depend on the private key,
+// using Welch's t-test on the timings of a fixed key versus random keys (as done by dudect).
+
+static void unhex(const char *hex, unsigned char *out, size_t len) {
+	assert(strlen(hex) == len * 2);
+
+	for(size_t i = 0; i < len; i++) {
+		unsigned int byte;
+		assert(sscanf(hex + 2 * i, "%2x", &byte) == 1);
+		out[i] = byte;
+	}
+}
+
+static void check_x25519(const char *scalar_hex, const char *u_hex, const char *expected_hex) {
+	unsigned char scalar[32], u[32], expected[32], out[32];
+	unhex(scalar_hex, scalar, sizeof(scalar));
+	unhex(u_hex, u, sizeof(u));
+	unhex(expected_hex, expected, sizeof(expected));
+
+	ed25519_x25519(out, u, scalar);
+	assert(!memcmp(out, expected, sizeof(out)));
+}
+
+static uint64_t ticks(void) {
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static double welch_t(const uint64_t *samples, const int *classes, size_t n, uint64_t cutoff) {
+	double sum[2] = {0, 0}, sumsq[2] = {0, 0};
+	size_t count[2] = {0, 0};
+
+	for(size_t i = 0; i < n; i++) {
+		// Ignore outliers caused by interrupts and other processes
+		if(samples[i] > cutoff) {
+			continue;
+		}
+
+		double x = samples[i];
+		sum[classes[i]] += x;
+		sumsq[classes[i]] += x * x;
+		count[classes[i]]++;
+	}
+
+	assert(count[0] > 1 && count[1] > 1);
+
+	double mean[2], var[2];
+
+	for(int c = 0; c < 2; c++) {
+		mean[c] = sum[c] / count[c];
+		var[c] = (sumsq[c] - count[c] * mean[c] * mean[c]) / (count[c] - 1);
+	}
+
+	return (mean[0] - mean[1]) / sqrt(var[0] / count[0] + var[1] / count[1]);
+}
+
+static void check_constant_time(void) {
+	enum {SAMPLES = 20000};
+	static unsigned char keys[SAMPLES][32];
+	static int classes[SAMPLES];
+	static uint64_t samples[SAMPLES];
+	static uint64_t sorted[SAMPLES];
+	unsigned char u[32], out[32];
+
+	srand(time(NULL));
+
+	for(size_t i = 0; i < sizeof(u); i++) {
+		u[i] = rand();
+	}
+
+	// Class 0 uses an all-zero key, class 1 random keys
+	for(size_t i = 0; i < SAMPLES; i++) {
+		classes[i] = rand() & 1;
+
+		for(size_t j = 0; j < 32; j++) {
+			keys[i][j] = classes[i] ? rand() : 0;
+		}
+	}
+
+	for(size_t i = 0; i < SAMPLES; i++) {
+		uint64_t start = ticks();
+		ed25519_x25519(out, u, keys[i]);
+		samples[i] = ticks() - start;
+	}
+
+	memcpy(sorted, samples, sizeof(sorted));
+	qsort(sorted, SAMPLES, sizeof(*sorted), compare_u64);
+
+	// A leak would show up as a large t value for at least one of the cutoffs
+	static const int percentiles[] = {50, 75, 90, 100};
+
+	for(size_t i = 0; i < sizeof(percentiles) / sizeof(*percentiles); i++) {
+		uint64_t cutoff = sorted[(SAMPLES - 1) * percentiles[i] / 100];
+		double t = welch_t(samples, classes, SAMPLES, cutoff);
+		printf("Timing t-test for X25519, samples up to the %dth percentile: t = %.2f\n", percentiles[i], t);
+		assert(fabs(t) < 10);
+	}
+}
+
+int main(void) {
+	// RFC 7748 section 5.2
+	check_x25519(
+	        "a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4",
+	        "e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c",
+	        "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552");
+
+	// The top bit of u must be ignored
+	check_x25519(
+	        "4b66e9d4d1b4673c5ad22691957d6af5c11b6421e0ea01d42ca4169e7918ba0d",
+	        "e5210f12786811d3f4b7959d0538ae2c31dbe7106fc03c3efc4cd549c715a493",
+	        "95cbde9476e8907d7aade45cb4b873f88b595a68799fa152e6f8f7647aac7957");
+
+	// RFC 7748 section 5.2, iterated 1 and 1000 times
+	unsigned char k[32] = {9}, u[32] = {9}, r[32], expected[32];
+
+	for(int i = 1; i <= 1000; i++) {
+		ed25519_x25519(r, u, k);
+		memcpy(u, k, sizeof(u));
+		memcpy(k, r, sizeof(k));
+
+		if(i == 1) {
+			unhex("422c8e7a6227d7bca1350b3e2bb7279f7897b87bb6854b783c60e80311ae3079", expected, sizeof(expected));
+			assert(!memcmp(k, expected, sizeof(k)));
+		}
+	}
+
+	unhex("684cf59ba83309552800ef566f2f4d3c1c3887c49360e3875f2eb94d99532c51", expected, sizeof(expected));
+	assert(!memcmp(k, expected, sizeof(k)));
+
+	// RFC 7748 section 6.1
+	static const unsigned char base[32] = {9};
+	unsigned char alice_private[32], alice_public[32], bob_private[32], bob_public[32], shared1[32], shared2[32];
+	unhex("77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a", alice_private, sizeof(alice_private));
+	unhex("5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb", bob_private, sizeof(bob_private));
+
+	ed25519_x25519(alice_public, base, alice_private);
+	unhex("8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a", expected, sizeof(expected));
+	assert(!memcmp(alice_public, expected, sizeof(expected)));
+
+	ed25519_x25519(bob_public, base, bob_private);
+	unhex("de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f", expected, sizeof(expected));
+	assert(!memcmp(bob_public, expected, sizeof(expected)));
+
+	ed25519_x25519(shared1, bob_public, alice_private);
+	ed25519_x25519(shared2, alice_public, bob_private);
+	unhex("4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742", expected, sizeof(expected));
+	assert(!memcmp(shared1, expected, sizeof(expected)));
+	assert(!memcmp(shared2, expected, sizeof(expected)));
+
+	// The key exchange with Ed25519 keys as used by SPTPS, the expected value comes from the original 32-bit implementation
+	unsigned char seed[32], public1[32], private1[64], public2[32], private2[64];
+	memset(seed, 1, sizeof(seed));
+	ed25519_create_keypair(public1, private1, seed);
+	memset(seed, 2, sizeof(seed));
+	ed25519_create_keypair(public2, private2, seed);
+
+	ed25519_key_exchange(shared1, public2, private1);
+	ed25519_key_exchange(shared2, public1, private2);
+	unhex("4181d7302557342bdb6d061c4b1eebea828ecb625c3368b7111680793307220b", expected, sizeof(expected));
+	assert(!memcmp(shared1, expected, sizeof(expected)));
+	assert(!memcmp(shared2, expected, sizeof(expected)));
+
+	check_constant_time();
+
+	return 0;
+}